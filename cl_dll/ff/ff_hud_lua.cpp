@@ -55,6 +55,9 @@ CHudLua::CHudLua(const char *pElementName) : CHudElement(pElementName), vgui::Pa
 
 	SetHiddenBits( HIDEHUD_PLAYERDEAD );
 	m_nHudElements = 0;
+
+	for( int i = 0; i < MAX_HUD_ELEMENTS; i++ )
+		m_sHudStates[ i ].Clear();
 }
 
 //-----------------------------------------------------------------------------
@@ -95,102 +98,57 @@ void CHudLua::Init()
 
 //-----------------------------------------------------------------------------
 // Purpose: Receive message and determine what to create
+//			A message is a batch of element updates, each only carrying the
+//			fields that changed since the server last sent that element.
 //-----------------------------------------------------------------------------
 void CHudLua::MsgFunc_FF_HudLua(bf_read &msg)
 {
-	byte wType = msg.ReadByte();
-
-	if (wType < 0)
-		return;
-
-
-	int hudIdentifier = msg.ReadShort();
-
-	if (wType == HUD_REMOVE)
+	// Anything less than a byte is padding
+	while (msg.GetNumBitsLeft() >= 8)
 	{
-		RemoveElement(hudIdentifier);
-		return;
-	}
+		int iType = msg.ReadUBitLong(HUD_ELEMENT_TYPE_BITS);
+		int hudIdentifier = msg.ReadUBitLong(HUD_ELEMENT_INDEX_BITS);
 
-	switch (wType)
-	{
-	case HUD_ICON:
+		if (iType == HUD_REMOVE)
 		{
-			int xPos = msg.ReadShort();
-			int yPos = msg.ReadShort();
+			RemoveElement(hudIdentifier);
+			continue;
+		}
 
-			char szSource[256];
-			if (!msg.ReadString(szSource, 255))
-				return;
+		int iFields = msg.ReadUBitLong(HUD_FIELD_COUNT);
 
-			int iWidth = msg.ReadShort();
-			int iHeight = msg.ReadShort();
-			int iAlignX = msg.ReadShort();
-			int iAlignY = msg.ReadShort();
+		// Still have to read past elements we can't show
+		LuaHudElementState_t sIgnored;
+		LuaHudElementState_t &state = (hudIdentifier < MAX_HUD_ELEMENTS) ? m_sHudStates[hudIdentifier] : sIgnored;
 
-			HudIcon(hudIdentifier, xPos, yPos, szSource, iWidth, iHeight, iAlignX, iAlignY);
+		state.iType = iType;
+		state.Read(msg, iFields);
 
+		if (msg.IsOverflowed())
 			break;
-		}
-		
-	case HUD_BOX:
-		{
-			int xPos = msg.ReadShort();
-			int yPos = msg.ReadShort();
-			int iWidth = msg.ReadShort();
-			int iHeight = msg.ReadShort();
-			int iRed = msg.ReadShort();
-			int iGreen = msg.ReadShort();
-			int iBlue = msg.ReadShort();
-			int iAlpha = msg.ReadShort();
-			int iBorderRed = msg.ReadShort();
-			int iBorderGreen = msg.ReadShort();
-			int iBorderBlue = msg.ReadShort();
-			int iBorderAlpha = msg.ReadShort();
-			int iBorderWidth = msg.ReadShort();
-			int iAlignX = msg.ReadShort();
-			int iAlignY = msg.ReadShort();
-
-			HudBox(hudIdentifier, xPos, yPos, iWidth, iHeight, Color(iRed,iGreen,iBlue,iAlpha), Color(iBorderRed,iBorderGreen,iBorderBlue,iBorderAlpha), iBorderWidth, iAlignX, iAlignY);
 
-			break;
-		}
+		if (hudIdentifier >= MAX_HUD_ELEMENTS)
+			continue;
 
-	case HUD_TEXT:
+		switch (iType)
 		{
-			int xPos = msg.ReadShort();
-			int yPos = msg.ReadShort();
-
-			char szText[256];
-			if (!msg.ReadString(szText, 255))
-				return;
-
-			int iAlignX = msg.ReadShort();
-			int iAlignY = msg.ReadShort();
-			int iSize = msg.ReadShort();
-
-			HudText(hudIdentifier, xPos, yPos, szText, iAlignX, iAlignY, iSize);
-
+		case HUD_ICON:
+			HudIcon(hudIdentifier, state.x, state.y, state.szString, state.iWidth, state.iHeight, state.iAlignX, state.iAlignY);
 			break;
-		}
 
-	case HUD_TIMER:
-		{
-			int xPos = msg.ReadShort();
-			int yPos = msg.ReadShort();
-
-			float	flValue = msg.ReadFloat();
-			float	flSpeed = msg.ReadFloat();
-
-			int iAlignX = msg.ReadShort();
-			int iAlignY = msg.ReadShort();
-			int iSize = msg.ReadShort();
+		case HUD_BOX:
+			HudBox(hudIdentifier, state.x, state.y, state.iWidth, state.iHeight, state.clr, state.clrBorder, state.iBorderWidth, state.iAlignX, state.iAlignY);
+			break;
 
-			HudTimer(hudIdentifier, xPos, yPos, flValue, flSpeed, iAlignX, iAlignY, iSize);
+		case HUD_TEXT:
+			HudText(hudIdentifier, state.x, state.y, state.szString, state.iAlignX, state.iAlignY, state.iSize);
+			break;
 
+		case HUD_TIMER:
+			HudTimer(hudIdentifier, state.x, state.y, state.flValue, state.flSpeed, state.iAlignX, state.iAlignY, state.iSize);
 			break;
-		}
-	} // end switch (wType)
+		} // end switch (iType)
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -728,6 +686,11 @@ Panel *CHudLua::GetHudElement(int hudIdentifier, HudElementType_t iType)
 //-----------------------------------------------------------------------------
 void CHudLua::RemoveElement(int hudIdentifier)
 {
+	if (hudIdentifier < 0 || hudIdentifier >= MAX_HUD_ELEMENTS)
+		return;
+
+	m_sHudStates[hudIdentifier].iType = HUD_REMOVE;
+
 	if (m_sHudElements[hudIdentifier].pPanel != NULL)
 	{
 		m_sHudElements[hudIdentifier].pPanel->SetVisible(false);
@@ -71,6 +71,10 @@ public:
 
 private:
 	HudElement_t		m_sHudElements[MAX_HUD_ELEMENTS];
+
+	// Last state the server sent for each element, updates only carry
+	// the fields that changed
+	LuaHudElementState_t	m_sHudStates[MAX_HUD_ELEMENTS];
 	int					m_nHudElements;
 };
 
@@ -2108,10 +2108,15 @@ int CBaseCombatCharacter::OnTakeDamage( const CTakeDamageInfo &info )
 				// and then killed by BaseClass::Event_Killed
 				// -------------------------------------------------------------------
 				// TODO: Change killer to an object
-				CFFLuaSC hPlayerKilled;
-				hPlayerKilled.Push(ToFFPlayer(this));
-				hPlayerKilled.Push(&info);
-				_scriptman.RunPredicates_LUA( NULL, &hPlayerKilled, "player_killed" );
+				bool bHasHook = _scriptman.HasGlobalHook( GLOBALHOOK_PLAYER_KILLED );
+				_scriptman.CountGlobalHook( GLOBALHOOK_PLAYER_KILLED, bHasHook );
+				if( bHasHook )
+				{
+					CFFLuaSC hPlayerKilled;
+					hPlayerKilled.Push(ToFFPlayer(this));
+					hPlayerKilled.Push(&info);
+					_scriptman.RunPredicates_LUA( NULL, &hPlayerKilled, "player_killed" );
+				}
 			}			
 
 			// Only classes that specifically request it are gibbed
@@ -611,11 +611,11 @@ void CBaseDoor::DoorTouch( CBaseEntity *pOther )
 	// TODO: Will need to change this so more than players can trigger doors
 	//CFFLuaObjectWrapper hAllowed;
 	CFFLuaSC hAllowed( 1, pOther );
-	if( _scriptman.RunPredicates_LUA( this, &hAllowed, "allowed" ) )
+	if( _scriptman.RunPredicates_LUA( this, &hAllowed, LUAHOOK_ALLOWED ) )
 	{
 		if( !hAllowed.GetBool() )
 		{
-			_scriptman.RunPredicates_LUA( this, &hAllowed, "onfailtouch" );
+			_scriptman.RunPredicates_LUA( this, &hAllowed, LUAHOOK_ONFAILTOUCH );
 			return;
 		}
 	}
@@ -638,7 +638,7 @@ void CBaseDoor::DoorTouch( CBaseEntity *pOther )
 
 	if (DoorActivate( ))
 	{
-		_scriptman.RunPredicates_LUA( this, &hAllowed, "ontouch" );
+		_scriptman.RunPredicates_LUA( this, &hAllowed, LUAHOOK_ONTOUCH );
 		// Temporarily disable the touch function, until movement is finished.
 		SetTouch( NULL );
 	}
@@ -714,11 +714,11 @@ void CBaseDoor::Use( CBaseEntity *pActivator, CBaseEntity *pCaller, USE_TYPE use
 
 	//CFFLuaObjectWrapper hAllowed;
 	CFFLuaSC hAllowed( 1, pActivator );
-	if( _scriptman.RunPredicates_LUA( this, &hAllowed, "allowed" ) )
+	if( _scriptman.RunPredicates_LUA( this, &hAllowed, LUAHOOK_ALLOWED ) )
 	{
 		if( !hAllowed.GetBool() )
 		{
-			_scriptman.RunPredicates_LUA( this, &hAllowed, "onfailuse" );
+			_scriptman.RunPredicates_LUA( this, &hAllowed, LUAHOOK_ONFAILUSE );
 			return;
 		}
 	}
@@ -732,7 +732,7 @@ void CBaseDoor::Use( CBaseEntity *pActivator, CBaseEntity *pCaller, USE_TYPE use
 		}
 		else
 		{
-			_scriptman.RunPredicates_LUA( this, &hAllowed, "onuse" );
+			_scriptman.RunPredicates_LUA( this, &hAllowed, LUAHOOK_ONUSE );
 			DoorActivate();
 		}
 	}
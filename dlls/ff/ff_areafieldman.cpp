@@ -0,0 +1,237 @@
+// ff_areafieldman.cpp
+
+/////////////////////////////////////////////////////////////////////////////
+// includes
+#include "cbase.h"
+#include "ff_areafieldman.h"
+#include "ff_player.h"
+#include "tier0/vprof.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// about the size of the biggest field, so most only look at 3x3 cells
+#define AREAFIELD_CELLSIZE	256.0f
+
+/////////////////////////////////////////////////////////////////////////////
+CFFAreaFieldManager _areafieldman;
+
+/////////////////////////////////////////////////////////////////////////////
+CFFAreaFieldManager::CFFAreaFieldManager() : m_Players( AREAFIELD_CELLSIZE )
+{
+	Init();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+CFFAreaFieldManager::~CFFAreaFieldManager()
+{
+	Shutdown();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFAreaFieldManager::Init()
+{
+	m_iTick = -1;
+	m_Fields.RemoveAll();
+	m_Players.RemoveAll();
+
+	m_nUpdates = 0;
+	m_nFieldUpdates = 0;
+	m_nPlayersTested = 0;
+	m_nPlayersInside = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFAreaFieldManager::Shutdown()
+{
+	m_Fields.Purge();
+	m_Players.Purge();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+int CFFAreaFieldManager::FindField( IFFAreaField *pField )
+{
+	for( int i = 0; i < m_Fields.Count(); i++ )
+	{
+		if( m_Fields[ i ].pField == pField )
+			return i;
+	}
+
+	return -1;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFAreaFieldManager::AddField( IFFAreaField *pField )
+{
+	if( !pField || FindField( pField ) != -1 )
+		return;
+
+	Field_t &field = m_Fields[ m_Fields.AddToTail() ];
+	field.pField = pField;
+	Q_memset( field.bInside, 0, sizeof( field.bInside ) );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFAreaFieldManager::RemoveField( IFFAreaField *pField )
+{
+	int iField = FindField( pField );
+	if( iField != -1 )
+		m_Fields.Remove( iField );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFAreaFieldManager::Update()
+{
+	if( m_iTick == gpGlobals->tickcount )
+		return;
+
+	m_iTick = gpGlobals->tickcount;
+
+	if( !m_Fields.Count() )
+		return;
+
+	VPROF_BUDGET( "CFFAreaFieldManager::Update", VPROF_BUDGETGROUP_GAME );
+
+	m_nUpdates++;
+
+	BuildGrid();
+
+	// a callback could remove a field, so go by the field itself rather
+	// than an index
+	CUtlVector<IFFAreaField *> fields;
+	for( int i = 0; i < m_Fields.Count(); i++ )
+		fields.AddToTail( m_Fields[ i ].pField );
+
+	for( int i = 0; i < fields.Count(); i++ )
+	{
+		int iField = FindField( fields[ i ] );
+		if( iField == -1 )
+			continue;
+
+		if( !fields[ i ]->IsFieldActive() )
+			continue;
+
+		UpdateField( fields[ i ] );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFAreaFieldManager::BuildGrid()
+{
+	m_Players.RemoveAll();
+
+	for( int i = 1; i <= gpGlobals->maxClients && i <= MAX_PLAYERS; i++ )
+	{
+		CFFPlayer *pPlayer = ToFFPlayer( UTIL_PlayerByIndex( i ) );
+		if( !pPlayer || pPlayer->IsObserver() )
+			continue;
+
+		Player_t &player = m_Players.Add( pPlayer->GetAbsOrigin() );
+		player.iPlayer = i;
+		player.vecOrigin = pPlayer->GetAbsOrigin();
+	}
+
+	m_Players.Sort();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFAreaFieldManager::UpdateField( IFFAreaField *pField )
+{
+	m_nFieldUpdates++;
+
+	Vector vecOrigin = pField->GetFieldOrigin();
+	float flRadius = pField->GetFieldRadius();
+
+	// distance to everyone in the cells the field overlaps
+	bool bTested[ MAX_PLAYERS + 1 ];
+	float flDistance[ MAX_PLAYERS + 1 ];
+	Q_memset( bTested, 0, sizeof( bTested ) );
+
+	int nTested = 0;
+
+	int iMinX = m_Players.CellCoord( vecOrigin.x - flRadius ), iMaxX = m_Players.CellCoord( vecOrigin.x + flRadius );
+	int iMinY = m_Players.CellCoord( vecOrigin.y - flRadius ), iMaxY = m_Players.CellCoord( vecOrigin.y + flRadius );
+
+	for( int x = iMinX; x <= iMaxX; x++ )
+	{
+		for( int y = iMinY; y <= iMaxY; y++ )
+		{
+			int iEnd;
+			for( int i = m_Players.FindCell( x, y, &iEnd ); i < iEnd; i++ )
+			{
+				const Player_t &player = m_Players[ i ];
+				bTested[ player.iPlayer ] = true;
+				flDistance[ player.iPlayer ] = ( player.vecOrigin - vecOrigin ).Length();
+
+				nTested++;
+			}
+		}
+	}
+
+	m_nPlayersTested += nTested;
+	VPROF_INCREMENT_COUNTER( "Area field players tested", nTested );
+
+	// Players that weren't near enough to be tested are outside too, but
+	// players that aren't in the grid at all (observers) are left alone
+	bool bInGrid[ MAX_PLAYERS + 1 ];
+	Q_memset( bInGrid, 0, sizeof( bInGrid ) );
+	for( int i = 0; i < m_Players.Count(); i++ )
+		bInGrid[ m_Players[ i ].iPlayer ] = true;
+
+	Field_t *pState = &m_Fields[ FindField( pField ) ];
+
+	for( int i = 1; i <= MAX_PLAYERS; i++ )
+	{
+		if( !bInGrid[ i ] )
+			continue;
+
+		bool bInside = bTested[ i ] && flDistance[ i ] < flRadius;
+		if( !bInside && !pState->bInside[ i ] )
+			continue;
+
+		CFFPlayer *pPlayer = ToFFPlayer( UTIL_PlayerByIndex( i ) );
+		if( !pPlayer )
+			continue;
+
+		bool bWasInside = pState->bInside[ i ];
+		pState->bInside[ i ] = bInside;
+
+		if( bInside )
+		{
+			m_nPlayersInside++;
+
+			if( !bWasInside )
+				pField->OnFieldEnter( pPlayer );
+
+			pField->OnFieldInside( pPlayer, flDistance[ i ] );
+		}
+		else
+			pField->OnFieldExit( pPlayer );
+
+		// the callback may have added or removed fields
+		int iField = FindField( pField );
+		if( iField == -1 )
+			return;
+
+		pState = &m_Fields[ iField ];
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFAreaFieldManager::PrintStats()
+{
+	Msg( "Area fields since level start:\n" );
+	Msg( "  %d active fields\n", m_Fields.Count() );
+	Msg( "  %u ticks, %u field updates\n", m_nUpdates, m_nFieldUpdates );
+	Msg( "  %u players measured, %u inside a field\n", m_nPlayersTested, m_nPlayersInside );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+CON_COMMAND( ff_areafield_stats, "Shows how many players the area fields looked at for the current level" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	_areafieldman.PrintStats();
+}
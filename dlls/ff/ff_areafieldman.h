@@ -0,0 +1,102 @@
+// ff_areafieldman.h
+
+/////////////////////////////////////////////////////////////////////////////
+#ifndef FF_AREAFIELDMAN_H
+#define FF_AREAFIELDMAN_H
+
+/////////////////////////////////////////////////////////////////////////////
+// includes
+#ifndef UTLVECTOR_H
+	#include "utlvector.h"
+#endif
+#ifndef FF_CELLGRID_H
+	#include "ff_cellgrid.h"
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+class CFFPlayer;
+
+/////////////////////////////////////////////////////////////////////////////
+// Something that affects every player within a radius of it (slowfield
+// grenades). Registered with _areafieldman, which works out who is inside
+// it and calls it back for just those players.
+/////////////////////////////////////////////////////////////////////////////
+class IFFAreaField
+{
+public:
+	// where the field is and how far it reaches this tick
+	virtual const Vector &GetFieldOrigin() = 0;
+	virtual float GetFieldRadius() = 0;
+
+	// false once the field has stopped affecting players
+	virtual bool IsFieldActive() = 0;
+
+	// called in player index order; enter comes just before the first
+	// inside, exit when a player that was inside is no longer
+	virtual void OnFieldEnter( CFFPlayer *pPlayer ) {}
+	virtual void OnFieldInside( CFFPlayer *pPlayer, float flDistance ) = 0;
+	virtual void OnFieldExit( CFFPlayer *pPlayer ) = 0;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// Works out once a tick which players are inside which area fields. The
+// players are bucketed on a grid so each field only measures the distance
+// to the players near it, rather than every field going through every
+// client on its own.
+/////////////////////////////////////////////////////////////////////////////
+class CFFAreaFieldManager
+{
+private:
+	struct Field_t
+	{
+		IFFAreaField	*pField;
+		bool			bInside[ MAX_PLAYERS + 1 ];
+	};
+
+	struct Player_t
+	{
+		int		iPlayer;
+		Vector	vecOrigin;
+	};
+
+public:
+	// 'structors
+	CFFAreaFieldManager();
+	~CFFAreaFieldManager();
+
+public:
+	void Init();
+	void Shutdown();
+
+	void AddField( IFFAreaField *pField );
+	void RemoveField( IFFAreaField *pField );
+
+	// updates every field, only does anything the first time it's called
+	// each tick so each field can call it from its own think
+	void Update();
+
+	void PrintStats();
+
+private:
+	int FindField( IFFAreaField *pField );
+
+	void BuildGrid();
+	void UpdateField( IFFAreaField *pField );
+
+private:
+	int						m_iTick;
+	CUtlVector<Field_t>		m_Fields;
+	CFFCellGrid<Player_t>	m_Players;
+
+	// stats since the level started
+	unsigned int	m_nUpdates;
+	unsigned int	m_nFieldUpdates;
+	unsigned int	m_nPlayersTested;	// distances measured
+	unsigned int	m_nPlayersInside;	// inside callbacks
+};
+
+/////////////////////////////////////////////////////////////////////////////
+extern CFFAreaFieldManager _areafieldman;
+
+/////////////////////////////////////////////////////////////////////////////
+#endif
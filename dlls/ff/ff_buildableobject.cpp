@@ -702,10 +702,15 @@ void CFFBuildableObject::Event_Killed( const CTakeDamageInfo& info )
 		m_pFlickerer = NULL;
 	}
 
-	CFFLuaSC hBuildableKilled;
-	hBuildableKilled.Push(this);
-	hBuildableKilled.Push(&info);
-	_scriptman.RunPredicates_LUA( NULL, &hBuildableKilled, "buildable_killed" );
+	bool bHasHook = _scriptman.HasGlobalHook( GLOBALHOOK_BUILDABLE_KILLED );
+	_scriptman.CountGlobalHook( GLOBALHOOK_BUILDABLE_KILLED, bHasHook );
+	if( bHasHook )
+	{
+		CFFLuaSC hBuildableKilled;
+		hBuildableKilled.Push(this);
+		hBuildableKilled.Push(&info);
+		_scriptman.RunPredicates_LUA( NULL, &hBuildableKilled, "buildable_killed" );
+	}
 
 	// Can't kill detpacks
 	if( Classify() != CLASS_DETPACK )
@@ -932,10 +937,15 @@ int CFFBuildableObject::OnTakeDamage( const CTakeDamageInfo &info )
 		return 0;
 
 	// Run through LUA!
-	CFFLuaSC hContext;
-	hContext.Push( this );
-	hContext.PushRef( adjustedDamage );
-	_scriptman.RunPredicates_LUA( NULL, &hContext, "buildable_ondamage" );
+	bool bHasHook = _scriptman.HasGlobalHook( GLOBALHOOK_BUILDABLE_ONDAMAGE );
+	_scriptman.CountGlobalHook( GLOBALHOOK_BUILDABLE_ONDAMAGE, bHasHook );
+	if( bHasHook )
+	{
+		CFFLuaSC hContext;
+		hContext.Push( this );
+		hContext.PushRef( adjustedDamage );
+		_scriptman.RunPredicates_LUA( NULL, &hContext, "buildable_ondamage" );
+	}
 
 	// Bug #0000333: Buildable Behavior (non build slot) while building
 	// Depending on the teamplay value, take damage
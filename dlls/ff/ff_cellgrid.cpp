@@ -0,0 +1,75 @@
+// ff_cellgrid.cpp
+
+/////////////////////////////////////////////////////////////////////////////
+// includes
+#include "cbase.h"
+#include "ff_cellgrid.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#ifdef _DEBUG
+/////////////////////////////////////////////////////////////////////////////
+// Puts points on both sides of x = 0 and y = 0 (and out at the edges of
+// the map) in a grid and checks every one is found in its own cell, and
+// only there
+/////////////////////////////////////////////////////////////////////////////
+CON_COMMAND( ff_cellgrid_check, "Checks cell grid lookups either side of the map's axes" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	const float flCellSize = 256.0f;
+	const float flCoords[] = { -16000.0f, -1000.0f, -300.0f, -256.0f, -100.0f, -1.0f, 0.0f, 1.0f, 100.0f, 255.0f, 256.0f, 300.0f, 1000.0f, 16000.0f };
+	const int nCoords = ARRAYSIZE( flCoords );
+
+	CFFCellGrid<int> grid( flCellSize );
+
+	for( int i = 0; i < nCoords; i++ )
+		for( int j = 0; j < nCoords; j++ )
+			grid.Add( Vector( flCoords[ i ], flCoords[ j ], 0 ) ) = i * nCoords + j;
+
+	grid.Sort();
+
+	int nFailed = 0;
+
+	for( int i = 0; i < nCoords; i++ )
+	{
+		for( int j = 0; j < nCoords; j++ )
+		{
+			int x = grid.CellCoord( flCoords[ i ] );
+			int y = grid.CellCoord( flCoords[ j ] );
+
+			bool bFound = false;
+
+			int iEnd;
+			for( int k = grid.FindCell( x, y, &iEnd ); k < iEnd; k++ )
+			{
+				int iPoint = grid[ k ];
+				int iX = iPoint / nCoords, iY = iPoint % nCoords;
+
+				// anything else in here has to share the cell
+				if( grid.CellCoord( flCoords[ iX ] ) != x || grid.CellCoord( flCoords[ iY ] ) != y )
+				{
+					Warning( "  (%.0f, %.0f) turned up in the cell of (%.0f, %.0f)\n", flCoords[ iX ], flCoords[ iY ], flCoords[ i ], flCoords[ j ] );
+					nFailed++;
+				}
+
+				if( iPoint == i * nCoords + j )
+					bFound = true;
+			}
+
+			if( !bFound )
+			{
+				Warning( "  (%.0f, %.0f) not found in cell (%d, %d)\n", flCoords[ i ], flCoords[ j ], x, y );
+				nFailed++;
+			}
+		}
+	}
+
+	if( nFailed )
+		Warning( "Cell grid check failed %d times\n", nFailed );
+	else
+		Msg( "Cell grid check passed (%d points)\n", nCoords * nCoords );
+}
+#endif // _DEBUG
@@ -0,0 +1,103 @@
+// ff_cellgrid.h
+
+/////////////////////////////////////////////////////////////////////////////
+#ifndef FF_CELLGRID_H
+#define FF_CELLGRID_H
+
+/////////////////////////////////////////////////////////////////////////////
+// includes
+#ifndef UTLVECTOR_H
+	#include "utlvector.h"
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+// Entries bucketed by position on a grid of square cells in x and y. Add
+// everything, Sort once, then each cell's entries are one run found with a
+// binary search. Built from scratch each tick by the managers that use it
+// (sentry targets, area fields, radio tags).
+//
+// Cell keys are unsigned with the row in the high 16 bits, so sorting by
+// key sorts by row and then column, negative coordinates included. Cell
+// coordinates must be within +/-32767, which a map always is.
+/////////////////////////////////////////////////////////////////////////////
+template< class T >
+class CFFCellGrid
+{
+private:
+	struct Entry_t
+	{
+		unsigned int	iKey;
+		T				data;
+	};
+
+public:
+	// 'structors
+	CFFCellGrid( float flCellSize ) : m_flCellSize( flCellSize ) {}
+
+public:
+	int CellCoord( float f ) const { return (int) floor( f / m_flCellSize ); }
+
+	static unsigned int CellKey( int x, int y )
+	{
+		return ( (unsigned int)( x + 0x8000 ) & 0xFFFF ) | ( ( (unsigned int)( y + 0x8000 ) & 0xFFFF ) << 16 );
+	}
+
+	void RemoveAll() { m_Entries.RemoveAll(); }
+	void Purge() { m_Entries.Purge(); }
+
+	// adds an entry in the cell vecOrigin is in, Sort before looking it up
+	T &Add( const Vector &vecOrigin )
+	{
+		Entry_t &entry = m_Entries[ m_Entries.AddToTail() ];
+		entry.iKey = CellKey( CellCoord( vecOrigin.x ), CellCoord( vecOrigin.y ) );
+		return entry.data;
+	}
+
+	void Sort() { m_Entries.Sort( EntryCompare ); }
+
+	// the entries in cell x, y are [return value, *piEnd)
+	int FindCell( int x, int y, int *piEnd ) const
+	{
+		unsigned int iKey = CellKey( x, y );
+
+		// first entry not before this cell
+		int iLow = 0, iHigh = m_Entries.Count();
+		while( iLow < iHigh )
+		{
+			int iMid = ( iLow + iHigh ) / 2;
+			if( m_Entries[ iMid ].iKey < iKey )
+				iLow = iMid + 1;
+			else
+				iHigh = iMid;
+		}
+
+		int iEnd = iLow;
+		while( iEnd < m_Entries.Count() && m_Entries[ iEnd ].iKey == iKey )
+			iEnd++;
+
+		*piEnd = iEnd;
+		return iLow;
+	}
+
+	int Count() const { return m_Entries.Count(); }
+
+	T &operator[]( int i ) { return m_Entries[ i ].data; }
+	const T &operator[]( int i ) const { return m_Entries[ i ].data; }
+
+private:
+	// same order as the < used by FindCell, no subtraction to overflow
+	static int __cdecl EntryCompare( const Entry_t *a, const Entry_t *b )
+	{
+		if( a->iKey < b->iKey )
+			return -1;
+
+		return a->iKey > b->iKey ? 1 : 0;
+	}
+
+private:
+	CUtlVector<Entry_t>	m_Entries;
+	float				m_flCellSize;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+#endif
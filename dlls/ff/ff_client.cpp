@@ -32,6 +32,7 @@
 #include "ff_bot_temp.h"
 #include "viewport_panel_names.h"
 #include "ff_scriptman.h"
+#include "ff_luahudman.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -45,6 +46,9 @@ void FinishClientPutInServer( CFFPlayer *pPlayer )
 {
 	pPlayer->m_flNextSpawnDelay = 0;
 
+	// new client, nothing on its lua hud yet
+	_luahudman.ResetPlayer( pPlayer->entindex() );
+
 	pPlayer->InitialSpawn();
 	pPlayer->Spawn();
 
@@ -24,6 +24,9 @@
 #include "ff_luacontext.h"
 #include "ff_scheduleman.h"
 #include "ff_timerman.h"
+#include "ff_luagcman.h"
+#include "ff_luahudman.h"
+#include "ff_nailsim.h"
 #include "ff_menuman.h"
 #include "ff_scriptman.h"
 #include "ff_utils.h"
@@ -82,6 +85,9 @@ void CFFEntitySystemHelper::OnThink()
 	_scheduleman.Update();
 	//_menuman.Update();
 	_timerman.Update();
+	_luagcman.Update();
+	_luahudman.Update();
+	_nailsim.Update();
 	SetNextThink(gpGlobals->curtime + TICK_INTERVAL);
 }
 
@@ -0,0 +1,529 @@
+// ff_explosionharness.cpp
+
+/////////////////////////////////////////////////////////////////////////////
+// includes
+#include "cbase.h"
+#include "ff_explosionharness.h"
+#include "ff_gamerules.h"
+#include "ff_player.h"
+#include "ff_buildableobjects_shared.h"
+#include "world.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+/////////////////////////////////////////////////////////////////////////////
+#define EXPLOSIONHARNESS_VERSION	2
+
+/////////////////////////////////////////////////////////////////////////////
+CFFExplosionHarness _explosionharness;
+
+/////////////////////////////////////////////////////////////////////////////
+CFFExplosionHarness::CFFExplosionHarness()
+{
+	m_hFile = FILESYSTEM_INVALID_HANDLE;
+	m_nExplosions = 0;
+	m_nEntities = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+CFFExplosionHarness::~CFFExplosionHarness()
+{
+	StopRecording();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool CFFExplosionHarness::StartRecording( const char *pszFilename )
+{
+	StopRecording();
+
+	m_hFile = filesystem->Open( pszFilename, "w", "MOD" );
+	if( m_hFile == FILESYSTEM_INVALID_HANDLE )
+		return false;
+
+	m_nExplosions = 0;
+	m_nEntities = 0;
+
+	filesystem->FPrintf( m_hFile, "ffexplosions %d %s\n", EXPLOSIONHARNESS_VERSION, STRING( gpGlobals->mapname ) );
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFExplosionHarness::StopRecording()
+{
+	if( m_hFile == FILESYSTEM_INVALID_HANDLE )
+		return;
+
+	filesystem->Close( m_hFile );
+	m_hFile = FILESYSTEM_INVALID_HANDLE;
+
+	Msg( "Recorded %d explosions reaching %d entities\n", m_nExplosions, m_nEntities );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// index 0 is the world, which UTIL_EntityByIndex won't give out
+CBaseEntity *CFFExplosionHarness::FindEntity( int iIndex, const char *pszClassname )
+{
+	CBaseEntity *pEntity = NULL;
+
+	if( iIndex == 0 )
+		pEntity = GetWorldEntity();
+	else if( iIndex > 0 )
+		pEntity = UTIL_EntityByIndex( iIndex );
+
+	if( !pEntity || !FClassnameIs( pEntity, pszClassname ) )
+		return NULL;
+
+	return pEntity;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Everything RadiusDamage and TakeDamage look at that can change between
+// one explosion and the next
+void CFFExplosionHarness::Snapshot( CBaseEntity *pEntity, FFExplosionEntity_t &state )
+{
+	state.iIndex = pEntity->entindex();
+	Q_strncpy( state.szClassname, pEntity->GetClassname(), sizeof( state.szClassname ) );
+	state.iTeam = pEntity->GetTeamNumber();
+	state.iClassSlot = pEntity->IsPlayer() ? ToFFPlayer( pEntity )->GetClassSlot() : 0;
+
+	state.vecOrigin = pEntity->GetAbsOrigin();
+	state.angAngles = pEntity->GetAbsAngles();
+	state.vecVelocity = pEntity->GetAbsVelocity();
+
+	CBaseEntity *pGround = pEntity->GetGroundEntity();
+	state.iGroundIndex = pGround ? pGround->entindex() : -1;
+
+	state.bDucked = ( pEntity->GetFlags() & FL_DUCKING ) != 0;
+	state.iHealth = pEntity->GetHealth();
+	state.iArmor = pEntity->GetArmor();
+
+	state.iHealthAfter = state.iHealth;
+	state.iArmorAfter = state.iArmor;
+	state.vecVelocityAfter = state.vecVelocity;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFExplosionHarness::Restore( CBaseEntity *pEntity, const FFExplosionEntity_t &state )
+{
+	pEntity->Teleport( &state.vecOrigin, &state.angAngles, &state.vecVelocity );
+
+	// after the teleport, which can take them off the ground
+	CBaseEntity *pGround = NULL;
+	if( state.iGroundIndex == 0 )
+		pGround = GetWorldEntity();
+	else if( state.iGroundIndex > 0 )
+		pGround = UTIL_EntityByIndex( state.iGroundIndex );
+
+	pEntity->SetGroundEntity( pGround );
+
+	if( state.bDucked )
+		pEntity->AddFlag( FL_DUCKING );
+	else
+		pEntity->RemoveFlag( FL_DUCKING );
+
+	pEntity->SetHealth( state.iHealth );
+	pEntity->SetArmor( state.iArmor );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Whether the current map has everything the explosion needs, in the state
+// it needs it
+bool CFFExplosionHarness::CanReplay( const FFExplosion_t &explosion, const FFExplosionEntity_t *pEntities )
+{
+	for( int i = 0; i < explosion.nEntities; i++ )
+	{
+		const FFExplosionEntity_t &state = pEntities[ i ];
+
+		// a kill can't be put back afterwards
+		if( state.iHealth > 0 && state.iHealthAfter <= 0 )
+			return false;
+
+		CBaseEntity *pEntity = FindEntity( state.iIndex, state.szClassname );
+		if( !pEntity || pEntity->GetTeamNumber() != state.iTeam )
+			return false;
+
+		if( pEntity->IsPlayer() )
+		{
+			CFFPlayer *pPlayer = ToFFPlayer( pEntity );
+			if( !pPlayer->IsAlive() || pPlayer->GetClassSlot() != state.iClassSlot )
+				return false;
+		}
+	}
+
+	if( Q_strcmp( explosion.szAttackerClass, "-" ) && !FindEntity( explosion.iAttackerIndex, explosion.szAttackerClass ) )
+		return false;
+
+	// the inflictor gets a stand-in if it's gone
+	if( explosion.iIgnoreIndex != explosion.iInflictorIndex && Q_strcmp( explosion.szIgnoreClass, "-" ) && !FindEntity( explosion.iIgnoreIndex, explosion.szIgnoreClass ) )
+		return false;
+
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Only called while recording, so none of this costs anything otherwise.
+// %.9g is enough for a float to come back bit for bit
+void CFFExplosionHarness::RecordRadiusDamage( const CTakeDamageInfo &info, const Vector &vecSrc, float flRadius, int iClassIgnore, CBaseEntity *pEntityIgnore )
+{
+	// everything RadiusDamage could get to
+	CUtlVector<EHANDLE> hEntities;
+	CUtlVector<FFExplosionEntity_t> entities;
+
+	CBaseEntity *pEntity = NULL;
+	for( CEntitySphereQuery sphere( vecSrc, flRadius ); ( pEntity = sphere.GetCurrentEntity() ) != NULL; sphere.NextEntity() )
+	{
+		if( pEntity->m_takedamage == DAMAGE_NO )
+			continue;
+
+		hEntities.AddToTail( pEntity );
+		Snapshot( pEntity, entities[ entities.AddToTail() ] );
+	}
+
+	CBaseEntity *pInflictor = info.GetInflictor();
+	CBaseEntity *pOwner = pInflictor ? pInflictor->GetOwnerEntity() : NULL;
+	CBaseEntity *pAttacker = info.GetAttacker();
+
+	FFExplosion_t e;
+	e.iSeed = random->RandomInt( 0, 0x7fffffff );
+	e.vecSrc = vecSrc;
+	e.flRadius = flRadius;
+	e.iClassIgnore = iClassIgnore;
+	e.iIgnoreIndex = pEntityIgnore ? pEntityIgnore->entindex() : -1;
+	Q_strncpy( e.szIgnoreClass, pEntityIgnore ? pEntityIgnore->GetClassname() : "-", sizeof( e.szIgnoreClass ) );
+	e.iInflictorIndex = pInflictor ? pInflictor->entindex() : -1;
+	Q_strncpy( e.szInflictorClass, pInflictor ? pInflictor->GetClassname() : "-", sizeof( e.szInflictorClass ) );
+	e.vecInflictorOrigin = pInflictor ? pInflictor->GetAbsOrigin() : vec3_origin;
+	e.iInflictorOwnerIndex = pOwner ? pOwner->entindex() : -1;
+	e.iAttackerIndex = pAttacker ? pAttacker->entindex() : -1;
+	Q_strncpy( e.szAttackerClass, pAttacker ? pAttacker->GetClassname() : "-", sizeof( e.szAttackerClass ) );
+	e.flDamage = info.GetDamage();
+	e.flMaxDamage = info.GetMaxDamage();
+	e.bitsDamageType = info.GetDamageType();
+	e.iCustomKill = info.GetCustomKill();
+	e.iAmmoType = info.GetAmmoType();
+	e.vecDamageForce = info.GetDamageForce();
+	e.vecDamagePosition = info.GetDamagePosition();
+	e.vecReportedPosition = info.GetReportedPosition();
+	e.nEntities = entities.Count();
+
+	// the noisy body targets have to come out the same on playback
+	random->SetSeed( e.iSeed );
+
+	FFGameRules()->ApplyRadiusDamage( info, vecSrc, flRadius, iClassIgnore, pEntityIgnore );
+
+	for( int i = 0; i < entities.Count(); i++ )
+	{
+		FFExplosionEntity_t &state = entities[ i ];
+
+		pEntity = hEntities[ i ];
+		if( !pEntity )
+		{
+			state.iHealthAfter = 0;
+			continue;
+		}
+
+		state.iHealthAfter = pEntity->GetHealth();
+		state.iArmorAfter = pEntity->GetArmor();
+		state.vecVelocityAfter = pEntity->GetAbsVelocity();
+	}
+
+	// an explosion set off by this one has already been written, which is
+	// fine, each line carries everything it needs
+	filesystem->FPrintf( m_hFile,
+		"explosion %d %.9g %.9g %.9g %.9g %d %d %s %d %s %.9g %.9g %.9g %d %d %s "
+		"%.9g %.9g %d %d %d %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %d\n",
+		e.iSeed, e.vecSrc.x, e.vecSrc.y, e.vecSrc.z, e.flRadius, e.iClassIgnore, e.iIgnoreIndex, e.szIgnoreClass,
+		e.iInflictorIndex, e.szInflictorClass, e.vecInflictorOrigin.x, e.vecInflictorOrigin.y, e.vecInflictorOrigin.z,
+		e.iInflictorOwnerIndex, e.iAttackerIndex, e.szAttackerClass,
+		e.flDamage, e.flMaxDamage, e.bitsDamageType, e.iCustomKill, e.iAmmoType,
+		e.vecDamageForce.x, e.vecDamageForce.y, e.vecDamageForce.z,
+		e.vecDamagePosition.x, e.vecDamagePosition.y, e.vecDamagePosition.z,
+		e.vecReportedPosition.x, e.vecReportedPosition.y, e.vecReportedPosition.z,
+		e.nEntities );
+
+	for( int i = 0; i < entities.Count(); i++ )
+	{
+		const FFExplosionEntity_t &s = entities[ i ];
+
+		filesystem->FPrintf( m_hFile,
+			"entity %d %s %d %d %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %d %d %d %d "
+			"%d %d %.9g %.9g %.9g\n",
+			s.iIndex, s.szClassname, s.iTeam, s.iClassSlot,
+			s.vecOrigin.x, s.vecOrigin.y, s.vecOrigin.z, s.angAngles.x, s.angAngles.y, s.angAngles.z,
+			s.vecVelocity.x, s.vecVelocity.y, s.vecVelocity.z, s.iGroundIndex, s.bDucked, s.iHealth, s.iArmor,
+			s.iHealthAfter, s.iArmorAfter, s.vecVelocityAfter.x, s.vecVelocityAfter.y, s.vecVelocityAfter.z );
+	}
+
+	m_nExplosions++;
+	m_nEntities += entities.Count();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool CFFExplosionHarness::Load( const char *pszFilename, CUtlVector<FFExplosion_t> &explosions, CUtlVector<FFExplosionEntity_t> &entities )
+{
+	FileHandle_t hFile = filesystem->Open( pszFilename, "r", "MOD" );
+	if( hFile == FILESYSTEM_INVALID_HANDLE )
+	{
+		Warning( "Unable to open %s\n", pszFilename );
+		return false;
+	}
+
+	char szLine[ 1024 ];
+	char szMap[ 64 ];
+	int iVersion = 0;
+
+	if( !filesystem->ReadLine( szLine, sizeof( szLine ), hFile ) || sscanf( szLine, "ffexplosions %d %63s", &iVersion, szMap ) != 2 || iVersion != EXPLOSIONHARNESS_VERSION )
+	{
+		Warning( "%s isn't a version %d explosion recording\n", pszFilename, EXPLOSIONHARNESS_VERSION );
+		filesystem->Close( hFile );
+		return false;
+	}
+
+	if( Q_stricmp( szMap, STRING( gpGlobals->mapname ) ) )
+		Warning( "%s was recorded on %s, expect most of it to be skipped\n", pszFilename, szMap );
+
+	int iLine = 1;
+	bool bOk = true;
+
+	while( bOk && filesystem->ReadLine( szLine, sizeof( szLine ), hFile ) )
+	{
+		iLine++;
+
+		FFExplosion_t e;
+		int nFields = sscanf( szLine,
+			"explosion %d %f %f %f %f %d %d %63s %d %63s %f %f %f %d %d %63s "
+			"%f %f %d %d %d %f %f %f %f %f %f %f %f %f %d",
+			&e.iSeed, &e.vecSrc.x, &e.vecSrc.y, &e.vecSrc.z, &e.flRadius, &e.iClassIgnore, &e.iIgnoreIndex, e.szIgnoreClass,
+			&e.iInflictorIndex, e.szInflictorClass, &e.vecInflictorOrigin.x, &e.vecInflictorOrigin.y, &e.vecInflictorOrigin.z,
+			&e.iInflictorOwnerIndex, &e.iAttackerIndex, e.szAttackerClass,
+			&e.flDamage, &e.flMaxDamage, &e.bitsDamageType, &e.iCustomKill, &e.iAmmoType,
+			&e.vecDamageForce.x, &e.vecDamageForce.y, &e.vecDamageForce.z,
+			&e.vecDamagePosition.x, &e.vecDamagePosition.y, &e.vecDamagePosition.z,
+			&e.vecReportedPosition.x, &e.vecReportedPosition.y, &e.vecReportedPosition.z,
+			&e.nEntities );
+
+		if( nFields != 31 || e.nEntities < 0 )
+		{
+			Warning( "Bad explosion on line %d of %s\n", iLine, pszFilename );
+			bOk = false;
+			break;
+		}
+
+		e.iFirstEntity = entities.Count();
+
+		for( int i = 0; i < e.nEntities; i++ )
+		{
+			iLine++;
+
+			FFExplosionEntity_t s;
+			int bDucked;
+
+			nFields = 0;
+			if( filesystem->ReadLine( szLine, sizeof( szLine ), hFile ) )
+			{
+				nFields = sscanf( szLine,
+					"entity %d %63s %d %d %f %f %f %f %f %f %f %f %f %d %d %d %d "
+					"%d %d %f %f %f",
+					&s.iIndex, s.szClassname, &s.iTeam, &s.iClassSlot,
+					&s.vecOrigin.x, &s.vecOrigin.y, &s.vecOrigin.z, &s.angAngles.x, &s.angAngles.y, &s.angAngles.z,
+					&s.vecVelocity.x, &s.vecVelocity.y, &s.vecVelocity.z, &s.iGroundIndex, &bDucked, &s.iHealth, &s.iArmor,
+					&s.iHealthAfter, &s.iArmorAfter, &s.vecVelocityAfter.x, &s.vecVelocityAfter.y, &s.vecVelocityAfter.z );
+			}
+
+			if( nFields != 22 )
+			{
+				Warning( "Bad entity on line %d of %s\n", iLine, pszFilename );
+				bOk = false;
+				break;
+			}
+
+			s.bDucked = bDucked != 0;
+			entities.AddToTail( s );
+		}
+
+		explosions.AddToTail( e );
+	}
+
+	filesystem->Close( hFile );
+	return bOk;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool CFFExplosionHarness::VerifyRecording( const char *pszFilename, int nIterations )
+{
+	if( IsRecording() )
+	{
+		Warning( "Stop recording first\n" );
+		return false;
+	}
+
+	if( !FFGameRules() )
+		return false;
+
+	CUtlVector<FFExplosion_t> explosions;
+	CUtlVector<FFExplosionEntity_t> entities;
+	if( !Load( pszFilename, explosions, entities ) )
+		return false;
+
+	nIterations = max( nIterations, 1 );
+
+	int nReplayed = 0;
+	int nSkipped = 0;
+	int nMismatches = 0;
+	double flTime = 0.0;
+
+	CUtlVector<CBaseEntity *> victims;
+
+	for( int iExplosion = 0; iExplosion < explosions.Count(); iExplosion++ )
+	{
+		const FFExplosion_t &e = explosions[ iExplosion ];
+		const FFExplosionEntity_t *pEntities = entities.Base() + e.iFirstEntity;
+
+		if( !CanReplay( e, pEntities ) )
+		{
+			nSkipped++;
+			continue;
+		}
+
+		// the grenade or rocket will usually be long gone, so make another
+		// like it. buildables need too much setting up for that
+		CBaseEntity *pInflictor = FindEntity( e.iInflictorIndex, e.szInflictorClass );
+		CBaseEntity *pStandIn = NULL;
+
+		if( !pInflictor && Q_strcmp( e.szInflictorClass, "-" ) )
+		{
+			pStandIn = CreateEntityByName( e.szInflictorClass );
+			if( pStandIn && FF_ToBuildableObject( pStandIn ) )
+			{
+				UTIL_Remove( pStandIn );
+				pStandIn = NULL;
+			}
+
+			if( !pStandIn )
+			{
+				nSkipped++;
+				continue;
+			}
+
+			pStandIn->SetAbsOrigin( e.vecInflictorOrigin );
+			pStandIn->SetOwnerEntity( UTIL_EntityByIndex( e.iInflictorOwnerIndex ) );
+			DispatchSpawn( pStandIn );
+
+			pInflictor = pStandIn;
+		}
+
+		CBaseEntity *pAttacker = FindEntity( e.iAttackerIndex, e.szAttackerClass );
+		CBaseEntity *pIgnore = ( e.iIgnoreIndex >= 0 && e.iIgnoreIndex == e.iInflictorIndex ) ? pInflictor : FindEntity( e.iIgnoreIndex, e.szIgnoreClass );
+
+		Vector vecReportedPosition = e.vecReportedPosition;
+		CTakeDamageInfo info( pInflictor, pAttacker, e.vecDamageForce, e.vecDamagePosition, e.flDamage, e.bitsDamageType, e.iCustomKill, &vecReportedPosition );
+		info.SetMaxDamage( e.flMaxDamage );
+		info.SetAmmoType( e.iAmmoType );
+
+		victims.RemoveAll();
+		for( int i = 0; i < e.nEntities; i++ )
+			victims.AddToTail( FindEntity( pEntities[ i ].iIndex, pEntities[ i ].szClassname ) );
+
+		for( int iIteration = 0; iIteration < nIterations; iIteration++ )
+		{
+			for( int i = 0; i < victims.Count(); i++ )
+				Restore( victims[ i ], pEntities[ i ] );
+
+			random->SetSeed( e.iSeed );
+
+			double flStart = Plat_FloatTime();
+			FFGameRules()->RadiusDamage( info, e.vecSrc, e.flRadius, e.iClassIgnore, pIgnore );
+			flTime += Plat_FloatTime() - flStart;
+
+			if( iIteration > 0 )
+				continue;
+
+			bool bMatches = true;
+
+			for( int i = 0; i < victims.Count(); i++ )
+			{
+				const FFExplosionEntity_t &s = pEntities[ i ];
+				CBaseEntity *pVictim = victims[ i ];
+
+				if( pVictim->GetHealth() == s.iHealthAfter && pVictim->GetArmor() == s.iArmorAfter && pVictim->GetAbsVelocity() == s.vecVelocityAfter )
+					continue;
+
+				bMatches = false;
+
+				// don't flood the console
+				if( nMismatches++ < 10 )
+				{
+					const Vector &vecVelocity = pVictim->GetAbsVelocity();
+
+					Warning( "Explosion %d, %s %d differs: health %d (%d) armor %d (%d) velocity %.9g %.9g %.9g (%.9g %.9g %.9g)\n",
+						iExplosion, s.szClassname, s.iIndex,
+						pVictim->GetHealth(), s.iHealthAfter,
+						pVictim->GetArmor(), s.iArmorAfter,
+						vecVelocity.x, vecVelocity.y, vecVelocity.z,
+						s.vecVelocityAfter.x, s.vecVelocityAfter.y, s.vecVelocityAfter.z );
+				}
+			}
+
+			// whatever changed could snowball, no point timing it
+			if( !bMatches )
+				break;
+		}
+
+		// leave everyone the way they were
+		for( int i = 0; i < victims.Count(); i++ )
+			Restore( victims[ i ], pEntities[ i ] );
+
+		if( pStandIn )
+			UTIL_Remove( pStandIn );
+
+		nReplayed++;
+	}
+
+	Msg( "%s: %d explosions, %d replayed, %d skipped, %d entities differ\n", pszFilename, explosions.Count(), nReplayed, nSkipped, nMismatches );
+
+	if( nReplayed )
+		Msg( "  %.1f ns/explosion over %d iterations\n", flTime * 1e9 / ( (double) nReplayed * nIterations ), nIterations );
+
+	return nMismatches == 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+CON_COMMAND( ff_explosion_record, "Records radius damage and everything it reaches to a file for ff_explosion_verify. Record with the code you trust. Arguments: <file>, no file stops recording" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if( engine->Cmd_Argc() < 2 )
+	{
+		_explosionharness.StopRecording();
+		return;
+	}
+
+	const char *pszFilename = engine->Cmd_Argv( 1 );
+
+	if( _explosionharness.StartRecording( pszFilename ) )
+		Msg( "Recording explosions to %s\n", pszFilename );
+	else
+		Warning( "Unable to write to %s\n", pszFilename );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+CON_COMMAND( ff_explosion_verify, "Replays a radius damage recording on the current map, checks the results against it and times it. Hurts and moves the players involved. Arguments: <file> [iterations=10]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if( engine->Cmd_Argc() < 2 )
+	{
+		Msg( "Usage: ff_explosion_verify <file> [iterations]\n" );
+		return;
+	}
+
+	int nIterations = engine->Cmd_Argc() > 2 ? atoi( engine->Cmd_Argv( 2 ) ) : 10;
+
+	if( _explosionharness.VerifyRecording( engine->Cmd_Argv( 1 ), nIterations ) )
+		Msg( "Explosion recording matches\n" );
+	else
+		Warning( "Explosion recording does NOT match\n" );
+}
@@ -0,0 +1,120 @@
+// ff_explosionharness.h
+
+/////////////////////////////////////////////////////////////////////////////
+#ifndef FF_EXPLOSIONHARNESS_H
+#define FF_EXPLOSIONHARNESS_H
+
+/////////////////////////////////////////////////////////////////////////////
+// includes
+#ifndef UTLVECTOR_H
+	#include "utlvector.h"
+#endif
+#ifndef FILESYSTEM_H
+	#include "filesystem.h"
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+class CTakeDamageInfo;
+
+/////////////////////////////////////////////////////////////////////////////
+// One entity an explosion could reach, as it was just before the explosion
+// and what the game made of it
+struct FFExplosionEntity_t
+{
+	int		iIndex;
+	char	szClassname[ 64 ];
+	int		iTeam;
+	int		iClassSlot;			// 0 if not a player
+
+	Vector	vecOrigin;
+	QAngle	angAngles;
+	Vector	vecVelocity;
+	int		iGroundIndex;		// -1 if not on the ground
+	bool	bDucked;
+	int		iHealth;
+	int		iArmor;
+
+	// golden values
+	int		iHealthAfter;
+	int		iArmorAfter;
+	Vector	vecVelocityAfter;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// One CFFGameRules::RadiusDamage call
+struct FFExplosion_t
+{
+	int		iSeed;				// for the random stream (noisy body targets)
+	Vector	vecSrc;
+	float	flRadius;
+	int		iClassIgnore;
+	int		iIgnoreIndex;		// -1 for none
+	char	szIgnoreClass[ 64 ];
+
+	// the damage info
+	int		iInflictorIndex;
+	char	szInflictorClass[ 64 ];
+	Vector	vecInflictorOrigin;
+	int		iInflictorOwnerIndex;
+	int		iAttackerIndex;
+	char	szAttackerClass[ 64 ];
+	float	flDamage;
+	float	flMaxDamage;
+	int		bitsDamageType;
+	int		iCustomKill;
+	int		iAmmoType;
+	Vector	vecDamageForce;
+	Vector	vecDamagePosition;
+	Vector	vecReportedPosition;
+
+	int		iFirstEntity;		// into the list of entities
+	int		nEntities;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// Records every radius damage call along with the state of everything it
+// could reach, before and after. Recordings are played back on the same
+// map by putting the entities back the way they were and calling
+// RadiusDamage again, so the whole path is checked (traces, falloff, push,
+// TakeDamage) and timed.
+//
+// Record with the code you trust, verify with the code you changed.
+/////////////////////////////////////////////////////////////////////////////
+class CFFExplosionHarness
+{
+public:
+	// 'structors
+	CFFExplosionHarness();
+	~CFFExplosionHarness();
+
+public:
+	bool StartRecording( const char *pszFilename );
+	void StopRecording();
+	bool IsRecording() const { return m_hFile != FILESYSTEM_INVALID_HANDLE; }
+
+	// CFFGameRules::RadiusDamage hands over to this while recording
+	void RecordRadiusDamage( const CTakeDamageInfo &info, const Vector &vecSrc, float flRadius, int iClassIgnore, CBaseEntity *pEntityIgnore );
+
+	// plays a recording back nIterations times, returns false if anything
+	// came out different
+	bool VerifyRecording( const char *pszFilename, int nIterations );
+
+private:
+	static bool Load( const char *pszFilename, CUtlVector<FFExplosion_t> &explosions, CUtlVector<FFExplosionEntity_t> &entities );
+
+	static CBaseEntity *FindEntity( int iIndex, const char *pszClassname );
+	static void Snapshot( CBaseEntity *pEntity, FFExplosionEntity_t &state );
+	static void Restore( CBaseEntity *pEntity, const FFExplosionEntity_t &state );
+	static bool CanReplay( const FFExplosion_t &explosion, const FFExplosionEntity_t *pEntities );
+
+private:
+	FileHandle_t	m_hFile;
+	int				m_nExplosions;
+	int				m_nEntities;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+extern CFFExplosionHarness _explosionharness;
+
+/////////////////////////////////////////////////////////////////////////////
+#endif
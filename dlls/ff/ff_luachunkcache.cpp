@@ -0,0 +1,212 @@
+// ff_luachunkcache.cpp
+
+//---------------------------------------------------------------------------
+// includes
+#include "cbase.h"
+#include "ff_luachunkcache.h"
+#include "ff_scriptman.h"
+#include "tier0/vprof.h"
+
+// Lua includes
+extern "C"
+{
+	#include "lua.h"
+	#include "lauxlib.h"
+}
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+//---------------------------------------------------------------------------
+ConVar lua_chunkcache( "lua_chunkcache", "1", 0, "Keep compiled Lua scripts in memory across level changes" );
+ConVar lua_chunkcache_maxkb( "lua_chunkcache_maxkb", "8192", 0, "Maximum size (in KB) of compiled Lua scripts kept by lua_chunkcache" );
+ConVar lua_chunkcache_debug( "lua_chunkcache_debug", "0", 0, "Print Lua chunk cache hits and misses and load times after every level load" );
+
+//---------------------------------------------------------------------------
+CFFLuaChunkCache::CFFLuaChunkCache()
+{
+	m_iUseCounter = 0;
+	m_nBytes = 0;
+
+	ResetLoadStats();
+}
+
+//---------------------------------------------------------------------------
+CFFLuaChunkCache::~CFFLuaChunkCache()
+{
+	Clear();
+}
+
+//---------------------------------------------------------------------------
+int CFFLuaChunkCache::Writer( lua_State *L, const void *p, size_t sz, void *ud )
+{
+	CUtlBuffer *pBuffer = (CUtlBuffer *)ud;
+	pBuffer->Put( p, (int)sz );
+	return 0;
+}
+
+//---------------------------------------------------------------------------
+int CFFLuaChunkCache::Load( lua_State *L, const char *pszFilename, const char *pszChunkName, const char *pBuffer, int nSize )
+{
+	VPROF_BUDGET( "CFFLuaChunkCache::Load", VPROF_BUDGETGROUP_FF_LUA );
+
+	if ( !lua_chunkcache.GetBool() )
+		return luaL_loadbuffer( L, pBuffer, nSize, pszChunkName );
+
+	double flStart = Plat_FloatTime();
+	CRC32_t crc = CRC32_ProcessSingleBuffer( pBuffer, nSize );
+
+	int iChunk = m_Chunks.Find( pszFilename );
+	if ( m_Chunks.IsValidIndex( iChunk ) )
+	{
+		Chunk_t *pChunk = m_Chunks[iChunk];
+		if ( pChunk->crc == crc && pChunk->nSourceSize == nSize )
+		{
+			if ( luaL_loadbuffer( L, (const char *)pChunk->bytecode.Base(), pChunk->bytecode.TellPut(), pszChunkName ) == 0 )
+			{
+				double flElapsed = Plat_FloatTime() - flStart;
+
+				pChunk->iLastUsed = ++m_iUseCounter;
+
+				m_nHits++;
+				m_flLoadTime += flElapsed;
+				m_flSavedTime += max( 0.0, pChunk->flCompileTime - flElapsed );
+				return 0;
+			}
+
+			// shouldn't happen, but recompile rather than fail
+			lua_pop( L, 1 );
+		}
+
+		// the file changed
+		RemoveChunk( iChunk );
+	}
+
+	double flCompileStart = Plat_FloatTime();
+	int errorCode = luaL_loadbuffer( L, pBuffer, nSize, pszChunkName );
+	double flCompileTime = Plat_FloatTime() - flCompileStart;
+
+	m_nMisses++;
+
+	// leave the error on the stack for the caller
+	if ( errorCode != 0 )
+	{
+		m_flLoadTime += Plat_FloatTime() - flStart;
+		return errorCode;
+	}
+
+	Chunk_t *pChunk = new Chunk_t;
+	pChunk->crc = crc;
+	pChunk->nSourceSize = nSize;
+	pChunk->flCompileTime = flCompileTime;
+	pChunk->iLastUsed = ++m_iUseCounter;
+	lua_dump( L, Writer, &pChunk->bytecode );
+
+	int nBytes = pChunk->bytecode.TellPut();
+	if ( nBytes > lua_chunkcache_maxkb.GetInt() * 1024 )
+	{
+		delete pChunk;
+	}
+	else
+	{
+		MakeRoom( nBytes );
+		m_Chunks.Insert( pszFilename, pChunk );
+		m_nBytes += nBytes;
+	}
+
+	m_flLoadTime += Plat_FloatTime() - flStart;
+	return 0;
+}
+
+//---------------------------------------------------------------------------
+void CFFLuaChunkCache::MakeRoom( int nBytes )
+{
+	int nMaxBytes = lua_chunkcache_maxkb.GetInt() * 1024;
+
+	while ( m_Chunks.Count() && m_nBytes + nBytes > nMaxBytes )
+	{
+		int iOldest = m_Chunks.First();
+		for ( int i = m_Chunks.Next( iOldest ); i != m_Chunks.InvalidIndex(); i = m_Chunks.Next( i ) )
+		{
+			if ( m_Chunks[i]->iLastUsed < m_Chunks[iOldest]->iLastUsed )
+				iOldest = i;
+		}
+
+		RemoveChunk( iOldest );
+	}
+}
+
+//---------------------------------------------------------------------------
+void CFFLuaChunkCache::RemoveChunk( int iChunk )
+{
+	Chunk_t *pChunk = m_Chunks[iChunk];
+	m_nBytes -= pChunk->bytecode.TellPut();
+
+	delete pChunk;
+	m_Chunks.RemoveAt( iChunk );
+}
+
+//---------------------------------------------------------------------------
+void CFFLuaChunkCache::Clear()
+{
+	m_Chunks.PurgeAndDeleteElements();
+	m_nBytes = 0;
+}
+
+//---------------------------------------------------------------------------
+void CFFLuaChunkCache::ResetLoadStats()
+{
+	m_nHits = 0;
+	m_nMisses = 0;
+	m_flLoadTime = 0.0;
+	m_flSavedTime = 0.0;
+}
+
+//---------------------------------------------------------------------------
+void CFFLuaChunkCache::PrintLoadStats()
+{
+	if ( !lua_chunkcache_debug.GetBool() )
+		return;
+
+	Msg( "[SCRIPT] chunk cache: %d hits, %d misses, %.2f ms loading, %.2f ms compile time saved\n",
+		m_nHits,
+		m_nMisses,
+		m_flLoadTime * 1000.0,
+		m_flSavedTime * 1000.0 );
+}
+
+//---------------------------------------------------------------------------
+void CFFLuaChunkCache::PrintStats()
+{
+	Msg( "%d chunks, %d KB of bytecode (max %d KB)\n", m_Chunks.Count(), m_nBytes / 1024, lua_chunkcache_maxkb.GetInt() );
+
+	for ( int i = m_Chunks.First(); i != m_Chunks.InvalidIndex(); i = m_Chunks.Next( i ) )
+	{
+		Chunk_t *pChunk = m_Chunks[i];
+		Msg( "  %-48s %6d bytes  %.2f ms to compile\n", m_Chunks.GetElementName( i ), pChunk->bytecode.TellPut(), pChunk->flCompileTime * 1000.0 );
+	}
+
+	Msg( "Last level: %d hits, %d misses, %.2f ms loading, %.2f ms compile time saved\n",
+		m_nHits,
+		m_nMisses,
+		m_flLoadTime * 1000.0,
+		m_flSavedTime * 1000.0 );
+}
+
+//---------------------------------------------------------------------------
+CON_COMMAND( lua_chunkcache_stats, "Lists the compiled Lua scripts kept across level changes" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	_scriptman.GetChunkCache().PrintStats();
+}
+
+//---------------------------------------------------------------------------
+CON_COMMAND( lua_chunkcache_clear, "Throws away the compiled Lua scripts kept across level changes" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	_scriptman.GetChunkCache().Clear();
+}
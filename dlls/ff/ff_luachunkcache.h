@@ -0,0 +1,83 @@
+// ff_luachunkcache.h
+
+//---------------------------------------------------------------------------
+#ifndef FF_LUACHUNKCACHE_H
+#define FF_LUACHUNKCACHE_H
+
+//---------------------------------------------------------------------------
+// includes
+#ifndef UTLDICT_H
+	#include "utldict.h"
+#endif
+#ifndef UTLBUFFER_H
+	#include "utlbuffer.h"
+#endif
+#ifndef CHECKSUM_CRC_H
+	#include "checksum_crc.h"
+#endif
+
+//---------------------------------------------------------------------------
+// foward declarations
+struct lua_State;
+
+//---------------------------------------------------------------------------
+// Keeps the compiled bytecode of every script file loaded by the script
+// manager (map scripts and anything pulled in with require/IncludeScript)
+// across level changes. Entries are keyed by file path and only reused
+// while the source CRC still matches, so edited scripts are recompiled.
+// Bytecode is only ever produced by this cache and never read from disk;
+// lua's undump does no verification.
+//---------------------------------------------------------------------------
+class CFFLuaChunkCache
+{
+private:
+	struct Chunk_t
+	{
+		CRC32_t			crc;			// CRC of the source it was compiled from
+		int				nSourceSize;
+		CUtlBuffer		bytecode;
+		double			flCompileTime;	// seconds spent compiling the source
+		unsigned int	iLastUsed;
+	};
+
+public:
+	// 'structors
+	CFFLuaChunkCache();
+	~CFFLuaChunkCache();
+
+public:
+	// same as luaL_loadbuffer, but reuses the bytecode if the file was
+	// compiled before and has not changed since
+	int Load( lua_State *L, const char *pszFilename, const char *pszChunkName, const char *pBuffer, int nSize );
+
+	// throws away all compiled chunks
+	void Clear();
+
+	// per level load stats
+	void ResetLoadStats();
+	void PrintLoadStats();
+
+	void PrintStats();
+
+private:
+	static int Writer( lua_State *L, const void *p, size_t sz, void *ud );
+
+	// evicts the least recently used chunks until there is room for nBytes
+	void MakeRoom( int nBytes );
+	void RemoveChunk( int iChunk );
+
+private:
+	CUtlDict<Chunk_t *, int>	m_Chunks;
+
+	unsigned int	m_iUseCounter;
+	int				m_nBytes;			// bytecode held by all chunks
+
+	// since ResetLoadStats
+	int				m_nHits;
+	int				m_nMisses;
+	double			m_flLoadTime;		// seconds spent in Load
+	double			m_flSavedTime;		// compile time avoided by hits
+};
+
+//---------------------------------------------------------------------------
+#endif
@@ -39,14 +39,11 @@ extern "C"
 
 //---------------------------------------------------------------------------
 // defines
-#define SETOBJECT(val)		new luabind::adl::object(_scriptman.GetLuaState(), val)
-#define SETOBJECTREF(val)	new luabind::adl::object(_scriptman.GetLuaState(), boost::ref(val))
-
 #define RETURN_OBJECTCAST(type, defaultVal, idx)	\
 			try					\
 			{					\
-				if(idx < m_returnVals.Count())		\
-					return luabind::object_cast<type>((*m_returnVals[idx]));	\
+				if(idx < m_nReturnVals)		\
+					return luabind::object_cast<type>(GetObject(idx));	\
 				else			\
 					return defaultVal;	\
 			}					\
@@ -56,11 +53,27 @@ extern "C"
 				return defaultVal;	\
 			}					\
 
+//---------------------------------------------------------------------------
+CFFLuaSC::CFFLuaSC()
+{
+	m_pLuaState = NULL;
+	m_nParams = 0;
+	m_iReturnRef = LUA_NOREF;
+	m_nReturnVals = 0;
+	m_szFunction[0] = 0;
+}
+
 //---------------------------------------------------------------------------
 // Purpose: Constructor to use a bunch of args
 //---------------------------------------------------------------------------
 CFFLuaSC::CFFLuaSC( int iArgs, ... )
 {
+	m_pLuaState = NULL;
+	m_nParams = 0;
+	m_iReturnRef = LUA_NOREF;
+	m_nReturnVals = 0;
+	m_szFunction[0] = 0;
+
 	// TODO: Make the constructor and setparams use this same code
 
 	va_list ap;		
@@ -107,44 +120,77 @@ void CFFLuaSC::SetParams( int iArgs, ... )
 //---------------------------------------------------------------------------
 CFFLuaSC::~CFFLuaSC()
 {
-	m_params.PurgeAndDeleteElements();
-	m_returnVals.PurgeAndDeleteElements();
+	ClearParams();
+	ClearReturnVals();
+}
+
+//---------------------------------------------------------------------------
+template <class T>
+void CFFLuaSC::PushValue(const T& value)
+{
+	lua_State* L = _scriptman.GetLuaState();
+	if(!L)
+		return;
+
+	// the temporary object lives on the C++ stack; only its value is kept
+	luabind::adl::object(L, value).push(L);
+	AddParamFromStack(L);
+}
+
+//---------------------------------------------------------------------------
+void CFFLuaSC::AddParamFromStack(lua_State* L)
+{
+	// params pushed before a VM restart are useless now
+	if(m_pLuaState != L)
+	{
+		m_nParams = 0;
+		m_pLuaState = L;
+	}
+
+	if(m_nParams >= MAX_PARAMS)
+	{
+		lua_pop(L, 1);
+		DevWarning("[SCRIPT] Too many parameters pushed to a script context (max %d)\n", MAX_PARAMS);
+		return;
+	}
+
+	m_iParamRefs[m_nParams++] = luaL_ref(L, LUA_REGISTRYINDEX);
 }
 
 //---------------------------------------------------------------------------
-void CFFLuaSC::Push(float value) { m_params.AddToTail(SETOBJECT(value)); }
-void CFFLuaSC::Push(int value) { m_params.AddToTail(SETOBJECT(value)); }
-void CFFLuaSC::Push(bool value) { m_params.AddToTail(SETOBJECT(value)); }
-void CFFLuaSC::Push(const char *value) { m_params.AddToTail(SETOBJECT(value)); }
-void CFFLuaSC::Push(luabind::adl::object& luabindObject) { m_params.AddToTail(SETOBJECT(luabindObject)); }
-void CFFLuaSC::Push(CBaseEntity* pEntity) { m_params.AddToTail(SETOBJECT(pEntity)); }
-void CFFLuaSC::Push(CFFBuildableObject* pEntity) { m_params.AddToTail(SETOBJECT(pEntity)); }
-void CFFLuaSC::Push(CFFDispenser* pEntity) { m_params.AddToTail(SETOBJECT(pEntity)); }
-void CFFLuaSC::Push(CFFSentryGun* pEntity) { m_params.AddToTail(SETOBJECT(pEntity)); }
-void CFFLuaSC::Push(CFFDetpack* pEntity) { m_params.AddToTail(SETOBJECT(pEntity)); }
-void CFFLuaSC::Push(CTeam* pEntity) { m_params.AddToTail(SETOBJECT(pEntity)); }
-void CFFLuaSC::Push(CFFTeam* pEntity) { m_params.AddToTail(SETOBJECT(pEntity)); }
-void CFFLuaSC::Push(CFFGrenadeBase* pEntity) { m_params.AddToTail(SETOBJECT(pEntity)); }
-void CFFLuaSC::Push(CBasePlayer* pEntity) { m_params.AddToTail(SETOBJECT(pEntity)); }
-void CFFLuaSC::Push(CFFPlayer* pEntity) { m_params.AddToTail(SETOBJECT(pEntity)); }
-void CFFLuaSC::Push(CFFInfoScript* pEntity) { m_params.AddToTail(SETOBJECT(pEntity)); }
-void CFFLuaSC::Push(CBeam* pEntity) { m_params.AddToTail(SETOBJECT(pEntity)); }
-void CFFLuaSC::Push(Vector vector) { m_params.AddToTail(SETOBJECT(vector)); }
-void CFFLuaSC::Push(QAngle angle) { m_params.AddToTail(SETOBJECT(angle)); }
-void CFFLuaSC::Push(const CTakeDamageInfo* pInfo) { m_params.AddToTail(SETOBJECT(pInfo)); }
+void CFFLuaSC::Push(float value) { PushValue(value); }
+void CFFLuaSC::Push(int value) { PushValue(value); }
+void CFFLuaSC::Push(bool value) { PushValue(value); }
+void CFFLuaSC::Push(const char *value) { PushValue(value); }
+void CFFLuaSC::Push(luabind::adl::object& luabindObject) { PushValue(luabindObject); }
+void CFFLuaSC::Push(CBaseEntity* pEntity) { PushValue(pEntity); }
+void CFFLuaSC::Push(CFFBuildableObject* pEntity) { PushValue(pEntity); }
+void CFFLuaSC::Push(CFFDispenser* pEntity) { PushValue(pEntity); }
+void CFFLuaSC::Push(CFFSentryGun* pEntity) { PushValue(pEntity); }
+void CFFLuaSC::Push(CFFDetpack* pEntity) { PushValue(pEntity); }
+void CFFLuaSC::Push(CTeam* pEntity) { PushValue(pEntity); }
+void CFFLuaSC::Push(CFFTeam* pEntity) { PushValue(pEntity); }
+void CFFLuaSC::Push(CFFGrenadeBase* pEntity) { PushValue(pEntity); }
+void CFFLuaSC::Push(CBasePlayer* pEntity) { PushValue(pEntity); }
+void CFFLuaSC::Push(CFFPlayer* pEntity) { PushValue(pEntity); }
+void CFFLuaSC::Push(CFFInfoScript* pEntity) { PushValue(pEntity); }
+void CFFLuaSC::Push(CBeam* pEntity) { PushValue(pEntity); }
+void CFFLuaSC::Push(Vector vector) { PushValue(vector); }
+void CFFLuaSC::Push(QAngle angle) { PushValue(angle); }
+void CFFLuaSC::Push(const CTakeDamageInfo* pInfo) { PushValue(pInfo); }
 
 //---------------------------------------------------------------------------
-void CFFLuaSC::PushRef(luabind::adl::object& luabindObject) { m_params.AddToTail(SETOBJECTREF(luabindObject)); }
-void CFFLuaSC::PushRef(Vector &vector) { m_params.AddToTail(SETOBJECTREF(vector)); }
-void CFFLuaSC::PushRef(QAngle &angle) { m_params.AddToTail(SETOBJECTREF(angle)); }
-void CFFLuaSC::PushRef(CTakeDamageInfo& info) { m_params.AddToTail(SETOBJECTREF(info)); }
+void CFFLuaSC::PushRef(luabind::adl::object& luabindObject) { PushValue(boost::ref(luabindObject)); }
+void CFFLuaSC::PushRef(Vector &vector) { PushValue(boost::ref(vector)); }
+void CFFLuaSC::PushRef(QAngle &angle) { PushValue(boost::ref(angle)); }
+void CFFLuaSC::PushRef(CTakeDamageInfo& info) { PushValue(boost::ref(info)); }
 
 //---------------------------------------------------------------------------
 bool CFFLuaSC::CallFunction(CBaseEntity* pEntity, const char* szFunctionName, const char *szTargetEntName)
 {
 	VPROF_BUDGET( "CFFLuaSC::CallFunction", VPROF_BUDGETGROUP_FF_LUA );
 
-	m_returnVals.PurgeAndDeleteElements();
+	ClearReturnVals();
 
 	lua_State* L = _scriptman.GetLuaState();
 
@@ -153,21 +199,8 @@ bool CFFLuaSC::CallFunction(CBaseEntity* pEntity, const char* szFunctionName, co
 		return false;
 
 	// set lua's reference to the calling entity
-	luabind::object globals = luabind::globals(L);
-	try
-	{
-		if(pEntity)
-			globals["entity"] = luabind::object(L, pEntity);
-		else
-			globals["entity"] = luabind::adl::object();
-	}
-	catch(...)
-	{
-		// CBaseEntity was not registered with luabind
-		// if this happens, something very bad has happened
-		ASSERT(false);
+	if(!SetEntityGlobal(L, pEntity))
 		return false;
-	}
 
 	// look up the function
 	if(pEntity)
@@ -250,13 +283,83 @@ bool CFFLuaSC::CallFunction(CBaseEntity* pEntity, const char* szFunctionName, co
 		Q_strncpy(m_szFunction, szFunctionName, sizeof(m_szFunction));
 	}
 
+	return CallPushedFunction(L, pEntity||szTargetEntName ? 1 : 0, szFunctionName, pEntity);
+}
+
+//---------------------------------------------------------------------------
+bool CFFLuaSC::CallFunction(CBaseEntity* pEntity, FFLuaHook_t eHook)
+{
+	VPROF_BUDGET( "CFFLuaSC::CallFunction", VPROF_BUDGETGROUP_FF_LUA );
+
+	ClearReturnVals();
+
+	lua_State* L = _scriptman.GetLuaState();
+
+	if(!L || !pEntity)
+		return false;
+
+	int iTableRef, iFuncRef;
+	if(!_scriptman.GetHookRefs(pEntity, eHook, iTableRef, iFuncRef))
+		return false;
+
+	// set lua's reference to the calling entity
+	if(!SetEntityGlobal(L, pEntity))
+		return false;
+
+	// push the function onto stack ( entname:addname )
+	lua_rawgeti(L, LUA_REGISTRYINDEX, iFuncRef);
+	lua_rawgeti(L, LUA_REGISTRYINDEX, iTableRef);
+
+	const char *szFunctionName = CFFScriptManager::GetHookName(eHook);
+
+	// store the name of the entity and function for debugging purposes
+	Q_snprintf(m_szFunction,
+			   sizeof(m_szFunction),
+			   "%s:%s()",
+			   STRING(pEntity->GetEntityName()),
+			   szFunctionName);
+
+	return CallPushedFunction(L, 1, szFunctionName, pEntity);
+}
+
+//---------------------------------------------------------------------------
+bool CFFLuaSC::SetEntityGlobal(lua_State* L, CBaseEntity* pEntity)
+{
+	luabind::object globals = luabind::globals(L);
+	try
+	{
+		if(pEntity)
+			globals["entity"] = luabind::object(L, pEntity);
+		else
+			globals["entity"] = luabind::adl::object();
+	}
+	catch(...)
+	{
+		// CBaseEntity was not registered with luabind
+		// if this happens, something very bad has happened
+		ASSERT(false);
+		return false;
+	}
+
+	return true;
+}
+
+//---------------------------------------------------------------------------
+bool CFFLuaSC::CallPushedFunction(lua_State* L, int nSelfArgs, const char* szFunctionName, CBaseEntity* pEntity)
+{
+	CFFLuaProfileScope profileScope( "CFFLuaSC::CallFunction" );
+
+	// params pushed before a VM restart are useless now
+	if(m_pLuaState != L)
+		m_nParams = 0;
+
 	// push all the parameters
 	int nParams = GetNumParams();
 	for(int iParam = 0 ; iParam < nParams ; ++iParam)
-		(*m_params[iParam]).push(L);
+		lua_rawgeti(L, LUA_REGISTRYINDEX, m_iParamRefs[iParam]);
 
 	// call out to the script
-	if(lua_pcall(L, pEntity||szTargetEntName ? nParams + 1 : nParams, 1, 0) != 0)
+	if(lua_pcall(L, nParams + nSelfArgs, 1, 0) != 0)
 	{
 		const char* szErrorMsg = lua_tostring(L, -1);
 		_scriptman.LuaWarning("Error calling %s (%s) ent: %s\n",
@@ -267,19 +370,13 @@ bool CFFLuaSC::CallFunction(CBaseEntity* pEntity, const char* szFunctionName, co
 		return false;
 	}
 
-	// get the return values
-	int nRetVals = 1;
-	for(int iRet = 0 ; iRet < nRetVals ; ++iRet)
-	{
-		luabind::adl::object* pRetObj = new luabind::adl::object(luabind::from_stack(L, -1 - iRet));
-		m_returnVals.AddToHead(pRetObj);
-	}
-
-	lua_pop(L, nRetVals);
+	// get the return value (pops it)
+	m_pLuaState = L;
+	m_iReturnRef = luaL_ref(L, LUA_REGISTRYINDEX);
+	m_nReturnVals = 1;
 
 	// cleanup
-	luabind::adl::object dummy;
-	globals[ "entity" ] = dummy;
+	SetEntityGlobal(L, NULL);
 
 	return true;
 }
@@ -295,7 +392,25 @@ bool CFFLuaSC::CallFunction(const char* szFunctionName)
 //---------------------------------------------------------------------------
 void CFFLuaSC::ClearParams()
 {
-	m_params.PurgeAndDeleteElements();
+	lua_State* L = _scriptman.GetLuaState();
+	if(L && L == m_pLuaState)
+	{
+		for(int iParam = 0 ; iParam < m_nParams ; ++iParam)
+			luaL_unref(L, LUA_REGISTRYINDEX, m_iParamRefs[iParam]);
+	}
+
+	m_nParams = 0;
+}
+
+//---------------------------------------------------------------------------
+void CFFLuaSC::ClearReturnVals()
+{
+	lua_State* L = _scriptman.GetLuaState();
+	if(L && L == m_pLuaState && m_nReturnVals)
+		luaL_unref(L, LUA_REGISTRYINDEX, m_iReturnRef);
+
+	m_iReturnRef = LUA_NOREF;
+	m_nReturnVals = 0;
 }
 
 //---------------------------------------------------------------------------
@@ -317,15 +432,23 @@ int CFFLuaSC::GetInt(int idx)
 }
 
 //---------------------------------------------------------------------------
-luabind::adl::object* CFFLuaSC::GetObject(int idx)
+luabind::adl::object CFFLuaSC::GetObject(int idx)
 {
-	return m_returnVals[idx];
+	lua_State* L = _scriptman.GetLuaState();
+	if(!L || L != m_pLuaState || idx >= m_nReturnVals)
+		return luabind::adl::object();
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, m_iReturnRef);
+	luabind::adl::object retObj(luabind::from_stack(L, -1));
+	lua_pop(L, 1);
+
+	return retObj;
 }
 
 //---------------------------------------------------------------------------
 bool CFFLuaSC::DidReturnNil(int idx)
 {
-	return luabind::type(*GetObject(idx)) == LUA_TNIL;
+	return luabind::type(GetObject(idx)) == LUA_TNIL;
 }
 
 //---------------------------------------------------------------------------
@@ -359,3 +482,81 @@ void CFFLuaSC::QuickCallFunction(CBaseEntity* pEntity, const char* szFunctionNam
 	CFFLuaSC sc;
 	sc.CallFunction(pEntity, szFunctionName);
 }
+
+//---------------------------------------------------------------------------
+// Purpose: Measures CFFLuaSC call throughput against the old way of
+//			marshalling arguments (a heap allocated luabind object per
+//			parameter and return value)
+//---------------------------------------------------------------------------
+CON_COMMAND( lua_bench_callfunction, "Times script calls through CFFLuaSC against heap allocated argument marshalling. Usage: lua_bench_callfunction [iterations]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	lua_State *L = _scriptman.GetLuaState();
+	if ( !L )
+	{
+		Msg( "No Lua VM is running\n" );
+		return;
+	}
+
+	int nIterations = ( engine->Cmd_Argc() > 1 ) ? atoi( engine->Cmd_Argv( 1 ) ) : 100000;
+	if ( nIterations <= 0 )
+		nIterations = 100000;
+
+	// a do-nothing function to call into
+	if ( luaL_dostring( L, "function __ff_bench_callfunction( a, b, c ) return a end" ) != 0 )
+	{
+		Warning( "%s\n", lua_tostring( L, -1 ) );
+		lua_pop( L, 1 );
+		return;
+	}
+
+	CBaseEntity *pWorld = CBaseEntity::Instance( INDEXENT( 0 ) );
+
+	// current implementation
+	double flStart = Plat_FloatTime();
+	for ( int i = 0; i < nIterations; i++ )
+	{
+		CFFLuaSC hContext;
+		hContext.Push( pWorld );
+		hContext.Push( i );
+		hContext.Push( 1.0f );
+		hContext.CallFunction( "__ff_bench_callfunction" );
+		hContext.DidReturnNil();
+	}
+	double flInline = Plat_FloatTime() - flStart;
+
+	// heap allocated marshalling
+	luabind::object globals = luabind::globals( L );
+	flStart = Plat_FloatTime();
+	for ( int i = 0; i < nIterations; i++ )
+	{
+		CUtlVector<luabind::adl::object*> params, returnVals;
+		params.AddToTail( new luabind::adl::object( L, pWorld ) );
+		params.AddToTail( new luabind::adl::object( L, i ) );
+		params.AddToTail( new luabind::adl::object( L, 1.0f ) );
+
+		globals[ "entity" ] = luabind::adl::object();
+		lua_getglobal( L, "__ff_bench_callfunction" );
+		for ( int iParam = 0; iParam < params.Count(); iParam++ )
+			params[ iParam ]->push( L );
+
+		if ( lua_pcall( L, params.Count(), 1, 0 ) == 0 )
+			returnVals.AddToTail( new luabind::adl::object( luabind::from_stack( L, -1 ) ) );
+		lua_pop( L, 1 );
+
+		if ( returnVals.Count() )
+			luabind::type( *returnVals[ 0 ] );
+		params.PurgeAndDeleteElements();
+		returnVals.PurgeAndDeleteElements();
+	}
+	double flHeap = Plat_FloatTime() - flStart;
+
+	lua_pushnil( L );
+	lua_setglobal( L, "__ff_bench_callfunction" );
+
+	Msg( "[SCRIPT] %d calls with 3 params\n", nIterations );
+	Msg( "[SCRIPT]   inline refs: %.3fs (%.0f calls/sec)\n", flInline, flInline > 0 ? nIterations / flInline : 0.0 );
+	Msg( "[SCRIPT]   heap objects: %.3fs (%.0f calls/sec)\n", flHeap, flHeap > 0 ? nIterations / flHeap : 0.0 );
+}
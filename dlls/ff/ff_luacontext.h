@@ -13,9 +13,13 @@
 #ifndef VECTOR_H
 	#include "vector.h"
 #endif
+#ifndef FF_SCRIPTMAN_H
+	#include "ff_scriptman.h"
+#endif
 
 //---------------------------------------------------------------------------
 // foward declarations
+struct lua_State;
 class CBaseEntity;
 class CFFBuildableObject;
 class CFFDispenser;
@@ -43,10 +47,13 @@ class CFFLuaSC
 {
 public:
 	// 'structors
-	CFFLuaSC() {}
+	CFFLuaSC();
 	CFFLuaSC( int iArgs, ... );
 	~CFFLuaSC();
 
+	// maximum number of parameters that can be pushed onto a context
+	enum { MAX_PARAMS = 8 };
+
 public:
 	// pushes a parameter in preperation for a function call
 	void Push(float value);
@@ -77,7 +84,7 @@ public:
 	void PushRef(QAngle &angle);
 
 	// returns the number of parameters
-	int GetNumParams() const { return m_params.Count(); }
+	int GetNumParams() const { return m_nParams; }
 
 	// clears the parameter list
 	void ClearParams();
@@ -90,8 +97,12 @@ public:
 	// calls a global function
 	bool CallFunction(const char* szFunctionName);
 
+	// calls one of the entity's well-known callbacks through the script
+	// manager's cached references (avoids looking anything up by name)
+	bool CallFunction(CBaseEntity* pEntity, FFLuaHook_t eHook);
+
 	// returns the number of return values
-	int GetNumReturns() const { return m_returnVals.Count(); }
+	int GetNumReturns() const { return m_nReturnVals; }
 
 	// gets the return value
 	bool	GetBool(int idx = 0);
@@ -99,7 +110,7 @@ public:
 	int		GetInt(int idx = 0);
 	QAngle	GetQAngle();
 	Vector	GetVector();
-	luabind::adl::object* GetObject(int idx = 0);
+	luabind::adl::object GetObject(int idx = 0);
 	bool	DidReturnNil(int idx = 0);
 
 public:
@@ -109,11 +120,39 @@ public:
 protected:
 	void	SetParams( int iArgs, ... );
 
+	// converts value to lua and stores it as the next parameter
+	template <class T>
+	void	PushValue(const T& value);
+
+	// stores the value on top of the lua stack as the next parameter
+	void	AddParamFromStack(lua_State* L);
+
+	// frees the references held for the return value
+	void	ClearReturnVals();
+
+	// sets the "entity" global to pEntity (or nil)
+	bool	SetEntityGlobal(lua_State* L, CBaseEntity* pEntity);
+
+	// pushes the params, calls the function already on the stack (below
+	// nSelfArgs implicit args) and collects the return value
+	bool	CallPushedFunction(lua_State* L, int nSelfArgs, const char* szFunctionName, CBaseEntity* pEntity);
+
+private:
+	// not copyable, the registry references are owned by this context
+	CFFLuaSC( const CFFLuaSC& );
+	CFFLuaSC& operator=( const CFFLuaSC& );
+
 private:
 	// private data
-	CUtlVector<luabind::adl::object*>	m_params;			// parameters
-	CUtlVector<luabind::adl::object*>	m_returnVals;		// return values
-	char								m_szFunction[256];	// function called
+	// parameters and return values are kept as lua registry references
+	// rather than heap allocated luabind objects so that a call doesn't
+	// have to touch the allocator
+	lua_State*	m_pLuaState;				// VM the references belong to
+	int			m_iParamRefs[MAX_PARAMS];	// parameters
+	int			m_nParams;
+	int			m_iReturnRef;				// return value
+	int			m_nReturnVals;
+	char		m_szFunction[256];			// function called
 };
 
 //---------------------------------------------------------------------------
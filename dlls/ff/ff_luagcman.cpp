@@ -0,0 +1,204 @@
+// ff_luagcman.cpp
+
+/////////////////////////////////////////////////////////////////////////////
+// includes
+#include "cbase.h"
+#include "ff_luagcman.h"
+#include "ff_scriptman.h"
+#include "tier0/vprof.h"
+
+// lua
+extern "C"
+{
+	#include "lua.h"
+}
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+/////////////////////////////////////////////////////////////////////////////
+ConVar lua_gc_budget( "lua_gc_budget", "500", 0, "Microseconds per tick spent on incremental Lua garbage collection. 0 leaves collection to Lua." );
+ConVar lua_gc_stepsize( "lua_gc_stepsize", "4", 0, "Size (in KB) of each incremental Lua garbage collection step." );
+ConVar lua_gc_pause( "lua_gc_pause", "2", 0, "Start a new Lua garbage collection cycle once the heap is this many times its size after the last one (like Lua's setpause)." );
+ConVar lua_gc_backoff( "lua_gc_backoff", "0.25", 0, "Fraction of lua_gc_budget used on ticks where the server is running behind." );
+ConVar lua_gc_maxgrowth( "lua_gc_maxgrowth", "2", 0, "Ignore lua_gc_backoff once the Lua heap is this many times its size after the last collection." );
+ConVar lua_gc_debug( "lua_gc_debug", "0", 0, "Print the Lua heap size and garbage collection time every tick." );
+
+// a heap this small never counts as over-grown, so it always backs off
+#define LUAGC_MIN_HEAP_KB	1024
+
+/////////////////////////////////////////////////////////////////////////////
+CFFLuaGCManager _luagcman;
+
+/////////////////////////////////////////////////////////////////////////////
+CFFLuaGCManager::CFFLuaGCManager()
+{
+	m_pLuaState = NULL;
+	Init();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+CFFLuaGCManager::~CFFLuaGCManager()
+{
+
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFLuaGCManager::Init()
+{
+	m_pLuaState = NULL;
+	m_bManual = false;
+	m_flLastUpdate = 0.0;
+	m_nCycleHeapKB = 0;
+	m_bCycleRunning = true;		// nothing collected yet, so start straight away
+
+	m_nTicks = 0;
+	m_nBackoffTicks = 0;
+	m_nCycles = 0;
+	m_nSteps = 0;
+	m_flTotalTime = 0.0;
+	m_flMaxTime = 0.0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFLuaGCManager::Shutdown()
+{
+	RestoreAutomaticGC();
+	Init();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFLuaGCManager::RestoreAutomaticGC()
+{
+	// only touch the VM we stopped, a new one starts out automatic anyway
+	if( m_bManual && m_pLuaState && m_pLuaState == _scriptman.GetLuaState() )
+		lua_gc( m_pLuaState, LUA_GCRESTART, 0 );
+
+	m_bManual = false;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFLuaGCManager::Update()
+{
+	VPROF_BUDGET( "CFFLuaGCManager::Update", VPROF_BUDGETGROUP_FF_LUA );
+
+	lua_State *L = _scriptman.GetLuaState();
+	if( !L )
+		return;
+
+	// the VM was restarted underneath us
+	if( L != m_pLuaState )
+	{
+		Init();
+		m_pLuaState = L;
+	}
+
+	int iBudget = lua_gc_budget.GetInt();
+	if( iBudget <= 0 )
+	{
+		RestoreAutomaticGC();
+		return;
+	}
+
+	double flStart = Plat_FloatTime();
+
+	// running behind if the last tick took noticeably longer than a tick.
+	// this is the stand-in for "combat-heavy": there's no direct signal for
+	// that here, but fights (explosions, traces, damage callbacks) are what
+	// make ticks run long, and a long tick is what the backoff protects
+	// against whatever the cause
+	bool bBehind = ( m_flLastUpdate > 0.0 ) && ( flStart - m_flLastUpdate > TICK_INTERVAL * 1.5 );
+	m_flLastUpdate = flStart;
+
+	int nHeapKB = lua_gc( L, LUA_GCCOUNT, 0 );
+	if( !m_nCycleHeapKB )
+		m_nCycleHeapKB = nHeapKB;
+
+	// the last cycle's done, wait for the heap to grow before the next one
+	// rather than spending the whole budget on it again straight away
+	if( !m_bCycleRunning && nHeapKB >= (int)( m_nCycleHeapKB * max( 1.0f, lua_gc_pause.GetFloat() ) ) )
+		m_bCycleRunning = true;
+
+	bool bPaused = !m_bCycleRunning;
+
+	// if the heap is getting out of hand the collector has to keep up regardless
+	bool bOverGrown = nHeapKB > max( LUAGC_MIN_HEAP_KB, (int)( m_nCycleHeapKB * lua_gc_maxgrowth.GetFloat() ) );
+
+	float flBudget = bPaused ? 0.0f : (float)iBudget;
+	if( !bPaused && bBehind && !bOverGrown )
+	{
+		flBudget *= clamp( lua_gc_backoff.GetFloat(), 0.0f, 1.0f );
+		m_nBackoffTicks++;
+	}
+
+	double flDeadline = flStart + flBudget / 1000000.0;
+	int nStepSize = max( 0, lua_gc_stepsize.GetInt() );
+	int nSteps = 0;
+	bool bCycleDone = false;
+
+	while( Plat_FloatTime() < flDeadline )
+	{
+		nSteps++;
+
+		// returns 1 when a cycle finishes
+		if( lua_gc( L, LUA_GCSTEP, nStepSize ) )
+		{
+			bCycleDone = true;
+			break;
+		}
+	}
+
+	// a step re-arms lua's own threshold, so stop it again every time
+	lua_gc( L, LUA_GCSTOP, 0 );
+	m_bManual = true;
+
+	if( bCycleDone )
+	{
+		m_nCycleHeapKB = lua_gc( L, LUA_GCCOUNT, 0 );
+		m_bCycleRunning = false;
+		m_nCycles++;
+	}
+
+	double flElapsed = Plat_FloatTime() - flStart;
+
+	m_nTicks++;
+	m_nSteps += nSteps;
+	m_flTotalTime += flElapsed;
+	if( flElapsed > m_flMaxTime )
+		m_flMaxTime = flElapsed;
+
+	if( lua_gc_debug.GetBool() )
+	{
+		Msg( "[SCRIPT] gc: heap %d KB, %d steps, %.3f ms%s%s%s\n",
+			lua_gc( L, LUA_GCCOUNT, 0 ),
+			nSteps,
+			flElapsed * 1000.0,
+			bPaused ? ", paused" : "",
+			( !bPaused && bBehind && !bOverGrown ) ? ", backed off" : "",
+			bCycleDone ? ", cycle done" : "" );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFLuaGCManager::PrintStats()
+{
+	lua_State *L = _scriptman.GetLuaState();
+
+	Msg( "Lua heap: %d KB (%d KB after last cycle)\n", L ? lua_gc( L, LUA_GCCOUNT, 0 ) : 0, m_nCycleHeapKB );
+	Msg( "Collector: %s\n", !m_bManual ? "automatic" : ( m_bCycleRunning ? "budgeted, collecting" : "budgeted, paused" ) );
+	Msg( "Ticks: %u (%u backed off)\n", m_nTicks, m_nBackoffTicks );
+	Msg( "Cycles: %u, steps: %u\n", m_nCycles, m_nSteps );
+	Msg( "GC time: %.3f ms total, %.4f ms/tick avg, %.3f ms max\n",
+		m_flTotalTime * 1000.0,
+		m_nTicks ? m_flTotalTime * 1000.0 / m_nTicks : 0.0,
+		m_flMaxTime * 1000.0 );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+CON_COMMAND( lua_gc_stats, "Shows Lua heap size and garbage collection time for the current level" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	_luagcman.PrintStats();
+}
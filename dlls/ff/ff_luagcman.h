@@ -0,0 +1,60 @@
+// ff_luagcman.h
+
+/////////////////////////////////////////////////////////////////////////////
+#ifndef FF_LUAGCMAN_H
+#define FF_LUAGCMAN_H
+
+/////////////////////////////////////////////////////////////////////////////
+struct lua_State;
+
+/////////////////////////////////////////////////////////////////////////////
+// Takes garbage collection away from lua's allocator-driven collector and
+// runs incremental steps from the entity system helper's think instead, so
+// that a collection can only cost a fixed slice of each tick
+// (lua_gc_budget). The slice shrinks on ticks where the server is running
+// behind, unless the heap has grown too far past its last collected size.
+// Like lua's own setpause, a new cycle only starts once the heap has grown
+// enough since the last one (lua_gc_pause).
+/////////////////////////////////////////////////////////////////////////////
+class CFFLuaGCManager
+{
+public:
+	// 'structors
+	CFFLuaGCManager();
+	~CFFLuaGCManager();
+
+public:
+	void Init();
+	void Shutdown();
+
+	// call once per tick
+	void Update();
+
+	void PrintStats();
+
+private:
+	// hands collection back to lua
+	void RestoreAutomaticGC();
+
+private:
+	lua_State*	m_pLuaState;		// VM that collection is being managed for
+	bool		m_bManual;			// lua's own collector is stopped
+	double		m_flLastUpdate;		// wall time of the last update
+
+	int			m_nCycleHeapKB;		// heap size right after the last full cycle
+	bool		m_bCycleRunning;	// stepping through a cycle, not waiting for the heap to grow
+
+	// stats since the level started
+	unsigned int	m_nTicks;
+	unsigned int	m_nBackoffTicks;
+	unsigned int	m_nCycles;
+	unsigned int	m_nSteps;
+	double			m_flTotalTime;
+	double			m_flMaxTime;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+extern CFFLuaGCManager _luagcman;
+
+/////////////////////////////////////////////////////////////////////////////
+#endif
@@ -0,0 +1,340 @@
+// ff_luahudman.cpp
+
+/////////////////////////////////////////////////////////////////////////////
+// includes
+#include "cbase.h"
+#include "ff_luahudman.h"
+#include "ff_player.h"
+#include "bitbuf.h"
+#include "checksum_crc.h"
+#include "tier0/vprof.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// keep well under the engine's user message limit when packing updates
+// together, an update bigger than this goes in a message on its own
+#define LUAHUD_MAX_MESSAGE_BYTES	240
+
+/////////////////////////////////////////////////////////////////////////////
+CFFLuaHudManager _luahudman;
+
+/////////////////////////////////////////////////////////////////////////////
+CFFLuaHudManager::CFFLuaHudManager()
+{
+	Init();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+CFFLuaHudManager::~CFFLuaHudManager()
+{
+	Shutdown();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFLuaHudManager::Init()
+{
+	ResetAll();
+	m_Ops.RemoveAll();
+
+	m_nUpdates = 0;
+	m_nUnchanged = 0;
+	m_nOps = 0;
+	m_nDeliveries = 0;
+	m_nMessages = 0;
+	m_nBytes = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFLuaHudManager::Shutdown()
+{
+	ResetAll();
+	m_Ops.Purge();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFLuaHudManager::ResetPlayer( int iPlayerIndex )
+{
+	if( iPlayerIndex < 1 || iPlayerIndex > MAX_PLAYERS )
+		return;
+
+	// anything sent from now on is sent in full
+	Client_t &client = m_Clients[ iPlayerIndex - 1 ];
+	client.m_Elements.Purge();
+	client.m_Dirty.Purge();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFLuaHudManager::ResetAll()
+{
+	for( int i = 1; i <= MAX_PLAYERS; i++ )
+		ResetPlayer( i );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+CFFLuaHudManager::Element_t *CFFLuaHudManager::GetElement( CFFPlayer *pPlayer, int iElement )
+{
+	if( !pPlayer )
+		return NULL;
+
+	int iPlayerIndex = pPlayer->entindex();
+	if( iPlayerIndex < 1 || iPlayerIndex > MAX_PLAYERS )
+		return NULL;
+
+	if( iElement < 0 || iElement >= ( 1 << HUD_ELEMENT_INDEX_BITS ) )
+		return NULL;
+
+	Client_t &client = m_Clients[ iPlayerIndex - 1 ];
+
+	int iIndex = -1;
+	for( int i = 0; i < client.m_Elements.Count(); i++ )
+	{
+		if( client.m_Elements[ i ].iElement == iElement )
+		{
+			iIndex = i;
+			break;
+		}
+	}
+
+	if( iIndex == -1 )
+	{
+		iIndex = client.m_Elements.AddToTail();
+
+		Element_t &element = client.m_Elements[ iIndex ];
+		element.iElement = iElement;
+		element.sent.Clear();
+		element.pending.Clear();
+		element.bDirty = false;
+		element.bForce = false;
+	}
+
+	Element_t &element = client.m_Elements[ iIndex ];
+	if( !element.bDirty )
+	{
+		element.bDirty = true;
+		client.m_Dirty.AddToTail( iIndex );
+	}
+
+	m_nUpdates++;
+
+	return &element;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFLuaHudManager::SetElement( CFFPlayer *pPlayer, int iElement, const LuaHudElementState_t &state, bool bForce )
+{
+	Element_t *pElement = GetElement( pPlayer, iElement );
+	if( !pElement )
+		return;
+
+	pElement->pending = state;
+	pElement->bForce |= bForce;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFLuaHudManager::RemoveElement( CFFPlayer *pPlayer, int iElement )
+{
+	Element_t *pElement = GetElement( pPlayer, iElement );
+	if( !pElement )
+		return;
+
+	pElement->pending.Clear();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFLuaHudManager::Update()
+{
+	VPROF_BUDGET( "CFFLuaHudManager::Update", VPROF_BUDGETGROUP_FF_LUA );
+
+	for( int i = 1; i <= gpGlobals->maxClients && i <= MAX_PLAYERS; i++ )
+	{
+		Client_t &client = m_Clients[ i - 1 ];
+		if( !client.m_Dirty.Count() )
+			continue;
+
+		if( !UTIL_PlayerByIndex( i ) )
+		{
+			ResetPlayer( i );
+			continue;
+		}
+
+		for( int j = 0; j < client.m_Dirty.Count(); j++ )
+			QueueOp( i, client.m_Elements[ client.m_Dirty[ j ] ] );
+
+		client.m_Dirty.RemoveAll();
+	}
+
+	if( m_Ops.Count() )
+		SendOps();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFLuaHudManager::QueueOp( int iPlayerIndex, Element_t &element )
+{
+	const LuaHudElementState_t &pending = element.pending;
+	bool bForce = element.bForce;
+
+	element.bDirty = false;
+	element.bForce = false;
+
+	int iFields = 0;
+
+	if( pending.iType == HUD_REMOVE )
+	{
+		// client doesn't have it to remove
+		if( element.sent.iType == HUD_REMOVE )
+		{
+			m_nUnchanged++;
+			return;
+		}
+	}
+	else
+	{
+		// a new element (or one that changed type) needs everything
+		if( pending.iType != element.sent.iType )
+			iFields = FF_LuaHudFields( pending.iType );
+		else
+			iFields = pending.Diff( element.sent );
+
+		if( !iFields && !bForce )
+		{
+			m_nUnchanged++;
+			return;
+		}
+	}
+
+	element.sent = pending;
+
+	Op_t op;
+	Q_memset( op.data, 0, sizeof( op.data ) );
+
+	op.nBits = EncodeOp( op.data, sizeof( op.data ), element.iElement, pending, iFields );
+
+	// Only a long string can make an update too big for a message of its
+	// own, so cut the string down to fit rather than lose the update
+	if( op.nBits < 0 )
+	{
+		unsigned char scratch[ LUAHUD_MAX_OP_BYTES * 2 ];
+		int nExcess = ( EncodeOp( scratch, sizeof( scratch ), element.iElement, pending, iFields ) + 7 ) / 8 - LUAHUD_MAX_OP_BYTES;
+
+		LuaHudElementState_t trimmed = pending;
+		int nLength = Q_strlen( trimmed.szString );
+		trimmed.szString[ max( 0, nLength - nExcess ) ] = '\0';
+
+		Warning( "[SCRIPT] Lua hud element %d's string is too long to send, cut to %d characters\n", element.iElement, Q_strlen( trimmed.szString ) );
+
+		Q_memset( op.data, 0, sizeof( op.data ) );
+		op.nBits = EncodeOp( op.data, sizeof( op.data ), element.iElement, trimmed, iFields );
+		Assert( op.nBits >= 0 );
+	}
+
+	int nBytes = ( op.nBits + 7 ) / 8;
+	op.nCRC = CRC32_ProcessSingleBuffer( op.data, nBytes );
+
+	// the same update for another player (team and all-player hud calls)
+	// just gets another recipient
+	for( int i = 0; i < m_Ops.Count(); i++ )
+	{
+		Op_t &other = m_Ops[ i ];
+		if( other.nCRC == op.nCRC && other.nBits == op.nBits && !Q_memcmp( other.data, op.data, nBytes ) )
+		{
+			other.recipients.Set( iPlayerIndex - 1 );
+			return;
+		}
+	}
+
+	op.recipients.ClearAll();
+	op.recipients.Set( iPlayerIndex - 1 );
+	op.bSent = false;
+
+	m_Ops.AddToTail( op );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+int CFFLuaHudManager::EncodeOp( unsigned char *pData, int nBytes, int iElement, const LuaHudElementState_t &state, int iFields )
+{
+	bf_write buf( pData, nBytes );
+	buf.WriteUBitLong( state.iType, HUD_ELEMENT_TYPE_BITS );
+	buf.WriteUBitLong( iElement, HUD_ELEMENT_INDEX_BITS );
+
+	if( state.iType != HUD_REMOVE )
+	{
+		buf.WriteUBitLong( iFields, HUD_FIELD_COUNT );
+		state.Write( buf, iFields );
+	}
+
+	if( buf.IsOverflowed() )
+		return -1;
+
+	return buf.GetNumBitsWritten();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFLuaHudManager::SendOps()
+{
+	unsigned char data[ LUAHUD_MAX_OP_BYTES ];
+
+	for( int i = 0; i < m_Ops.Count(); i++ )
+	{
+		if( m_Ops[ i ].bSent )
+			continue;
+
+		CBitVec<ABSOLUTE_PLAYER_LIMIT> &recipients = m_Ops[ i ].recipients;
+
+		int nRecipients = 0;
+		for( int iBit = recipients.FindNextSetBit( 0 ); iBit > -1; iBit = recipients.FindNextSetBit( iBit + 1 ) )
+			nRecipients++;
+
+		bf_write buf( data, sizeof( data ) );
+
+		// everything else going to exactly the same players that fits
+		for( int j = i; j < m_Ops.Count(); j++ )
+		{
+			Op_t &op = m_Ops[ j ];
+			if( op.bSent || op.recipients != recipients )
+				continue;
+
+			// the first one always goes, even if it's too big to share
+			if( buf.GetNumBitsWritten() && buf.GetNumBitsWritten() + op.nBits > LUAHUD_MAX_MESSAGE_BYTES * 8 )
+				continue;
+
+			buf.WriteBits( op.data, op.nBits );
+			op.bSent = true;
+
+			m_nOps++;
+			m_nDeliveries += nRecipients;
+		}
+
+		CRecipientFilter filter;
+		filter.AddPlayersFromBitMask( recipients );
+		filter.MakeReliable();
+
+		UserMessageBegin( filter, "FF_HudLua" );
+			WRITE_BITS( data, buf.GetNumBitsWritten() );
+		MessageEnd();
+
+		m_nMessages++;
+		m_nBytes += buf.GetNumBytesWritten();
+	}
+
+	m_Ops.RemoveAll();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFLuaHudManager::PrintStats()
+{
+	Msg( "[SCRIPT] Lua hud since level start:\n" );
+	Msg( "  %u updates, %u unchanged\n", m_nUpdates, m_nUnchanged );
+	Msg( "  %u element updates sent, %u received\n", m_nOps, m_nDeliveries );
+	Msg( "  %u messages, %u bytes\n", m_nMessages, m_nBytes );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+CON_COMMAND( lua_hud_stats, "Shows how many Lua hud updates were batched and sent for the current level" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	_luahudman.PrintStats();
+}
@@ -0,0 +1,113 @@
+// ff_luahudman.h
+
+/////////////////////////////////////////////////////////////////////////////
+#ifndef FF_LUAHUDMAN_H
+#define FF_LUAHUDMAN_H
+
+/////////////////////////////////////////////////////////////////////////////
+// includes
+#ifndef UTLVECTOR_H
+	#include "utlvector.h"
+#endif
+#ifndef BITVEC_H
+	#include "bitvec.h"
+#endif
+#ifndef FF_UTILS_H
+	#include "ff_utils.h"
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+// the engine won't send a user message bigger than this, so neither can
+// a single element update be
+#define LUAHUD_MAX_OP_BYTES		255
+
+/////////////////////////////////////////////////////////////////////////////
+class CFFPlayer;
+
+/////////////////////////////////////////////////////////////////////////////
+// Batches lua hud updates. The FF_LuaHud functions only record the state
+// each player's elements should end up in; once a tick whatever differs
+// from what the player was last sent goes out as FF_HudLua messages
+// carrying just the changed fields. Updates that are the same for several
+// players (team and all-player hud calls) are written once and sent to
+// all of them in the same message.
+/////////////////////////////////////////////////////////////////////////////
+class CFFLuaHudManager
+{
+private:
+	struct Element_t
+	{
+		int						iElement;
+		LuaHudElementState_t	sent;		// what the client has
+		LuaHudElementState_t	pending;	// what the client should have
+		bool					bDirty;
+		bool					bForce;		// send even if nothing changed
+	};
+
+	struct Client_t
+	{
+		CUtlVector<Element_t>	m_Elements;
+		CUtlVector<int>			m_Dirty;	// indices into m_Elements
+	};
+
+	// an encoded element update and who it goes to
+	struct Op_t
+	{
+		unsigned char				data[LUAHUD_MAX_OP_BYTES];
+		int							nBits;
+		unsigned int				nCRC;
+		CBitVec<ABSOLUTE_PLAYER_LIMIT>	recipients;
+		bool						bSent;
+	};
+
+public:
+	// 'structors
+	CFFLuaHudManager();
+	~CFFLuaHudManager();
+
+public:
+	void Init();
+	void Shutdown();
+
+	// sends everything queued since the last update, call once per tick
+	void Update();
+
+	// the client has thrown away its lua hud (connected or round restarted)
+	void ResetPlayer( int iPlayerIndex );
+	void ResetAll();
+
+	void SetElement( CFFPlayer *pPlayer, int iElement, const LuaHudElementState_t &state, bool bForce = false );
+	void RemoveElement( CFFPlayer *pPlayer, int iElement );
+
+	void PrintStats();
+
+private:
+	Element_t *GetElement( CFFPlayer *pPlayer, int iElement );
+
+	// encodes the changes of one element and adds it to the ops for this tick
+	void QueueOp( int iPlayerIndex, Element_t &element );
+
+	// returns the bits written, or -1 if it didn't fit
+	static int EncodeOp( unsigned char *pData, int nBytes, int iElement, const LuaHudElementState_t &state, int iFields );
+
+	// packs ops with the same recipients into as few messages as possible
+	void SendOps();
+
+private:
+	Client_t			m_Clients[ MAX_PLAYERS ];
+	CUtlVector<Op_t>	m_Ops;
+
+	// stats since the level started
+	unsigned int	m_nUpdates;			// FF_LuaHud calls
+	unsigned int	m_nUnchanged;		// updates that didn't change anything
+	unsigned int	m_nOps;				// element updates sent
+	unsigned int	m_nDeliveries;		// element updates received by clients
+	unsigned int	m_nMessages;
+	unsigned int	m_nBytes;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+extern CFFLuaHudManager _luahudman;
+
+/////////////////////////////////////////////////////////////////////////////
+#endif
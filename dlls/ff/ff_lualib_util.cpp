@@ -87,6 +87,380 @@ enum CollectionFilter
 	CF_MAX_FLAG
 };
 
+// defined in ff_lualib_globals.cpp
+namespace FFLib
+{
+	bool IsBuildable(CBaseEntity *pEntity);
+	bool IsDispenser(CBaseEntity *pEntity);
+	bool IsSentrygun(CBaseEntity *pEntity);
+	bool IsDetpack(CBaseEntity *pEntity);
+	bool IsJumpPad(CBaseEntity *pEntity);
+	bool IsGrenade(CBaseEntity *pEntity);
+	bool IsProjectile(CBaseEntity *pEntity);
+	bool IsInfoScript(CBaseEntity *pEntity);
+}
+
+//============================================================================
+// CFFEntity_CollectionFilterSet
+// Purpose: a set of CF filters parsed once from lua. Filters of the same
+//			kind (entity types, classes, teams, info_ff_script states,
+//			buildable types) are or'ed together; an entity has to pass
+//			every kind that has at least one filter set.
+//============================================================================
+class CFFEntity_CollectionFilterSet
+{
+public:
+	CFFEntity_CollectionFilterSet()
+	{
+		memset(m_bFlags, 0, sizeof(m_bFlags));
+		m_bAnyType = m_bAnyClass = m_bAnyTeam = m_bAnyInfoScript = m_bAnyBuildable = false;
+	}
+
+	CFFEntity_CollectionFilterSet(const luabind::adl::object& filters)
+	{
+		memset(m_bFlags, 0, sizeof(m_bFlags));
+
+		if(filters.is_valid())
+		{
+			if(luabind::type(filters) == LUA_TNUMBER)
+				AddFlag(luabind::object_cast<int>(filters));
+
+			else if(luabind::type(filters) == LUA_TTABLE)
+			{
+				for(luabind::iterator ib(filters), ie; ib != ie; ++ib)
+				{
+					luabind::adl::object val = *ib;
+					if(luabind::type(val) == LUA_TNUMBER)
+						AddFlag(luabind::object_cast<int>(val));
+				}
+			}
+		}
+
+		m_bAnyType = AnySet(CF_PLAYERS, CF_BOT_PLAYERS) || AnySet(CF_PROJECTILES, CF_INFOSCRIPTS) || m_bFlags[CF_BUILDABLES];
+		m_bAnyClass = AnySet(CF_PLAYER_SCOUT, CF_PLAYER_CIVILIAN);
+		m_bAnyTeam = AnySet(CF_TEAMS, CF_TEAM_GREEN);
+		m_bAnyInfoScript = AnySet(CF_INFOSCRIPT_CARRIED, CF_INFOSCRIPT_REMOVED);
+		m_bAnyBuildable = AnySet(CF_BUILDABLE_DISPENSER, CF_BUILDABLE_JUMPPAD);
+	}
+
+	bool TraceBlockWalls() const { return m_bFlags[CF_TRACE_BLOCK_WALLS]; }
+
+	// only players can pass, so there is no need to look further than the clients
+	bool PlayersOnly() const
+	{
+		if(m_bAnyClass)
+			return true;
+
+		return m_bAnyType && !AnySet(CF_PROJECTILES, CF_INFOSCRIPTS) && !m_bFlags[CF_BUILDABLES];
+	}
+
+	bool Passes(CBaseEntity *pEntity) const
+	{
+		if(!pEntity)
+			return false;
+
+		CFFPlayer *pPlayer = pEntity->IsPlayer() ? ToFFPlayer(pEntity) : NULL;
+
+		if(m_bAnyType)
+		{
+			bool bPass = (m_bFlags[CF_PLAYERS] && pPlayer)
+				|| (m_bFlags[CF_HUMAN_PLAYERS] && pPlayer && !pPlayer->IsBot())
+				|| (m_bFlags[CF_BOT_PLAYERS] && pPlayer && pPlayer->IsBot())
+				|| (m_bFlags[CF_PROJECTILES] && FFLib::IsProjectile(pEntity))
+				|| (m_bFlags[CF_GRENADES] && FFLib::IsGrenade(pEntity))
+				|| (m_bFlags[CF_INFOSCRIPTS] && FFLib::IsInfoScript(pEntity))
+				|| (m_bFlags[CF_BUILDABLES] && FFLib::IsBuildable(pEntity));
+
+			if(!bPass)
+				return false;
+		}
+
+		if(m_bAnyClass)
+		{
+			if(!pPlayer)
+				return false;
+
+			// CF_PLAYER_SCOUT..CF_PLAYER_CIVILIAN are in class order
+			int iClass = pPlayer->GetClassSlot();
+			if(iClass < CLASS_SCOUT || iClass > CLASS_CIVILIAN || !m_bFlags[CF_PLAYER_SCOUT + iClass - CLASS_SCOUT])
+				return false;
+		}
+
+		if(m_bAnyTeam)
+		{
+			// CF_TEAM_SPECTATOR..CF_TEAM_GREEN are in team order
+			int iTeam = pEntity->GetTeamNumber();
+			bool bPass = (m_bFlags[CF_TEAMS] && iTeam >= TEAM_BLUE && iTeam <= TEAM_GREEN)
+				|| (iTeam >= TEAM_SPECTATOR && iTeam <= TEAM_GREEN && m_bFlags[CF_TEAM_SPECTATOR + iTeam - TEAM_SPECTATOR]);
+
+			if(!bPass)
+				return false;
+		}
+
+		if(m_bAnyInfoScript)
+		{
+			if(!FFLib::IsInfoScript(pEntity))
+				return false;
+
+			CFFInfoScript *pInfoScript = static_cast<CFFInfoScript *>(pEntity);
+			bool bPass = (m_bFlags[CF_INFOSCRIPT_CARRIED] && pInfoScript->IsCarried())
+				|| (m_bFlags[CF_INFOSCRIPT_DROPPED] && pInfoScript->IsDropped())
+				|| (m_bFlags[CF_INFOSCRIPT_RETURNED] && pInfoScript->IsReturned())
+				|| (m_bFlags[CF_INFOSCRIPT_ACTIVE] && pInfoScript->IsActive())
+				|| (m_bFlags[CF_INFOSCRIPT_INACTIVE] && pInfoScript->IsInactive())
+				|| (m_bFlags[CF_INFOSCRIPT_REMOVED] && pInfoScript->IsRemoved());
+
+			if(!bPass)
+				return false;
+		}
+
+		if(m_bAnyBuildable)
+		{
+			bool bPass = (m_bFlags[CF_BUILDABLE_DISPENSER] && FFLib::IsDispenser(pEntity))
+				|| (m_bFlags[CF_BUILDABLE_SENTRYGUN] && FFLib::IsSentrygun(pEntity))
+				|| (m_bFlags[CF_BUILDABLE_DETPACK] && FFLib::IsDetpack(pEntity))
+				|| (m_bFlags[CF_BUILDABLE_JUMPPAD] && FFLib::IsJumpPad(pEntity));
+
+			if(!bPass)
+				return false;
+		}
+
+		return true;
+	}
+
+private:
+	void AddFlag(int iFlag)
+	{
+		if(iFlag > CF_NONE && iFlag < CF_MAX_FLAG)
+			m_bFlags[iFlag] = true;
+	}
+
+	bool AnySet(int iFirst, int iLast) const
+	{
+		for(int i = iFirst; i <= iLast; i++)
+		{
+			if(m_bFlags[i])
+				return true;
+		}
+
+		return false;
+	}
+
+	bool	m_bFlags[CF_MAX_FLAG];
+	bool	m_bAnyType;
+	bool	m_bAnyClass;
+	bool	m_bAnyTeam;
+	bool	m_bAnyInfoScript;
+	bool	m_bAnyBuildable;
+};
+
+//============================================================================
+// CFFEntity_Collection
+// Purpose: a list of entities that is filled in C++ with the CF filters,
+//			so scripts don't build and walk a fresh table every call. Holds
+//			handles, so a collection can be kept and refilled across frames;
+//			entities removed in the meantime are skipped when iterating.
+//
+//			local c = Collection()
+//			c:GetInSphere(vecOrigin, 512, { CF.kPlayers, CF.kTeamBlue, CF.kTraceBlockWalls })
+//			for player in c:Items() do ... end
+//============================================================================
+class CFFEntity_Collection
+{
+public:
+	// iterates by index, so refilling the collection from inside a loop
+	// ends the loop instead of reading freed memory
+	class iterator
+	{
+	public:
+		iterator(const CFFEntity_Collection *pCollection, int iIndex)
+			: m_pCollection(pCollection), m_iIndex(iIndex)
+		{
+			SkipRemoved();
+		}
+
+		CBaseEntity *operator*() const { return m_pCollection->m_hEntities[m_iIndex].Get(); }
+
+		iterator &operator++()
+		{
+			m_iIndex++;
+			SkipRemoved();
+			return *this;
+		}
+
+		bool operator==(const iterator &rhs) const { return Position() == rhs.Position(); }
+		bool operator!=(const iterator &rhs) const { return Position() != rhs.Position(); }
+
+	private:
+		int Position() const { return min(m_iIndex, m_pCollection->m_hEntities.Count()); }
+
+		void SkipRemoved()
+		{
+			while(m_iIndex < m_pCollection->m_hEntities.Count() && !m_pCollection->m_hEntities[m_iIndex].Get())
+				m_iIndex++;
+		}
+
+		const CFFEntity_Collection	*m_pCollection;
+		int							m_iIndex;
+	};
+
+	typedef iterator const_iterator;
+
+public:
+	CFFEntity_Collection() {}
+
+	iterator begin() const { return iterator(this, 0); }
+	iterator end() const { return iterator(this, m_hEntities.Count()); }
+
+	// for ent in collection:Items() do
+	const CFFEntity_Collection& Items() const { return *this; }
+
+	// the Get* functions replace the contents and return how many entities were collected
+	int GetInSphere(const Vector& vecOrigin, float flRadius)
+	{
+		return GetInSphere(vecOrigin, flRadius, luabind::adl::object());
+	}
+
+	int GetInSphere(const Vector& vecOrigin, float flRadius, const luabind::adl::object& filters)
+	{
+		VPROF_BUDGET( "CFFEntity_Collection::GetInSphere", VPROF_BUDGETGROUP_FF_LUA );
+
+		CFFEntity_CollectionFilterSet filterSet(filters);
+		m_hEntities.RemoveAll();
+
+		CBaseEntity *pEntity = NULL;
+		for( CEntitySphereQuery sphere( vecOrigin, flRadius ); ( pEntity = sphere.GetCurrentEntity() ) != NULL; sphere.NextEntity() )
+		{
+			if(!filterSet.Passes(pEntity))
+				continue;
+
+			// the trace is the expensive part, so only entities that passed everything else get one
+			if(filterSet.TraceBlockWalls())
+			{
+				trace_t tr;
+				UTIL_TraceLine( vecOrigin, pEntity->GetAbsOrigin(), MASK_SOLID, NULL, COLLISION_GROUP_NONE, &tr );
+
+				if( FF_TraceHitWorld( &tr ) )
+					continue;
+			}
+
+			m_hEntities.AddToTail(pEntity);
+		}
+
+		return m_hEntities.Count();
+	}
+
+	int GetByName(const char *szName)
+	{
+		return GetByName(szName, luabind::adl::object());
+	}
+
+	int GetByName(const char *szName, const luabind::adl::object& filters)
+	{
+		VPROF_BUDGET( "CFFEntity_Collection::GetByName", VPROF_BUDGETGROUP_FF_LUA );
+
+		CFFEntity_CollectionFilterSet filterSet(filters);
+		m_hEntities.RemoveAll();
+
+		for(CBaseEntity *pEntity = gEntList.FindEntityByName(NULL, szName); pEntity; pEntity = gEntList.FindEntityByName(pEntity, szName))
+		{
+			if(filterSet.Passes(pEntity))
+				m_hEntities.AddToTail(pEntity);
+		}
+
+		return m_hEntities.Count();
+	}
+
+	int GetByFilter(const luabind::adl::object& filters)
+	{
+		VPROF_BUDGET( "CFFEntity_Collection::GetByFilter", VPROF_BUDGETGROUP_FF_LUA );
+
+		CFFEntity_CollectionFilterSet filterSet(filters);
+		m_hEntities.RemoveAll();
+
+		if(filterSet.PlayersOnly())
+		{
+			for(int i = 1; i <= gpGlobals->maxClients; i++)
+			{
+				CBaseEntity *pEntity = UTIL_EntityByIndex(i);
+				if(filterSet.Passes(pEntity))
+					m_hEntities.AddToTail(pEntity);
+			}
+		}
+		else
+		{
+			for(CBaseEntity *pEntity = gEntList.FirstEnt(); pEntity; pEntity = gEntList.NextEnt(pEntity))
+			{
+				if(filterSet.Passes(pEntity))
+					m_hEntities.AddToTail(pEntity);
+			}
+		}
+
+		return m_hEntities.Count();
+	}
+
+	// drops the entities that don't pass the filters, keeping the order
+	int Filter(const luabind::adl::object& filters)
+	{
+		CFFEntity_CollectionFilterSet filterSet(filters);
+
+		for(int i = m_hEntities.Count() - 1; i >= 0; i--)
+		{
+			if(!filterSet.Passes(m_hEntities[i].Get()))
+				m_hEntities.Remove(i);
+		}
+
+		return m_hEntities.Count();
+	}
+
+	void AddItem(CBaseEntity *pEntity)
+	{
+		if(pEntity && !HasItem(pEntity))
+			m_hEntities.AddToTail(pEntity);
+	}
+
+	void RemoveItem(CBaseEntity *pEntity)
+	{
+		for(int i = 0; i < m_hEntities.Count(); i++)
+		{
+			if(m_hEntities[i].Get() == pEntity)
+			{
+				m_hEntities.Remove(i);
+				return;
+			}
+		}
+	}
+
+	bool HasItem(CBaseEntity *pEntity) const
+	{
+		for(int i = 0; i < m_hEntities.Count(); i++)
+		{
+			if(m_hEntities[i].Get() == pEntity)
+				return true;
+		}
+
+		return false;
+	}
+
+	// 1 based, like lua tables
+	CBaseEntity *Element(int iIndex) const
+	{
+		if(iIndex < 1 || iIndex > m_hEntities.Count())
+			return NULL;
+
+		return m_hEntities[iIndex - 1].Get();
+	}
+
+	void Clear() { m_hEntities.RemoveAll(); }
+
+	// counts entities that may have been removed since the collection was filled
+	int Count() const { return m_hEntities.Count(); }
+	bool IsEmpty() const { return m_hEntities.Count() == 0; }
+
+private:
+	CUtlVector<EHANDLE>	m_hEntities;
+};
+
 //---------------------------------------------------------------------------
 void CFFLuaLib::InitUtil(lua_State* L)
 {
@@ -107,7 +481,7 @@ void CFFLuaLib::InitUtil(lua_State* L)
 				value("kPlayerSniper",		CF_PLAYER_SNIPER),
 				value("kPlayerSoldier",		CF_PLAYER_SOLDIER),
 				value("kPlayerDemoman",		CF_PLAYER_DEMOMAN),
-				value("kPlayerMedic",		CF_PLAYER_DEMOMAN),
+				value("kPlayerMedic",		CF_PLAYER_MEDIC),
 				value("kPlayerHWGuy",		CF_PLAYER_HWGUY),
 				value("kPlayerPyro",		CF_PLAYER_PYRO),
 				value("kPlayerSpy",			CF_PLAYER_SPY),
@@ -140,6 +514,24 @@ void CFFLuaLib::InitUtil(lua_State* L)
 				value("kSentrygun",			CF_BUILDABLE_SENTRYGUN),
 				value("kDetpack",			CF_BUILDABLE_DETPACK),
 				value("kJumpPad",			CF_BUILDABLE_JUMPPAD)
-			]
+			],
+
+		// CFFEntity_Collection
+		class_<CFFEntity_Collection>("Collection")
+			.def(constructor<>())
+			.def("GetInSphere",			(int(CFFEntity_Collection::*)(const Vector&, float))&CFFEntity_Collection::GetInSphere)
+			.def("GetInSphere",			(int(CFFEntity_Collection::*)(const Vector&, float, const luabind::adl::object&))&CFFEntity_Collection::GetInSphere)
+			.def("GetByName",			(int(CFFEntity_Collection::*)(const char*))&CFFEntity_Collection::GetByName)
+			.def("GetByName",			(int(CFFEntity_Collection::*)(const char*, const luabind::adl::object&))&CFFEntity_Collection::GetByName)
+			.def("GetByFilter",			&CFFEntity_Collection::GetByFilter)
+			.def("Filter",				&CFFEntity_Collection::Filter)
+			.def("AddItem",				&CFFEntity_Collection::AddItem)
+			.def("RemoveItem",			&CFFEntity_Collection::RemoveItem)
+			.def("HasItem",				&CFFEntity_Collection::HasItem)
+			.def("Element",				&CFFEntity_Collection::Element)
+			.def("Clear",				&CFFEntity_Collection::Clear)
+			.def("Count",				&CFFEntity_Collection::Count)
+			.def("IsEmpty",				&CFFEntity_Collection::IsEmpty)
+			.def("Items",				&CFFEntity_Collection::Items, return_stl_iterator)
 	];
 };
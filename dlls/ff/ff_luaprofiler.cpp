@@ -0,0 +1,424 @@
+// ff_luaprofiler.cpp
+
+//---------------------------------------------------------------------------
+// includes
+#include "cbase.h"
+#include "ff_luaprofiler.h"
+#include "ff_scriptman.h"
+#include "utlsymbol.h"
+
+// engine
+#include "filesystem.h"
+
+// Lua includes
+extern "C"
+{
+	#include "lua.h"
+	#include "lauxlib.h"
+}
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+//---------------------------------------------------------------------------
+void LuaProfile_Callback( ConVar *var, char const *pOldString );
+ConVar lua_profile( "lua_profile", "0", 0, "Records per-function time, call counts and allocations for server-side Lua (see lua_profile_dump)", LuaProfile_Callback );
+
+//---------------------------------------------------------------------------
+// names and entry points are kept for the lifetime of the process because
+// VPROF holds on to the pointers
+static CUtlSymbolTable s_ProfilerStrings( 0, 64 );
+
+unsigned int CFFLuaProfiler::s_nBytesAllocated = 0;
+
+//---------------------------------------------------------------------------
+void LuaProfile_Callback( ConVar *var, char const *pOldString )
+{
+	lua_State *L = _scriptman.GetLuaState();
+	if ( !L )
+		return;
+
+	if ( var->GetBool() )
+		_scriptman.GetProfiler().Attach( L );
+	else
+		_scriptman.GetProfiler().Detach( L );
+}
+
+//---------------------------------------------------------------------------
+CFFLuaProfiler::CFFLuaProfiler()
+{
+	m_bActive = false;
+	m_pszEntryPoint = NULL;
+	m_nEntryDepth = 0;
+	m_iFunctionNamesRef = LUA_NOREF;
+
+	m_RecordIndex.SetLessFunc( RecordKeyLessFunc );
+}
+
+//---------------------------------------------------------------------------
+CFFLuaProfiler::~CFFLuaProfiler()
+{
+}
+
+//---------------------------------------------------------------------------
+bool CFFLuaProfiler::RecordKeyLessFunc( const RecordKey_t &a, const RecordKey_t &b )
+{
+	if ( a.pszName != b.pszName )
+		return a.pszName < b.pszName;
+
+	return a.pszEntryPoint < b.pszEntryPoint;
+}
+
+//---------------------------------------------------------------------------
+void *CFFLuaProfiler::Alloc( void *ud, void *ptr, size_t osize, size_t nsize )
+{
+	if ( nsize == 0 )
+	{
+		free( ptr );
+		return NULL;
+	}
+
+	if ( nsize > osize )
+		s_nBytesAllocated += nsize - osize;
+
+	return realloc( ptr, nsize );
+}
+
+//---------------------------------------------------------------------------
+void CFFLuaProfiler::Attach( lua_State *L )
+{
+	CloseFrames( 0 );
+
+	// names are keyed on the functions themselves rather than their
+	// addresses, which the collector hands out again once a function has
+	// gone. the keys are weak so the profiler doesn't keep anything alive
+	lua_newtable( L );
+	lua_newtable( L );
+	lua_pushstring( L, "k" );
+	lua_setfield( L, -2, "__mode" );
+	lua_setmetatable( L, -2 );
+	m_iFunctionNamesRef = luaL_ref( L, LUA_REGISTRYINDEX );
+
+	lua_sethook( L, Hook, LUA_MASKCALL | LUA_MASKRET, 0 );
+	m_bActive = true;
+}
+
+//---------------------------------------------------------------------------
+void CFFLuaProfiler::Detach( lua_State *L )
+{
+	if ( L )
+	{
+		lua_sethook( L, NULL, 0, 0 );
+		luaL_unref( L, LUA_REGISTRYINDEX, m_iFunctionNamesRef );
+	}
+
+	m_iFunctionNamesRef = LUA_NOREF;
+
+	CloseFrames( 0 );
+
+	m_bActive = false;
+	m_pszEntryPoint = NULL;
+	m_nEntryDepth = 0;
+}
+
+//---------------------------------------------------------------------------
+void CFFLuaProfiler::Reset()
+{
+	CloseFrames( 0 );
+
+	m_Records.RemoveAll();
+	m_RecordIndex.RemoveAll();
+}
+
+//---------------------------------------------------------------------------
+int CFFLuaProfiler::EnterEntryPoint( const char *pszEntryPoint )
+{
+	if ( m_nEntryDepth++ == 0 )
+		m_pszEntryPoint = s_ProfilerStrings.String( s_ProfilerStrings.AddString( pszEntryPoint ) );
+
+	return m_Frames.Count();
+}
+
+//---------------------------------------------------------------------------
+void CFFLuaProfiler::LeaveEntryPoint( int iFrameDepth )
+{
+	// profiling was toggled while inside the scope
+	if ( !m_bActive || m_nEntryDepth <= 0 )
+		return;
+
+	// a script error unwinds the lua stack without return events
+	CloseFrames( iFrameDepth );
+
+	if ( --m_nEntryDepth == 0 )
+		m_pszEntryPoint = NULL;
+}
+
+//---------------------------------------------------------------------------
+void CFFLuaProfiler::CloseFrames( int iFrameDepth )
+{
+	while ( m_Frames.Count() > iFrameDepth )
+		OnReturn();
+}
+
+//---------------------------------------------------------------------------
+void CFFLuaProfiler::Hook( lua_State *L, lua_Debug *ar )
+{
+	CFFLuaProfiler &profiler = _scriptman.GetProfiler();
+
+	switch ( ar->event )
+	{
+	case LUA_HOOKCALL:
+		profiler.OnCall( L, ar );
+		break;
+
+	case LUA_HOOKRET:
+	case LUA_HOOKTAILRET:
+		profiler.OnReturn();
+		break;
+	}
+}
+
+//---------------------------------------------------------------------------
+const char *CFFLuaProfiler::GetFunctionName( lua_State *L, lua_Debug *ar )
+{
+	// pushes the function being called
+	if ( !lua_getinfo( L, "f", ar ) )
+		return "?";
+
+	lua_rawgeti( L, LUA_REGISTRYINDEX, m_iFunctionNamesRef );
+	if ( !lua_istable( L, -1 ) )
+	{
+		lua_pop( L, 2 );
+		return "?";
+	}
+
+	lua_pushvalue( L, -2 );
+	lua_rawget( L, -2 );
+	const char *pszCached = (const char *)lua_touserdata( L, -1 );
+	lua_pop( L, 1 );
+
+	if ( pszCached )
+	{
+		lua_pop( L, 2 );
+		return pszCached;
+	}
+
+	// first time we see this function, build a readable name
+	char szName[ 256 ];
+	lua_getinfo( L, "Sn", ar );
+
+	if ( ar->what && !Q_strcmp( ar->what, "C" ) )
+		Q_snprintf( szName, sizeof( szName ), "%s [C]", ar->name ? ar->name : "?" );
+	else
+		Q_snprintf( szName, sizeof( szName ), "%s (%s:%d)", ar->name ? ar->name : "?", ar->short_src, ar->linedefined );
+
+	const char *pszName = s_ProfilerStrings.String( s_ProfilerStrings.AddString( szName ) );
+
+	// names[ function ] = name
+	lua_pushvalue( L, -2 );
+	lua_pushlightuserdata( L, (void *)pszName );
+	lua_rawset( L, -3 );
+	lua_pop( L, 2 );
+
+	return pszName;
+}
+
+//---------------------------------------------------------------------------
+int CFFLuaProfiler::GetRecord( const char *pszName )
+{
+	RecordKey_t key;
+	key.pszName = pszName;
+	key.pszEntryPoint = m_pszEntryPoint ? m_pszEntryPoint : "<none>";
+
+	unsigned short it = m_RecordIndex.Find( key );
+	if ( m_RecordIndex.IsValidIndex( it ) )
+		return m_RecordIndex[ it ];
+
+	int iRecord = m_Records.AddToTail();
+	Record_t &record = m_Records[ iRecord ];
+	record.pszName = key.pszName;
+	record.pszEntryPoint = key.pszEntryPoint;
+	record.nCalls = 0;
+	record.flInclusive = 0.0;
+	record.flExclusive = 0.0;
+	record.nInclusiveBytes = 0;
+	record.nExclusiveBytes = 0;
+
+	m_RecordIndex.Insert( key, iRecord );
+	return iRecord;
+}
+
+//---------------------------------------------------------------------------
+void CFFLuaProfiler::OnCall( lua_State *L, lua_Debug *ar )
+{
+	const char *pszName = GetFunctionName( L, ar );
+
+#ifdef VPROF_ENABLED
+	g_VProfCurrentProfile.EnterScope( pszName, 0, VPROF_BUDGETGROUP_FF_LUA, false, BUDGETFLAG_OTHER );
+#endif
+
+	Frame_t &frame = m_Frames[ m_Frames.AddToTail() ];
+	frame.iRecord = GetRecord( pszName );
+	frame.flChildTime = 0.0;
+	frame.nChildBytes = 0;
+	frame.nStartBytes = s_nBytesAllocated;
+	frame.flStart = Plat_FloatTime();
+}
+
+//---------------------------------------------------------------------------
+void CFFLuaProfiler::OnReturn()
+{
+	double flNow = Plat_FloatTime();
+
+	// return from a call that started before the hook was installed
+	if ( !m_Frames.Count() )
+		return;
+
+#ifdef VPROF_ENABLED
+	g_VProfCurrentProfile.ExitScope();
+#endif
+
+	int iFrame = m_Frames.Count() - 1;
+	Frame_t frame = m_Frames[ iFrame ];
+	m_Frames.Remove( iFrame );
+
+	double flElapsed = flNow - frame.flStart;
+	unsigned int nBytes = s_nBytesAllocated - frame.nStartBytes;
+
+	Record_t &record = m_Records[ frame.iRecord ];
+	record.nCalls++;
+	record.flInclusive += flElapsed;
+	record.flExclusive += flElapsed - frame.flChildTime;
+	record.nInclusiveBytes += nBytes;
+	record.nExclusiveBytes += nBytes - frame.nChildBytes;
+
+	// charge the caller for its child
+	if ( m_Frames.Count() )
+	{
+		Frame_t &parent = m_Frames[ m_Frames.Count() - 1 ];
+		parent.flChildTime += flElapsed;
+		parent.nChildBytes += nBytes;
+	}
+}
+
+//---------------------------------------------------------------------------
+int __cdecl CFFLuaProfiler::RecordCompare( const Record_t *a, const Record_t *b )
+{
+	if ( a->flExclusive > b->flExclusive )
+		return -1;
+
+	if ( a->flExclusive < b->flExclusive )
+		return 1;
+
+	return 0;
+}
+
+//---------------------------------------------------------------------------
+void CFFLuaProfiler::SortRecords( CUtlVector<Record_t> &sorted )
+{
+	sorted.CopyArray( m_Records.Base(), m_Records.Count() );
+	sorted.Sort( RecordCompare );
+}
+
+//---------------------------------------------------------------------------
+void CFFLuaProfiler::Dump( int nMaxRows )
+{
+	CUtlVector<Record_t> sorted;
+	SortRecords( sorted );
+
+	Msg( "%8s %10s %10s %10s %10s  %-28s %s\n", "calls", "excl ms", "incl ms", "excl KB", "incl KB", "entry point", "function" );
+
+	for ( int i = 0; i < sorted.Count() && i < nMaxRows; i++ )
+	{
+		const Record_t &record = sorted[ i ];
+		Msg( "%8u %10.3f %10.3f %10.1f %10.1f  %-28s %s\n",
+			record.nCalls,
+			record.flExclusive * 1000.0,
+			record.flInclusive * 1000.0,
+			record.nExclusiveBytes / 1024.0f,
+			record.nInclusiveBytes / 1024.0f,
+			record.pszEntryPoint,
+			record.pszName );
+	}
+
+	if ( sorted.Count() > nMaxRows )
+		Msg( "(%d more, use lua_profile_dump <rows> or lua_profile_csv)\n", sorted.Count() - nMaxRows );
+}
+
+//---------------------------------------------------------------------------
+bool CFFLuaProfiler::DumpCSV( const char *pszFilename )
+{
+	FileHandle_t hFile = filesystem->Open( pszFilename, "w", "MOD" );
+	if ( !hFile )
+		return false;
+
+	CUtlVector<Record_t> sorted;
+	SortRecords( sorted );
+
+	filesystem->FPrintf( hFile, "function,entry point,calls,exclusive ms,inclusive ms,exclusive bytes,inclusive bytes\n" );
+
+	for ( int i = 0; i < sorted.Count(); i++ )
+	{
+		const Record_t &record = sorted[ i ];
+		filesystem->FPrintf( hFile, "\"%s\",\"%s\",%u,%.4f,%.4f,%u,%u\n",
+			record.pszName,
+			record.pszEntryPoint,
+			record.nCalls,
+			record.flExclusive * 1000.0,
+			record.flInclusive * 1000.0,
+			record.nExclusiveBytes,
+			record.nInclusiveBytes );
+	}
+
+	filesystem->Close( hFile );
+	return true;
+}
+
+//---------------------------------------------------------------------------
+CFFLuaProfileScope::CFFLuaProfileScope( const char *pszEntryPoint )
+{
+	m_iFrameDepth = -1;
+
+	CFFLuaProfiler &profiler = _scriptman.GetProfiler();
+	if ( profiler.IsActive() )
+		m_iFrameDepth = profiler.EnterEntryPoint( pszEntryPoint );
+}
+
+//---------------------------------------------------------------------------
+CFFLuaProfileScope::~CFFLuaProfileScope()
+{
+	if ( m_iFrameDepth >= 0 )
+		_scriptman.GetProfiler().LeaveEntryPoint( m_iFrameDepth );
+}
+
+//---------------------------------------------------------------------------
+CON_COMMAND( lua_profile_dump, "Prints the Lua profile sorted by exclusive time. Usage: lua_profile_dump [rows]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nRows = ( engine->Cmd_Argc() > 1 ) ? atoi( engine->Cmd_Argv( 1 ) ) : 30;
+	_scriptman.GetProfiler().Dump( nRows > 0 ? nRows : 30 );
+}
+
+//---------------------------------------------------------------------------
+CON_COMMAND( lua_profile_csv, "Writes the Lua profile to a CSV file in the mod directory. Usage: lua_profile_csv [filename]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	const char *pszFilename = ( engine->Cmd_Argc() > 1 ) ? engine->Cmd_Argv( 1 ) : "luaprofile.csv";
+	if ( _scriptman.GetProfiler().DumpCSV( pszFilename ) )
+		Msg( "Wrote Lua profile to %s\n", pszFilename );
+	else
+		Warning( "Unable to write Lua profile to %s\n", pszFilename );
+}
+
+//---------------------------------------------------------------------------
+CON_COMMAND( lua_profile_reset, "Clears the recorded Lua profile" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	_scriptman.GetProfiler().Reset();
+}
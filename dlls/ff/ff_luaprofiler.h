@@ -0,0 +1,131 @@
+// ff_luaprofiler.h
+
+//---------------------------------------------------------------------------
+#ifndef FF_LUAPROFILER_H
+#define FF_LUAPROFILER_H
+
+//---------------------------------------------------------------------------
+// includes
+#ifndef UTLMAP_H
+	#include "utlmap.h"
+#endif
+#ifndef UTLVECTOR_H
+	#include "utlvector.h"
+#endif
+
+//---------------------------------------------------------------------------
+// foward declarations
+struct lua_State;
+struct lua_Debug;
+
+//---------------------------------------------------------------------------
+// Records call counts, inclusive/exclusive time and bytes allocated for
+// every script function, split by the C++ entry point that called into
+// lua. Driven by a lua call/return hook while lua_profile is set; each
+// function also gets its own VPROF node under the FF Lua budget group.
+//---------------------------------------------------------------------------
+class CFFLuaProfiler
+{
+private:
+	struct Record_t
+	{
+		const char		*pszName;			// interned "function (source:line)"
+		const char		*pszEntryPoint;		// interned C++ entry point
+		unsigned int	nCalls;
+		double			flInclusive;		// seconds
+		double			flExclusive;		// seconds
+		unsigned int	nInclusiveBytes;
+		unsigned int	nExclusiveBytes;
+	};
+
+	struct Frame_t
+	{
+		int				iRecord;
+		double			flStart;
+		double			flChildTime;
+		unsigned int	nStartBytes;
+		unsigned int	nChildBytes;
+	};
+
+	struct RecordKey_t
+	{
+		const char		*pszName;
+		const char		*pszEntryPoint;
+	};
+
+public:
+	// 'structors
+	CFFLuaProfiler();
+	~CFFLuaProfiler();
+
+public:
+	// installs/removes the call hook on a VM
+	void Attach( lua_State *L );
+	void Detach( lua_State *L );
+	bool IsActive() const { return m_bActive; }
+
+	// throws away everything recorded so far
+	void Reset();
+
+	// entry point tracking, use CFFLuaProfileScope rather than these
+	int		EnterEntryPoint( const char *pszEntryPoint );
+	void	LeaveEntryPoint( int iFrameDepth );
+
+	// prints the top records sorted by exclusive time
+	void Dump( int nMaxRows );
+
+	// writes every record to a CSV file relative to the mod dir
+	bool DumpCSV( const char *pszFilename );
+
+	// allocator for the VM that keeps track of how much lua allocates
+	static void *Alloc( void *ud, void *ptr, size_t osize, size_t nsize );
+
+private:
+	static void Hook( lua_State *L, lua_Debug *ar );
+
+	void OnCall( lua_State *L, lua_Debug *ar );
+	void OnReturn();
+
+	// closes open frames until only iFrameDepth are left
+	void CloseFrames( int iFrameDepth );
+
+	const char *GetFunctionName( lua_State *L, lua_Debug *ar );
+	int GetRecord( const char *pszName );
+
+	// copies the records sorted by exclusive time, slowest first
+	void SortRecords( CUtlVector<Record_t> &sorted );
+	static int __cdecl RecordCompare( const Record_t *a, const Record_t *b );
+
+private:
+	static bool RecordKeyLessFunc( const RecordKey_t &a, const RecordKey_t &b );
+
+	bool	m_bActive;
+
+	const char	*m_pszEntryPoint;	// outermost C++ entry point currently running
+	int			m_nEntryDepth;
+
+	CUtlVector<Record_t>			m_Records;
+	CUtlVector<Frame_t>				m_Frames;
+	CUtlMap<RecordKey_t, int>		m_RecordIndex;
+	int								m_iFunctionNamesRef;	// registry ref of a weak keyed function -> name table in the attached VM
+
+	static unsigned int s_nBytesAllocated;
+};
+
+//---------------------------------------------------------------------------
+// Marks a C++ entry point into lua. Script time is attributed to the
+// outermost scope; frames left open by a script error are closed when the
+// scope ends.
+//---------------------------------------------------------------------------
+class CFFLuaProfileScope
+{
+public:
+	CFFLuaProfileScope( const char *pszEntryPoint );
+	~CFFLuaProfileScope();
+
+private:
+	int m_iFrameDepth;
+};
+
+//---------------------------------------------------------------------------
+#endif
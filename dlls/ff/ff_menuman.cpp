@@ -98,6 +98,8 @@ bool CFFLuaMenu::Update()
 	{
 		if(m_iNumPlayersActive <= 0)
 		{
+			CFFLuaProfileScope profileScope( "menu callback" );
+
 			CFFLuaSC hContext( 0 );
 			hContext.Push( m_szIdentifier );
 			hContext.Push( m_iNumPlayersSent );
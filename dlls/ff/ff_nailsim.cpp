@@ -0,0 +1,340 @@
+// ff_nailsim.cpp
+
+/////////////////////////////////////////////////////////////////////////////
+// includes
+#include "cbase.h"
+#include "ff_nailsim.h"
+#include "ff_tracebatch.h"
+#include "ff_shareddefs.h"
+#include "ff_utils.h"
+#include "ammodef.h"
+#include "tier0/vprof.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+/////////////////////////////////////////////////////////////////////////////
+ConVar sv_nail_entities( "sv_nail_entities", "0", 0, "Fire nails as entities rather than simulating them all together" );
+
+/////////////////////////////////////////////////////////////////////////////
+// m_fFlags
+#define NAILSIM_NAILGRENADE		( 1 << 0 )
+#define NAILSIM_BUBBLECHECKED	( 1 << 1 )
+
+// the nail entity's first bubble think
+#define NAILSIM_BUBBLE_DELAY	0.1f
+
+// same as ff_projectile_nail.cpp
+#define NAIL_BBOX				2.0f
+#define NAIL_SGMOD				10.0f
+#define FF_NAIL_PUSHMULTIPLIER	0.05f
+
+/////////////////////////////////////////////////////////////////////////////
+CFFNailSimulator _nailsim;
+
+/////////////////////////////////////////////////////////////////////////////
+// What a nail entity's movement would have collided with: everything a
+// COLLISION_GROUP_ROCKET entity collides with, apart from whoever fired it
+/////////////////////////////////////////////////////////////////////////////
+class CFFNailTraceFilter : public CTraceFilterSimple
+{
+public:
+	DECLARE_CLASS( CFFNailTraceFilter, CTraceFilterSimple );
+
+	CFFNailTraceFilter() : CTraceFilterSimple( NULL, COLLISION_GROUP_ROCKET ), m_pOwner( NULL ) {}
+
+	void SetOwner( const IHandleEntity *pOwner ) { m_pOwner = pOwner; }
+
+	virtual bool ShouldHitEntity( IHandleEntity *pHandleEntity, int contentsMask )
+	{
+		if( pHandleEntity == m_pOwner )
+			return false;
+
+		return BaseClass::ShouldHitEntity( pHandleEntity, contentsMask );
+	}
+
+private:
+	const IHandleEntity	*m_pOwner;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+CFFNailSimulator::CFFNailSimulator()
+{
+	Init();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+CFFNailSimulator::~CFFNailSimulator()
+{
+	Shutdown();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFNailSimulator::Init()
+{
+	RemoveAll();
+
+	m_nNails = 0;
+	m_nTraces = 0;
+	m_nHits = 0;
+	m_nMostNails = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFNailSimulator::Shutdown()
+{
+	RemoveAll();
+
+	m_vecOrigins.Purge();
+	m_vecVelocities.Purge();
+	m_hOwners.Purge();
+	m_hSources.Purge();
+	m_flDamages.Purge();
+	m_flSpawnTimes.Purge();
+	m_fFlags.Purge();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFNailSimulator::RemoveAll()
+{
+	m_vecOrigins.RemoveAll();
+	m_vecVelocities.RemoveAll();
+	m_hOwners.RemoveAll();
+	m_hSources.RemoveAll();
+	m_flDamages.RemoveAll();
+	m_flSpawnTimes.RemoveAll();
+	m_fFlags.RemoveAll();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool CFFNailSimulator::IsEnabled() const
+{
+	return !sv_nail_entities.GetBool();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFNailSimulator::AddNail( CBaseEntity *pSource, const Vector &vecOrigin, const Vector &vecVelocity, CBaseEntity *pOwner, float flDamage, bool bNailGrenadeNail )
+{
+	m_vecOrigins.AddToTail( vecOrigin );
+	m_vecVelocities.AddToTail( vecVelocity );
+	m_hOwners.AddToTail( pOwner );
+	m_hSources.AddToTail( pSource );
+	m_flDamages.AddToTail( flDamage );
+	m_flSpawnTimes.AddToTail( gpGlobals->curtime );
+	m_fFlags.AddToTail( bNailGrenadeNail ? NAILSIM_NAILGRENADE : 0 );
+
+	m_nNails++;
+	m_nMostNails = max( m_nMostNails, m_vecOrigins.Count() );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFNailSimulator::Update()
+{
+	int nNails = m_vecOrigins.Count();
+	if( !nNails )
+		return;
+
+	VPROF_BUDGET( "CFFNailSimulator::Update", VPROF_BUDGETGROUP_GAME );
+
+	float flFrameTime = gpGlobals->frametime;
+
+	Vector vecMins = -Vector( 1.0f, 1.0f, 1.0f ) * NAIL_BBOX;
+	Vector vecMaxs = Vector( 1.0f, 1.0f, 1.0f ) * NAIL_BBOX;
+
+	// sweep every nail as far as it goes this tick
+	CUtlVector<CFFNailTraceFilter> filters;
+	filters.SetCount( nNails );
+
+	CFFTraceBatch batch;
+	for( int i = 0; i < nNails; i++ )
+	{
+		// nail grenade nails can hit the grenade's owner
+		if( !( m_fFlags[ i ] & NAILSIM_NAILGRENADE ) )
+			filters[ i ].SetOwner( m_hOwners[ i ].Get() );
+
+		batch.AddTraceHull( m_vecOrigins[ i ], m_vecOrigins[ i ] + m_vecVelocities[ i ] * flFrameTime, vecMins, vecMaxs, MASK_SOLID, &filters[ i ] );
+	}
+
+	batch.Execute();
+	m_nTraces += nNails;
+
+	// Then deal with them in the order they were fired, a hit can't move
+	// the other nails but it can kill whoever fired them
+	int iKeep = 0;
+	for( int i = 0; i < nNails; i++ )
+	{
+		const trace_t &tr = batch.GetResult( i );
+
+		bool bRemove = false;
+
+		if( tr.fraction < 1.0f && tr.m_pEnt )
+		{
+			bRemove = Hit( i, tr );
+			m_vecOrigins[ i ] = tr.endpos;
+		}
+		else
+		{
+			m_vecOrigins[ i ] = tr.endpos;
+
+			const Vector &vecOrigin = m_vecOrigins[ i ];
+			if( vecOrigin.x >= MAX_COORD_INTEGER || vecOrigin.y >= MAX_COORD_INTEGER || vecOrigin.z >= MAX_COORD_INTEGER ||
+				vecOrigin.x <= MIN_COORD_INTEGER || vecOrigin.y <= MIN_COORD_INTEGER || vecOrigin.z <= MIN_COORD_INTEGER )
+			{
+				bRemove = true;
+			}
+		}
+
+		// The nail entity checked for water once, shortly after being
+		// fired, and then every 5 seconds for as long as it stayed wet
+		if( !bRemove && gpGlobals->curtime >= m_flSpawnTimes[ i ] + NAILSIM_BUBBLE_DELAY && !( m_fFlags[ i ] & NAILSIM_BUBBLECHECKED ) )
+		{
+			if( UTIL_PointContents( m_vecOrigins[ i ] ) & MASK_WATER )
+			{
+				UTIL_BubbleTrail( m_vecOrigins[ i ] - m_vecVelocities[ i ] * 0.1f, m_vecOrigins[ i ], 1 );
+				m_flSpawnTimes[ i ] += 5.0f;
+			}
+			else
+				m_fFlags[ i ] |= NAILSIM_BUBBLECHECKED;
+		}
+
+		if( bRemove )
+			continue;
+
+		if( iKeep != i )
+		{
+			m_vecOrigins[ iKeep ] = m_vecOrigins[ i ];
+			m_vecVelocities[ iKeep ] = m_vecVelocities[ i ];
+			m_hOwners[ iKeep ] = m_hOwners[ i ];
+			m_hSources[ iKeep ] = m_hSources[ i ];
+			m_flDamages[ iKeep ] = m_flDamages[ i ];
+			m_flSpawnTimes[ iKeep ] = m_flSpawnTimes[ i ];
+			m_fFlags[ iKeep ] = m_fFlags[ i ];
+		}
+
+		iKeep++;
+	}
+
+	// nails fired while dealing out damage (by a script, say) go on the end
+	int nAdded = m_vecOrigins.Count() - nNails;
+	for( int i = 0; i < nAdded; i++ )
+	{
+		m_vecOrigins[ iKeep + i ] = m_vecOrigins[ nNails + i ];
+		m_vecVelocities[ iKeep + i ] = m_vecVelocities[ nNails + i ];
+		m_hOwners[ iKeep + i ] = m_hOwners[ nNails + i ];
+		m_hSources[ iKeep + i ] = m_hSources[ nNails + i ];
+		m_flDamages[ iKeep + i ] = m_flDamages[ nNails + i ];
+		m_flSpawnTimes[ iKeep + i ] = m_flSpawnTimes[ nNails + i ];
+		m_fFlags[ iKeep + i ] = m_fFlags[ nNails + i ];
+	}
+
+	int nCount = iKeep + nAdded;
+	m_vecOrigins.SetCount( nCount );
+	m_vecVelocities.SetCount( nCount );
+	m_hOwners.SetCount( nCount );
+	m_hSources.SetCount( nCount );
+	m_flDamages.SetCount( nCount );
+	m_flSpawnTimes.SetCount( nCount );
+	m_fFlags.SetCount( nCount );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Same as CFFProjectileNail::NailTouch
+/////////////////////////////////////////////////////////////////////////////
+bool CFFNailSimulator::Hit( int iNail, const trace_t &tr )
+{
+	CBaseEntity *pOther = tr.m_pEnt;
+
+	m_nHits++;
+
+	// This entity can take damage, so deal it out
+	if( pOther->m_takedamage != DAMAGE_NO )
+	{
+		Vector vecNormalizedVel = m_vecVelocities[ iNail ];
+		VectorNormalize( vecNormalizedVel );
+
+		int iDamageType = DMG_BULLET | DMG_NEVERGIB;
+		if( FF_IsAirshot( pOther ) )
+			iDamageType |= DMG_AIRSHOT;
+
+		// the weapon stands in for the nail in death notices (they used the
+		// nail's source classname anyway)
+		CBaseEntity *pOwner = m_hOwners[ iNail ].Get();
+		CBaseEntity *pInflictor = m_hSources[ iNail ].Get();
+		if( !pInflictor )
+			pInflictor = pOwner;
+
+		ClearMultiDamage();
+
+		CTakeDamageInfo dmgInfo( pInflictor, pOwner, m_flDamages[ iNail ], iDamageType );
+		CalculateBulletDamageForce( &dmgInfo, GetAmmoDef()->Index( "AMMO_NAILS" ), vecNormalizedVel, tr.endpos );
+		dmgInfo.SetDamagePosition( tr.endpos );
+
+		if( pOther->IsPlayer() )
+		{
+			dmgInfo.ScaleDamageForce( FF_NAIL_PUSHMULTIPLIER );
+		}
+		else if( ( pOther->Classify() == CLASS_SENTRYGUN ) && ( m_fFlags[ iNail ] & NAILSIM_NAILGRENADE ) )
+		{
+			// Modify the damage +- cvar value
+			dmgInfo.SetDamage( dmgInfo.GetDamage() + NAIL_SGMOD );
+		}
+
+		pOther->DispatchTraceAttack( dmgInfo, vecNormalizedVel, const_cast<trace_t *>( &tr ) );
+
+		ApplyMultiDamage();
+
+		// Keep going through the glass.
+		if( pOther->GetCollisionGroup() == COLLISION_GROUP_BREAKABLE_GLASS )
+			return false;
+
+		// Play body "thwack" sound
+		CPASAttenuationFilter filter( tr.endpos, "Nail.HitBody" );
+		CBaseEntity::EmitSound( filter, 0, "Nail.HitBody", &tr.endpos );
+	}
+
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+int CFFNailSimulator::TakeEmp( const Vector &vecOrigin, float flRadius, CUtlVector<Vector> &origins, CUtlVector<int> &damage )
+{
+	int nTaken = 0;
+
+	for( int i = m_vecOrigins.Count() - 1; i >= 0; i-- )
+	{
+		if( ( m_vecOrigins[ i ] - vecOrigin ).LengthSqr() > flRadius * flRadius )
+			continue;
+
+		origins.AddToTail( m_vecOrigins[ i ] );
+		damage.AddToTail( (int) m_flDamages[ i ] );
+
+		m_vecOrigins.Remove( i );
+		m_vecVelocities.Remove( i );
+		m_hOwners.Remove( i );
+		m_hSources.Remove( i );
+		m_flDamages.Remove( i );
+		m_flSpawnTimes.Remove( i );
+		m_fFlags.Remove( i );
+
+		nTaken++;
+	}
+
+	return nTaken;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFNailSimulator::PrintStats()
+{
+	Msg( "Nails since level start:\n" );
+	Msg( "  %d in flight, %d at most\n", m_vecOrigins.Count(), m_nMostNails );
+	Msg( "  %u fired, %u traces, %u hits\n", m_nNails, m_nTraces, m_nHits );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+CON_COMMAND( ff_nail_stats, "Shows how many nails have been simulated for the current level" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	_nailsim.PrintStats();
+}
@@ -0,0 +1,78 @@
+// ff_nailsim.h
+
+/////////////////////////////////////////////////////////////////////////////
+#ifndef FF_NAILSIM_H
+#define FF_NAILSIM_H
+
+/////////////////////////////////////////////////////////////////////////////
+// includes
+#ifndef UTLVECTOR_H
+	#include "utlvector.h"
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+// Nails fired by the nailgun and super nailgun, simulated without an
+// entity each. Clients already draw nails from the Projectile_Nail effect
+// sent when they're fired (the nail entities were never networked), so
+// all the server needs to keep is where each nail is, where it's going
+// and who fired it. Every tick all the nails are swept at once as a batch
+// of hull traces and whatever they hit gets the same damage the nail
+// entity's touch used to do.
+//
+// sv_nail_entities 1 goes back to a CFFProjectileNail per nail.
+/////////////////////////////////////////////////////////////////////////////
+class CFFNailSimulator
+{
+public:
+	// 'structors
+	CFFNailSimulator();
+	~CFFNailSimulator();
+
+public:
+	void Init();
+	void Shutdown();
+
+	// false if nails should be entities
+	bool IsEnabled() const;
+
+	void AddNail( CBaseEntity *pSource, const Vector &vecOrigin, const Vector &vecVelocity, CBaseEntity *pOwner, float flDamage, bool bNailGrenadeNail = false );
+
+	// moves every nail along, call once per tick
+	void Update();
+
+	// takes the nails within flRadius out of the simulation (emp), returns
+	// how many were removed and where they were
+	int TakeEmp( const Vector &vecOrigin, float flRadius, CUtlVector<Vector> &origins, CUtlVector<int> &damage );
+
+	int Count() const { return m_vecOrigins.Count(); }
+
+	void PrintStats();
+
+private:
+	// applies a nail's hit, returns false if it carries on
+	bool Hit( int iNail, const trace_t &tr );
+
+	void RemoveAll();
+
+private:
+	// one element per nail
+	CUtlVector<Vector>			m_vecOrigins;
+	CUtlVector<Vector>			m_vecVelocities;
+	CUtlVector<EHANDLE>			m_hOwners;
+	CUtlVector<EHANDLE>			m_hSources;		// weapon, used as the inflictor
+	CUtlVector<float>			m_flDamages;
+	CUtlVector<float>			m_flSpawnTimes;
+	CUtlVector<unsigned char>	m_fFlags;
+
+	// stats since the level started
+	unsigned int	m_nNails;
+	unsigned int	m_nTraces;
+	unsigned int	m_nHits;
+	int				m_nMostNails;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+extern CFFNailSimulator _nailsim;
+
+/////////////////////////////////////////////////////////////////////////////
+#endif
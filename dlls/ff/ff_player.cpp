@@ -37,6 +37,8 @@
 #include "client.h"
 #include "gib.h"
 #include "omnibot_interface.h"
+#include "ff_radiotagman.h"
+#include "tier0/vprof.h"
 #include "te_effect_dispatch.h"
 
 // added these so I could cast to check for grenades that are not derived from projectile base
@@ -83,10 +85,6 @@ int g_iLimbs[CLASS_CIVILIAN + 1][5] = { { 0 } };
 //ConVar ffdev_ic_selfdamagemultiplier("ffdev_ic_selfdamagemultiplier","0.45", FCVAR_FF_FFDEV_REPLICATED, "Self damage multipler for IC jumping");
 #define FFDEV_PYRO_IC_SELFDAMAGE_MULTIPLIER 0.45 //ffdev_ic_selfdamagemultiplier.GetFloat()
 
-// [integer] Max distance a player can be from us to be shown
-//static ConVar radiotag_distance( "ffdev_radiotag_distance", "1024" );
-#define RADIOTAG_DISTANCE 1024
-
 // [float] Time between radio tag updates
 //static ConVar radiotag_duration( "ffdev_radiotag_duration", "0.25" );
 #define RADIOTAG_DURATION 0.25f
@@ -252,12 +250,17 @@ void CC_Player_Kill( void )
 		// Bug #0000578: Suiciding using /kill doesn't cause a respawn delay
 		if( pPlayer->IsAlive() )
 		{
-			CFFLuaSC hPlayerOnKill;
-			hPlayerOnKill.Push(pPlayer);
-			if(_scriptman.RunPredicates_LUA( NULL, &hPlayerOnKill, "player_onkill" ))
+			bool bHasHook = _scriptman.HasGlobalHook( GLOBALHOOK_PLAYER_ONKILL );
+			_scriptman.CountGlobalHook( GLOBALHOOK_PLAYER_ONKILL, bHasHook );
+			if( bHasHook )
 			{
-				if(hPlayerOnKill.GetBool() == false)
-					return;
+				CFFLuaSC hPlayerOnKill;
+				hPlayerOnKill.Push(pPlayer);
+				if(_scriptman.RunPredicates_LUA( NULL, &hPlayerOnKill, "player_onkill" ))
+				{
+					if(hPlayerOnKill.GetBool() == false)
+						return;
+				}
 			}
 
 			pPlayer->SetRespawnDelay( 5.0f );
@@ -269,9 +272,14 @@ void CC_Player_Kill( void )
 			ClientKill( pPlayer->edict() );
 
 			// Call lua player_killed on suicides
-			CFFLuaSC hPlayerKilled;
-			hPlayerKilled.Push(pPlayer);
-			_scriptman.RunPredicates_LUA( NULL, &hPlayerKilled, "player_killed" );
+			bool bHasKilledHook = _scriptman.HasGlobalHook( GLOBALHOOK_PLAYER_KILLED );
+			_scriptman.CountGlobalHook( GLOBALHOOK_PLAYER_KILLED, bHasKilledHook );
+			if( bHasKilledHook )
+			{
+				CFFLuaSC hPlayerKilled;
+				hPlayerKilled.Push(pPlayer);
+				_scriptman.RunPredicates_LUA( NULL, &hPlayerKilled, "player_killed" );
+			}
 		}
 	}
 }
@@ -589,6 +597,8 @@ CFFPlayer::CFFPlayer()
 	m_flNextGas = 0;
 	m_flGasTime = 0;
 
+	WakeStatusEffects();
+
 	m_hActiveSlowfield = NULL;
 
 	m_Locations.Purge();
@@ -1042,58 +1052,72 @@ ReturnSpot:
 
 	CBaseEntity *pSpot = NULL, *pGibSpot = NULL, *pFirstSpot = NULL;
 
-	CUtlVector<CBaseEntity*> spawns;
-	spawns.EnsureCapacity( FFGameRules()->m_SpawnPoints.Count() );
-	spawns.CopyArray( FFGameRules()->m_SpawnPoints.Base(), FFGameRules()->m_SpawnPoints.Count() );
+	CFFGameRules *pRules = FFGameRules();
 
-	// loop until there are no more spawn points to loop through
-	while( spawns.Count() > 0 )
+	// If we got a spawn spot and we're spec, it's valid
+	if( GetTeamNumber() < TEAM_BLUE )
 	{
-		// pick a random number
-		int iRand = random->RandomInt(0, spawns.Count() - 1);
-
-		// let's check this random spot
-		pSpot = spawns[iRand];
-
-		// Jon: this is just for testing purposes
-		//Class_T classtype = pSpot->Classify();
-		//if (classtype != CLASS_TEAMSPAWN)
-		//	classtype = classtype;
+		if( pRules->m_SpawnPoints.Count() > 0 )
+		{
+			pSpot = pRules->m_SpawnPoints[ random->RandomInt( 0, pRules->m_SpawnPoints.Count() - 1 ) ];
+			if( pSpot )
+				goto ReturnSpot;
+		}
+	}
+	else
+	{
+		// Indices into the game rules' spawn points
+		CUtlVector<int> spawns;
+		spawns.SetCount( pRules->m_SpawnPoints.Count() );
+		for( int i = 0; i < spawns.Count(); i++ )
+			spawns[i] = i;
 
-		// as long as there's something to check, that is
-		if(pSpot)
+		// loop until there are no more spawn points to loop through
+		while( spawns.Count() > 0 )
 		{
-			// initialize the first spot
-			if (!pFirstSpot)
-			{
-				pFirstSpot = pSpot;
-				pGibSpot = pFirstSpot;
-			}
+			// pick a random number
+			int iRand = random->RandomInt(0, spawns.Count() - 1);
+			int iSpawn = spawns[iRand];
 
-			// If we got a spawn spot and we're spec, it's valid
-			if( GetTeamNumber() < TEAM_BLUE )
-			{
-				goto ReturnSpot;
-			}
+			// let's check this random spot
+			pSpot = pRules->m_SpawnPoints[iSpawn];
 
-			// is this spot valid according to the game rules?
-			if( FFGameRules()->IsSpawnPointValid( pSpot, ( CBasePlayer * )this ) )
+			// as long as there's something to check, that is
+			if(pSpot)
 			{
-				// See if the spot is clear
-				if( FFGameRules()->IsSpawnPointClear( pSpot, ( CBasePlayer * )this ) )
+				// initialize the first spot
+				if (!pFirstSpot)
 				{
-					goto ReturnSpot;
+					pFirstSpot = pSpot;
+					pGibSpot = pFirstSpot;
 				}
-				else
+
+				// is this spot valid according to the game rules? Players of
+				// the same team and class spawning this tick share the answer
+				if( pRules->IsSpawnPointValidCached( iSpawn, this ) )
 				{
-					// Not clear, so perhaps later we'll gib the guy here
-					pGibSpot = pSpot;
+					// Someone else already got this one this tick, no need to look
+					if( pRules->IsSpawnPointClaimed( iSpawn ) )
+					{
+						pGibSpot = pSpot;
+					}
+					// See if the spot is clear
+					else if( pRules->IsSpawnPointClear( pSpot, ( CBasePlayer * )this ) )
+					{
+						pRules->ClaimSpawnPoint( iSpawn );
+						goto ReturnSpot;
+					}
+					else
+					{
+						// Not clear, so perhaps later we'll gib the guy here
+						pGibSpot = pSpot;
+					}
 				}
 			}
-		}
 
-		// remove this spawn point from the list, reducing the count as well
-		spawns.FastRemove(iRand);
+			// remove this spawn point from the list, reducing the count as well
+			spawns.FastRemove(iRand);
+		}
 	}
 
 /*
@@ -1331,6 +1355,9 @@ void CFFPlayer::Spawn( void )
 	m_flSpeedModifierOld		= 1.0f;
 	m_flSpeedModifierChangeTime	= 0;
 
+	// Class and alive state may have changed, so look at everything again
+	WakeStatusEffects();
+
 	m_iActiveSabotages = 0;
 	m_iSabotagedSentries = 0;
 	m_iSabotagedDispensers = 0;
@@ -1360,9 +1387,14 @@ void CFFPlayer::Spawn( void )
 	Extinguish();
 	
 	//AfterShock - flaginfo on spawn (connect doesnt work)
-	CFFLuaSC hFlagInfo;
-	hFlagInfo.Push(this);
-	_scriptman.RunPredicates_LUA(NULL, &hFlagInfo, "flaginfo");
+	bool bHasHook = _scriptman.HasGlobalHook( GLOBALHOOK_FLAGINFO );
+	_scriptman.CountGlobalHook( GLOBALHOOK_FLAGINFO, bHasHook );
+	if( bHasHook )
+	{
+		CFFLuaSC hFlagInfo;
+		hFlagInfo.Push(this);
+		_scriptman.RunPredicates_LUA(NULL, &hFlagInfo, "flaginfo");
+	}
 
 	// Tried to spawn while unassigned (and not in a map guide)
 	// Bug #0001767 -- Improved camera stuff when speccing / changing teams / etc.
@@ -1484,8 +1516,13 @@ void CFFPlayer::Spawn( void )
 
 	// Run this after SetupClassVariables in case lua is
 	// manipulating the players' inventory
-	CFFLuaSC hPlayerSpawn( 1, this );
-	_scriptman.RunPredicates_LUA( NULL, &hPlayerSpawn, "player_spawn" );
+	bool bHasSpawnHook = _scriptman.HasGlobalHook( GLOBALHOOK_PLAYER_SPAWN );
+	_scriptman.CountGlobalHook( GLOBALHOOK_PLAYER_SPAWN, bHasSpawnHook );
+	if( bHasSpawnHook )
+	{
+		CFFLuaSC hPlayerSpawn( 1, this );
+		_scriptman.RunPredicates_LUA( NULL, &hPlayerSpawn, "player_spawn" );
+	}
 
 	//////////////////////////////////////////////////////////////////////////
 	while(true) // meh, cheat so i can use break;
@@ -1820,7 +1857,7 @@ void CFFPlayer::Command_SpySilentCloak( void )
 		while( pEnt != NULL )
 		{
 			// Tell the ent that it Cloaked
-			_scriptman.RunPredicates_LUA( pEnt, &hOwnerCloak, "onownercloak" );
+			_scriptman.RunPredicates_LUA( pEnt, &hOwnerCloak, LUAHOOK_ONOWNERCLOAK );
 
 			// Next!
 			pEnt = (CFFInfoScript*)gEntList.FindEntityByOwnerAndClassT( pEnt, ( CBaseEntity * )this, CLASS_INFOSCRIPT );
@@ -2547,9 +2584,14 @@ void CFFPlayer::ChangeClass(const char *szNewClassName)
 			KillAndRemoveItems();
 			if( bAlive && (GetClassSlot() != 0) )
 			{
-				CFFLuaSC hPlayerKilled;
-				hPlayerKilled.Push(this);
-				_scriptman.RunPredicates_LUA( NULL, &hPlayerKilled, "player_killed" );
+				bool bHasHook = _scriptman.HasGlobalHook( GLOBALHOOK_PLAYER_KILLED );
+				_scriptman.CountGlobalHook( GLOBALHOOK_PLAYER_KILLED, bHasHook );
+				if( bHasHook )
+				{
+					CFFLuaSC hPlayerKilled;
+					hPlayerKilled.Push(this);
+					_scriptman.RunPredicates_LUA( NULL, &hPlayerKilled, "player_killed" );
+				}
 			}
 		}
 
@@ -2641,9 +2683,14 @@ void CFFPlayer::ChangeClass(const char *szNewClassName)
 
 		if( bAlive && (GetClassSlot() != 0) )
 		{
-			CFFLuaSC hPlayerKilled;
-			hPlayerKilled.Push(this);
-			_scriptman.RunPredicates_LUA( NULL, &hPlayerKilled, "player_killed" );
+			bool bHasHook = _scriptman.HasGlobalHook( GLOBALHOOK_PLAYER_KILLED );
+			_scriptman.CountGlobalHook( GLOBALHOOK_PLAYER_KILLED, bHasHook );
+			if( bHasHook )
+			{
+				CFFLuaSC hPlayerKilled;
+				hPlayerKilled.Push(this);
+				_scriptman.RunPredicates_LUA( NULL, &hPlayerKilled, "player_killed" );
+			}
 		}		
 
 		// Should call ActivateClass right afterwards too, since otherwise they might
@@ -2814,9 +2861,14 @@ void CFFPlayer::Command_Team( void )
 		KillPlayer();
 
 		// This isn't called when you changeteams
-		CFFLuaSC hPlayerKilled;
-		hPlayerKilled.Push(this);
-		_scriptman.RunPredicates_LUA( NULL, &hPlayerKilled, "player_killed" );
+		bool bHasHook = _scriptman.HasGlobalHook( GLOBALHOOK_PLAYER_KILLED );
+		_scriptman.CountGlobalHook( GLOBALHOOK_PLAYER_KILLED, bHasHook );
+		if( bHasHook )
+		{
+			CFFLuaSC hPlayerKilled;
+			hPlayerKilled.Push(this);
+			_scriptman.RunPredicates_LUA( NULL, &hPlayerKilled, "player_killed" );
+		}
 	}
 	
 	// drop my damage contributions on any assists right away
@@ -3019,66 +3071,9 @@ void CFFPlayer::UnlockPlayer( void )
 
 void CFFPlayer::FindRadioTaggedPlayers( void )
 {
-	if( !m_hRadioTagData.Get() )
-		return;
-
-	// Reset stuff back to zero
-	m_hRadioTagData->ClearVisible();
-
-	// Get client count
-	int iMaxClients = gpGlobals->maxClients;
-
-	// If we're the only ones we don't care
-	if( iMaxClients < 2 )
-		return;	
-
-	// My origin
-	Vector vecOrigin = GetFeetOrigin();
-
-	// Loop through doing stuff on each player
-	for( int i = 1; i <= iMaxClients; i++ )
-	{
-		CFFPlayer *pPlayer = ToFFPlayer( UTIL_PlayerByIndex( i ) );
-		
-		if( !pPlayer )
-			continue;		
-
-		// Skip if not a player
-		if( !pPlayer->IsPlayer() )
-			continue;
-
-		// Skip if spec
-		if( pPlayer->IsObserver() || FF_IsPlayerSpec( pPlayer ) )
-			continue;
-
-		// Skip if us
-		if( pPlayer == this )
-			continue;
-
-		// Skip if not tagged
-		if( !pPlayer->IsRadioTagged() )
-			continue;
-
-		// Bug #0000517: Enemies see radio tag.
-		// Only want to show players whom people on our team have tagged or
-		// players whom allies have tagged
-		if( g_pGameRules->PlayerRelationship( this, ToFFPlayer( pPlayer->GetPlayerWhoTaggedMe() ) ) != GR_TEAMMATE )
-			continue;
-
-		// Get their origin
-		Vector vecPlayerOrigin = pPlayer->GetFeetOrigin();
-
-		// Skip if they're out of range
-		if( vecOrigin.DistTo( vecPlayerOrigin ) > RADIOTAG_DISTANCE )
-			continue;
-
-		// We're left w/ a player who's within range
-		// Add player to a list and send off to client
-
-		m_hRadioTagData->Set( pPlayer->entindex(), true, pPlayer->GetClassSlot(), pPlayer->GetTeamNumber(), !!( pPlayer->GetFlags() & FL_DUCKING ), vecPlayerOrigin );
-
-		Omnibot::Notify_RadioTagUpdate(this, pPlayer);	
-	}
+	// Everyone's tagged players are found together, the first time
+	// this is called each tick
+	_radiotagman.Update();
 }
 
 void CFFPlayer::Command_WhatTeam( void )
@@ -3698,6 +3693,11 @@ void CFFPlayer::PostBuildGenericThink( void )
 */
 void CFFPlayer::Command_FlagInfo( void )
 {	
+	bool bHasHook = _scriptman.HasGlobalHook( GLOBALHOOK_FLAGINFO );
+	_scriptman.CountGlobalHook( GLOBALHOOK_FLAGINFO, bHasHook );
+	if( !bHasHook )
+		return;
+
 	CFFLuaSC hFlagInfo( 1, this );
 	_scriptman.RunPredicates_LUA(NULL, &hFlagInfo, "flaginfo");
 }
@@ -3716,7 +3716,7 @@ void CFFPlayer::Command_DropItems( void )
 		if( pEnt->GetOwnerEntity() == ( CBaseEntity * )this )
 		{
 			// If the function exists, try and drop
-			_scriptman.RunPredicates_LUA( pEnt, &hDropItemCmd, "dropitemcmd" );
+			_scriptman.RunPredicates_LUA( pEnt, &hDropItemCmd, LUAHOOK_DROPITEMCMD );
 				//pEnt->Drop(30.0f, 500.0f);
 		}
 
@@ -3836,265 +3836,391 @@ void CFFPlayer::Command_Discard( void )
 	}
 }
 
+// status effect checks since the level started
+static int			s_iStatusEffectStatsTick = INT_MAX;
+static unsigned int	s_nStatusEffectThinks = 0;
+static unsigned int	s_nStatusEffectEvaluations = 0;
+static unsigned int	s_nStatusEffectPolls = 0;		// checks if everything was checked every think
+
 void CFFPlayer::StatusEffectsThink( void )
 {
-	if( m_bGassed )
+	VPROF_BUDGET( "CFFPlayer::StatusEffectsThink", VPROF_BUDGETGROUP_GAME );
+
+	if( gpGlobals->tickcount < s_iStatusEffectStatsTick )
 	{
-		if(m_flGasTime > gpGlobals->curtime)
+		// new level
+		s_iStatusEffectStatsTick = gpGlobals->tickcount;
+		s_nStatusEffectThinks = 0;
+		s_nStatusEffectEvaluations = 0;
+		s_nStatusEffectPolls = 0;
+	}
+
+	s_nStatusEffectThinks++;
+	s_nStatusEffectPolls += SED_COUNT;
+
+	// If we jump in water up to waist level, extinguish ourselves
+	if (GetBurnLevel() > 0 && GetWaterLevel() >= WL_Waist)
+		Extinguish();
+
+	// Health can go over max from all over the place, so keep an eye out
+	if( m_iHealth > m_iMaxHealth && m_flStatusDeadlines[ SED_OVERHEALTH ] == FLT_MAX )
+		ScheduleStatusEffect( SED_OVERHEALTH, m_flLastOverHealthTick + FFDEV_OVERHEALTH_FREQ );
+
+	// Nothing due yet
+	if( gpGlobals->curtime < m_flNextStatusDeadline )
+		return;
+
+	int nEvaluations = 0;
+
+	if( IsStatusEffectDue( SED_GAS ) )
+	{
+		nEvaluations++;
+
+		if( m_bGassed )
 		{
-			if(m_flNextGas < gpGlobals->curtime)
+			if(m_flGasTime > gpGlobals->curtime)
 			{
-				CFFPlayer *pGasser = GetGasser();
-				if( pGasser )
+				if(m_flNextGas < gpGlobals->curtime)
 				{
-					CTakeDamageInfo info(pGasser, pGasser, vec3_origin, GetAbsOrigin(), 1.0f, DMG_DIRECT);
-					info.SetCustomKill(KILLTYPE_GASSED);
+					CFFPlayer *pGasser = GetGasser();
+					if( pGasser )
+					{
+						CTakeDamageInfo info(pGasser, pGasser, vec3_origin, GetAbsOrigin(), 1.0f, DMG_DIRECT);
+						info.SetCustomKill(KILLTYPE_GASSED);
 
-					TakeDamage(info);
-				}
-				else //must be lua set...
-				{
-					CTakeDamageInfo info(this, this, vec3_origin, GetAbsOrigin(), 1.0f, DMG_DIRECT);
-					info.SetCustomKill(KILLTYPE_GASSED);
+						TakeDamage(info);
+					}
+					else //must be lua set...
+					{
+						CTakeDamageInfo info(this, this, vec3_origin, GetAbsOrigin(), 1.0f, DMG_DIRECT);
+						info.SetCustomKill(KILLTYPE_GASSED);
 
-					TakeDamage(info);
-				}
+						TakeDamage(info);
+					}
 
-				CSingleUserRecipientFilter user( ( CBasePlayer * )this );
-				user.MakeReliable();
-				UserMessageBegin( user, "FFViewEffect" );
-					WRITE_BYTE( FF_VIEWEFFECT_GASSED );
-					// Jiggles: Changed from 6 to 2.5 to better match the 10 sec gas duration (Mantis: 0001222)
-					WRITE_FLOAT( 2.5f );
-				MessageEnd();
+					CSingleUserRecipientFilter user( ( CBasePlayer * )this );
+					user.MakeReliable();
+					UserMessageBegin( user, "FFViewEffect" );
+						WRITE_BYTE( FF_VIEWEFFECT_GASSED );
+						// Jiggles: Changed from 6 to 2.5 to better match the 10 sec gas duration (Mantis: 0001222)
+						WRITE_FLOAT( 2.5f );
+					MessageEnd();
 
-				m_flNextGas = gpGlobals->curtime + 1.0f;
+					m_flNextGas = gpGlobals->curtime + 1.0f;
+				}
+			}
+			else
+			{
+				UnGas();
 			}
 		}
-		else
-		{
-			UnGas();
-		}
+
+		ScheduleStatusEffect( SED_GAS, m_bGassed ? min( m_flNextGas, m_flGasTime ) : FLT_MAX );
 	}
 
-	if (m_bSliding)
+	if( IsStatusEffectDue( SED_SLIDING ) )
 	{
-		if (m_flSlidingTime <= gpGlobals->curtime)
+		nEvaluations++;
+
+		if (m_bSliding)
 		{
-			StopSliding();
+			if (m_flSlidingTime <= gpGlobals->curtime)
+			{
+				StopSliding();
+			}
 		}
-	}
 
-	// If we jump in water up to waist level, extinguish ourselves
-	if (GetBurnLevel() > 0 && GetWaterLevel() >= WL_Waist)
-		Extinguish();
+		ScheduleStatusEffect( SED_SLIDING, m_bSliding ? m_flSlidingTime : FLT_MAX );
+	}
 
 	// check if the player needs a little health/armor (because they are a medic/engy)
-	if ( IsAlive() ) // AfterShock: possible fix for medic crouch bug? Regen health the same tick you die?
+	if( IsStatusEffectDue( SED_REGEN ) )
 	{
-		if( ( ( GetClassSlot() == CLASS_MEDIC ) || ( GetClassSlot() == CLASS_ENGINEER ) ) &&
-			( gpGlobals->curtime > ( m_fLastHealTick + FFDEV_REGEN_FREQ ) ) )
-		{		
-			m_fLastHealTick = gpGlobals->curtime;
+		nEvaluations++;
 
-			if( GetClassSlot() == CLASS_MEDIC )
-			{
-				// add the regen health
-				// Don't call CFFPlayer::TakeHealth as it will clear status effects
-				// Bug #0000528: Medics can self-cure being caltropped/tranq'ed
-				if( BaseClass::TakeHealth( FFDEV_REGEN_HEALTH, DMG_GENERIC ) )			
-				//if( TakeHealth( ffdev_regen_health.GetInt(), DMG_GENERIC ) )
-				{				
-					// make a sound if we did
-					//EmitSound( "medkit.hit" );
-				}
+		if ( IsAlive() ) // AfterShock: possible fix for medic crouch bug? Regen health the same tick you die?
+		{
+			if( ( ( GetClassSlot() == CLASS_MEDIC ) || ( GetClassSlot() == CLASS_ENGINEER ) ) &&
+				( gpGlobals->curtime > ( m_fLastHealTick + FFDEV_REGEN_FREQ ) ) )
+			{		
+				m_fLastHealTick = gpGlobals->curtime;
 
-				// Give te medic some cells to generate health packs with...!
-				GiveAmmo(5, AMMO_CELLS, true);
-			}
-			else if( GetClassSlot() == CLASS_ENGINEER )
-			{
-				// add the regen armor
-				m_iArmor.GetForModify() = clamp( m_iArmor + FFDEV_REGEN_ARMOR, 0, m_iMaxArmor );
+				if( GetClassSlot() == CLASS_MEDIC )
+				{
+					// add the regen health
+					// Don't call CFFPlayer::TakeHealth as it will clear status effects
+					// Bug #0000528: Medics can self-cure being caltropped/tranq'ed
+					if( BaseClass::TakeHealth( FFDEV_REGEN_HEALTH, DMG_GENERIC ) )			
+					//if( TakeHealth( ffdev_regen_health.GetInt(), DMG_GENERIC ) )
+					{				
+						// make a sound if we did
+						//EmitSound( "medkit.hit" );
+					}
+
+					// Give te medic some cells to generate health packs with...!
+					GiveAmmo(5, AMMO_CELLS, true);
+				}
+				else if( GetClassSlot() == CLASS_ENGINEER )
+				{
+					// add the regen armor
+					m_iArmor.GetForModify() = clamp( m_iArmor + FFDEV_REGEN_ARMOR, 0, m_iMaxArmor );
+				}
 			}
 		}
+
+		// Spawning wakes this up again
+		bool bRegen = IsAlive() && ( ( GetClassSlot() == CLASS_MEDIC ) || ( GetClassSlot() == CLASS_ENGINEER ) );
+		ScheduleStatusEffect( SED_REGEN, bRegen ? m_fLastHealTick + FFDEV_REGEN_FREQ : FLT_MAX );
 	}
 
 	// Bug #0000485: If you're given beyond 100% health, by a medic, the health doesn't count down back to 100.
 	// Reduce health if we're over healthed (health > maxhealth
-	if( m_iHealth > m_iMaxHealth )
+	if( IsStatusEffectDue( SED_OVERHEALTH ) )
 	{
-		if( gpGlobals->curtime > ( m_flLastOverHealthTick + FFDEV_OVERHEALTH_FREQ ) )
+		nEvaluations++;
+
+		if( m_iHealth > m_iMaxHealth )
 		{
-			m_flLastOverHealthTick = gpGlobals->curtime;
-			m_iHealth = max( m_iHealth - FFDEV_REGEN_HEALTH, m_iMaxHealth );
+			if( gpGlobals->curtime > ( m_flLastOverHealthTick + FFDEV_OVERHEALTH_FREQ ) )
+			{
+				m_flLastOverHealthTick = gpGlobals->curtime;
+				m_iHealth = max( m_iHealth - FFDEV_REGEN_HEALTH, m_iMaxHealth );
+			}
 		}
+
+		ScheduleStatusEffect( SED_OVERHEALTH, ( m_iHealth > m_iMaxHealth ) ? m_flLastOverHealthTick + FFDEV_OVERHEALTH_FREQ : FLT_MAX );
 	}
 
 	// If the player is infected, then take appropriate action
-	if( IsInfected() && ( gpGlobals->curtime > ( m_fLastInfectedTick + FFDEV_INFECT_FREQ ) ) )
+	if( IsStatusEffectDue( SED_INFECTION ) )
 	{
-		bool bIsInfected = true;
+		nEvaluations++;
 
-		// Need to check to see if the medic who infected us has changed teams
-		// or dropped - switching to EHANDLE will handle the drop case
-		if( m_hInfector )
+		if( IsInfected() && ( gpGlobals->curtime > ( m_fLastInfectedTick + FFDEV_INFECT_FREQ ) ) )
 		{
-			CFFPlayer *pInfector = ToFFPlayer( m_hInfector );
+			bool bIsInfected = true;
+
+			// Need to check to see if the medic who infected us has changed teams
+			// or dropped - switching to EHANDLE will handle the drop case
+			if( m_hInfector )
+			{
+				CFFPlayer *pInfector = ToFFPlayer( m_hInfector );
 			
-			// dexter - reworked this a lil and removed the assert
-			//AssertMsg( pInfector, "[Infect] pInfector == NULL\n" );
-			if( pInfector )
-			{				
-				// Medic changed teams / switched class				
-				if( pInfector->GetTeamNumber() != m_iInfectedTeam || !pInfector->GetClassSlot() || pInfector->GetClassSlot() != CLASS_MEDIC )
+				// dexter - reworked this a lil and removed the assert
+				//AssertMsg( pInfector, "[Infect] pInfector == NULL\n" );
+				if( pInfector )
+				{				
+					// Medic changed teams / switched class				
+					if( pInfector->GetTeamNumber() != m_iInfectedTeam || !pInfector->GetClassSlot() || pInfector->GetClassSlot() != CLASS_MEDIC )
+					{
+						//DevMsg("Removing infection from %s because infector %s changed class or team\n", this->m_szNetname, pInfector->m_szNetname);
+						m_bInfected = false;
+					}
+				}
+				else
 				{
-					//DevMsg("Removing infection from %s because infector %s changed class or team\n", this->m_szNetname, pInfector->m_szNetname);
+					// dexter - this is a ghetto catch all incase the EHANDLE is good but isnt CFFPlayer (how the fuck)
 					m_bInfected = false;
 				}
 			}
 			else
 			{
-				// dexter - this is a ghetto catch all incase the EHANDLE is good but isnt CFFPlayer (how the fuck)
+				// Player dropped
 				m_bInfected = false;
 			}
-		}
-		else
-		{
-			// Player dropped
-			m_bInfected = false;
-		}
 
-		if( m_iInfectTick >= FFDEV_INFECT_NUMTICKS )// GreenMushy: check to see if the infection should end
-		{
-			//Will heal for the correct amount
-			Cure( NULL );
-		}
+			if( m_iInfectTick >= FFDEV_INFECT_NUMTICKS )// GreenMushy: check to see if the infection should end
+			{
+				//Will heal for the correct amount
+				Cure( NULL );
+			}
 
-		// If we were infected but just became uninfected,
-		// remove hud effect
-		if( bIsInfected && !m_bInfected )
-		{
-			CSingleUserRecipientFilter user( ( CBasePlayer * )this );
-			user.MakeReliable();
-			UserMessageBegin( user, "FFViewEffect" );
-				WRITE_BYTE( FF_VIEWEFFECT_INFECTED );
-				WRITE_FLOAT( 0.0f );
-			MessageEnd(); 
-		}
+			// If we were infected but just became uninfected,
+			// remove hud effect
+			if( bIsInfected && !m_bInfected )
+			{
+				CSingleUserRecipientFilter user( ( CBasePlayer * )this );
+				user.MakeReliable();
+				UserMessageBegin( user, "FFViewEffect" );
+					WRITE_BYTE( FF_VIEWEFFECT_INFECTED );
+					WRITE_FLOAT( 0.0f );
+				MessageEnd(); 
+			}
 
-		// If we're still infected, cause damage
-		if (IsInfected() && IsAlive())	// |-- Mirv: Bug #0000461: Infect sound plays eventhough you are dead
-		{
-			CFFPlayer *pInfector = ToFFPlayer( m_hInfector );
+			// If we're still infected, cause damage
+			if (IsInfected() && IsAlive())	// |-- Mirv: Bug #0000461: Infect sound plays eventhough you are dead
+			{
+				CFFPlayer *pInfector = ToFFPlayer( m_hInfector );
 
-			// When you change this be sure to change the StopSound above ^^ for bug
+				// When you change this be sure to change the StopSound above ^^ for bug
 			
-			EmitSound( "Player.DrownContinue" );	// |-- Mirv: [TODO] Change to something more suitable
-			m_fLastInfectedTick = gpGlobals->curtime;
-			m_iInfectTick++;
+				EmitSound( "Player.DrownContinue" );	// |-- Mirv: [TODO] Change to something more suitable
+				m_fLastInfectedTick = gpGlobals->curtime;
+				m_iInfectTick++;
 
-			int iInfectDamage = m_fNextInfectedTickDamage;
-			// if infect damage will kill, then bring the player to 1hp instead
-			iInfectDamage = min(iInfectDamage, GetHealth() - 1);
+				int iInfectDamage = m_fNextInfectedTickDamage;
+				// if infect damage will kill, then bring the player to 1hp instead
+				iInfectDamage = min(iInfectDamage, GetHealth() - 1);
 
-			// calc next tick's damage
-			// multiply tick damage by the mult, raise to the power of the exp, and round to the nearest whole number
-			m_fNextInfectedTickDamage = (int)(pow(m_fNextInfectedTickDamage * FFDEV_INFECT_DAMAGEPERTICK_MULT, FFDEV_INFECT_DAMAGEPERTICK_EXP) + 0.5f);
+				// calc next tick's damage
+				// multiply tick damage by the mult, raise to the power of the exp, and round to the nearest whole number
+				m_fNextInfectedTickDamage = (int)(pow(m_fNextInfectedTickDamage * FFDEV_INFECT_DAMAGEPERTICK_MULT, FFDEV_INFECT_DAMAGEPERTICK_EXP) + 0.5f);
 
-			m_nNumInfectDamage += iInfectDamage;
+				m_nNumInfectDamage += iInfectDamage;
 
-			//Msg("Damage done: %d Tick: %d Total damage done: %d\n", iInfectDamage, m_iInfectTick, m_nNumInfectDamage);
+				//Msg("Damage done: %d Tick: %d Total damage done: %d\n", iInfectDamage, m_iInfectTick, m_nNumInfectDamage);
 
-			CTakeDamageInfo info( pInfector, pInfector, iInfectDamage, DMG_POISON );
-			info.SetCustomKill(KILLTYPE_INFECTION);
-			info.SetDamagePosition( GetAbsOrigin() );
-			TakeDamage( info );
+				CTakeDamageInfo info( pInfector, pInfector, iInfectDamage, DMG_POISON );
+				info.SetCustomKill(KILLTYPE_INFECTION);
+				info.SetDamagePosition( GetAbsOrigin() );
+				TakeDamage( info );
 
-			CSingleUserRecipientFilter user((CBasePlayer *)this);
-			user.MakeReliable();
-			UserMessageBegin(user, "StatusIconUpdate");
-				WRITE_BYTE(FF_STATUSICON_INFECTION);
-				WRITE_FLOAT(2.0f);
-			MessageEnd(); 
-
-			/*
-			// Bug #0000504: No infection visible effect
-			CEffectData data;
-			data.m_vOrigin = GetAbsOrigin() - Vector( 0, 0, 16.0f );
-			data.m_vStart = GetAbsVelocity();
-			data.m_flScale = 1.0f;
-			DispatchEffect( "FF_InfectionEffect", data );
-
-			CEffectData data2;
-			data2.m_vOrigin = EyePosition() - Vector( 0, 0, 16.0f );
-			data2.m_vStart = GetAbsVelocity();
-			data2.m_flScale = 1.0f;			
-			DispatchEffect( "FF_InfectionEffect", data2 );
-			*/
-
-			// Removing friendly infection spreading to stop laming on servers -> Defrag
-
-			/*
-			CBaseEntity *ent = NULL;
-
-			// Infect anybody nearby
-			for( CEntitySphereQuery sphere( GetAbsOrigin(), 128 ); ( ent = sphere.GetCurrentEntity() ) != NULL; sphere.NextEntity() )
-			{
-				if( ent->IsPlayer() )
+				CSingleUserRecipientFilter user((CBasePlayer *)this);
+				user.MakeReliable();
+				UserMessageBegin(user, "StatusIconUpdate");
+					WRITE_BYTE(FF_STATUSICON_INFECTION);
+					WRITE_FLOAT(2.0f);
+				MessageEnd(); 
+
+				/*
+				// Bug #0000504: No infection visible effect
+				CEffectData data;
+				data.m_vOrigin = GetAbsOrigin() - Vector( 0, 0, 16.0f );
+				data.m_vStart = GetAbsVelocity();
+				data.m_flScale = 1.0f;
+				DispatchEffect( "FF_InfectionEffect", data );
+
+				CEffectData data2;
+				data2.m_vOrigin = EyePosition() - Vector( 0, 0, 16.0f );
+				data2.m_vStart = GetAbsVelocity();
+				data2.m_flScale = 1.0f;			
+				DispatchEffect( "FF_InfectionEffect", data2 );
+				*/
+
+				// Removing friendly infection spreading to stop laming on servers -> Defrag
+
+				/*
+				CBaseEntity *ent = NULL;
+
+				// Infect anybody nearby
+				for( CEntitySphereQuery sphere( GetAbsOrigin(), 128 ); ( ent = sphere.GetCurrentEntity() ) != NULL; sphere.NextEntity() )
 				{
-					CFFPlayer *player = ToFFPlayer( ent );
-
-					if( player && ( player != this ) && player->IsAlive() )
+					if( ent->IsPlayer() )
 					{
-						trace_t traceHit;
-						UTIL_TraceLine( GetAbsOrigin(), player->GetAbsOrigin(), MASK_SOLID_BRUSHONLY, this, COLLISION_GROUP_DEBRIS, &traceHit );
+						CFFPlayer *player = ToFFPlayer( ent );
 
-						if( traceHit.fraction != 1.0f )
-							continue;
+						if( player && ( player != this ) && player->IsAlive() )
+						{
+							trace_t traceHit;
+							UTIL_TraceLine( GetAbsOrigin(), player->GetAbsOrigin(), MASK_SOLID_BRUSHONLY, this, COLLISION_GROUP_DEBRIS, &traceHit );
+
+							if( traceHit.fraction != 1.0f )
+								continue;
 
-						if( player->GetClassSlot() == CLASS_MEDIC )
-							continue;
+							if( player->GetClassSlot() == CLASS_MEDIC )
+								continue;
 
-						// Bug #0000468: Infections transmit to non-teammates
-						//if( player->GetTeamNumber() != GetTeamNumber() )
-						// Changed to allow infections across allies
-						if( g_pGameRules->PlayerRelationship( this, player ) == GR_NOTTEAMMATE )
-							continue;
+							// Bug #0000468: Infections transmit to non-teammates
+							//if( player->GetTeamNumber() != GetTeamNumber() )
+							// Changed to allow infections across allies
+							if( g_pGameRules->PlayerRelationship( this, player ) == GR_NOTTEAMMATE )
+								continue;
 
-						// Infect this guy
-						player->Infect( pInfector );
+							// Infect this guy
+							player->Infect( pInfector );
+						}
 					}
 				}
+				*/
 			}
-			*/
 		}
+
+		ScheduleStatusEffect( SED_INFECTION, IsInfected() ? m_fLastInfectedTick + FFDEV_INFECT_FREQ : FLT_MAX );
 	}
 
 	// check if any speed effects are over
-	bool recalcspeed = false;
-	for (int i=0; i<NUM_SPEED_EFFECTS; i++)
+	if( IsStatusEffectDue( SED_SPEEDEFFECTS ) )
 	{
-		if (m_vSpeedEffects[i].active && ( m_vSpeedEffects[i].endTime < gpGlobals->curtime ) && ( m_vSpeedEffects[i].duration != -1 ) )
+		nEvaluations++;
+
+		bool recalcspeed = false;
+		float flNextEnd = FLT_MAX;
+		for (int i=0; i<NUM_SPEED_EFFECTS; i++)
 		{
-			RemoveSpeedEffectByIndex( i );
-			recalcspeed = true;
+			if (m_vSpeedEffects[i].active && ( m_vSpeedEffects[i].endTime < gpGlobals->curtime ) && ( m_vSpeedEffects[i].duration != -1 ) )
+			{
+				RemoveSpeedEffectByIndex( i );
+				recalcspeed = true;
+			}
+			else if( m_vSpeedEffects[i].active && ( m_vSpeedEffects[i].duration != -1 ) )
+				flNextEnd = min( flNextEnd, m_vSpeedEffects[i].endTime );
 		}
-	}
 
-	// we might need to actually set their speed
-	if (recalcspeed)
-		RecalculateSpeed();
+		// we might need to actually set their speed
+		if (recalcspeed)
+			RecalculateSpeed();
+
+		ScheduleStatusEffect( SED_SPEEDEFFECTS, flNextEnd );
+	}
 
 	// Bug #0000503: "Immunity" is not in the mod
 	// See if immunity has worn off
-	if( IsImmune() )
+	if( IsStatusEffectDue( SED_IMMUNITY ) )
 	{
-		// TODO: Dispatch immune effect!
+		nEvaluations++;
+
+		if( IsImmune() )
+		{
+			// TODO: Dispatch immune effect!
+
+			if( gpGlobals->curtime > m_flImmuneTime )
+				m_bImmune = false;
+		}
 
-		if( gpGlobals->curtime > m_flImmuneTime )
-			m_bImmune = false;
+		ScheduleStatusEffect( SED_IMMUNITY, IsImmune() ? m_flImmuneTime : FLT_MAX );
 	}
+
+	s_nStatusEffectEvaluations += nEvaluations;
+	VPROF_INCREMENT_COUNTER( "Status effects evaluated", nEvaluations );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Sets when a status effect next needs checking
+//-----------------------------------------------------------------------------
+void CFFPlayer::ScheduleStatusEffect( int iDeadline, float flTime )
+{
+	m_flStatusDeadlines[ iDeadline ] = flTime;
+
+	m_flNextStatusDeadline = FLT_MAX;
+	for( int i = 0; i < SED_COUNT; i++ )
+		m_flNextStatusDeadline = min( m_flNextStatusDeadline, m_flStatusDeadlines[ i ] );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Check every status effect on the next think
+//-----------------------------------------------------------------------------
+void CFFPlayer::WakeStatusEffects( void )
+{
+	for( int i = 0; i < SED_COUNT; i++ )
+		m_flStatusDeadlines[ i ] = 0.0f;
+
+	m_flNextStatusDeadline = 0.0f;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Shows how many status effects were looked at compared with
+//			checking all of them on every think
+//-----------------------------------------------------------------------------
+CON_COMMAND( ff_statuseffect_stats, "Shows how many status effect checks were done for the current level" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nTicks = max( gpGlobals->tickcount - s_iStatusEffectStatsTick, 1 );
+
+	Msg( "Status effects since level start (%d ticks):\n", nTicks );
+	Msg( "  %u thinks, %u checks (%.2f per tick)\n", s_nStatusEffectThinks, s_nStatusEffectEvaluations, (float) s_nStatusEffectEvaluations / nTicks );
+	Msg( "  checking everything every think would have been %u checks (%.2f per tick)\n", s_nStatusEffectPolls, (float) s_nStatusEffectPolls / nTicks );
 }
 
 //-----------------------------------------------------------------------------
@@ -4264,6 +4390,9 @@ void CFFPlayer::AddSpeedEffect(SpeedEffectType type, float duration, float speed
 	m_vSpeedEffects[i].modifiers = mod;
 	m_vSpeedEffects[i].bLuaEnforced = bLuaAdded;
 
+	if( duration != -1 )
+		ScheduleStatusEffect( SED_SPEEDEFFECTS, min( m_flStatusDeadlines[ SED_SPEEDEFFECTS ], m_vSpeedEffects[i].endTime ) );
+
 	if( iIcon != -1 )
 	{
 		CSingleUserRecipientFilter user( ( CBasePlayer * )this );
@@ -4579,6 +4708,7 @@ bool CFFPlayer::Infect( CFFPlayer *pInfector )
 		m_iInfectTick = 0;
 		m_fLastInfectedTick = gpGlobals->curtime;
 		m_fNextInfectedTickDamage = FFDEV_INFECT_DAMAGE;
+		ScheduleStatusEffect( SED_INFECTION, m_fLastInfectedTick + FFDEV_INFECT_FREQ );
 		m_nNumInfectDamage = 0;
 		m_hInfector = pInfector;
 		m_iInfectedTeam = pInfector->GetTeamNumber();
@@ -4619,6 +4749,7 @@ bool CFFPlayer::Cure( CFFPlayer *pCurer )
 		// Bug# 0000503: "Immunity" is not in the mod
 		m_bImmune = true;
 		m_flImmuneTime = gpGlobals->curtime + FFDEV_IMMUNE_TIME;
+		ScheduleStatusEffect( SED_IMMUNITY, m_flImmuneTime );
 		m_iInfectTick = 0;
 
 		// Send the status icon to the player
@@ -5192,10 +5323,15 @@ int CFFPlayer::OnTakeDamage(const CTakeDamageInfo &inputInfo)
 		return 0;
 
 	// call script: player_ondamage(player, damageinfo)	
-	CFFLuaSC func;
-	func.Push(this);
-	func.PushRef(info);
-	func.CallFunction("player_ondamage");
+	bool bHasHook = _scriptman.HasGlobalHook( GLOBALHOOK_PLAYER_ONDAMAGE );
+	_scriptman.CountGlobalHook( GLOBALHOOK_PLAYER_ONDAMAGE, bHasHook );
+	if( bHasHook )
+	{
+		CFFLuaSC func;
+		func.Push(this);
+		func.PushRef(info);
+		func.CallFunction("player_ondamage");
+	}
 
 	// Bug #0000781: Placing a detpack can be interrupted
 	if( !m_bStaticBuilding )
@@ -5918,6 +6054,8 @@ void CFFPlayer::Gas( float flDuration, float flIconDuration, CFFPlayer *pGasser)
 	else
 		m_flGasTime = gpGlobals->curtime + 99999.0f;//this should last a while.
 
+	ScheduleStatusEffect( SED_GAS, min( m_flNextGas, m_flGasTime ) );
+
 	// Send status icon
 	CSingleUserRecipientFilter user( ( CBasePlayer * )this );
 	user.MakeReliable();
@@ -5965,6 +6103,8 @@ void CFFPlayer::StartSliding( float flDuration, float flIconDuration )
 	else
 		m_flSlidingTime = gpGlobals->curtime + 99999.0f;//this should last a while.
 
+	ScheduleStatusEffect( SED_SLIDING, m_flSlidingTime );
+
 	// Send status icon
 	CSingleUserRecipientFilter user( ( CBasePlayer * )this );
 	user.MakeReliable();
@@ -6887,7 +7027,7 @@ bool CFFPlayer::IsInNoBuild(const CFFBuildableInfo &hBuildInfo)
 		luatblInfo["fusetime"] = m_iDetpackTime;
 	}
 	// CFFLuaSC constructor assumes all args are CBaseEntity*, so push the table separately
-	CFFLuaSC hContext = CFFLuaSC(1, (CBaseEntity*)this);
+	CFFLuaSC hContext(1, (CBaseEntity*)this);
 	hContext.Push(luatblInfo);
 	return !FFScriptRunPredicates( &hContext, "onbuild", true, vecOrigin, 40.0f );
 }
@@ -612,6 +612,30 @@ private:
 	void StatusEffectsThink( void );
 	void RecalculateSpeed( );
 
+	// When each status effect next needs looking at. StatusEffectsThink
+	// only checks the effects that are due; anything that starts or
+	// changes an effect schedules it, and the effect reschedules itself
+	// each time it's checked. Checking one early is harmless.
+	enum StatusEffectDeadline_t
+	{
+		SED_GAS = 0,
+		SED_SLIDING,
+		SED_REGEN,
+		SED_OVERHEALTH,
+		SED_INFECTION,
+		SED_SPEEDEFFECTS,
+		SED_IMMUNITY,
+
+		SED_COUNT
+	};
+
+	float m_flStatusDeadlines[ SED_COUNT ];
+	float m_flNextStatusDeadline;
+
+	void ScheduleStatusEffect( int iDeadline, float flTime );
+	void WakeStatusEffects( void );
+	bool IsStatusEffectDue( int iDeadline ) const { return m_flStatusDeadlines[ iDeadline ] <= gpGlobals->curtime; }
+
 private:
 	// --> Mirv: Player class script files
 	virtual const unsigned char *GetEncryptionKey();
@@ -634,6 +658,7 @@ public:
 	void SetUnRadioTagged( void );
 	int GetTeamNumOfWhoTaggedMe( void ) const;
 	CFFPlayer *GetPlayerWhoTaggedMe( void );
+	CFFRadioTagData *GetRadioTagData( void ) { return m_hRadioTagData.Get(); }
 protected:
 	bool m_bRadioTagged;
 	float m_flRadioTaggedStartTime;
@@ -0,0 +1,172 @@
+// ff_pvscache.cpp
+
+/////////////////////////////////////////////////////////////////////////////
+// includes
+#include "cbase.h"
+#include "ff_pvscache.h"
+#include "bspfile.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+/////////////////////////////////////////////////////////////////////////////
+ConVar sv_pvscache( "sv_pvscache", "1", 0, "Cache cluster lookups and decompressed PVS for sentry, bot and Lua visibility checks." );
+
+/////////////////////////////////////////////////////////////////////////////
+CFFPVSCache _pvscache;
+
+/////////////////////////////////////////////////////////////////////////////
+CFFPVSCache::CFFPVSCache()
+{
+	Init();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+CFFPVSCache::~CFFPVSCache()
+{
+	Shutdown();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFPVSCache::Init()
+{
+	Invalidate();
+
+	m_nChecks = 0;
+	m_nOriginHits = 0;
+	m_nOriginMisses = 0;
+	m_nPVSHits = 0;
+	m_nPVSMisses = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFPVSCache::Shutdown()
+{
+	Invalidate();
+
+	for( int i = 0; i < PVSCACHE_PVS_SLOTS; i++ )
+		m_PVS[ i ].data.Purge();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFPVSCache::Invalidate()
+{
+	for( int i = 0; i < PVSCACHE_ORIGIN_SLOTS; i++ )
+		m_Origins[ i ].bValid = false;
+
+	for( int i = 0; i < PVSCACHE_PVS_SLOTS; i++ )
+	{
+		m_PVS[ i ].iCluster = -1;
+		m_PVS[ i ].iLastUsed = 0;
+	}
+
+	m_iUseCount = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+int CFFPVSCache::GetCluster( const Vector &vecOrigin )
+{
+	if( !sv_pvscache.GetBool() )
+		return engine->GetClusterForOrigin( vecOrigin );
+
+	// same spot, same cluster; most queries come from things that don't move
+	const unsigned int *pBits = ( const unsigned int * )vecOrigin.Base();
+	unsigned int iHash = ( pBits[ 0 ] * 73856093 ) ^ ( pBits[ 1 ] * 19349663 ) ^ ( pBits[ 2 ] * 83492791 );
+
+	Origin_t &slot = m_Origins[ ( iHash ^ ( iHash >> 16 ) ) & ( PVSCACHE_ORIGIN_SLOTS - 1 ) ];
+	if( slot.bValid && slot.vecOrigin == vecOrigin )
+	{
+		m_nOriginHits++;
+		return slot.iCluster;
+	}
+
+	m_nOriginMisses++;
+
+	slot.vecOrigin = vecOrigin;
+	slot.iCluster = engine->GetClusterForOrigin( vecOrigin );
+	slot.bValid = true;
+
+	return slot.iCluster;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+const byte *CFFPVSCache::GetPVS( int iCluster, int &iLength )
+{
+	iLength = 0;
+
+	if( iCluster < 0 )
+		return NULL;
+
+	// least recently used slot gets replaced if this cluster isn't cached
+	int iOldest = 0;
+	for( int i = 0; i < PVSCACHE_PVS_SLOTS; i++ )
+	{
+		PVS_t &pvs = m_PVS[ i ];
+		if( pvs.iCluster == iCluster )
+		{
+			m_nPVSHits++;
+
+			pvs.iLastUsed = ++m_iUseCount;
+			iLength = pvs.data.Count();
+			return pvs.data.Base();
+		}
+
+		if( pvs.iLastUsed < m_PVS[ iOldest ].iLastUsed )
+			iOldest = i;
+	}
+
+	m_nPVSMisses++;
+
+	byte buffer[ MAX_MAP_CLUSTERS / 8 ];
+	int iPVSLength = engine->GetPVSForCluster( iCluster, sizeof( buffer ), buffer );
+
+	PVS_t &pvs = m_PVS[ iOldest ];
+	pvs.iCluster = iCluster;
+	pvs.iLastUsed = ++m_iUseCount;
+	pvs.data.SetCount( iPVSLength );
+	Q_memcpy( pvs.data.Base(), buffer, iPVSLength );
+
+	iLength = iPVSLength;
+	return pvs.data.Base();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool CFFPVSCache::CheckPVS( const Vector &vecOrigin, const Vector &vecTarget )
+{
+	m_nChecks++;
+
+	if( !sv_pvscache.GetBool() )
+	{
+		byte pvs[ MAX_MAP_CLUSTERS / 8 ];
+		int iPVSCluster = engine->GetClusterForOrigin( vecOrigin );
+		int iPVSLength = engine->GetPVSForCluster( iPVSCluster, sizeof( pvs ), pvs );
+		return engine->CheckOriginInPVS( vecTarget, pvs, iPVSLength );
+	}
+
+	int iLength;
+	const byte *pPVS = GetPVS( GetCluster( vecOrigin ), iLength );
+
+	// in solid or outside the world, can't rule anything out
+	if( !pPVS )
+		return true;
+
+	return engine->CheckOriginInPVS( vecTarget, pPVS, iLength );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFPVSCache::PrintStats()
+{
+	Msg( "PVS cache since level start:\n" );
+	Msg( "  %u checks\n", m_nChecks );
+	Msg( "  clusters: %u hits, %u misses\n", m_nOriginHits, m_nOriginMisses );
+	Msg( "  PVS: %u hits, %u misses\n", m_nPVSHits, m_nPVSMisses );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+CON_COMMAND( sv_pvscache_stats, "Shows how well cluster lookups and PVS are being cached for the current level" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	_pvscache.PrintStats();
+}
@@ -0,0 +1,83 @@
+// ff_pvscache.h
+
+/////////////////////////////////////////////////////////////////////////////
+#ifndef FF_PVSCACHE_H
+#define FF_PVSCACHE_H
+
+/////////////////////////////////////////////////////////////////////////////
+// includes
+#ifndef UTLVECTOR_H
+	#include "utlvector.h"
+#endif
+
+// origins whose cluster is remembered, must be a power of 2
+#define PVSCACHE_ORIGIN_SLOTS	256
+
+// decompressed PVS bitsets kept around
+#define PVSCACHE_PVS_SLOTS		32
+
+/////////////////////////////////////////////////////////////////////////////
+// Remembers which cluster an origin is in and keeps the decompressed PVS of
+// the most recently used clusters, so PVS checks from the same spot (a
+// sentry, or several bots in the same room) don't ask the engine to find
+// the leaf and decompress the vis data every time. Clusters and PVS only
+// change with the map; areaportal state isn't part of the PVS, so the
+// cache only needs throwing away on level change.
+/////////////////////////////////////////////////////////////////////////////
+class CFFPVSCache
+{
+private:
+	struct Origin_t
+	{
+		Vector	vecOrigin;
+		int		iCluster;
+		bool	bValid;
+	};
+
+	struct PVS_t
+	{
+		int					iCluster;
+		unsigned int		iLastUsed;
+		CUtlVector<byte>	data;
+	};
+
+public:
+	// 'structors
+	CFFPVSCache();
+	~CFFPVSCache();
+
+public:
+	void Init();
+	void Shutdown();
+
+	// forgets every cluster and PVS
+	void Invalidate();
+
+	// false if vecTarget definitely can't be seen from vecOrigin
+	bool CheckPVS( const Vector &vecOrigin, const Vector &vecTarget );
+
+	int GetCluster( const Vector &vecOrigin );
+
+	// decompressed PVS of a cluster, NULL if there isn't one
+	const byte *GetPVS( int iCluster, int &iLength );
+
+	void PrintStats();
+
+private:
+	Origin_t		m_Origins[ PVSCACHE_ORIGIN_SLOTS ];
+	PVS_t			m_PVS[ PVSCACHE_PVS_SLOTS ];
+	unsigned int	m_iUseCount;
+
+	// stats since the level started
+	unsigned int	m_nChecks;
+	unsigned int	m_nOriginHits;
+	unsigned int	m_nOriginMisses;
+	unsigned int	m_nPVSHits;
+	unsigned int	m_nPVSMisses;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+extern CFFPVSCache _pvscache;
+
+/////////////////////////////////////////////////////////////////////////////
+#endif
@@ -0,0 +1,242 @@
+// ff_radiotagman.cpp
+
+/////////////////////////////////////////////////////////////////////////////
+// includes
+#include "cbase.h"
+#include "ff_radiotagman.h"
+#include "ff_player.h"
+#include "ff_radiotagdata.h"
+#include "ff_utils.h"
+#include "omnibot_interface.h"
+#include "tier0/vprof.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// [integer] Max distance a player can be from us to be shown
+//static ConVar radiotag_distance( "ffdev_radiotag_distance", "1024" );
+#define RADIOTAG_DISTANCE 1024
+
+// anyone near enough is in the 3x3 cells around us
+#define RADIOTAG_CELLSIZE	RADIOTAG_DISTANCE
+
+/////////////////////////////////////////////////////////////////////////////
+CFFRadioTagManager _radiotagman;
+
+/////////////////////////////////////////////////////////////////////////////
+CFFRadioTagManager::CFFRadioTagManager() : m_Tagged( RADIOTAG_CELLSIZE )
+{
+	Init();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+CFFRadioTagManager::~CFFRadioTagManager()
+{
+	Shutdown();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFRadioTagManager::Init()
+{
+	m_iTick = -1;
+	m_Tagged.RemoveAll();
+
+	for( int i = 0; i <= MAX_PLAYERS; i++ )
+		m_Visible[ i ].ClearAll();
+
+	m_nUpdates = 0;
+	m_nTagged = 0;
+	m_nTested = 0;
+	m_nBotChanges = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFRadioTagManager::Shutdown()
+{
+	m_Tagged.Purge();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFRadioTagManager::Update()
+{
+	if( m_iTick == gpGlobals->tickcount )
+		return;
+
+	m_iTick = gpGlobals->tickcount;
+
+	VPROF_BUDGET( "CFFRadioTagManager::Update", VPROF_BUDGETGROUP_GAME );
+
+	m_nUpdates++;
+
+	for( int i = 0; i < TEAM_COUNT; i++ )
+	{
+		for( int j = 0; j < TEAM_COUNT; j++ )
+			m_iRelationship[ i ][ j ] = -1;
+	}
+
+	BuildGrid();
+
+	for( int i = 1; i <= gpGlobals->maxClients && i <= MAX_PLAYERS; i++ )
+	{
+		CFFPlayer *pPlayer = ToFFPlayer( UTIL_PlayerByIndex( i ) );
+		if( !pPlayer )
+		{
+			m_Visible[ i ].ClearAll();
+			continue;
+		}
+
+		UpdatePlayer( pPlayer );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFRadioTagManager::BuildGrid()
+{
+	m_Tagged.RemoveAll();
+
+	// If we're the only ones we don't care
+	if( gpGlobals->maxClients < 2 )
+		return;
+
+	for( int i = 1; i <= gpGlobals->maxClients && i <= MAX_PLAYERS; i++ )
+	{
+		CFFPlayer *pPlayer = ToFFPlayer( UTIL_PlayerByIndex( i ) );
+		if( !pPlayer )
+			continue;
+
+		// Skip if spec
+		if( pPlayer->IsObserver() || FF_IsPlayerSpec( pPlayer ) )
+			continue;
+
+		// Skip if not tagged
+		if( !pPlayer->IsRadioTagged() )
+			continue;
+
+		// nobody is a teammate of a tagger that's gone
+		CFFPlayer *pTagger = ToFFPlayer( pPlayer->GetPlayerWhoTaggedMe() );
+		if( !pTagger )
+			continue;
+
+		Tagged_t &tagged = m_Tagged.Add( pPlayer->GetFeetOrigin() );
+		tagged.iPlayer = i;
+		tagged.iTagger = pTagger->entindex();
+		tagged.iTaggerTeam = pTagger->GetTeamNumber();
+		tagged.iClass = pPlayer->GetClassSlot();
+		tagged.iTeam = pPlayer->GetTeamNumber();
+		tagged.bDucking = !!( pPlayer->GetFlags() & FL_DUCKING );
+		tagged.vecOrigin = pPlayer->GetFeetOrigin();
+	}
+
+	m_Tagged.Sort();
+
+	m_nTagged += m_Tagged.Count();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool CFFRadioTagManager::IsTeammate( CFFPlayer *pPlayer, CFFPlayer *pTagger )
+{
+	// Between two different players this only depends on their teams, so
+	// it's only asked once per pair of teams
+	int iTeam = pPlayer->GetTeamNumber();
+	int iTaggerTeam = pTagger->GetTeamNumber();
+
+	if( pPlayer == pTagger || iTeam < 0 || iTeam >= TEAM_COUNT || iTaggerTeam < 0 || iTaggerTeam >= TEAM_COUNT )
+		return g_pGameRules->PlayerRelationship( pPlayer, pTagger ) == GR_TEAMMATE;
+
+	int &iRelationship = m_iRelationship[ iTeam ][ iTaggerTeam ];
+	if( iRelationship == -1 )
+		iRelationship = g_pGameRules->PlayerRelationship( pPlayer, pTagger );
+
+	return iRelationship == GR_TEAMMATE;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFRadioTagManager::UpdatePlayer( CFFPlayer *pPlayer )
+{
+	CFFRadioTagData *pData = pPlayer->GetRadioTagData();
+	if( !pData )
+		return;
+
+	// Reset stuff back to zero
+	pData->ClearVisible();
+
+	int iPlayer = pPlayer->entindex();
+
+	CBitVec<MAX_PLAYERS + 1> visible;
+	visible.ClearAll();
+
+	if( m_Tagged.Count() )
+	{
+		// My origin
+		Vector vecOrigin = pPlayer->GetFeetOrigin();
+
+		int nTested = 0;
+
+		int iX = m_Tagged.CellCoord( vecOrigin.x ), iY = m_Tagged.CellCoord( vecOrigin.y );
+
+		for( int x = iX - 1; x <= iX + 1; x++ )
+		{
+			for( int y = iY - 1; y <= iY + 1; y++ )
+			{
+				int iEnd;
+				for( int i = m_Tagged.FindCell( x, y, &iEnd ); i < iEnd; i++ )
+				{
+					const Tagged_t &tagged = m_Tagged[ i ];
+
+					// Skip if us
+					if( tagged.iPlayer == iPlayer )
+						continue;
+
+					// Bug #0000517: Enemies see radio tag.
+					// Only want to show players whom people on our team have tagged or
+					// players whom allies have tagged
+					CFFPlayer *pTagger = ToFFPlayer( UTIL_PlayerByIndex( tagged.iTagger ) );
+					if( !pTagger || !IsTeammate( pPlayer, pTagger ) )
+						continue;
+
+					nTested++;
+
+					// Skip if they're out of range
+					if( vecOrigin.DistTo( tagged.vecOrigin ) > RADIOTAG_DISTANCE )
+						continue;
+
+					pData->Set( tagged.iPlayer, true, tagged.iClass, tagged.iTeam, tagged.bDucking, tagged.vecOrigin );
+					visible.Set( tagged.iPlayer );
+				}
+			}
+		}
+
+		m_nTested += nTested;
+	}
+
+	if( visible == m_Visible[ iPlayer ] )
+		return;
+
+	m_Visible[ iPlayer ] = visible;
+
+	if( !pPlayer->IsBot() )
+		return;
+
+	m_nBotChanges++;
+
+	for( int i = visible.FindNextSetBit( 0 ); i > -1; i = visible.FindNextSetBit( i + 1 ) )
+		Omnibot::Notify_RadioTagUpdate( pPlayer, UTIL_PlayerByIndex( i ) );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFRadioTagManager::PrintStats()
+{
+	Msg( "Radio tags since level start:\n" );
+	Msg( "  %u updates, %u tagged players\n", m_nUpdates, m_nTagged );
+	Msg( "  %u distances measured, %u bot updates\n", m_nTested, m_nBotChanges );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+CON_COMMAND( ff_radiotag_stats, "Shows how much radio tag work was done for the current level" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	_radiotagman.PrintStats();
+}
@@ -0,0 +1,87 @@
+// ff_radiotagman.h
+
+/////////////////////////////////////////////////////////////////////////////
+#ifndef FF_RADIOTAGMAN_H
+#define FF_RADIOTAGMAN_H
+
+/////////////////////////////////////////////////////////////////////////////
+// includes
+#ifndef UTLVECTOR_H
+	#include "utlvector.h"
+#endif
+#ifndef BITVEC_H
+	#include "bitvec.h"
+#endif
+#ifndef FF_CELLGRID_H
+	#include "ff_cellgrid.h"
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+class CFFPlayer;
+
+/////////////////////////////////////////////////////////////////////////////
+// Works out which radio tagged players each player can see. Once a tick
+// every tagged player goes into a grid by position, then each player only
+// looks at the tagged players in the cells around them, rather than every
+// player looking at every other player. Bots are only told about their
+// tagged players when the set they can see changes; the update hands them
+// the entity so they can follow it from there.
+/////////////////////////////////////////////////////////////////////////////
+class CFFRadioTagManager
+{
+private:
+	struct Tagged_t
+	{
+		int		iPlayer;
+		int		iTagger;		// who tagged them
+		int		iTaggerTeam;
+		int		iClass;
+		int		iTeam;
+		bool	bDucking;
+		Vector	vecOrigin;		// feet
+	};
+
+public:
+	// 'structors
+	CFFRadioTagManager();
+	~CFFRadioTagManager();
+
+public:
+	void Init();
+	void Shutdown();
+
+	// updates every player's radio tag data, only does anything the first
+	// time it's called each tick so each player can call it from PreThink
+	void Update();
+
+	void PrintStats();
+
+private:
+	void BuildGrid();
+	void UpdatePlayer( CFFPlayer *pPlayer );
+
+	// whether pPlayer gets to see who pTagger has tagged
+	bool IsTeammate( CFFPlayer *pPlayer, CFFPlayer *pTagger );
+
+private:
+	int						m_iTick;
+	CFFCellGrid<Tagged_t>	m_Tagged;
+
+	// team relationships for this tick, -1 until looked up
+	int		m_iRelationship[ TEAM_COUNT ][ TEAM_COUNT ];
+
+	// what each player could see last tick, for the bots
+	CBitVec<MAX_PLAYERS + 1>	m_Visible[ MAX_PLAYERS + 1 ];
+
+	// stats since the level started
+	unsigned int	m_nUpdates;
+	unsigned int	m_nTagged;			// tagged players put in the grid
+	unsigned int	m_nTested;			// distances measured
+	unsigned int	m_nBotChanges;		// bot visible sets that changed
+};
+
+/////////////////////////////////////////////////////////////////////////////
+extern CFFRadioTagManager _radiotagman;
+
+/////////////////////////////////////////////////////////////////////////////
+#endif
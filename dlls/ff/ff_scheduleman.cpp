@@ -5,6 +5,15 @@
 // includes
 #include "cbase.h"
 #include "ff_scheduleman.h"
+#include "ff_scriptman.h"
+#include "tier0/vprof.h"
+
+// lua
+extern "C"
+{
+	#include "lua.h"
+	#include "lauxlib.h"
+}
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -35,20 +44,26 @@ bool CRC32_LessFunc(const CRC32_t& a, const CRC32_t& b)
 CFFScheduleCallback::CFFScheduleCallback(const luabind::adl::object& fn, float timer)
 {
 	m_function = fn;
-	m_timeLeft = timer;
 	m_timeTotal = timer;
 	m_nRepeat = 1;
 	m_nParams = 0;
+	m_id = 0;
+	m_flDeadline = 0.0;
+	m_iSequence = 0;
+	m_iQueueIndex = -1;
 }
 
 /////////////////////////////////////////////////////////////////////////////
 CFFScheduleCallback::CFFScheduleCallback(const luabind::adl::object& fn, float timer, int nRepeat)
 {
 	m_function = fn;
-	m_timeLeft = timer;
 	m_timeTotal = timer;
 	m_nRepeat = nRepeat;
 	m_nParams = 0;
+	m_id = 0;
+	m_flDeadline = 0.0;
+	m_iSequence = 0;
+	m_iQueueIndex = -1;
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -58,10 +73,13 @@ CFFScheduleCallback::CFFScheduleCallback(const luabind::adl::object& fn,
 									   const luabind::adl::object& param)
 {
 	m_function = fn;
-	m_timeLeft = timer;
 	m_timeTotal = timer;
 	m_nRepeat = nRepeat;
 	m_nParams = 1;
+	m_id = 0;
+	m_flDeadline = 0.0;
+	m_iSequence = 0;
+	m_iQueueIndex = -1;
 	m_params[0] = param;
 }
 
@@ -73,10 +91,13 @@ CFFScheduleCallback::CFFScheduleCallback(const luabind::adl::object& fn,
 									   const luabind::adl::object& param2)
 {
 	m_function = fn;
-	m_timeLeft = timer;
 	m_timeTotal = timer;
 	m_nRepeat = nRepeat;
 	m_nParams = 2;
+	m_id = 0;
+	m_flDeadline = 0.0;
+	m_iSequence = 0;
+	m_iQueueIndex = -1;
 	m_params[0] = param1;
 	m_params[1] = param2;
 }
@@ -90,10 +111,13 @@ CFFScheduleCallback::CFFScheduleCallback(const luabind::adl::object& fn,
 										 const luabind::adl::object& param3)
 {
 	m_function = fn;
-	m_timeLeft = timer;
 	m_timeTotal = timer;
 	m_nRepeat = nRepeat;
 	m_nParams = 3;
+	m_id = 0;
+	m_flDeadline = 0.0;
+	m_iSequence = 0;
+	m_iQueueIndex = -1;
 	m_params[0] = param1;
 	m_params[1] = param2;
 	m_params[2] = param3;
@@ -109,10 +133,13 @@ CFFScheduleCallback::CFFScheduleCallback(const luabind::adl::object& fn,
 										 const luabind::adl::object& param4)
 {
 	m_function = fn;
-	m_timeLeft = timer;
 	m_timeTotal = timer;
 	m_nRepeat = nRepeat;
 	m_nParams = 4;
+	m_id = 0;
+	m_flDeadline = 0.0;
+	m_iSequence = 0;
+	m_iQueueIndex = -1;
 	m_params[0] = param1;
 	m_params[1] = param2;
 	m_params[2] = param3;
@@ -123,7 +150,6 @@ CFFScheduleCallback::CFFScheduleCallback(const luabind::adl::object& fn,
 CFFScheduleCallback::CFFScheduleCallback(const CFFScheduleCallback& rhs)
 {
 	m_function = rhs.m_function;
-	m_timeLeft = rhs.m_timeLeft;
 	m_timeTotal = rhs.m_timeTotal;
 	m_nRepeat = rhs.m_nRepeat;
 	m_nParams = rhs.m_nParams;
@@ -131,64 +157,46 @@ CFFScheduleCallback::CFFScheduleCallback(const CFFScheduleCallback& rhs)
 	m_params[1] = rhs.m_params[1];
 	m_params[2] = rhs.m_params[2];
 	m_params[3] = rhs.m_params[3];
+	m_id = rhs.m_id;
+	m_flDeadline = rhs.m_flDeadline;
+	m_iSequence = rhs.m_iSequence;
+	m_iQueueIndex = -1;
 }
 
 /////////////////////////////////////////////////////////////////////////////
-bool CFFScheduleCallback::Update()
+bool CFFScheduleCallback::Fire()
 {
-	m_timeLeft -= gpGlobals->frametime;
+	CFFLuaProfileScope profileScope( "schedule callback" );
 
-	if(m_timeLeft <= 0.0f)
+	// call the lua function
+	try
 	{
-		// call the lua function
-		try
-		{
-			if(m_nParams == 0)
-				m_function();
-
-			else if(m_nParams == 1)
-				m_function(m_params[0]);
-
-			else if(m_nParams == 2)
-				m_function(m_params[0], m_params[1]);
-
-			else if(m_nParams == 3)
-				m_function(m_params[0], m_params[1], m_params[2]);
-
-			else if(m_nParams == 4)
-				m_function(m_params[0], m_params[1], m_params[2], m_params[3]);
-		}
-		catch(...)
-		{
+		if(m_nParams == 0)
+			m_function();
 
-		}
+		else if(m_nParams == 1)
+			m_function(m_params[0]);
 
-		// repeat only so many times
-		if (m_nRepeat > 0)
-			--m_nRepeat;
+		else if(m_nParams == 2)
+			m_function(m_params[0], m_params[1]);
 
-		// schedule is done, so clean up
-		if (m_nRepeat == 0)
-			return true;
+		else if(m_nParams == 3)
+			m_function(m_params[0], m_params[1], m_params[2]);
 
-		// reset the timer for repeating shit
-		m_timeLeft = m_timeTotal;
+		else if(m_nParams == 4)
+			m_function(m_params[0], m_params[1], m_params[2], m_params[3]);
 	}
-
-	return false;
-}
-
-/////////////////////////////////////////////////////////////////////////////
-bool CFFScheduleCallback::IsComplete()
-{
-	if(m_timeLeft <= 0.0f)
+	catch(...)
 	{
-		// schedule is done
-		if (m_nRepeat == 0)
-			return true;
+
 	}
 
-	return false;
+	// repeat only so many times
+	if (m_nRepeat > 0)
+		--m_nRepeat;
+
+	// schedule is done, so clean up
+	return (m_nRepeat == 0);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -197,6 +205,11 @@ bool CFFScheduleCallback::IsComplete()
 CFFScheduleManager::CFFScheduleManager()
 {
 	m_schedules.SetLessFunc(CRC32_LessFunc);
+
+	m_flTime = 0.0;
+	m_iSequence = 0;
+	m_pFiring = NULL;
+	m_bFiringRemoved = false;
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -205,6 +218,16 @@ CFFScheduleManager::~CFFScheduleManager()
 
 }
 
+/////////////////////////////////////////////////////////////////////////////
+void CFFScheduleManager::InsertSchedule(CRC32_t id, CFFScheduleCallback* pCallback)
+{
+	pCallback->m_id = id;
+	pCallback->m_flDeadline = m_flTime + pCallback->m_timeTotal;
+
+	m_schedules.Insert(id, pCallback);
+	QueuePush(pCallback);
+}
+
 /////////////////////////////////////////////////////////////////////////////
 void CFFScheduleManager::AddSchedule(const char* szScheduleName,
 									 float timer,
@@ -220,7 +243,7 @@ void CFFScheduleManager::AddSchedule(const char* szScheduleName,
 	CFFScheduleCallback* pCallback = new CFFScheduleCallback(fn,
 															timer);
 
-	m_schedules.Insert(id, pCallback);
+	InsertSchedule(id, pCallback);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -240,7 +263,7 @@ void CFFScheduleManager::AddSchedule(const char* szScheduleName,
 														   timer,
 														   nRepeat);
 
-	m_schedules.Insert(id, pCallback);
+	InsertSchedule(id, pCallback);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -262,7 +285,7 @@ void CFFScheduleManager::AddSchedule(const char* szScheduleName,
 														   nRepeat,
 														   param);
 
-	m_schedules.Insert(id, pCallback);
+	InsertSchedule(id, pCallback);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -286,7 +309,7 @@ void CFFScheduleManager::AddSchedule(const char* szScheduleName,
 														   param1,
 														   param2);
 
-	m_schedules.Insert(id, pCallback);
+	InsertSchedule(id, pCallback);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -312,7 +335,7 @@ void CFFScheduleManager::AddSchedule(const char* szScheduleName,
 															param2,
 															param3);
 
-	m_schedules.Insert(id, pCallback);
+	InsertSchedule(id, pCallback);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -340,7 +363,7 @@ void CFFScheduleManager::AddSchedule(const char* szScheduleName,
 															param3,
 															param4);
 
-	m_schedules.Insert(id, pCallback);
+	InsertSchedule(id, pCallback);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -356,53 +379,273 @@ void CFFScheduleManager::RemoveSchedule(const char* szScheduleName)
 
 	// remove the schedule from the list
 	unsigned short it = m_schedules.Find(id);
-	if(m_schedules.IsValidIndex(it))
-		m_schedules.RemoveAt(it);
+	if(!m_schedules.IsValidIndex(it))
+		return;
+
+	CFFScheduleCallback* pCallback = m_schedules.Element(it);
+	m_schedules.RemoveAt(it);
+
+	// a schedule removing itself gets cleaned up once its call returns
+	if(pCallback == m_pFiring)
+	{
+		m_bFiringRemoved = true;
+		return;
+	}
+
+	QueueRemove(pCallback->m_iQueueIndex);
+	delete pCallback;
 }
 
 /////////////////////////////////////////////////////////////////////////////
 void CFFScheduleManager::Shutdown()
 {
+	for(unsigned short it = m_schedules.FirstInorder(); m_schedules.IsValidIndex(it); it = m_schedules.NextInorder(it))
+	{
+		CFFScheduleCallback* pCallback = m_schedules.Element(it);
+		if(pCallback == m_pFiring)
+			m_bFiringRemoved = true;
+		else
+			delete pCallback;
+	}
+
 	m_schedules.RemoveAll();
+	m_queue.RemoveAll();
+
+	m_flTime = 0.0;
+	m_iSequence = 0;
 }
 
 /////////////////////////////////////////////////////////////////////////////
 void CFFScheduleManager::Update()
 {
-	// update each item in the schedule list
-	unsigned short it = m_schedules.FirstInorder();
-	while(m_schedules.IsValidIndex(it))
+	VPROF_BUDGET( "CFFScheduleManager::Update", VPROF_BUDGETGROUP_FF_LUA );
+
+	Advance(gpGlobals->frametime);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFScheduleManager::Advance(float flFrameTime)
+{
+	m_flTime += flFrameTime;
+
+	// anything queued from here on waits for the next frame, so a zero
+	// length repeating schedule can't keep this loop going forever
+	unsigned int iFirstNewSequence = m_iSequence;
+
+	while(m_queue.Count())
 	{
-		CFFScheduleCallback* pCallback = m_schedules.Element(it);
-		if (!pCallback)
-			return;
+		CFFScheduleCallback* pCallback = m_queue[0];
+		if(pCallback->m_flDeadline > m_flTime || pCallback->m_iSequence >= iFirstNewSequence)
+			break;
 
-		bool isComplete = pCallback->Update();
+		QueueRemove(0);
 
-		if(isComplete)
+		m_pFiring = pCallback;
+		m_bFiringRemoved = false;
+
+		bool isComplete = pCallback->Fire();
+
+		m_pFiring = NULL;
+
+		// already taken out of the list by RemoveSchedule
+		if(m_bFiringRemoved)
 		{
-			// remove and cleanup the schedule callback
-			CRC32_t id = m_schedules.Key(it);
-			if (m_schedules.IsValidIndex(it))
-				it = m_schedules.NextInorder(it);
-			
-			unsigned short itCheck = m_schedules.Find(id);
-			if(m_schedules.IsValidIndex(itCheck))
-			{
-				CFFScheduleCallback* pCallbackCheck = m_schedules.Element(itCheck);
-				if (!pCallbackCheck)
-					return;
-
-				if (pCallbackCheck->IsComplete())
-					m_schedules.RemoveAt(itCheck);
-			}
+			delete pCallback;
+			continue;
 		}
-		else
+
+		if(isComplete)
 		{
-			if (m_schedules.IsValidIndex(it))
-				it = m_schedules.NextInorder(it);
+			// remove and cleanup the schedule callback
+			unsigned short it = m_schedules.Find(pCallback->m_id);
+			if(m_schedules.IsValidIndex(it) && m_schedules.Element(it) == pCallback)
+				m_schedules.RemoveAt(it);
+
+			delete pCallback;
+			continue;
 		}
+
+		// reset the timer for repeating shit
+		pCallback->m_flDeadline = m_flTime + pCallback->m_timeTotal;
+		QueuePush(pCallback);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool CFFScheduleManager::QueueLess(const CFFScheduleCallback* a, const CFFScheduleCallback* b) const
+{
+	if(a->m_flDeadline != b->m_flDeadline)
+		return a->m_flDeadline < b->m_flDeadline;
+
+	return a->m_iSequence < b->m_iSequence;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFScheduleManager::QueueSet(int iIndex, CFFScheduleCallback* pCallback)
+{
+	m_queue[iIndex] = pCallback;
+	pCallback->m_iQueueIndex = iIndex;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFScheduleManager::QueuePush(CFFScheduleCallback* pCallback)
+{
+	pCallback->m_iSequence = m_iSequence++;
+
+	int iIndex = m_queue.AddToTail(pCallback);
+	QueueSiftUp(iIndex);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFScheduleManager::QueueRemove(int iIndex)
+{
+	Assert(m_queue.IsValidIndex(iIndex));
+	if(!m_queue.IsValidIndex(iIndex))
+		return;
+
+	m_queue[iIndex]->m_iQueueIndex = -1;
+
+	// move the last one into the hole and let it find its place
+	int iLast = m_queue.Count() - 1;
+	if(iIndex != iLast)
+	{
+		QueueSet(iIndex, m_queue[iLast]);
+		m_queue.Remove(iLast);
+
+		QueueSiftUp(iIndex);
+		QueueSiftDown(iIndex);
+	}
+	else
+	{
+		m_queue.Remove(iLast);
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFScheduleManager::QueueSiftUp(int iIndex)
+{
+	CFFScheduleCallback* pCallback = m_queue[iIndex];
+
+	while(iIndex > 0)
+	{
+		int iParent = (iIndex - 1) / 2;
+		if(!QueueLess(pCallback, m_queue[iParent]))
+			break;
+
+		QueueSet(iIndex, m_queue[iParent]);
+		iIndex = iParent;
+	}
+
+	QueueSet(iIndex, pCallback);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFScheduleManager::QueueSiftDown(int iIndex)
+{
+	CFFScheduleCallback* pCallback = m_queue[iIndex];
+	int nCount = m_queue.Count();
+
+	for(;;)
+	{
+		int iChild = iIndex * 2 + 1;
+		if(iChild >= nCount)
+			break;
+
+		if(iChild + 1 < nCount && QueueLess(m_queue[iChild + 1], m_queue[iChild]))
+			iChild++;
+
+		if(!QueueLess(m_queue[iChild], pCallback))
+			break;
+
+		QueueSet(iIndex, m_queue[iChild]);
+		iIndex = iChild;
+	}
+
+	QueueSet(iIndex, pCallback);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+CON_COMMAND( lua_bench_schedules, "Times the schedule manager with a number of repeating schedules. Usage: lua_bench_schedules [schedules] [ticks]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	lua_State *L = _scriptman.GetLuaState();
+	if ( !L )
+	{
+		Msg( "No Lua VM is running\n" );
+		return;
 	}
+
+	int nSchedules = ( engine->Cmd_Argc() > 1 ) ? atoi( engine->Cmd_Argv( 1 ) ) : 10000;
+	if ( nSchedules <= 0 )
+		nSchedules = 10000;
+
+	int nTicks = ( engine->Cmd_Argc() > 2 ) ? atoi( engine->Cmd_Argv( 2 ) ) : 1000;
+	if ( nTicks <= 0 )
+		nTicks = 1000;
+
+	// a function that counts its calls
+	if ( luaL_dostring( L, "__ff_bench_schedules = 0 return function() __ff_bench_schedules = __ff_bench_schedules + 1 end" ) != 0 )
+	{
+		Warning( "%s\n", lua_tostring( L, -1 ) );
+		lua_pop( L, 1 );
+		return;
+	}
+
+	luabind::adl::object fn( luabind::from_stack( L, -1 ) );
+	lua_pop( L, 1 );
+
+	// a separate manager, so the map's schedules aren't touched
+	CFFScheduleManager *pScheduleMan = new CFFScheduleManager;
+
+	char szName[32];
+
+	double flStart = Plat_FloatTime();
+	for ( int i = 0; i < nSchedules; i++ )
+	{
+		// repeat forever, spread over 0.5 to 30 seconds
+		Q_snprintf( szName, sizeof( szName ), "bench%d", i );
+		pScheduleMan->AddSchedule( szName, 0.5f + 29.5f * ( (float)i / nSchedules ), fn, -1 );
+	}
+	double flAdd = Plat_FloatTime() - flStart;
+
+	// ticks where nothing is due, the common case
+	flStart = Plat_FloatTime();
+	for ( int i = 0; i < nTicks; i++ )
+		pScheduleMan->Advance( 0.0f );
+	double flIdle = Plat_FloatTime() - flStart;
+
+	// ticks of real time
+	double flMax = 0.0;
+	flStart = Plat_FloatTime();
+	for ( int i = 0; i < nTicks; i++ )
+	{
+		double flTickStart = Plat_FloatTime();
+		pScheduleMan->Advance( TICK_INTERVAL );
+		flMax = max( flMax, Plat_FloatTime() - flTickStart );
+	}
+	double flRun = Plat_FloatTime() - flStart;
+
+	lua_getglobal( L, "__ff_bench_schedules" );
+	int nCalls = (int)lua_tonumber( L, -1 );
+	lua_pop( L, 1 );
+
+	flStart = Plat_FloatTime();
+	for ( int i = 0; i < nSchedules; i++ )
+	{
+		Q_snprintf( szName, sizeof( szName ), "bench%d", i );
+		pScheduleMan->RemoveSchedule( szName );
+	}
+	double flRemove = Plat_FloatTime() - flStart;
+
+	delete pScheduleMan;
+
+	Msg( "%d schedules, %d ticks\n", nSchedules, nTicks );
+	Msg( "add:    %.3f ms (%.3f us each)\n", flAdd * 1000.0, flAdd * 1000000.0 / nSchedules );
+	Msg( "idle:   %.3f us per tick\n", flIdle * 1000000.0 / nTicks );
+	Msg( "run:    %.3f us per tick, %.3f us max, %d calls (%.3f us per call)\n", flRun * 1000000.0 / nTicks, flMax * 1000000.0, nCalls, nCalls ? flRun * 1000000.0 / nCalls : 0.0 );
+	Msg( "remove: %.3f ms (%.3f us each)\n", flRemove * 1000.0, flRemove * 1000000.0 / nSchedules );
 }
 
 /////////////////////////////////////////////////////////////////////////////
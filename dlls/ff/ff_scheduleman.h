@@ -6,6 +6,9 @@
 #ifndef UTLMAP_H
 	#include "utlmap.h"
 #endif
+#ifndef UTLVECTOR_H
+	#include "utlvector.h"
+#endif
 #ifndef CHECKSUM_CRC_H
 	#include "checksum_crc.h"
 #endif
@@ -56,21 +59,25 @@ public:
 	~CFFScheduleCallback() {}
 
 public:
-	// updates. call only once per frame. returns true if the schedule is
-	// complete and should be deleted; otherwise returns false
-	bool Update();
-	
-	// returns true if this schedule is completely done and should be deleted
-	bool IsComplete();
+	// calls the lua function. returns true if the schedule is complete and
+	// should be deleted; otherwise returns false
+	bool Fire();
 
 private:
+	friend class CFFScheduleManager;
+
 	// private data
 	luabind::adl::object m_function;	// handle to the lua function to call
-	float	m_timeLeft;					// time until the lua function should be called
 	float	m_timeTotal;				// total time for a complete cycle
 	int		m_nRepeat;					// number of times to cycle (-1 is infinite)
 	int		m_nParams;					// number of params to pass to the function
 	luabind::adl::object m_params[4];	// params to pass to function
+
+	// owned by the schedule manager
+	CRC32_t			m_id;				// key in the schedule list
+	double			m_flDeadline;		// schedule clock time the function should be called at
+	unsigned int	m_iSequence;		// keeps schedules due at the same time in order
+	int				m_iQueueIndex;		// position in the queue, -1 if not queued
 };
 
 /////////////////////////////////////////////////////////////////////////////
@@ -86,6 +93,9 @@ public:
 	void Shutdown();
 	void Update();
 
+	// advances the schedule clock and calls every schedule that is due
+	void Advance(float flFrameTime);
+
 public:
 	// adds a schedule
 	void AddSchedule(const char* szScheduleName,
@@ -130,10 +140,33 @@ public:
 	// removes a schedule
 	void RemoveSchedule(const char* szScheduleName);
 
+private:
+	// adds a new schedule to the list and the queue
+	void InsertSchedule(CRC32_t id, CFFScheduleCallback* pCallback);
+
+	// binary min-heap ordered by deadline
+	bool QueueLess(const CFFScheduleCallback* a, const CFFScheduleCallback* b) const;
+	void QueuePush(CFFScheduleCallback* pCallback);
+	void QueueRemove(int iIndex);
+	void QueueSet(int iIndex, CFFScheduleCallback* pCallback);
+	void QueueSiftUp(int iIndex);
+	void QueueSiftDown(int iIndex);
+
 private:
 	// list of schedules. key is the checksum of an identifying name; it
 	// isnt necessarily the name of the lua function to call
 	CUtlMap<CRC32_t, CFFScheduleCallback*>	m_schedules;
+
+	// the same schedules, soonest first, so only the ones that are due
+	// get looked at each frame
+	CUtlVector<CFFScheduleCallback*>	m_queue;
+
+	double			m_flTime;			// schedule clock, advances by frametime
+	unsigned int	m_iSequence;		// next queue sequence number
+
+	// schedule currently being called; lua may remove it from inside its own callback
+	CFFScheduleCallback*	m_pFiring;
+	bool					m_bFiringRemoved;
 };
 
 /////////////////////////////////////////////////////////////////////////////
@@ -37,9 +37,11 @@ extern "C"
 
 // extern globals
 extern bool g_Disable_Timelimit;
+extern ConVar lua_profile;
 
 // custom game modes made so damn easy
 ConVar sv_mapluasuffix( "sv_mapluasuffix", "", FCVAR_ARCHIVE, "Have a custom lua file (game mode) loaded when the map loads. If this suffix string is set, maps\\mapname__suffix__.lua (if it exists) is used instead of maps\\mapname.lua. To reset this cvar, make it \"\".");
+ConVar lua_persistentvm( "lua_persistentvm", "0", 0, "Keep the Lua VM and its bindings across level changes, giving each map a fresh copy of the globals instead. Takes effect on the next level change." );
 ConVar sv_globalluascript( "sv_globalluascript", "", FCVAR_ARCHIVE, "Load a custom lua file globally after map scripts. Will overwrite map script. Will be loaded from maps\\globalscripts. To disable, set to \"\".");
 
 // redirect Lua's print function to the console
@@ -67,6 +69,86 @@ static int print(lua_State *L)
 	return 0;
 }
 
+// same as the default panic function in lauxlib.c, but goes to the console
+static int panic(lua_State *L)
+{
+	Warning("[SCRIPT] PANIC: unprotected error in call to Lua API (%s)\n", lua_tostring(L, -1));
+	return 0;
+}
+
+// reads a file and compiles it (through the chunk cache) into a function on top of the stack
+// returns a lua_load error code, the error message is left on the stack on failure
+static int loadfile(lua_State *L, const char *filename, const char *pathID, const char *chunkname)
+{
+	FileHandle_t hFile = filesystem->Open(filename, "rb", pathID);
+	if (!hFile)
+	{
+		lua_pushfstring(L, "cannot open %s", filename);
+		return LUA_ERRFILE;
+	}
+
+	// allocate buffer for file contents
+	int fileSize = filesystem->Size(hFile);
+	char *buffer = (char*)MemAllocScratch(fileSize + 1);
+	Assert(buffer);
+
+	// load file contents into a null-terminated buffer
+	filesystem->Read(buffer, fileSize, hFile);
+	buffer[fileSize] = 0;
+	filesystem->Close(hFile);
+
+	int errorCode = _scriptman.GetChunkCache().Load(L, filename, chunkname, buffer, fileSize);
+
+	// cleanup buffer
+	MemFreeScratch();
+
+	return errorCode;
+}
+
+// based on pushnexttemplate in loadlib.c
+static const char *pushnexttemplate(lua_State *L, const char *path)
+{
+	const char *l;
+	while (*path == *LUA_PATHSEP) path++;  /* skip separators */
+	if (*path == '\0') return NULL;  /* no more templates */
+	l = strchr(path, *LUA_PATHSEP);  /* find next separator */
+	if (l == NULL) l = path + strlen(path);
+	lua_pushlstring(L, path, l - path);  /* template */
+	return l;
+}
+
+// replaces the package.path searcher used by require, so that includes go
+// through the chunk cache too; based on loader_Lua and findfile in loadlib.c
+static int loader_Lua(lua_State *L)
+{
+	const char *name = luaL_checkstring(L, 1);
+	name = luaL_gsub(L, name, ".", LUA_DIRSEP);
+
+	lua_getglobal(L, LUA_LOADLIBNAME);
+	lua_getfield(L, -1, "path");
+	const char *path = lua_tostring(L, -1);
+	if (path == NULL)
+		return luaL_error(L, LUA_QL("package.path") " must be a string");
+
+	lua_pushliteral(L, "");  /* error accumulator */
+	while ((path = pushnexttemplate(L, path)) != NULL)
+	{
+		const char *filename = luaL_gsub(L, lua_tostring(L, -1), LUA_PATH_MARK, name);
+		lua_remove(L, -2);  /* remove path template */
+		if (filesystem->FileExists(filename))
+		{
+			const char *chunkname = lua_pushfstring(L, "@%s", filename);
+			if (loadfile(L, filename, NULL, chunkname) != 0)
+				return luaL_error(L, "error loading module " LUA_QS " from file " LUA_QS ":\n\t%s", lua_tostring(L, 1), filename, lua_tostring(L, -1));
+			return 1;
+		}
+		lua_pushfstring(L, "\n\tno file " LUA_QS, filename);
+		lua_remove(L, -2);  /* remove file name */
+		lua_concat(L, 2);  /* add entry to possible error message */
+	}
+	return 1;  /* library not found in this path */
+}
+
 using namespace luabind;
 
 // global script manager instance
@@ -75,10 +157,74 @@ CFFScriptManager _scriptman;
 CStringRegistry	g_HudElementStrings;
 int nextHudElementIndex;
 
+// lua names of the FFLuaHook_t callbacks, in enum order
+static const char *g_pszLuaHookNames[LUAHOOK_COUNT] =
+{
+	"allowed",
+	"onfailtouch",
+	"ontouch",
+	"onfailuse",
+	"onuse",
+	"ontrigger",
+	"onactive",
+	"oninactive",
+	"onremoved",
+	"onrestored",
+	"spawn",
+	"validspawn",
+	"isinactive",
+	"onownercloak",
+	"dropitemcmd",
+};
+
+// lua names of the FFLuaGlobalHook_t callbacks, in enum order
+static const char *g_pszLuaGlobalHookNames[GLOBALHOOK_COUNT] =
+{
+	"player_ondamage",
+	"player_killed",
+	"player_onkill",
+	"player_spawn",
+	"player_onuse",
+	"buildable_ondamage",
+	"buildable_killed",
+	"flaginfo",
+	"restartround",
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// _G[name][hook] for GetHookRefs, or just _G[name] for HasGlobalHook when
+// there's no hook. Runs under lua_pcall because either index can go through
+// a script's __index metamethod, which is free to raise an error. Returns the
+// table and the callback, or nothing if there's no table.
+static int LookupHook( lua_State *L )
+{
+	lua_pushvalue( L, 1 );
+	lua_gettable( L, LUA_GLOBALSINDEX );
+	if( lua_isnoneornil( L, 2 ) )
+		return 1;
+
+	if( !lua_istable( L, -1 ) )
+		return 0;
+
+	lua_pushvalue( L, 2 );
+	lua_gettable( L, -2 );
+	return 2;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 CFFScriptManager::CFFScriptManager()
 {
 	L = NULL;
+	m_HookCache.SetLessFunc( DefLessFunc( int ) );
+
+	m_bPersistentVM = false;
+	m_iBaseGlobalsRef = LUA_NOREF;
+	m_iBaseLoadedRef = LUA_NOREF;
+	m_flBuildTime = 0.0;
+	m_iLookupHookRef = LUA_NOREF;
+
+	memset( m_nGlobalHookExecuted, 0, sizeof( m_nGlobalHookExecuted ) );
+	memset( m_nGlobalHookSkipped, 0, sizeof( m_nGlobalHookSkipped ) );
 }
 
 CFFScriptManager::~CFFScriptManager()
@@ -90,8 +236,19 @@ CFFScriptManager::~CFFScriptManager()
 */
 void CFFScriptManager::Shutdown()
 {
+	// the references die with the VM, no need to unref them
+	m_HookCache.RemoveAll();
+
+	m_bPersistentVM = false;
+	m_iBaseGlobalsRef = LUA_NOREF;
+	m_iBaseLoadedRef = LUA_NOREF;
+	m_iLookupHookRef = LUA_NOREF;
+
 	if(L)
 	{
+		if(m_Profiler.IsActive())
+			m_Profiler.Detach(L);
+
 		lua_close(L);
 		L = NULL;
 	}
@@ -102,12 +259,24 @@ void CFFScriptManager::Shutdown()
 */
 bool CFFScriptManager::Init()
 {
+	double flStart = Plat_FloatTime();
+
+	// keep the VM and all the bindings, only the map's environment is new
+	if(L && m_bPersistentVM && lua_persistentvm.GetBool())
+	{
+		BeginLevelEnvironment();
+
+		LuaMsg("Reusing the Lua VM, environment ready in %.2f ms (building the VM took %.2f ms).\n", (Plat_FloatTime() - flStart) * 1000.0, m_flBuildTime * 1000.0);
+		return true;
+	}
+
 	// shutdown VM if already running
 	Shutdown();
 
 	// initialize VM
 	LuaMsg("Attempting to start the Lua VM...\n");
-	L = lua_open();
+	// same as lua_open, but with an allocator the profiler can keep count with
+	L = lua_newstate(CFFLuaProfiler::Alloc, NULL);
 
 	// no need to continue if VM failed to initialize
 	if(!L)
@@ -115,6 +284,15 @@ bool CFFScriptManager::Init()
 		LuaMsg("Unable to initialize Lua VM.\n");
 		return false;
 	}
+
+	lua_atpanic(L, panic);
+
+	// kept in the registry so GetHookRefs doesn't make a new closure per call
+	lua_pushcfunction(L, LookupHook);
+	m_iLookupHookRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+	if(lua_profile.GetBool())
+		m_Profiler.Attach(L);
 	
 	// initialize all the FF specific stuff
 	SetupEnvironmentForFF();
@@ -122,10 +300,103 @@ bool CFFScriptManager::Init()
 	// make the standard libraries safe
 	MakeEnvironmentSafe();
 
-	LuaMsg("Lua VM initialization successful.\n");
+	m_flBuildTime = Plat_FloatTime() - flStart;
+
+	if(lua_persistentvm.GetBool())
+	{
+		m_bPersistentVM = true;
+
+		// remember what a clean environment looks like
+		lua_pushvalue(L, LUA_GLOBALSINDEX);
+		m_iBaseGlobalsRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+		lua_newtable(L);
+		lua_getfield(L, LUA_REGISTRYINDEX, "_LOADED");
+		lua_pushnil(L);
+		while(lua_next(L, -2) != 0)
+		{
+			lua_pushvalue(L, -2);
+			lua_insert(L, -2);
+			lua_rawset(L, -5); // copy[key] = _LOADED[key]
+		}
+		lua_pop(L, 1); // pop _LOADED
+		m_iBaseLoadedRef = luaL_ref(L, LUA_REGISTRYINDEX);
+
+		BeginLevelEnvironment();
+	}
+
+	LuaMsg("Lua VM initialization successful (%.2f ms).\n", m_flBuildTime * 1000.0);
 	return true;
 }
 
+/** Replaces the globals with a shallow copy of the ones set up by SetupEnvironmentForFF,
+	so that everything the map scripts define goes away with the table. Tables shared
+	with the base environment (string, math, luabind classes, ...) are not copied.
+*/
+void CFFScriptManager::BeginLevelEnvironment()
+{
+	Assert(L && m_bPersistentVM);
+
+	// free whatever the last map left behind while nobody is playing
+	lua_gc(L, LUA_GCCOLLECT, 0);
+
+	lua_newtable(L);
+	lua_rawgeti(L, LUA_REGISTRYINDEX, m_iBaseGlobalsRef);
+	lua_pushnil(L);
+	while(lua_next(L, -2) != 0)
+	{
+		lua_pushvalue(L, -2);
+		lua_insert(L, -2);
+		lua_rawset(L, -5); // env[key] = base[key]
+	}
+	lua_pop(L, 1); // pop base
+
+	// _G has to point at the map's globals, not the base ones
+	lua_pushvalue(L, -1);
+	lua_setfield(L, -2, "_G");
+
+	// functions loaded from now on get this as their environment
+	lua_replace(L, LUA_GLOBALSINDEX);
+
+	// function addresses from the last map may get reused
+	if(m_Profiler.IsActive())
+		m_Profiler.Attach(L);
+}
+
+/** Drops the map's globals and any modules it required, leaving the VM as it was after setup
+*/
+void CFFScriptManager::EndLevelEnvironment()
+{
+	Assert(L && m_bPersistentVM);
+
+	ClearHookCache();
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, m_iBaseGlobalsRef);
+	lua_replace(L, LUA_GLOBALSINDEX);
+
+	// so require loads them into the next map's environment
+	lua_getfield(L, LUA_REGISTRYINDEX, "_LOADED");
+	lua_rawgeti(L, LUA_REGISTRYINDEX, m_iBaseLoadedRef);
+	lua_pushnil(L);
+	while(lua_next(L, -3) != 0)
+	{
+		lua_pop(L, 1); // pop value
+		lua_pushvalue(L, -1);
+		lua_rawget(L, -3); // base[key]
+		bool bKeep = !lua_isnil(L, -1);
+		lua_pop(L, 1);
+
+		// clearing existing fields is fine during lua_next
+		if(!bKeep)
+		{
+			lua_pushvalue(L, -1);
+			lua_pushnil(L);
+			lua_rawset(L, -5); // _LOADED[key] = nil
+		}
+	}
+	lua_pop(L, 2); // pop the copy and _LOADED
+}
+
 /** Loads the Lua libraries and sets all the variables needed for FF
 */
 void CFFScriptManager::SetupEnvironmentForFF()
@@ -175,6 +446,13 @@ void CFFScriptManager::SetupEnvironmentForFF()
 	lua_settable(L, -3); // -3 is the package table
 	lua_pop(L, 1); // pop _G.package
 
+	// make require compile through the chunk cache; this is equivelent to _G.package.loaders[2] = loader_Lua
+	lua_getglobal(L, LUA_LOADLIBNAME);
+	lua_getfield(L, -1, "loaders");
+	lua_pushcfunction(L, loader_Lua);
+	lua_rawseti(L, -2, 2);
+	lua_pop(L, 2); // pop _G.package.loaders and _G.package
+
 	// initialize luabind
 	luabind::open(L);
 
@@ -234,32 +512,17 @@ bool CFFScriptManager::LoadFileIntoFunction( const char *filename )
 {
 	VPROF_BUDGET( "CFFScriptManager::LoadFileIntoFunction", VPROF_BUDGETGROUP_FF_LUA );
 
-	// open the file
+	// load the file into a function that is pushed to the top of the stack
 	LuaMsg("Loading Lua File: %s\n", filename);
-	FileHandle_t hFile = filesystem->Open(filename, "rb", "MOD");
+	int errorCode = loadfile(L, filename, "MOD", filename);
 
-	if (!hFile)
+	if (errorCode == LUA_ERRFILE)
 	{
 		LuaWarning("%s either does not exist or could not be opened.\n", filename);
+		lua_pop( L, 1 );
 		return false;
 	}
 
-	// allocate buffer for file contents
-	int fileSize = filesystem->Size(hFile);
-	char *buffer = (char*)MemAllocScratch(fileSize + 1);
-	Assert(buffer);
-		
-	// load file contents into a null-terminated buffer
-	filesystem->Read(buffer, fileSize, hFile);
-	buffer[fileSize] = 0;
-	filesystem->Close(hFile);
-	
-	// load the buffer into a function that is pushed to the top of the stack
-	int errorCode = luaL_loadbuffer(L, buffer, fileSize, filename);
-	
-	// cleanup buffer
-	MemFreeScratch();
-
 	// check if load was successful
 	if (errorCode != 0)
 	{
@@ -278,6 +541,7 @@ bool CFFScriptManager::LoadFileIntoFunction( const char *filename )
 bool CFFScriptManager::LoadFile(const char *filename)
 {
 	VPROF_BUDGET( "CFFScriptManager::LoadFile", VPROF_BUDGETGROUP_FF_LUA );
+	CFFLuaProfileScope profileScope( "LoadFile" );
 
 	if (!LoadFileIntoFunction( filename ))
 		return false;
@@ -327,11 +591,15 @@ void CFFScriptManager::LevelInit(const char* szMapName)
 	if(!szMapName)
 		return;
 
+	double flStart = Plat_FloatTime();
+
 	g_Disable_Timelimit = false;
 
 	// setup VM
 	Init();
 
+	m_ChunkCache.ResetLoadStats();
+
 	// load lua files
 	LoadFile("maps/includes/base.lua");
 
@@ -380,6 +648,15 @@ void CFFScriptManager::LevelInit(const char* szMapName)
 		}
 	}
 
+	// lua_globalhooks counts per level
+	memset( m_nGlobalHookExecuted, 0, sizeof( m_nGlobalHookExecuted ) );
+	memset( m_nGlobalHookSkipped, 0, sizeof( m_nGlobalHookSkipped ) );
+
+	// parse+compile time saved by reusing bytecode from earlier levels
+	m_ChunkCache.PrintLoadStats();
+
+	LuaMsg("Lua level setup took %.2f ms.\n", (Plat_FloatTime() - flStart) * 1000.0);
+
 	// spawn the helper entity
 	CFFEntitySystemHelper::Create();
 }
@@ -387,6 +664,12 @@ void CFFScriptManager::LevelInit(const char* szMapName)
 /////////////////////////////////////////////////////////////////////////////
 void CFFScriptManager::LevelShutdown()
 {
+	if(L && m_bPersistentVM && lua_persistentvm.GetBool())
+	{
+		EndLevelEnvironment();
+		return;
+	}
+
 	Shutdown();
 }
 
@@ -703,6 +986,7 @@ bool FFScriptRunPredicates( CFFLuaSC *pContext, const char *pszFunction, bool bE
 bool CFFScriptManager::RunPredicates_LUA( CBaseEntity *pObject, CFFLuaSC *pContext, const char *szFunctionName )
 {
 	VPROF_BUDGET( "CFFScriptManager::RunPredicates_LUA", VPROF_BUDGETGROUP_FF_LUA );
+	CFFLuaProfileScope profileScope( "RunPredicates_LUA" );
 
 	if( !pContext )
 		return false;
@@ -723,6 +1007,208 @@ bool CFFScriptManager::RunPredicates_LUA( CBaseEntity *pObject, CFFLuaSC *pConte
 	return false;
 }
 
+/////////////////////////////////////////////////////////////////////////////
+// Purpose: Same as above but calls a pre-resolved entity callback
+/////////////////////////////////////////////////////////////////////////////
+bool CFFScriptManager::RunPredicates_LUA( CBaseEntity *pObject, CFFLuaSC *pContext, FFLuaHook_t eHook )
+{
+	VPROF_BUDGET( "CFFScriptManager::RunPredicates_LUA", VPROF_BUDGETGROUP_FF_LUA );
+	CFFLuaProfileScope profileScope( "RunPredicates_LUA" );
+
+	if( !pContext )
+		return false;
+
+	// see above
+	if( pContext->GetNumParams() == 0 )
+	{
+		CBaseEntity *pEntity = NULL;
+		pContext->Push( pEntity );
+	}
+
+	return pContext->CallFunction( pObject, eHook );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+const char *CFFScriptManager::GetHookName( FFLuaHook_t eHook )
+{
+	if( eHook < 0 || eHook >= LUAHOOK_COUNT )
+		return "";
+
+	return g_pszLuaHookNames[ eHook ];
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool CFFScriptManager::HasHook( CBaseEntity *pEntity, FFLuaHook_t eHook )
+{
+	int iTableRef, iFuncRef;
+	return GetHookRefs( pEntity, eHook, iTableRef, iFuncRef );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool CFFScriptManager::HasGlobalHook( FFLuaGlobalHook_t eHook )
+{
+	VPROF_BUDGET( "CFFScriptManager::HasGlobalHook", VPROF_BUDGETGROUP_FF_LUA );
+	Assert( eHook >= 0 && eHook < GLOBALHOOK_COUNT );
+
+	if( !L || m_iLookupHookRef == LUA_NOREF )
+		return false;
+
+	// a single global lookup, still far cheaper than building a CFFLuaSC and
+	// going through luabind only to find the function isn't there
+	int iTop = lua_gettop( L );
+	lua_rawgeti( L, LUA_REGISTRYINDEX, m_iLookupHookRef );
+	lua_pushstring( L, g_pszLuaGlobalHookNames[ eHook ] );
+
+	bool bFound = false;
+	if( lua_pcall( L, 1, 1, 0 ) == 0 )
+		bFound = lua_isfunction( L, -1 ) != 0;
+	else
+		LuaWarning( "Error looking up %s: %s\n", g_pszLuaGlobalHookNames[ eHook ], lua_tostring( L, -1 ) );
+
+	lua_settop( L, iTop );
+	return bFound;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFScriptManager::CountGlobalHook( FFLuaGlobalHook_t eHook, bool bExecuted )
+{
+	Assert( eHook >= 0 && eHook < GLOBALHOOK_COUNT );
+
+	if( bExecuted )
+		m_nGlobalHookExecuted[ eHook ]++;
+	else
+		m_nGlobalHookSkipped[ eHook ]++;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFScriptManager::PrintGlobalHookStats()
+{
+	Msg( "%-20s %-8s %10s %10s\n", "callback", "defined", "executed", "skipped" );
+
+	for( int i = 0; i < GLOBALHOOK_COUNT; i++ )
+	{
+		Msg( "%-20s %-8s %10u %10u\n",
+			g_pszLuaGlobalHookNames[ i ],
+			HasGlobalHook( ( FFLuaGlobalHook_t )i ) ? "yes" : "no",
+			m_nGlobalHookExecuted[ i ],
+			m_nGlobalHookSkipped[ i ] );
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFScriptManager::ResetHookEntry( LuaHookEntry_t &entry, bool bUnref )
+{
+	if( bUnref && L )
+	{
+		luaL_unref( L, LUA_REGISTRYINDEX, entry.iTableRef );
+		for( int i = 0; i < LUAHOOK_COUNT; i++ )
+			luaL_unref( L, LUA_REGISTRYINDEX, entry.iFuncRefs[i] );
+	}
+
+	entry.iSerial = -1;
+	entry.iszName = NULL_STRING;
+	entry.iTableRef = LUA_NOREF;
+	for( int i = 0; i < LUAHOOK_COUNT; i++ )
+		entry.iFuncRefs[i] = LUA_NOREF;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Points iRef at the value at stack index iIndex, keeping the old reference
+// if it already refers to that value
+void CFFScriptManager::UpdateHookRef( int &iRef, int iIndex )
+{
+	if( iRef != LUA_NOREF )
+	{
+		lua_rawgeti( L, LUA_REGISTRYINDEX, iRef );
+		bool bSame = lua_rawequal( L, -1, iIndex ) != 0;
+		lua_pop( L, 1 );
+
+		if( bSame )
+			return;
+
+		luaL_unref( L, LUA_REGISTRYINDEX, iRef );
+	}
+
+	lua_pushvalue( L, iIndex );
+	iRef = luaL_ref( L, LUA_REGISTRYINDEX );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFScriptManager::ClearHookCache()
+{
+	for( unsigned short it = m_HookCache.FirstInorder(); m_HookCache.IsValidIndex( it ); it = m_HookCache.NextInorder( it ) )
+		ResetHookEntry( m_HookCache[it], true );
+
+	m_HookCache.RemoveAll();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool CFFScriptManager::GetHookRefs( CBaseEntity *pEntity, FFLuaHook_t eHook, int &iTableRef, int &iFuncRef )
+{
+	VPROF_BUDGET( "CFFScriptManager::GetHookRefs", VPROF_BUDGETGROUP_FF_LUA );
+
+	if( !L || m_iLookupHookRef == LUA_NOREF || !pEntity || eHook < 0 || eHook >= LUAHOOK_COUNT )
+		return false;
+
+	string_t iszName = pEntity->GetEntityName();
+	if( iszName == NULL_STRING || !STRING( iszName )[0] )
+		return false;
+
+	const CBaseHandle &hEntity = pEntity->GetRefEHandle();
+
+	unsigned short it = m_HookCache.Find( hEntity.GetEntryIndex() );
+	if( !m_HookCache.IsValidIndex( it ) )
+	{
+		LuaHookEntry_t entry;
+		ResetHookEntry( entry, false );
+		it = m_HookCache.Insert( hEntity.GetEntryIndex(), entry );
+	}
+
+	LuaHookEntry_t &entry = m_HookCache[it];
+
+	// slot was reused by a different entity or the entity got renamed
+	if( entry.iSerial != hEntity.GetSerialNumber() || entry.iszName != iszName )
+	{
+		ResetHookEntry( entry, true );
+		entry.iSerial = hEntity.GetSerialNumber();
+		entry.iszName = iszName;
+	}
+
+	// look the table and callback up again every time, as the scripts are
+	// free to (re)define either whenever they like. the lookup goes through
+	// __index so inherited functions work
+	int iTop = lua_gettop( L );
+	lua_rawgeti( L, LUA_REGISTRYINDEX, m_iLookupHookRef );
+	lua_pushstring( L, STRING( iszName ) );
+	lua_pushstring( L, g_pszLuaHookNames[ eHook ] );
+	if( lua_pcall( L, 2, 2, 0 ) != 0 )
+	{
+		LuaWarning( "Error looking up %s:%s: %s\n", STRING( iszName ), g_pszLuaHookNames[ eHook ], lua_tostring( L, -1 ) );
+		lua_settop( L, iTop );
+		return false;
+	}
+
+	// only positive lookups are kept, there's nothing to go stale otherwise
+	int &iHookRef = entry.iFuncRefs[ eHook ];
+	bool bFound = lua_istable( L, iTop + 1 ) && lua_isfunction( L, iTop + 2 );
+	if( bFound )
+	{
+		UpdateHookRef( entry.iTableRef, iTop + 1 );
+		UpdateHookRef( iHookRef, iTop + 2 );
+
+		iTableRef = entry.iTableRef;
+		iFuncRef = iHookRef;
+	}
+	else if( iHookRef != LUA_NOREF )
+	{
+		luaL_unref( L, LUA_REGISTRYINDEX, iHookRef );
+		iHookRef = LUA_NOREF;
+	}
+
+	lua_settop( L, iTop );
+	return bFound;
+}
+
 /** Wrapper for Msg that prefixes the string with info about where it's coming from in the format: [SCRIPT]
 */
 void CFFScriptManager::LuaMsg( const char *pszFormat, ... )
@@ -763,7 +1249,9 @@ CON_COMMAND( lua_dostring, "Run a server-side Lua string in the global environme
 	}
 
 	lua_State *L = _scriptman.GetLuaState();
+	CFFLuaProfileScope profileScope( "lua_dostring" );
 	int status = luaL_dostring(L, engine->Cmd_Args());
+
 	if (status != 0) {
 		Warning( "%s\n", lua_tostring(L, -1) );
 		lua_pop(L, 1);
@@ -779,3 +1267,11 @@ CON_COMMAND( lua_dostring, "Run a server-side Lua string in the global environme
 	}
 	lua_settop(L, 0);  /* clear stack */
 }
+
+CON_COMMAND( lua_globalhooks, "Shows which well-known global Lua callbacks the current scripts define and how many calls to them were executed or skipped" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	_scriptman.PrintGlobalHookStats();
+}
@@ -1,6 +1,16 @@
 #ifndef FF_SCRIPTMAN_H
 #define FF_SCRIPTMAN_H
 
+#ifndef UTLMAP_H
+	#include "utlmap.h"
+#endif
+#ifndef FF_LUAPROFILER_H
+	#include "ff_luaprofiler.h"
+#endif
+#ifndef FF_LUACHUNKCACHE_H
+	#include "ff_luachunkcache.h"
+#endif
+
 // forward declarations
 struct lua_State;
 
@@ -14,6 +24,48 @@ namespace luabind
 
 class CFFLuaSC;
 
+// well-known entity callbacks. these get resolved once per entity into lua
+// registry references so the hot paths (touches, uses, spawn checks) don't
+// have to look up the entity table and function by name on every call
+enum FFLuaHook_t
+{
+	LUAHOOK_ALLOWED = 0,
+	LUAHOOK_ONFAILTOUCH,
+	LUAHOOK_ONTOUCH,
+	LUAHOOK_ONFAILUSE,
+	LUAHOOK_ONUSE,
+	LUAHOOK_ONTRIGGER,
+	LUAHOOK_ONACTIVE,
+	LUAHOOK_ONINACTIVE,
+	LUAHOOK_ONREMOVED,
+	LUAHOOK_ONRESTORED,
+	LUAHOOK_SPAWN,
+	LUAHOOK_VALIDSPAWN,
+	LUAHOOK_ISINACTIVE,
+	LUAHOOK_ONOWNERCLOAK,
+	LUAHOOK_DROPITEMCMD,
+
+	LUAHOOK_COUNT
+};
+
+// well-known global callbacks. which of these the loaded scripts actually
+// define is recorded after every load so callers can skip building a
+// context for callbacks that don't exist
+enum FFLuaGlobalHook_t
+{
+	GLOBALHOOK_PLAYER_ONDAMAGE = 0,
+	GLOBALHOOK_PLAYER_KILLED,
+	GLOBALHOOK_PLAYER_ONKILL,
+	GLOBALHOOK_PLAYER_SPAWN,
+	GLOBALHOOK_PLAYER_ONUSE,
+	GLOBALHOOK_BUILDABLE_ONDAMAGE,
+	GLOBALHOOK_BUILDABLE_KILLED,
+	GLOBALHOOK_FLAGINFO,
+	GLOBALHOOK_RESTARTROUND,
+
+	GLOBALHOOK_COUNT
+};
+
 class CFFScriptManager
 {
 public:
@@ -28,6 +80,11 @@ private:
 	void SetupEnvironmentForFF();
 	void MakeEnvironmentSafe();
 
+	// gives each map a fresh copy of the globals on a VM that is kept across
+	// level changes (lua_persistentvm)
+	void BeginLevelEnvironment();
+	void EndLevelEnvironment();
+
 public:
 	bool LoadFileIntoFunction( const char *filename );
 	bool LoadFile( const char *filename );
@@ -66,13 +123,70 @@ public:
 	void RemoveKeysFromGlobalTable( const char *pszTableName, const char **ppszKeys );
 
 	bool RunPredicates_LUA( CBaseEntity *pObject, CFFLuaSC *pContext, const char *szFunctionName );
+	bool RunPredicates_LUA( CBaseEntity *pObject, CFFLuaSC *pContext, FFLuaHook_t eHook );
+
+	// looks up the registry references for an entity's lua table and one of
+	// its well-known callbacks. the lookup itself is done every time, so
+	// callbacks defined or replaced at run time are seen straight away; only
+	// the references are kept, and reused for as long as they still point at
+	// the same table and function. returns false if the entity has no table,
+	// the table doesn't define the callback or the lookup raised an error
+	bool GetHookRefs( CBaseEntity *pEntity, FFLuaHook_t eHook, int &iTableRef, int &iFuncRef );
+
+	// forgets every cached callback reference
+	void ClearHookCache();
+
+	static const char *GetHookName( FFLuaHook_t eHook );
+
+	// returns true if the entity defines the callback
+	bool HasHook( CBaseEntity *pEntity, FFLuaHook_t eHook );
+
+	// returns true if the scripts define the global callback. looked up on
+	// every call, so callbacks defined at run time are never missed
+	bool HasGlobalHook( FFLuaGlobalHook_t eHook );
+
+	// counts a call site as executed or skipped (see lua_globalhooks)
+	void CountGlobalHook( FFLuaGlobalHook_t eHook, bool bExecuted );
+
+	void PrintGlobalHookStats();
 
 public:
 	// returns the lua interpreter
 	lua_State* GetLuaState() const { return L; }
 
+	// per-function script profiler (lua_profile)
+	CFFLuaProfiler& GetProfiler() { return m_Profiler; }
+
+	// compiled scripts kept across level changes (lua_chunkcache)
+	CFFLuaChunkCache& GetChunkCache() { return m_ChunkCache; }
+
 private:
+	struct LuaHookEntry_t
+	{
+		int			iSerial;					///< serial number of the entity handle that was resolved
+		string_t	iszName;					///< entity name at the time it was resolved
+		int			iTableRef;					///< registry ref of the entity's table
+		int			iFuncRefs[LUAHOOK_COUNT];	///< registry refs of the callbacks
+	};
+
+	void ResetHookEntry( LuaHookEntry_t &entry, bool bUnref );
+	void UpdateHookRef( int &iRef, int iIndex );
+
 	lua_State*	L;				///< Lua VM
+
+	bool		m_bPersistentVM;	///< L is kept across level changes
+	int			m_iBaseGlobalsRef;	///< registry ref of the globals as set up by SetupEnvironmentForFF
+	int			m_iBaseLoadedRef;	///< registry ref of a copy of package.loaded as set up by SetupEnvironmentForFF
+	double		m_flBuildTime;		///< seconds it took to build L and the bindings
+	int			m_iLookupHookRef;	///< registry ref of the protected lookup GetHookRefs calls
+
+	CFFLuaProfiler	m_Profiler;
+	CFFLuaChunkCache	m_ChunkCache;
+
+	CUtlMap<int, LuaHookEntry_t>	m_HookCache;	///< keyed by entity handle entry index
+
+	unsigned int	m_nGlobalHookExecuted[GLOBALHOOK_COUNT];	///< calls made since the level started
+	unsigned int	m_nGlobalHookSkipped[GLOBALHOOK_COUNT];		///< calls skipped since the level started
 };
 
 // global externs
@@ -6,6 +6,8 @@
 #include "ff_utils.h"
 #include "ff_gamerules.h"
 #include "IEffects.h"
+#include "ff_pvscache.h"
+#include "ff_cellgrid.h"
 
 #include "omnibot_interface.h"
 
@@ -787,6 +789,154 @@ CBaseEntity *SG_IsBetterTarget( CBaseEntity *cur, CBaseEntity *latest, float dis
 	return cur;
 }
 
+//=============================================================================
+//
+//	class CFFSentryTargetList
+//
+//=============================================================================
+
+// How much further than SG_RANGE an entity's origin can be while its body
+// target is still in range of a sentry's center
+#define SG_TARGETLIST_SLACK 128.0f
+#define SG_TARGETLIST_CELLSIZE ( SG_RANGE + SG_TARGETLIST_SLACK )
+
+//-----------------------------------------------------------------------------
+// Purpose: Everything a sentry could target, built once a tick for all the
+//			sentries searching that tick. Players, sentries, dispensers and
+//			man cannons are bucketed on a grid of SG_RANGE sized cells so a
+//			sentry only looks at the players that have something near it,
+//			and the state of each player that doesn't depend on the sentry
+//			(cloak, disguise, radio tag) is worked out once.
+//-----------------------------------------------------------------------------
+class CFFSentryTargetList
+{
+public:
+	struct PlayerState_t
+	{
+		bool	bCloaked;
+		int		iDisguisedTeam;		// TEAM_UNASSIGNED if not disguised
+		int		iRadioTagTeams;		// teams this player is a radio tag target for
+	};
+
+	CFFSentryTargetList() : m_iTick( -1 ), m_Candidates( SG_TARGETLIST_CELLSIZE ) {}
+
+	// Fills pPlayers with the indices of players that have something within
+	// flRange (+ slack) of vecOrigin, in index order. Returns the count.
+	int GetPlayersInRange( const Vector &vecOrigin, float flRange, int *pPlayers );
+
+	const PlayerState_t &GetPlayerState( int iPlayer ) const { return m_Players[ iPlayer ]; }
+
+private:
+	struct Candidate_t
+	{
+		int		iPlayer;
+		Vector	vecOrigin;
+	};
+
+	void Build( void );
+	void AddCandidate( int iPlayer, CBaseEntity *pEntity );
+
+	int							m_iTick;
+	CFFCellGrid<Candidate_t>	m_Candidates;
+	PlayerState_t				m_Players[ MAX_PLAYERS + 1 ];
+};
+
+static CFFSentryTargetList g_SentryTargetList;
+
+//-----------------------------------------------------------------------------
+// Purpose: Rebuild the list from scratch
+//-----------------------------------------------------------------------------
+void CFFSentryTargetList::Build( void )
+{
+	VPROF_BUDGET( "CFFSentryTargetList::Build", VPROF_BUDGETGROUP_FF_BUILDABLE );
+
+	m_iTick = gpGlobals->tickcount;
+	m_Candidates.RemoveAll();
+
+	for( int i = 1; i <= gpGlobals->maxClients && i <= MAX_PLAYERS; i++ ) 
+	{
+		CFFPlayer *pPlayer = ToFFPlayer( UTIL_PlayerByIndex( i ) );
+		if( !pPlayer || pPlayer->IsObserver() )
+			continue;
+
+		PlayerState_t &state = m_Players[ i ];
+		state.bCloaked = pPlayer->IsCloaked();
+		state.iDisguisedTeam = pPlayer->IsDisguised() ? pPlayer->GetDisguisedTeam() : TEAM_UNASSIGNED;
+		state.iRadioTagTeams = 0;
+
+		if( pPlayer->IsRadioTagged() )
+		{
+			for( int iTeam = TEAM_BLUE; iTeam <= TEAM_GREEN; iTeam++ )
+			{
+				if( IsPlayerRadioTagTarget( pPlayer, iTeam ) )
+					state.iRadioTagTeams |= ( 1 << iTeam );
+			}
+		}
+
+		if( pPlayer->IsAlive() )
+			AddCandidate( i, pPlayer );
+
+		AddCandidate( i, pPlayer->GetSentryGun() );
+		AddCandidate( i, pPlayer->GetDispenser() );
+		AddCandidate( i, pPlayer->GetManCannon() );
+	}
+
+	m_Candidates.Sort();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Put an entity in the cell its origin is in
+//-----------------------------------------------------------------------------
+void CFFSentryTargetList::AddCandidate( int iPlayer, CBaseEntity *pEntity )
+{
+	if( !pEntity )
+		return;
+
+	Candidate_t &candidate = m_Candidates.Add( pEntity->GetAbsOrigin() );
+	candidate.iPlayer = iPlayer;
+	candidate.vecOrigin = pEntity->GetAbsOrigin();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Players with something in range of a sentry
+//-----------------------------------------------------------------------------
+int CFFSentryTargetList::GetPlayersInRange( const Vector &vecOrigin, float flRange, int *pPlayers )
+{
+	if( m_iTick != gpGlobals->tickcount )
+		Build();
+
+	bool bInRange[ MAX_PLAYERS + 1 ];
+	Q_memset( bInRange, 0, sizeof( bInRange ) );
+
+	float flRangeSqr = ( flRange + SG_TARGETLIST_SLACK ) * ( flRange + SG_TARGETLIST_SLACK );
+	int x = m_Candidates.CellCoord( vecOrigin.x );
+	int y = m_Candidates.CellCoord( vecOrigin.y );
+
+	// Cells are at least as big as the range so the 3x3 around us covers it
+	for( int dx = -1; dx <= 1; dx++ )
+	{
+		for( int dy = -1; dy <= 1; dy++ )
+		{
+			int iEnd;
+			for( int i = m_Candidates.FindCell( x + dx, y + dy, &iEnd ); i < iEnd; i++ )
+			{
+				const Candidate_t &candidate = m_Candidates[ i ];
+				if( ( candidate.vecOrigin - vecOrigin ).LengthSqr() <= flRangeSqr )
+					bInRange[ candidate.iPlayer ] = true;
+			}
+		}
+	}
+
+	int nPlayers = 0;
+	for( int i = 1; i <= MAX_PLAYERS; i++ )
+	{
+		if( bInRange[ i ] )
+			pPlayers[ nPlayers++ ] = i;
+	}
+
+	return nPlayers;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: The turret doesn't run base AI properly, which is a bad decision.
 //			As a result, it has to manually find enemies.
@@ -811,14 +961,24 @@ CBaseEntity *CFFSentryGun::HackFindEnemy( void )
 	// reset every single time through
 	m_flCloakDistance = 65536.0f;
 
-	for( int i = 1; i <= gpGlobals->maxClients; i++ ) 
+	// Only players with something in range, everyone else would fail the
+	// range check in IsTargetVisible anyway
+	int iPlayers[ MAX_PLAYERS ];
+	int nPlayers = g_SentryTargetList.GetPlayersInRange( vecOrigin, SG_RANGE, iPlayers );
+
+	VPROF_INCREMENT_COUNTER( "SG candidates considered", nPlayers );
+
+	for( int iCandidate = 0; iCandidate < nPlayers; iCandidate++ ) 
 	{
+		int i = iPlayers[ iCandidate ];
 		CFFPlayer *pPlayer = ToFFPlayer( UTIL_PlayerByIndex(i) );
 		if( !pPlayer )
 			continue;
 		if( pPlayer->IsObserver() )
 			continue;
 
+		const CFFSentryTargetList::PlayerState_t &state = g_SentryTargetList.GetPlayerState( i );
+
 		bool bIsSentryVisible = false;
 		bool bIsSentryMaliciouslySabotaged = false;
 		CFFSentryGun *pSentryGun = pPlayer->GetSentryGun();
@@ -848,7 +1008,7 @@ CBaseEntity *CFFSentryGun::HackFindEnemy( void )
 				continue;
 		}
 
-		if ( pPlayer->IsCloaked() )
+		if ( state.bCloaked )
 		{
 			// the player won't be visible, but m_flCloakDistance may change and cause the sonar sound to emit
 			IsTargetVisible( pPlayer, SG_RANGE );
@@ -856,15 +1016,17 @@ CBaseEntity *CFFSentryGun::HackFindEnemy( void )
 		}
 
 		// Spy check - but don't let valid radio tagged targets sneak by!
-		if( pPlayer->IsDisguised() ) // && !pPlayer->IsCloaked() )
+		if( state.iDisguisedTeam != TEAM_UNASSIGNED ) // && !pPlayer->IsCloaked() )
 		{
+			bool bRadioTagTarget = ( state.iRadioTagTeams & ( 1 << pOwner->GetTeamNumber() ) ) != 0;
+
 			// Spy disguised as owners team
-			if( ( pPlayer->GetDisguisedTeam() == pOwner->GetTeamNumber() ) && ( !IsPlayerRadioTagTarget( pPlayer, pOwner->GetTeamNumber() ) ) )
+			if( ( state.iDisguisedTeam == pOwner->GetTeamNumber() ) && !bRadioTagTarget )
 				continue;
 
 			// Spy disguised as allied team
 			//if( pOwnerTeam->GetAllies() & ( 1 << pPlayer->GetDisguisedTeam() ) )
-			if( FFGameRules()->IsTeam1AlliedToTeam2( pOwner->GetTeamNumber(), pPlayer->GetDisguisedTeam() ) && !IsPlayerRadioTagTarget( pPlayer, pOwner->GetTeamNumber() ) )
+			if( FFGameRules()->IsTeam1AlliedToTeam2( pOwner->GetTeamNumber(), state.iDisguisedTeam ) && !bRadioTagTarget )
 				continue;
 		}
 
@@ -1042,14 +1204,10 @@ bool CFFSentryGun::IsTargetVisible( CBaseEntity *pTarget, int iSightDistance )
 		return false;
 
 	// Check PVS for early out
-	if(SG_USEPVS)
-	{
-		byte pvs[ MAX_MAP_CLUSTERS/8 ];
-		int iPVSCluster = engine->GetClusterForOrigin(vecOrigin);
-		int iPVSLength = engine->GetPVSForCluster(iPVSCluster, sizeof(pvs), pvs);
-		if(!engine->CheckOriginInPVS(vecTarget, pvs, iPVSLength))
-			return false;
-	}
+	if( SG_USEPVS && !_pvscache.CheckPVS( vecOrigin, vecTarget ) )
+		return false;
+
+	VPROF_INCREMENT_COUNTER( "SG candidates traced", 1 );
 
 	// Can we trace to the target?
 	trace_t tr;
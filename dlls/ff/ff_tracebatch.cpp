@@ -0,0 +1,128 @@
+// ff_tracebatch.cpp
+
+/////////////////////////////////////////////////////////////////////////////
+// includes
+#include "cbase.h"
+#include "ff_tracebatch.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+/////////////////////////////////////////////////////////////////////////////
+CFFTraceService _traceservice;
+
+/////////////////////////////////////////////////////////////////////////////
+int CFFTraceBatch::AddTraceLine( const Vector &vecStart, const Vector &vecEnd, unsigned int fMask, const IHandleEntity *pIgnore, int iCollisionGroup )
+{
+	int iSlot = m_Requests.AddToTail();
+
+	Request_t &request = m_Requests[ iSlot ];
+	request.ray.Init( vecStart, vecEnd );
+	request.fMask = fMask;
+	request.pFilter = NULL;
+	request.pIgnore = pIgnore;
+	request.iCollisionGroup = iCollisionGroup;
+
+	return iSlot;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+int CFFTraceBatch::AddTraceLine( const Vector &vecStart, const Vector &vecEnd, unsigned int fMask, ITraceFilter *pFilter )
+{
+	int iSlot = m_Requests.AddToTail();
+
+	Request_t &request = m_Requests[ iSlot ];
+	request.ray.Init( vecStart, vecEnd );
+	request.fMask = fMask;
+	request.pFilter = pFilter;
+	request.pIgnore = NULL;
+	request.iCollisionGroup = COLLISION_GROUP_NONE;
+
+	return iSlot;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+int CFFTraceBatch::AddTraceHull( const Vector &vecStart, const Vector &vecEnd, const Vector &vecMins, const Vector &vecMaxs, unsigned int fMask, ITraceFilter *pFilter )
+{
+	int iSlot = m_Requests.AddToTail();
+
+	Request_t &request = m_Requests[ iSlot ];
+	request.ray.Init( vecStart, vecEnd, vecMins, vecMaxs );
+	request.fMask = fMask;
+	request.pFilter = pFilter;
+	request.pIgnore = NULL;
+	request.iCollisionGroup = COLLISION_GROUP_NONE;
+
+	return iSlot;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFTraceBatch::Execute()
+{
+	_traceservice.CountBatch( m_Requests.Count() );
+
+	for( int i = 0; i < m_Requests.Count(); i++ )
+	{
+		Request_t &request = m_Requests[ i ];
+
+		// same as UTIL_TraceLine/UTIL_TraceHull, minus the debug overlays
+		if( request.pFilter )
+		{
+			enginetrace->TraceRay( request.ray, request.fMask, request.pFilter, &request.tr );
+		}
+		else
+		{
+			CTraceFilterSimple traceFilter( request.pIgnore, request.iCollisionGroup );
+			enginetrace->TraceRay( request.ray, request.fMask, &traceFilter, &request.tr );
+		}
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+CFFTraceService::CFFTraceService()
+{
+	Init();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+CFFTraceService::~CFFTraceService()
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFTraceService::Init()
+{
+	m_nBatches = 0;
+	m_nTraces = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFTraceService::Shutdown()
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFTraceService::CountBatch( int nTraces )
+{
+	if( !nTraces )
+		return;
+
+	m_nBatches++;
+	m_nTraces += nTraces;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFTraceService::PrintStats()
+{
+	Msg( "Trace batches since level start:\n" );
+	Msg( "  %u batches, %u traces\n", m_nBatches, m_nTraces );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+CON_COMMAND( sv_trace_stats, "Shows how many traces were batched for the current level" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	_traceservice.PrintStats();
+}
@@ -0,0 +1,85 @@
+// ff_tracebatch.h
+
+/////////////////////////////////////////////////////////////////////////////
+#ifndef FF_TRACEBATCH_H
+#define FF_TRACEBATCH_H
+
+/////////////////////////////////////////////////////////////////////////////
+// includes
+#ifndef UTLVECTOR_H
+	#include "utlvector.h"
+#endif
+
+/////////////////////////////////////////////////////////////////////////////
+// A set of independent line (or hull) traces. Callers queue everything they want
+// traced, run the batch once and then read the results back by slot, in
+// whatever order they like (normally the order they were queued in).
+//
+// Everything runs on the game thread: neither the engine's traces nor the
+// filters' game callbacks are safe to call from anywhere else. Nothing may
+// move, spawn or be removed between queueing and Execute.
+/////////////////////////////////////////////////////////////////////////////
+class CFFTraceBatch
+{
+private:
+	struct Request_t
+	{
+		Ray_t					ray;
+		unsigned int			fMask;
+		ITraceFilter			*pFilter;			// NULL to use pIgnore/iCollisionGroup
+		const IHandleEntity		*pIgnore;
+		int						iCollisionGroup;
+		trace_t					tr;
+	};
+
+public:
+	// queues a trace, returns the slot its result will be in
+	int AddTraceLine( const Vector &vecStart, const Vector &vecEnd, unsigned int fMask, const IHandleEntity *pIgnore, int iCollisionGroup );
+
+	// the filter has to stay around until the batch has been executed
+	int AddTraceLine( const Vector &vecStart, const Vector &vecEnd, unsigned int fMask, ITraceFilter *pFilter );
+
+	// swept box, same as UTIL_TraceHull
+	int AddTraceHull( const Vector &vecStart, const Vector &vecEnd, const Vector &vecMins, const Vector &vecMaxs, unsigned int fMask, ITraceFilter *pFilter );
+
+	// runs every queued trace
+	void Execute();
+
+	const trace_t &GetResult( int iSlot ) const { return m_Requests[ iSlot ].tr; }
+
+	int Count() const { return m_Requests.Count(); }
+	void Clear() { m_Requests.RemoveAll(); }
+
+private:
+	CUtlVector<Request_t>	m_Requests;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// Counts the batched traces for sv_trace_stats
+/////////////////////////////////////////////////////////////////////////////
+class CFFTraceService
+{
+public:
+	// 'structors
+	CFFTraceService();
+	~CFFTraceService();
+
+public:
+	void Init();
+	void Shutdown();
+
+	void CountBatch( int nTraces );
+
+	void PrintStats();
+
+private:
+	// stats since the level started
+	unsigned int	m_nBatches;
+	unsigned int	m_nTraces;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+extern CFFTraceService _traceservice;
+
+/////////////////////////////////////////////////////////////////////////////
+#endif
@@ -82,6 +82,13 @@
 #include "ff_luacontext.h"
 #include "ff_scheduleman.h"
 #include "ff_timerman.h"
+#include "ff_luagcman.h"
+#include "ff_luahudman.h"
+#include "ff_pvscache.h"
+#include "ff_tracebatch.h"
+#include "ff_areafieldman.h"
+#include "ff_nailsim.h"
+#include "ff_radiotagman.h"
 #include "util.h"
 
 #if !defined( _RETAIL )
@@ -824,6 +831,13 @@ bool CServerGameDLL::LevelInit( const char *pMapName, char const *pMapEntities,
 	// Added: Initialize Lua stuff
 	_scheduleman.Init();
 	_timerman.Init();
+	_luagcman.Init();
+	_luahudman.Init();
+	_pvscache.Init();
+	_traceservice.Init();
+	_areafieldman.Init();
+	_nailsim.Init();
+	_radiotagman.Init();
 	_scriptman.LevelInit(pMapName);
 
 	Omnibot::omnibot_interface::LevelInit();
@@ -1202,8 +1216,16 @@ void CServerGameDLL::LevelShutdown( void )
 
 	gEntList.Clear();
 
-	_scriptman.LevelShutdown();
+	// schedules hold references into the VM, so they go first
 	_scheduleman.Shutdown();
+	_luagcman.Shutdown();
+	_luahudman.Shutdown();
+	_pvscache.Shutdown();
+	_traceservice.Shutdown();
+	_areafieldman.Shutdown();
+	_nailsim.Shutdown();
+	_radiotagman.Shutdown();
+	_scriptman.LevelShutdown();
 	_timerman.Shutdown();
 
 	IGameSystem::LevelShutdownPostEntityAllSystems();
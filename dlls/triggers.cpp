@@ -374,11 +374,11 @@ bool CBaseTrigger::PassesTriggerFilters(CBaseEntity *pOther)
 			// If the entity sys allowed func returns false then 
 			// bail. If true, run these other checks.
 			CFFLuaSC hAllowed( 1, pOther );
-			if( _scriptman.RunPredicates_LUA( this, &hAllowed, "allowed" ) )
+			if( _scriptman.RunPredicates_LUA( this, &hAllowed, LUAHOOK_ALLOWED ) )
 			{
 				if( !hAllowed.GetBool() )
 				{
-					_scriptman.RunPredicates_LUA( this, &hAllowed, "onfailtouch" );
+					_scriptman.RunPredicates_LUA( this, &hAllowed, LUAHOOK_ONFAILTOUCH );
 					return false;
 				}
 			}
@@ -394,11 +394,11 @@ bool CBaseTrigger::PassesTriggerFilters(CBaseEntity *pOther)
 				// If the entity sys allowed func returns false then 
 				// bail. If true, run these other checks.
 				CFFLuaSC hAllowed( 1, pOther );
-				if( _scriptman.RunPredicates_LUA( this, &hAllowed, "allowed" ) )
+				if( _scriptman.RunPredicates_LUA( this, &hAllowed, LUAHOOK_ALLOWED ) )
 				{
 					if( !hAllowed.GetBool() )
 					{
-						_scriptman.RunPredicates_LUA( this, &hAllowed, "onfailtouch" );
+						_scriptman.RunPredicates_LUA( this, &hAllowed, LUAHOOK_ONFAILTOUCH );
 						return false;
 					}
 				}
@@ -412,11 +412,11 @@ bool CBaseTrigger::PassesTriggerFilters(CBaseEntity *pOther)
 				// If the entity sys allowed func returns false then 
 				// bail. If true, run these other checks.
 				CFFLuaSC hAllowed( 1, pOther );
-				if( _scriptman.RunPredicates_LUA( this, &hAllowed, "allowed" ) )
+				if( _scriptman.RunPredicates_LUA( this, &hAllowed, LUAHOOK_ALLOWED ) )
 				{
 					if( !hAllowed.GetBool() )
 					{
-						_scriptman.RunPredicates_LUA( this, &hAllowed, "onfailtouch" );
+						_scriptman.RunPredicates_LUA( this, &hAllowed, LUAHOOK_ONFAILTOUCH );
 						return false;
 					}
 				}
@@ -430,11 +430,11 @@ bool CBaseTrigger::PassesTriggerFilters(CBaseEntity *pOther)
 				// If the entity sys allowed func returns false then 
 				// bail. If true, run these other checks.
 				CFFLuaSC hAllowed( 1, pOther );
-				if( _scriptman.RunPredicates_LUA( this, &hAllowed, "allowed" ) )
+				if( _scriptman.RunPredicates_LUA( this, &hAllowed, LUAHOOK_ALLOWED ) )
 				{
 					if( !hAllowed.GetBool() )
 					{
-						_scriptman.RunPredicates_LUA( this, &hAllowed, "onfailtouch" );
+						_scriptman.RunPredicates_LUA( this, &hAllowed, LUAHOOK_ONFAILTOUCH );
 						return false;
 					}
 				}
@@ -449,11 +449,11 @@ bool CBaseTrigger::PassesTriggerFilters(CBaseEntity *pOther)
 				// If the entity sys allowed func returns false then 
 				// bail. If true, run these other checks.
 				CFFLuaSC hAllowed( 1, pOther );
-				if( _scriptman.RunPredicates_LUA( this, &hAllowed, "allowed" ) )
+				if( _scriptman.RunPredicates_LUA( this, &hAllowed, LUAHOOK_ALLOWED ) )
 				{
 					if( !hAllowed.GetBool() )
 					{
-						_scriptman.RunPredicates_LUA( this, &hAllowed, "onfailtouch" );
+						_scriptman.RunPredicates_LUA( this, &hAllowed, LUAHOOK_ONFAILTOUCH );
 						return false;
 					}
 				}
@@ -538,7 +538,7 @@ void CBaseTrigger::StartTouch(CBaseEntity *pOther)
 
 		// Fire the lua output
 		CFFLuaSC hTouch( 1, pOther );
-		_scriptman.RunPredicates_LUA( this, &hTouch, "ontouch" );
+		_scriptman.RunPredicates_LUA( this, &hTouch, LUAHOOK_ONTOUCH );
 
 		// Got a trigger_ff_script - do special stuff
 		if( Classify() == CLASS_TRIGGERSCRIPT )
@@ -641,7 +641,7 @@ void CBaseTrigger::EndTouch(CBaseEntity *pOther)
 		// Tell lua we're not touching this thing anymore. Run allowed
 		// just to make sure we're allowed to still be touching it.
 		CFFLuaSC hAllowed( 1, pOther );
-		if( _scriptman.RunPredicates_LUA( this, &hAllowed, "allowed" ) )
+		if( _scriptman.RunPredicates_LUA( this, &hAllowed, LUAHOOK_ALLOWED ) )
 		{
 			if( hAllowed.GetBool() )
 			{
@@ -1087,7 +1087,7 @@ void CTriggerMultiple::ActivateMultiTrigger(CBaseEntity *pActivator)
 
 	// Run lua trigger event
 	CFFLuaSC hOnTrigger( 1, pActivator );
-	_scriptman.RunPredicates_LUA( this, &hOnTrigger, "ontrigger" );
+	_scriptman.RunPredicates_LUA( this, &hOnTrigger, LUAHOOK_ONTRIGGER );
 
 	m_OnTrigger.FireOutput(m_hActivator, this);
 
@@ -1141,7 +1141,7 @@ void CFuncFFScript::SetActive( void )
 	DispatchUpdateTransmitState();
 
 	CFFLuaSC hContext;
-	_scriptman.RunPredicates_LUA( this, &hContext, "onactive" );
+	_scriptman.RunPredicates_LUA( this, &hContext, LUAHOOK_ONACTIVE );
 }
 
 //-----------------------------------------------------------------------------
@@ -1153,7 +1153,7 @@ void CFuncFFScript::SetInactive( void )
 	DispatchUpdateTransmitState();
 
 	CFFLuaSC hContext;
-	_scriptman.RunPredicates_LUA( this, &hContext, "oninactive" );
+	_scriptman.RunPredicates_LUA( this, &hContext, LUAHOOK_ONINACTIVE );
 }
 
 //-----------------------------------------------------------------------------
@@ -1165,7 +1165,7 @@ void CFuncFFScript::SetRemoved( void )
 	DispatchUpdateTransmitState();
 
 	CFFLuaSC hContext;
-	_scriptman.RunPredicates_LUA( this, &hContext, "onremoved" );
+	_scriptman.RunPredicates_LUA( this, &hContext, LUAHOOK_ONREMOVED );
 }
 
 //-----------------------------------------------------------------------------
@@ -1174,7 +1174,7 @@ void CFuncFFScript::SetRemoved( void )
 void CFuncFFScript::SetRestored( void )
 {
 	CFFLuaSC hContext;
-	_scriptman.RunPredicates_LUA( this, &hContext, "onrestored" );
+	_scriptman.RunPredicates_LUA( this, &hContext, LUAHOOK_ONRESTORED );
 }
 
 //-----------------------------------------------------------------------------
@@ -1185,7 +1185,7 @@ void CFuncFFScript::Spawn( void )
 	BaseClass::Spawn();
 
 	CFFLuaSC hContext;
-	_scriptman.RunPredicates_LUA( this, &hContext, "spawn" );
+	_scriptman.RunPredicates_LUA( this, &hContext, LUAHOOK_SPAWN );
 }
 
 //-----------------------------------------------------------------------------
@@ -4525,7 +4525,7 @@ bool CBaseVPhysicsTrigger::PassesTriggerFilters( CBaseEntity *pOther )
 	// assed like it currently is.
 	/*
 	CFFLuaSC hAllowed( 1, pOther );
-	if( _scriptman.RunPredicates_LUA( this, &hAllowed, "allowed" ) )
+	if( _scriptman.RunPredicates_LUA( this, &hAllowed, LUAHOOK_ALLOWED ) )
 	{
 		if( !hAllowed.GetBool() )
 			return false;
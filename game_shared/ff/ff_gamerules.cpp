@@ -32,6 +32,8 @@
 	#include "ff_utils.h"
 	#include "ff_buildableobjects_shared.h"
 	#include "ff_menuman.h"
+	#include "ff_luahudman.h"
+	#include "ff_explosionharness.h"
 #endif
 
 
@@ -70,6 +72,7 @@ IMPLEMENT_NETWORKCLASS_ALIASED( FFGameRulesProxy, DT_FFGameRulesProxy )
 	ConVar botrules_teamlimits("botrules_teamlimits", "", FCVAR_GAMEDLL);
 	ConVar botrules_teamroles("botrules_teamroles", "", FCVAR_GAMEDLL);
 	ConVar mp_respawndelay( "mp_respawndelay", "0", 0, "Time (in seconds) for spawn delays. Can be overridden by LUA." );
+	ConVar sv_spawn_cache( "sv_spawn_cache", "1", 0, "Share lua validspawn answers between players of the same team and class spawning in the same tick" );
 
 	bool g_Disable_Timelimit = false;
 #endif
@@ -330,6 +333,11 @@ ConVar mp_friendlyfire_armorstrip( "mp_friendlyfire_armorstrip",
 		// Init
 		m_flRoundStarted = 0.0f;
 
+		m_iSpawnCacheTick = -1;
+		m_nSpawnValidLookups = 0;
+		m_nSpawnValidChecks = 0;
+		m_nSpawnCacheHits = 0;
+
 		// Prematch system, game has not started
 		m_flGameStarted = -1.0f;
 		
@@ -536,7 +544,9 @@ ConVar mp_friendlyfire_armorstrip( "mp_friendlyfire_armorstrip",
 		if( bFullReset )
 		{
 			// give lua a chance to prepare for the restart
-			if (_scriptman.GetLuaState() != NULL)
+			bool bHasHook = _scriptman.HasGlobalHook( GLOBALHOOK_RESTARTROUND );
+			_scriptman.CountGlobalHook( GLOBALHOOK_RESTARTROUND, bHasHook );
+			if( bHasHook )
 			{
 				CFFLuaSC hRestartRound;
 				_scriptman.RunPredicates_LUA(NULL, &hRestartRound, "restartround");
@@ -621,6 +631,9 @@ ConVar mp_friendlyfire_armorstrip( "mp_friendlyfire_armorstrip",
 			// final task, trigger the recreation of any entities that need it.
 			MapEntity_ParseAllEntities( engine->GetMapEntitiesString(), &filter, true );
 
+			// Clients clear their lua hud on this event
+			_luahudman.ResetAll();
+
 			// Send event
 			IGameEvent *pEvent = gameeventmanager->CreateEvent( "ff_restartround" );
 			if( pEvent )
@@ -966,13 +979,16 @@ ConVar mp_friendlyfire_armorstrip( "mp_friendlyfire_armorstrip",
 		// start from scratch every time this function is called
 		m_SpawnPoints.Purge();
 
+		// the indices in the spawn cache are no good any more
+		m_iSpawnCacheTick = -1;
+
 		CBaseEntity	*pEntity = NULL;
 		// Add all the entities with the matching class type
 		while ( (pEntity = gEntList.FindEntityByClassT( pEntity, CLASS_TEAMSPAWN )) != NULL )
 		{
 			// See if lua says the spawn point is inactive
 			CFFLuaSC hIsInactive;
-			_scriptman.RunPredicates_LUA( pEntity, &hIsInactive, "isinactive" );
+			_scriptman.RunPredicates_LUA( pEntity, &hIsInactive, LUAHOOK_ISINACTIVE );
 
 			// add this spawn point to the list oif valid spawns
 			if (!hIsInactive.GetBool())
@@ -980,6 +996,126 @@ ConVar mp_friendlyfire_armorstrip( "mp_friendlyfire_armorstrip",
 		}
 	}
 
+	//-----------------------------------------------------------------------------
+	// Purpose: Starts the spawn point cache over each tick
+	//-----------------------------------------------------------------------------
+	void CFFGameRules::CheckSpawnCacheTick( void )
+	{
+		if( m_iSpawnCacheTick == gpGlobals->tickcount )
+			return;
+
+		m_iSpawnCacheTick = gpGlobals->tickcount;
+
+		m_SpawnCache.RemoveAll();
+
+		m_SpawnClaimed.SetCount( m_SpawnPoints.Count() );
+		for( int i = 0; i < m_SpawnClaimed.Count(); i++ )
+			m_SpawnClaimed[ i ] = false;
+	}
+
+	//-----------------------------------------------------------------------------
+	// Purpose: Whether this player is allowed to use a spawn point
+	//-----------------------------------------------------------------------------
+	bool CFFGameRules::IsSpawnPointValidCached( int iSpawnPoint, CFFPlayer *pPlayer )
+	{
+		CheckSpawnCacheTick();
+
+		m_nSpawnValidLookups++;
+
+		if( iSpawnPoint < 0 || iSpawnPoint >= m_SpawnPoints.Count() )
+			return false;
+
+		if( !sv_spawn_cache.GetBool() )
+		{
+			m_nSpawnValidChecks++;
+			return IsSpawnPointValid( m_SpawnPoints[ iSpawnPoint ], pPlayer );
+		}
+
+		// Scripts decide by team and class, and anything else they look at
+		// (flags, round state) won't change until something else happens
+		int iTeam = pPlayer->GetTeamNumber();
+		int iClass = pPlayer->GetClassSlot();
+
+		int iCache;
+		for( iCache = 0; iCache < m_SpawnCache.Count(); iCache++ )
+		{
+			if( m_SpawnCache[ iCache ].iTeam == iTeam && m_SpawnCache[ iCache ].iClass == iClass )
+				break;
+		}
+
+		if( iCache == m_SpawnCache.Count() )
+		{
+			iCache = m_SpawnCache.AddToTail();
+
+			SpawnCache_t &cache = m_SpawnCache[ iCache ];
+			cache.iTeam = iTeam;
+			cache.iClass = iClass;
+			cache.valid.SetCount( m_SpawnPoints.Count() );
+			for( int i = 0; i < cache.valid.Count(); i++ )
+				cache.valid[ i ] = -1;
+		}
+
+		// Only ask lua about the spawn points someone actually looks at
+		char &valid = m_SpawnCache[ iCache ].valid[ iSpawnPoint ];
+		if( valid == -1 )
+		{
+			m_nSpawnValidChecks++;
+			valid = IsSpawnPointValid( m_SpawnPoints[ iSpawnPoint ], pPlayer ) ? 1 : 0;
+		}
+		else
+			m_nSpawnCacheHits++;
+
+		return valid == 1;
+	}
+
+	//-----------------------------------------------------------------------------
+	// Purpose: Whether someone has already been given this spawn point this tick
+	//-----------------------------------------------------------------------------
+	bool CFFGameRules::IsSpawnPointClaimed( int iSpawnPoint )
+	{
+		CheckSpawnCacheTick();
+
+		if( iSpawnPoint < 0 || iSpawnPoint >= m_SpawnClaimed.Count() )
+			return false;
+
+		return m_SpawnClaimed[ iSpawnPoint ];
+	}
+
+	//-----------------------------------------------------------------------------
+	// Purpose: Someone is spawning here this tick
+	//-----------------------------------------------------------------------------
+	void CFFGameRules::ClaimSpawnPoint( int iSpawnPoint )
+	{
+		CheckSpawnCacheTick();
+
+		if( iSpawnPoint < 0 || iSpawnPoint >= m_SpawnClaimed.Count() )
+			return;
+
+		m_SpawnClaimed[ iSpawnPoint ] = true;
+	}
+
+	//-----------------------------------------------------------------------------
+	// Purpose: Shows how much spawn point checking the cache saved
+	//-----------------------------------------------------------------------------
+	void CFFGameRules::PrintSpawnStats( void )
+	{
+		Msg( "Spawn point selection since level start:\n" );
+		Msg( "  %d spawn points, %u validity lookups, %u served from the cache\n", m_SpawnPoints.Count(), m_nSpawnValidLookups, m_nSpawnCacheHits );
+		Msg( "  %u validspawn checks, %u without the cache\n", m_nSpawnValidChecks, m_nSpawnValidLookups );
+	}
+
+	//-----------------------------------------------------------------------------
+	// Purpose: Admin command for the spawn point stats
+	//-----------------------------------------------------------------------------
+	CON_COMMAND( ff_spawn_stats, "Shows how many spawn point checks were done for the current level" )
+	{
+		if ( !UTIL_IsCommandIssuedByServerAdmin() )
+			return;
+
+		if( FFGameRules() )
+			FFGameRules()->PrintSpawnStats();
+	}
+
 	//-----------------------------------------------------------------------------
 	// Purpose: Checks to see if a spawn point is clear
 	//-----------------------------------------------------------------------------
@@ -1040,14 +1176,17 @@ ConVar mp_friendlyfire_armorstrip( "mp_friendlyfire_armorstrip",
 			return false;		
 
 		// Check if lua lets us spawn here			
-		CFFLuaSC hAllowed;
-		hAllowed.Push( pFFPlayer );
-		if( _scriptman.RunPredicates_LUA( pSpot, &hAllowed, "validspawn" ) )
+		if( _scriptman.HasHook( pSpot, LUAHOOK_VALIDSPAWN ) )
 		{
-			// Spot is a valid place for us to spawn
-			if( hAllowed.GetBool() )
+			CFFLuaSC hAllowed;
+			hAllowed.Push( pFFPlayer );
+			if( _scriptman.RunPredicates_LUA( pSpot, &hAllowed, LUAHOOK_VALIDSPAWN ) )
 			{
-				return true;
+				// Spot is a valid place for us to spawn
+				if( hAllowed.GetBool() )
+				{
+					return true;
+				}
 			}
 		}
 
@@ -1110,6 +1249,7 @@ ConVar mp_friendlyfire_armorstrip( "mp_friendlyfire_armorstrip",
 					slot = 0;
 
 				// select the item from the current menu
+				CFFLuaProfileScope profileScope( "menu callback" );
 				CFFLuaSC hContext( 0 );
 				hContext.Push( pPlayer );
 				hContext.Push( szMenuName );
@@ -1206,6 +1346,21 @@ ConVar mp_friendlyfire_armorstrip( "mp_friendlyfire_armorstrip",
 	//			The force (or change in v) is always 8x the total damage.
 	//------------------------------------------------------------------------
 	void CFFGameRules::RadiusDamage(const CTakeDamageInfo &info, const Vector &vecSrcIn, float flRadius, int iClassIgnore, CBaseEntity *pEntityIgnore)
+	{
+		// ff_explosion_record needs to see everything either side of it
+		if (_explosionharness.IsRecording())
+		{
+			_explosionharness.RecordRadiusDamage(info, vecSrcIn, flRadius, iClassIgnore, pEntityIgnore);
+			return;
+		}
+
+		ApplyRadiusDamage(info, vecSrcIn, flRadius, iClassIgnore, pEntityIgnore);
+	}
+
+	//------------------------------------------------------------------------
+	// Purpose: The radius damage itself
+	//------------------------------------------------------------------------
+	void CFFGameRules::ApplyRadiusDamage(const CTakeDamageInfo &info, const Vector &vecSrcIn, float flRadius, int iClassIgnore, CBaseEntity *pEntityIgnore)
 	{
 		CBaseEntity *pEntity = NULL;
 		trace_t		tr;
@@ -25,6 +25,8 @@
 	#include "player.h"
 	#include "ff_buildableobjects_shared.h"
 	#include "ff_mapfilter.h"
+
+	class CFFPlayer;
 #endif
 
 
@@ -132,6 +134,8 @@ public:
 	virtual ~CFFGameRules();
 
 	virtual void	RadiusDamage(const CTakeDamageInfo &info, const Vector &vecSrc, float flRadius, int iClassIgnore, CBaseEntity *pEntityIgnore);
+	// RadiusDamage without the recording check, for ff_explosionharness
+	void			ApplyRadiusDamage(const CTakeDamageInfo &info, const Vector &vecSrc, float flRadius, int iClassIgnore, CBaseEntity *pEntityIgnore);
 	virtual float	GetAdjustedPushForce(float flPushForce, CBaseEntity *pVictim, const CTakeDamageInfo &info);
 	virtual float	GetAdjustedDamage(float flDamage, CBaseEntity *pVictim, const CTakeDamageInfo &info);
 
@@ -166,6 +170,40 @@ public:
 	
 	virtual void	ClientSettingsChanged( CBasePlayer *pPlayer );
 
+	// Whether m_SpawnPoints[ iSpawnPoint ] is valid for this player. Lua's
+	// validspawn is only asked the first time a spawn point is looked at
+	// for a team and class each tick, so everyone respawning at round
+	// start shares the answers
+	bool			IsSpawnPointValidCached( int iSpawnPoint, CFFPlayer *pPlayer );
+
+	// Spawn points already handed out this tick
+	bool			IsSpawnPointClaimed( int iSpawnPoint );
+	void			ClaimSpawnPoint( int iSpawnPoint );
+
+	void			PrintSpawnStats( void );
+
+private:
+	struct SpawnCache_t
+	{
+		int					iTeam;
+		int					iClass;
+		CUtlVector<char>	valid;		// one per spawn point, -1 until asked
+	};
+
+	// throws away the cache if it's from an earlier tick
+	void			CheckSpawnCacheTick( void );
+
+	int								m_iSpawnCacheTick;
+	CUtlVector<SpawnCache_t>		m_SpawnCache;
+	CUtlVector<bool>				m_SpawnClaimed;		// one per spawn point
+
+	// stats since the level started
+	unsigned int	m_nSpawnValidLookups;		// IsSpawnPointValidCached calls
+	unsigned int	m_nSpawnValidChecks;		// IsSpawnPointValid calls
+	unsigned int	m_nSpawnCacheHits;
+
+public:
+
 //private:
 //	CFFMapFilter	m_hMapFilter;
 
@@ -25,6 +25,7 @@
 	#include "beam_flags.h"
 	#include "ff_entity_system.h"
 	#include "te_effect_dispatch.h"
+	#include "ff_nailsim.h"
 #endif
 
 extern short g_sModelIndexFireball;
@@ -114,66 +115,84 @@ PRECACHE_WEAPON_REGISTER( ff_grenade_emp );
 					// For all other projectiles or objects that return
 					// something from TakeEmp we gotta add the explosions
 					// ourselves
-
-					trace_t		tr;						
-					Vector		vecOrigin = pEntity->GetAbsOrigin();
-
-					// Traceline to check if we should do scorch marks on the floor						
-					UTIL_TraceLine( vecOrigin + Vector( 0, 0, 2.0f ), vecOrigin - Vector( 0, 0, FF_DECALTRACE_TRACE_DIST ), MASK_SHOT_HULL, pEntity, COLLISION_GROUP_NONE, &tr);
-
-					// Explode now
-					if( tr.fraction != 1.0 )
-					{
-						Vector vecNormal = tr.plane.normal;
-						surfacedata_t *pdata = physprops->GetSurfaceData( tr.surface.surfaceProps );	
-						CPASFilter filter( vecOrigin );
-
-						te->Explosion( filter, -1.0, // don't apply cl_interp delay
-							&vecOrigin,
-							!pEntity->GetWaterLevel() ? g_sModelIndexFireball : g_sModelIndexWExplosion,
-							m_DmgRadius * .03, 
-							25,
-							TE_EXPLFLAG_NONE,
-							m_DmgRadius,
-							m_flDamage,
-							&vecNormal,
-							( char )pdata->game.material );
-
-						// Normal decals since trace hit something
-						UTIL_DecalTrace( &tr, "Scorch" );
-					}
-					else
-					{
-						CPASFilter filter( vecOrigin );
-
-						te->Explosion( filter, -1.0, // don't apply cl_interp delay
-							&vecOrigin, 
-							!pEntity->GetWaterLevel() != 0 ? g_sModelIndexFireball : g_sModelIndexWExplosion,
-							m_DmgRadius * .03, 
-							25,
-							TE_EXPLFLAG_NONE,
-							m_DmgRadius,
-							m_flDamage );
-
-						// Trace hit nothing so do custom scorch mark finding
-						FF_DecalTrace( pEntity, FF_DECALTRACE_TRACE_DIST, "Scorch" );
-					}
-
-					CTakeDamageInfo info( this, GetOwnerEntity(), GetBlastForce(), pEntity->GetAbsOrigin(), explode, DMG_SHOCK, 0, &vecOrigin );
-					RadiusDamage( info, pEntity->GetAbsOrigin(), m_DmgRadius, CLASS_NONE, NULL );
-						
-					EmitSound( "BaseGrenade.Explode" );
-
-					UTIL_ScreenShake( pEntity->GetAbsOrigin(), explode, 150.0, 1.0, radius, SHAKE_START );
-
+					EmpExplosion( pEntity->GetAbsOrigin(), explode, pEntity->GetWaterLevel(), pEntity );
 					break;
 				}
 			}
 		}
 
+		// Simulated nails don't turn up in the sphere query
+		CUtlVector<Vector> nailOrigins;
+		CUtlVector<int> nailDamage;
+		_nailsim.TakeEmp( GetAbsOrigin(), radius, nailOrigins, nailDamage );
+
+		for( int i = 0; i < nailOrigins.Count(); i++ )
+		{
+			if( nailDamage[ i ] )
+				EmpExplosion( nailOrigins[ i ], nailDamage[ i ], ( UTIL_PointContents( nailOrigins[ i ] ) & MASK_WATER ) ? 3 : 0, NULL );
+		}
+
 		UTIL_Remove(this);
 	}
 
+	//-----------------------------------------------------------------------------
+	// Purpose: Blow up something that was caught in the emp. pEntity can be
+	//			NULL for things that aren't entities (simulated nails)
+	//-----------------------------------------------------------------------------
+	void CFFGrenadeEmp::EmpExplosion( const Vector &vecOrigin, int explode, int iWaterLevel, CBaseEntity *pEntity )
+	{
+		trace_t		tr;
+
+		// Traceline to check if we should do scorch marks on the floor						
+		UTIL_TraceLine( vecOrigin + Vector( 0, 0, 2.0f ), vecOrigin - Vector( 0, 0, FF_DECALTRACE_TRACE_DIST ), MASK_SHOT_HULL, pEntity, COLLISION_GROUP_NONE, &tr);
+
+		// Explode now
+		if( tr.fraction != 1.0 )
+		{
+			Vector vecNormal = tr.plane.normal;
+			surfacedata_t *pdata = physprops->GetSurfaceData( tr.surface.surfaceProps );	
+			CPASFilter filter( vecOrigin );
+
+			te->Explosion( filter, -1.0, // don't apply cl_interp delay
+				&vecOrigin,
+				!iWaterLevel ? g_sModelIndexFireball : g_sModelIndexWExplosion,
+				m_DmgRadius * .03, 
+				25,
+				TE_EXPLFLAG_NONE,
+				m_DmgRadius,
+				m_flDamage,
+				&vecNormal,
+				( char )pdata->game.material );
+
+			// Normal decals since trace hit something
+			UTIL_DecalTrace( &tr, "Scorch" );
+		}
+		else
+		{
+			CPASFilter filter( vecOrigin );
+
+			te->Explosion( filter, -1.0, // don't apply cl_interp delay
+				&vecOrigin, 
+				!iWaterLevel != 0 ? g_sModelIndexFireball : g_sModelIndexWExplosion,
+				m_DmgRadius * .03, 
+				25,
+				TE_EXPLFLAG_NONE,
+				m_DmgRadius,
+				m_flDamage );
+
+			// Trace hit nothing so do custom scorch mark finding
+			if( pEntity )
+				FF_DecalTrace( pEntity, FF_DECALTRACE_TRACE_DIST, "Scorch" );
+		}
+
+		CTakeDamageInfo info( this, GetOwnerEntity(), GetBlastForce(), vecOrigin, explode, DMG_SHOCK, 0, &vecOrigin );
+		RadiusDamage( info, vecOrigin, m_DmgRadius, CLASS_NONE, NULL );
+			
+		EmitSound( "BaseGrenade.Explode" );
+
+		UTIL_ScreenShake( vecOrigin, explode, 150.0, 1.0, GetGrenadeRadius(), SHAKE_START );
+	}
+
 	//----------------------------------------------------------------------------
 	// Purpose: Fire explosion sound early
 	//----------------------------------------------------------------------------
@@ -55,6 +55,9 @@ public:
 
 	void GrenadeThink( void );
 	bool m_bWarned;
+
+protected:
+	void EmpExplosion( const Vector &vecOrigin, int explode, int iWaterLevel, CBaseEntity *pEntity );
 #endif
 };
 
@@ -19,6 +19,7 @@
 #include "effect_dispatch_data.h"
 #include "IEffects.h"
 #include "beam_shared.h"
+#include "mathlib/ssemath.h"
 
 #ifdef GAME_DLL
 	#include "ff_entity_system.h"
@@ -91,6 +92,8 @@
 	#define LASERGREN_EXPLOSIONRADIUS 180.0f
 	//ConVar ffdev_lasergren_hitdelay("ffdev_lasergren_hitdelay", "0.15", FCVAR_FF_FFDEV, "Delay between ticks of damage");
 	#define LASERGREN_HITDELAY 0.15f //ffdev_lasergren_hitdelay.GetFloat()
+	// leeway for the beam prefilter, covers VectorNormalizeFast's error
+	#define LASERGREN_BEAMSLACK 4.0f
 #endif
 
 class CFFGrenadeLaser : public CFFGrenadeBase
@@ -318,18 +321,35 @@ float CFFGrenadeLaser::getLengthPercent()
 		SetAbsVelocity(Vector(0, 0, flRisingheight + LASERGREN_BOB * sin(DEG2RAD(gpGlobals->curtime * 360 * LASERGREN_BOBFREQ))));
 		SetAbsAngles(GetAbsAngles() + QAngle(0, LASERGREN_ROTATION_PER_TICK, 0));
 
-		Vector vecDirection;
 		Vector vecOrigin = GetAbsOrigin();
-		QAngle angRadial = GetAbsAngles();
-
-		//float flSize = 20.0f;
-		trace_t tr;
 		char i;
 
 		float flDeltaAngle = 360.0f / LASERGREN_BEAMS;
 
+		float flLengthPercent = getLengthPercent();
+		float flLength = LASERGREN_DISTANCE * flLengthPercent;
+
+		// don't allow dividing by zero
+		if (flLengthPercent == 0.0f)
+		{
+			SetNextThink( gpGlobals->curtime );
+			return;
+		}
+
+		// the beams point the same way for every entity
+		Vector vecBeams[MAX_BEAMS];
+		QAngle angRadial = GetAbsAngles();
+		for( i = 0; i < LASERGREN_BEAMS; i++ )
+		{
+			AngleVectors(angRadial, &vecBeams[i]);
+			VectorNormalizeFast(vecBeams[i]);
+			angRadial.y += flDeltaAngle;
+		}
+
+		CUtlVector<CBaseEntity *> candidates;
+
 		CBaseEntity *pEntity = NULL;
-		for (CEntitySphereQuery sphere(vecOrigin, LASERGREN_DISTANCE * getLengthPercent()); (pEntity = sphere.GetCurrentEntity()) != NULL; sphere.NextEntity()) 
+		for (CEntitySphereQuery sphere(vecOrigin, flLength); (pEntity = sphere.GetCurrentEntity()) != NULL; sphere.NextEntity()) 
 		{
 			if (!pEntity)
 				continue;
@@ -373,37 +393,130 @@ float CFFGrenadeLaser::getLengthPercent()
 			if (pEntity->GetAbsOrigin().z + vecMin.z > vecOrigin.z + LASERGREN_LASERRADIUS)
 				continue;
 
-			Vector vecDirection;
-			QAngle angRadial = GetAbsAngles();
-			// check each laser
+			candidates.AddToTail( pEntity );
+		}
+
+		if (!candidates.Count())
+		{
+			SetNextThink( gpGlobals->curtime );
+			return;
+		}
+
+		// Rule out every beam that can't reach an entity's bounds, four
+		// entities at a time. The beam's closest point to the entity's origin
+		// is tested against the entity's world bounds rather than its nearest
+		// point, which is never further away, so this only throws out beams
+		// that the exact test below would have too.
+		CUtlVector<int> beamMasks;
+		beamMasks.SetCount( candidates.Count() );
+
+		const float flMaxLength = flLength + 2*LASERGREN_LASERRADIUS + LASERGREN_BEAMSLACK;
+		const float flMaxDist = LASERGREN_LASERRADIUS + LASERGREN_BEAMSLACK;
+
+		__m128 maxLengthSqr = MMReplicate( flMaxLength * flMaxLength );
+		__m128 maxDistSqr = MMReplicate( flMaxDist * flMaxDist );
+		__m128 minDot = MMReplicate( -LASERGREN_BEAMSLACK );
+
+		for (int iFirst = 0; iFirst < candidates.Count(); iFirst += 4)
+		{
+			ALIGN16 float flX[4], flY[4], flZ[4];
+			ALIGN16 float flMinX[4], flMinY[4], flMaxX[4], flMaxY[4];
+
+			for (int iLane = 0; iLane < 4; iLane++)
+			{
+				// unused lanes are far enough away to fail every beam
+				if (iFirst + iLane >= candidates.Count())
+				{
+					flX[iLane] = flY[iLane] = flZ[iLane] = MAX_TRACE_LENGTH;
+					flMinX[iLane] = flMinY[iLane] = flMaxX[iLane] = flMaxY[iLane] = MAX_TRACE_LENGTH;
+					continue;
+				}
+
+				CBaseEntity *pCandidate = candidates[iFirst + iLane];
+
+				Vector vecToEnt = pCandidate->GetAbsOrigin() - vecOrigin;
+				Vector vecMins, vecMaxs;
+				pCandidate->CollisionProp()->WorldSpaceAABB( &vecMins, &vecMaxs );
+
+				flX[iLane] = vecToEnt.x;
+				flY[iLane] = vecToEnt.y;
+				flZ[iLane] = vecToEnt.z;
+				flMinX[iLane] = vecMins.x - vecOrigin.x;
+				flMinY[iLane] = vecMins.y - vecOrigin.y;
+				flMaxX[iLane] = vecMaxs.x - vecOrigin.x;
+				flMaxY[iLane] = vecMaxs.y - vecOrigin.y;
+			}
+
+			__m128 x = _mm_load_ps( flX );
+			__m128 y = _mm_load_ps( flY );
+			__m128 z = _mm_load_ps( flZ );
+			__m128 minX = _mm_load_ps( flMinX );
+			__m128 minY = _mm_load_ps( flMinY );
+			__m128 maxX = _mm_load_ps( flMaxX );
+			__m128 maxY = _mm_load_ps( flMaxY );
+
+			// behind every beam or too far away
+			__m128 lengthSqr = _mm_add_ps( _mm_mul_ps( x, x ), _mm_mul_ps( y, y ) );
+			__m128 inRange = _mm_cmple_ps( lengthSqr, maxLengthSqr );
+
+			int iMasks[4] = { 0, 0, 0, 0 };
+
 			for( i = 0; i < LASERGREN_BEAMS; i++ )
 			{
-				AngleVectors(angRadial, &vecDirection);
-				VectorNormalizeFast(vecDirection);
+				__m128 dirX = MMReplicate( vecBeams[i].x );
+				__m128 dirY = MMReplicate( vecBeams[i].y );
+				__m128 dirZ = MMReplicate( vecBeams[i].z );
 
-				Vector vecToEnt = pEntity->GetAbsOrigin() - vecOrigin;
+				__m128 dot = _mm_add_ps( _mm_add_ps( _mm_mul_ps( x, dirX ), _mm_mul_ps( y, dirY ) ), _mm_mul_ps( z, dirZ ) );
 
-				if (vecToEnt.Length2D() > LASERGREN_DISTANCE * getLengthPercent() + 2*LASERGREN_LASERRADIUS)
+				// closest point on the beam to the entity's origin
+				__m128 pointX = _mm_mul_ps( dirX, dot );
+				__m128 pointY = _mm_mul_ps( dirY, dot );
+
+				// and its distance from the entity's bounds, ignoring height
+				__m128 deltaX = _mm_sub_ps( pointX, _mm_min_ps( _mm_max_ps( pointX, minX ), maxX ) );
+				__m128 deltaY = _mm_sub_ps( pointY, _mm_min_ps( _mm_max_ps( pointY, minY ), maxY ) );
+				__m128 distSqr = _mm_add_ps( _mm_mul_ps( deltaX, deltaX ), _mm_mul_ps( deltaY, deltaY ) );
+
+				__m128 hit = _mm_and_ps( inRange, _mm_and_ps( _mm_cmpge_ps( dot, minDot ), _mm_cmple_ps( distSqr, maxDistSqr ) ) );
+
+				int iHits = _mm_movemask_ps( hit );
+				for (int iLane = 0; iLane < 4; iLane++)
 				{
-					angRadial.y += flDeltaAngle;
-					continue;
+					if (iHits & (1 << iLane))
+						iMasks[iLane] |= (1 << i);
 				}
+			}
+
+			for (int iLane = 0; iLane < 4 && iFirst + iLane < candidates.Count(); iLane++)
+				beamMasks[iFirst + iLane] = iMasks[iLane];
+		}
+
+		for (int iCandidate = 0; iCandidate < candidates.Count(); iCandidate++)
+		{
+			if (!beamMasks[iCandidate])
+				continue;
+
+			pEntity = candidates[iCandidate];
+
+			// check each laser that could be touching it
+			for( i = 0; i < LASERGREN_BEAMS; i++ )
+			{
+				if (!(beamMasks[iCandidate] & (1 << i)))
+					continue;
+
+				const Vector &vecDirection = vecBeams[i];
+
+				Vector vecToEnt = pEntity->GetAbsOrigin() - vecOrigin;
+
+				if (vecToEnt.Length2D() > flLength + 2*LASERGREN_LASERRADIUS)
+					continue;
 
 				float dot = DotProduct( vecDirection, vecToEnt );
 
 				// player is behind the laser
 				if (dot < 0)
-				{
-					angRadial.y += flDeltaAngle;
 					continue;
-				}
-
-				// don't allow dividing by zero
-				if (getLengthPercent() == 0.0f)
-				{
-					angRadial.y += flDeltaAngle;
-					continue;
-				}
 				
 				// check if inside the center gap
 				if (LASERGREN_CENTERGAP > 0)
@@ -417,13 +530,10 @@ float CFFGrenadeLaser::getLengthPercent()
 					Vector DistFromOrigin = gappoint - vecOrigin;
 
 					if (DistFromOrigin.Length() < LASERGREN_CENTERGAP - LASERGREN_LASERRADIUS)
-					{
-						angRadial.y += flDeltaAngle;
 						continue;
-					}
 				}
 				
-				Vector vecLaser = vecDirection * LASERGREN_DISTANCE * getLengthPercent();
+				Vector vecLaser = vecDirection * flLength;
 				float ratio = DotProduct( vecToEnt, vecLaser ) / DotProduct( vecLaser, vecLaser );
 				Vector vecLaserClosestPoint = vecOrigin + (ratio * vecLaser);
 				
@@ -439,10 +549,7 @@ float CFFGrenadeLaser::getLengthPercent()
 
 				// outside of the laser radius
 				if (dist > LASERGREN_LASERRADIUS)
-				{
-					angRadial.y += flDeltaAngle;
 					continue;
-				}
 
 				Vector startpos = vecOrigin + vecDirection * LASERGREN_CENTERGAP;
 
@@ -454,8 +561,6 @@ float CFFGrenadeLaser::getLengthPercent()
 				
 				if (!tr.m_pEnt || tr.m_pEnt == pEntity)
 					DoDamage( pEntity );
-
-				angRadial.y += flDeltaAngle;
 			}
 		}
 
@@ -28,6 +28,7 @@
 	#include "ff_entity_system.h"
 	#include "te_effect_dispatch.h"
 	#include "ai_basenpc.h"
+	#include "ff_areafieldman.h"
 #else
 	#include "c_te_effect_dispatch.h"
 #endif
@@ -65,7 +66,7 @@ ConVar slowfield_glow_size("ffdev_slowfield_glow_size", "0.3", FCVAR_FF_FFDEV_CL
 #define SLOWFIELD_GLOW_SIZE slowfield_glow_size.GetFloat()
 
 #endif
-
+
 #define GRENADE_BEAM_SPRITE	"sprites/plasma.spr"
 
 //ConVar ffdev_slowfield_beam_widthstart("ffdev_slowfield_beam_widthstart", "4", FCVAR_FF_FFDEV_REPLICATED, "Width at the start of the slowfield grenade beam");
@@ -88,7 +89,7 @@ ConVar slowfield_glow_size("ffdev_slowfield_glow_size", "0.3", FCVAR_FF_FFDEV_CL
 
 //ConVar ffdev_slowfield_radius_outer("ffdev_slowfield_radius_outer", "176", FCVAR_FF_FFDEV_REPLICATED, "Outer radius of slowfield grenade (scales from no effect to full effect at inner radius)");
 #define SLOWFIELD_RADIUS_OUTER 176 //ffdev_slowfield_radius_outer.GetFloat()
-
+
 //ConVar ffdev_slowfield_radius_inner("ffdev_slowfield_radius_inner", "64", FCVAR_FF_FFDEV_REPLICATED, "Inner radius of slowfield grenade (where slowfield has full effect)");
 #define SLOWFIELD_RADIUS_INNER 64 //ffdev_slowfield_radius_inner.GetFloat()
 
@@ -164,6 +165,9 @@ END_DATADESC()
 //=============================================================================
 
 class CFFGrenadeSlowfield : public CFFGrenadeBase
+#ifdef GAME_DLL
+	, public IFFAreaField
+#endif
 {
 public:
 	DECLARE_CLASS(CFFGrenadeSlowfield, CFFGrenadeBase) 
@@ -196,8 +200,19 @@ public:
 	virtual void SlowThink();
 	virtual void Explode(trace_t *pTrace, int bitsDamageType);
 
+	// IFFAreaField
+	virtual const Vector &GetFieldOrigin() { return GetAbsOrigin(); }
+	virtual float GetFieldRadius() { return GetGrenadeRadius(); }
+	virtual bool IsFieldActive() { return m_bIsOn && gpGlobals->curtime <= m_flDetonateTime; }
+	virtual void OnFieldInside( CFFPlayer *pPlayer, float flDistance );
+	virtual void OnFieldExit( CFFPlayer *pPlayer );
+
 protected:
+	// how far the full and partial slow reach as the field shrinks away
+	void GetSlowRadii( float &flInnerRadius, float &flOuterRadius, float &flInnerRadiusShrink );
+
 	bool m_bBeamLoopPlaying;
+	int m_nPlayersSlowed;	// since the last think
 	float	m_flLastThinkTime;
 
 	int m_iSequence;
@@ -250,6 +265,8 @@ void CFFGrenadeSlowfield::StopLoopingSounds()
 void CFFGrenadeSlowfield::UpdateOnRemove()
 {
 #ifdef GAME_DLL
+	_areafieldman.RemoveField( this );
+
 	// loop through all players
 	for(int i = 1 ; i <= gpGlobals->maxClients; i++)
 	{
@@ -298,6 +315,7 @@ void CFFGrenadeSlowfield::UpdateOnRemove()
 		m_Activity = ( Activity )ACT_GAS_IDLE;
 		m_iSequence = SelectWeightedSequence( m_Activity );
 		m_bBeamLoopPlaying = false;
+		m_nPlayersSlowed = 0;
 		SetSequence( m_iSequence );		
 	}
 
@@ -343,6 +361,8 @@ void CFFGrenadeSlowfield::UpdateOnRemove()
 		SetDetonateTimerLength(SLOWFIELD_DURATION);
 		m_bIsOn = true;
 
+		_areafieldman.AddField( this );
+
 		// Should this maybe be noclip?
 		SetMoveType(MOVETYPE_FLY);
 
@@ -384,6 +404,42 @@ void CFFGrenadeSlowfield::UpdateOnRemove()
 
 		float flRisingheight = 0;
 
+		// Lasts for 3 seconds, rise for 0.3, but only if not handheld
+		//if (gpGlobals->curtime > m_flDetonateTime - 0.3 && !m_fIsHandheld)
+		//	flRisingheight = 80;
+
+		SetAbsVelocity(Vector(0, 0, flRisingheight + 20 * sin(DEG2RAD(GetAbsAngles().y))));
+		SetAbsAngles(GetAbsAngles() + QAngle(0, 15, 0));
+
+		// slows everyone inside every slowfield, if another one hasn't already
+		_areafieldman.Update();
+
+		bool bHitPlayer = m_nPlayersSlowed > 0;
+		m_nPlayersSlowed = 0;
+
+		if(!bHitPlayer && m_bBeamLoopPlaying)
+		{
+			m_bBeamLoopPlaying = false;
+			StopSound( SLOWFIELDGRENADE_BEAM_LOOP );
+		}
+		else if(bHitPlayer && !m_bBeamLoopPlaying)
+		{
+			m_bBeamLoopPlaying = true;
+			EmitSound( SLOWFIELDGRENADE_BEAM_LOOP );
+		}
+
+		// Animate
+		StudioFrameAdvance();
+
+		SetNextThink(gpGlobals->curtime);
+		m_flLastThinkTime = gpGlobals->curtime;
+	}
+
+	//-----------------------------------------------------------------------------
+	// Purpose: Inner and outer radius as they shrink away at the end
+	//-----------------------------------------------------------------------------
+	void CFFGrenadeSlowfield::GetSlowRadii( float &flInnerRadius, float &flOuterRadius, float &flInnerRadiusShrink )
+	{
 		float flOuterStartShrinkTime = m_flDetonateTime - SLOWFIELD_SHRINKTIME_OUTER;
 		float flOuterRadiusShrink = 1.0f;
 		if( gpGlobals->curtime >= flOuterStartShrinkTime )
@@ -392,7 +448,7 @@ void CFFGrenadeSlowfield::UpdateOnRemove()
 		bool bShrinkStack = SLOWFIELD_SHRINKTIME_STACK;
 	
 		float flInnerStartShrinkTime = ( bShrinkStack ? m_flDetonateTime - ( SLOWFIELD_SHRINKTIME_OUTER + SLOWFIELD_SHRINKTIME_INNER ) : m_flDetonateTime - SLOWFIELD_SHRINKTIME_INNER );
-		float flInnerRadiusShrink = 1.0f;
+		flInnerRadiusShrink = 1.0f;
 
 		if( bShrinkStack && gpGlobals->curtime >= flOuterStartShrinkTime )
 			flInnerRadiusShrink = 0.0f;
@@ -401,145 +457,121 @@ void CFFGrenadeSlowfield::UpdateOnRemove()
 		else if( gpGlobals->curtime >= flInnerStartShrinkTime )
 			flInnerRadiusShrink = 1 - ( gpGlobals->curtime - flInnerStartShrinkTime ) / ( m_flDetonateTime - flInnerStartShrinkTime );
 
-		float flInnerRadius = SLOWFIELD_RADIUS_INNER * flInnerRadiusShrink;
-		float flOuterRadius = SLOWFIELD_RADIUS_OUTER * flOuterRadiusShrink;
+		flInnerRadius = SLOWFIELD_RADIUS_INNER * flInnerRadiusShrink;
+		flOuterRadius = SLOWFIELD_RADIUS_OUTER * flOuterRadiusShrink;
+	}
 
-		// Lasts for 3 seconds, rise for 0.3, but only if not handheld
-		//if (gpGlobals->curtime > m_flDetonateTime - 0.3 && !m_fIsHandheld)
-		//	flRisingheight = 80;
+	//-----------------------------------------------------------------------------
+	// Purpose: Slow down a player inside the radius of the gren
+	//-----------------------------------------------------------------------------
+	void CFFGrenadeSlowfield::OnFieldInside( CFFPlayer *pPlayer, float flDistance )
+	{
+		CFFPlayer *pSlower = ToFFPlayer( GetOwnerEntity() );
 
-		SetAbsVelocity(Vector(0, 0, flRisingheight + 20 * sin(DEG2RAD(GetAbsAngles().y))));
-		SetAbsAngles(GetAbsAngles() + QAngle(0, 15, 0));
+		if( !pSlower )
+			return;
 
-		Vector vecOrigin = GetAbsOrigin();
+		if( SLOWFIELD_FRIENDLYIGNORE && !g_pGameRules->FCanTakeDamage( pPlayer, GetOwnerEntity() ) )
+			return;
+		
+		if( SLOWFIELD_SELFIGNORE && pPlayer == pSlower )
+			return;
 
-		bool bHitPlayer = false;
+		float flInnerRadius, flOuterRadius, flInnerRadiusShrink;
+		GetSlowRadii( flInnerRadius, flOuterRadius, flInnerRadiusShrink );
 
-		for (int i=1; i<=gpGlobals->maxClients; i++)
+		float flFriendlyScale = 1.0f;
+
+		// Check if is a teammate and scale accordingly
+		if (pPlayer != pSlower && g_pGameRules->PlayerRelationship(pPlayer, pSlower) == GR_TEAMMATE)
+			flFriendlyScale = SLOWFIELD_FRIENDLYSCALE;
+		else if (pPlayer == pSlower)
+			flFriendlyScale = SLOWFIELD_SELFSCALE;
+
+		float flDistanceMult = 1.0f;
+		//if we're scaling between outer and inner radius (linear!!)
+		//don't allow divide by zero or for inner/outer to be reversed
+		if(flDistance > (flInnerRadius * flInnerRadiusShrink) && ( flOuterRadius - flInnerRadius ) > 0.0f)
 		{
-			CFFPlayer *pPlayer = ToFFPlayer( UTIL_PlayerByIndex(i) );
-			CFFPlayer *pSlower = ToFFPlayer( GetOwnerEntity() );
-				
-			if( !pPlayer || pPlayer->IsObserver() || !pSlower)
-				continue;
-
-			Vector vecDisplacement = pPlayer->GetAbsOrigin() - vecOrigin;
-			float flDistance = vecDisplacement.Length();
-
-			// inside the radius of the gren
-			if (flDistance < GetGrenadeRadius())
-			{
-				if( SLOWFIELD_FRIENDLYIGNORE && !g_pGameRules->FCanTakeDamage( pPlayer, GetOwnerEntity() ) )
-					continue;
-				
-				if( SLOWFIELD_SELFIGNORE && pPlayer == pSlower )
-					continue;
-
-				float flFriendlyScale = 1.0f;
-
-				// Check if is a teammate and scale accordingly
-				if (pPlayer != pSlower && g_pGameRules->PlayerRelationship(pPlayer, pSlower) == GR_TEAMMATE)
-					flFriendlyScale = SLOWFIELD_FRIENDLYSCALE;
-				else if (pPlayer == pSlower)
-					flFriendlyScale = SLOWFIELD_SELFSCALE;
-
-				float flDistanceMult = 1.0f;
-				//if we're scaling between outer and inner radius (linear!!)
-				//don't allow divide by zero or for inner/outer to be reversed
-				if(flDistance > (flInnerRadius * flInnerRadiusShrink) && ( flOuterRadius - flInnerRadius ) > 0.0f)
-				{
-					flDistanceMult = clamp(1.0f - ( flDistance - flInnerRadius ) / ( flOuterRadius - flInnerRadius ), 0.0f, 1.0f);
-				}
-
-				float flSpeed = pPlayer->GetAbsVelocity().Length();
-				float flSpeedReduction = flSpeed - ( pow( flSpeed, SLOWFIELD_POWER ) * SLOWFIELD_MULTIPLIER );
-				flSpeedReduction *= pow( flDistanceMult, SLOWFIELD_RADIUS_POWER );
-				flSpeedReduction *= flFriendlyScale;
-
-				float flLaggedMovement = 1.0f;
-				if(flSpeed > 0.0f)
-				//no divide by zero
-				{
-					flLaggedMovement = clamp( (flSpeed - flSpeedReduction), 1.0f, flSpeed ) / flSpeed;
-				}
-
-				// only change players active slowfield if they will be going slower
-				if (pPlayer->GetActiveSlowfield() != this && pPlayer->GetLaggedMovementValue() > flLaggedMovement || pPlayer->GetActiveSlowfield() == NULL)
-				{
-					pPlayer->SetLaggedMovementValue(flLaggedMovement);
-					pPlayer->SetActiveSlowfield( this );
-
-					// add status icon
-					CSingleUserRecipientFilter user( ( CBasePlayer * )pPlayer );
-					user.MakeReliable();
-
-					UserMessageBegin( user, "StatusIconUpdate" );
-						WRITE_BYTE( FF_STATUSICON_SLOWMOTION );
-						WRITE_FLOAT( -1.0f );
-					MessageEnd();
-				}
-				// else just give them an updated laggedmovement value
-				else if (pPlayer->GetActiveSlowfield() == this)
-				{
-					pPlayer->SetLaggedMovementValue(flLaggedMovement);
-				}		
-
-				CFFPlayer *pGrenOwner = ToFFPlayer( this->GetOwnerEntity() );
-
-				bHitPlayer = true;
-	
-				CBeam *pBeam = CBeam::BeamCreate( GRENADE_BEAM_SPRITE, 1 );
-				pBeam->SetWidth( SLOWFIELD_BEAM_WIDTHSTART );
-				pBeam->SetEndWidth( SLOWFIELD_BEAM_WIDTHEND );
-				pBeam->LiveForTime(gpGlobals->interval_per_tick);
-				pBeam->SetNoise( SLOWFIELD_BEAM_NOISE );
-				pBeam->SetBrightness( (1 - flLaggedMovement) * 128 + 128 );
-				if(pGrenOwner->GetTeamNumber() == TEAM_RED)
-					pBeam->SetColor( 255, 64, 64 );
-				else if(pGrenOwner->GetTeamNumber() == TEAM_BLUE)
-					pBeam->SetColor( 64, 128, 255 );
-				else if(pGrenOwner->GetTeamNumber() == TEAM_GREEN)
-					pBeam->SetColor( 153, 255, 153 );
-				else if(pGrenOwner->GetTeamNumber() == TEAM_YELLOW)
-					pBeam->SetColor( 255, 178, 0 );
-				else // just in case
-					pBeam->SetColor( 204, 204, 204 );
-				pBeam->PointsInit( vecOrigin, pPlayer->GetAbsOrigin() );
-			}
-			// outside the radius of the gren
-			else if (pPlayer->GetActiveSlowfield() == this)
-			{
-				pPlayer->SetLaggedMovementValue( 1.0f );
-				pPlayer->SetActiveSlowfield( NULL );
-				
-				// remove status icon
-				CSingleUserRecipientFilter user( ( CBasePlayer * )pPlayer );
-				user.MakeReliable();
-
-				UserMessageBegin( user, "StatusIconUpdate" );
-					WRITE_BYTE( FF_STATUSICON_SLOWMOTION );
-					WRITE_FLOAT( 0.0f );
-				MessageEnd();
-			}
+			flDistanceMult = clamp(1.0f - ( flDistance - flInnerRadius ) / ( flOuterRadius - flInnerRadius ), 0.0f, 1.0f);
 		}
 
+		float flSpeed = pPlayer->GetAbsVelocity().Length();
+		float flSpeedReduction = flSpeed - ( pow( flSpeed, SLOWFIELD_POWER ) * SLOWFIELD_MULTIPLIER );
+		flSpeedReduction *= pow( flDistanceMult, SLOWFIELD_RADIUS_POWER );
+		flSpeedReduction *= flFriendlyScale;
 
-		if(!bHitPlayer && m_bBeamLoopPlaying)
+		float flLaggedMovement = 1.0f;
+		if(flSpeed > 0.0f)
+		//no divide by zero
 		{
-			m_bBeamLoopPlaying = false;
-			StopSound( SLOWFIELDGRENADE_BEAM_LOOP );
+			flLaggedMovement = clamp( (flSpeed - flSpeedReduction), 1.0f, flSpeed ) / flSpeed;
 		}
-		else if(bHitPlayer && !m_bBeamLoopPlaying)
+
+		// only change players active slowfield if they will be going slower
+		if (pPlayer->GetActiveSlowfield() != this && pPlayer->GetLaggedMovementValue() > flLaggedMovement || pPlayer->GetActiveSlowfield() == NULL)
 		{
-			m_bBeamLoopPlaying = true;
-			EmitSound( SLOWFIELDGRENADE_BEAM_LOOP );
+			pPlayer->SetLaggedMovementValue(flLaggedMovement);
+			pPlayer->SetActiveSlowfield( this );
+
+			// add status icon
+			CSingleUserRecipientFilter user( ( CBasePlayer * )pPlayer );
+			user.MakeReliable();
+
+			UserMessageBegin( user, "StatusIconUpdate" );
+				WRITE_BYTE( FF_STATUSICON_SLOWMOTION );
+				WRITE_FLOAT( -1.0f );
+			MessageEnd();
 		}
+		// else just give them an updated laggedmovement value
+		else if (pPlayer->GetActiveSlowfield() == this)
+		{
+			pPlayer->SetLaggedMovementValue(flLaggedMovement);
+		}		
+
+		m_nPlayersSlowed++;
+
+		CBeam *pBeam = CBeam::BeamCreate( GRENADE_BEAM_SPRITE, 1 );
+		pBeam->SetWidth( SLOWFIELD_BEAM_WIDTHSTART );
+		pBeam->SetEndWidth( SLOWFIELD_BEAM_WIDTHEND );
+		pBeam->LiveForTime(gpGlobals->interval_per_tick);
+		pBeam->SetNoise( SLOWFIELD_BEAM_NOISE );
+		pBeam->SetBrightness( (1 - flLaggedMovement) * 128 + 128 );
+		if(pSlower->GetTeamNumber() == TEAM_RED)
+			pBeam->SetColor( 255, 64, 64 );
+		else if(pSlower->GetTeamNumber() == TEAM_BLUE)
+			pBeam->SetColor( 64, 128, 255 );
+		else if(pSlower->GetTeamNumber() == TEAM_GREEN)
+			pBeam->SetColor( 153, 255, 153 );
+		else if(pSlower->GetTeamNumber() == TEAM_YELLOW)
+			pBeam->SetColor( 255, 178, 0 );
+		else // just in case
+			pBeam->SetColor( 204, 204, 204 );
+		pBeam->PointsInit( GetAbsOrigin(), pPlayer->GetAbsOrigin() );
+	}
 
-		// Animate
-		StudioFrameAdvance();
+	//-----------------------------------------------------------------------------
+	// Purpose: Back to normal speed once outside the radius of the gren
+	//-----------------------------------------------------------------------------
+	void CFFGrenadeSlowfield::OnFieldExit( CFFPlayer *pPlayer )
+	{
+		if( !GetOwnerEntity() )
+			return;
 
-		SetNextThink(gpGlobals->curtime);
-		m_flLastThinkTime = gpGlobals->curtime;
+		if (pPlayer->GetActiveSlowfield() != this)
+			return;
+
+		pPlayer->SetLaggedMovementValue( 1.0f );
+		pPlayer->SetActiveSlowfield( NULL );
+		
+		// remove status icon
+		CSingleUserRecipientFilter user( ( CBasePlayer * )pPlayer );
+		user.MakeReliable();
+
+		UserMessageBegin( user, "StatusIconUpdate" );
+			WRITE_BYTE( FF_STATUSICON_SLOWMOTION );
+			WRITE_FLOAT( 0.0f );
+		MessageEnd();
 	}
 
 #endif
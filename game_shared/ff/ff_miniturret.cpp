@@ -29,6 +29,7 @@
 	#include "ff_scriptman.h"
 	#include "ff_luacontext.h"
 	#include "ff_utils.h"
+	#include "ff_pvscache.h"
 #endif
 
 // memdbgon must be the last include file in a .cpp file!!!
@@ -988,14 +989,8 @@ bool CFFMiniTurret::IsTargetVisible( CBaseEntity *pTarget )
 		return false;*/
 
 	// Check PVS for early out
-	if(TURRET_USEPVS)
-	{
-		byte pvs[ MAX_MAP_CLUSTERS/8 ];
-		int iPVSCluster = engine->GetClusterForOrigin(vecMuzzle);
-		int iPVSLength = engine->GetPVSForCluster(iPVSCluster, sizeof(pvs), pvs);
-		if(!engine->CheckOriginInPVS(vecTarget, pvs, iPVSLength))
-			return false;
-	}
+	if( TURRET_USEPVS && !_pvscache.CheckPVS( vecMuzzle, vecTarget ) )
+		return false;
 
 	// Can we trace to the target?
 	trace_t tr;
@@ -632,11 +632,16 @@ void CFFPlayer::PlayerUse()
 #ifdef GAME_DLL
 	if (m_afButtonPressed & IN_USE)
 	{
-		CFFLuaSC hContext( 0 );
-		hContext.Push( this );
-		if( _scriptman.RunPredicates_LUA( NULL, &hContext, "player_onuse" ) && !hContext.DidReturnNil() && !hContext.GetBool() )
+		bool bHasHook = _scriptman.HasGlobalHook( GLOBALHOOK_PLAYER_ONUSE );
+		_scriptman.CountGlobalHook( GLOBALHOOK_PLAYER_ONUSE, bHasHook );
+		if( bHasHook )
 		{
-			return;
+			CFFLuaSC hContext( 0 );
+			hContext.Push( this );
+			if( _scriptman.RunPredicates_LUA( NULL, &hContext, "player_onuse" ) && !hContext.DidReturnNil() && !hContext.GetBool() )
+			{
+				return;
+			}
 		}
 	}
 #endif
@@ -36,6 +36,7 @@
 	#include "c_te_effect_dispatch.h"
 #else
 	#include "te_effect_dispatch.h"
+	#include "ff_nailsim.h"
 
 //=============================================================================
 // CFFProjectileNail tables
@@ -192,6 +193,29 @@ void CFFProjectileNail::BubbleThink()
 //----------------------------------------------------------------------------
 CFFProjectileNail *CFFProjectileNail::CreateNail(const CBaseEntity *pSource, const Vector &vecOrigin, const QAngle &angAngles, CBaseEntity *pentOwner, const int iDamage, const int iSpeed, bool bNotClientSide) 
 {
+#ifdef GAME_DLL
+	// Clients only ever draw the effect, so unless entities are wanted the
+	// nail just goes into the simulation
+	if (_nailsim.IsEnabled() && !bNotClientSide)
+	{
+		Vector vecVelocity;
+		AngleVectors(angAngles, &vecVelocity);
+		vecVelocity *= NAIL_SPEED;
+
+		_nailsim.AddNail(const_cast<CBaseEntity *>(pSource), vecOrigin, vecVelocity, pentOwner, iDamage);
+
+		CEffectData data;
+		data.m_vOrigin = vecOrigin;
+		data.m_vAngles = angAngles;
+		data.m_nDamageType = NAIL_SPEED; // AfterShock: HACK: use m_nDamageType to pass the nail speed int
+		data.m_nEntIndex = pentOwner->entindex();
+
+		DispatchEffect("Projectile_Nail", data);
+
+		return NULL;
+	}
+#endif
+
 	CFFProjectileNail *pNail = (CFFProjectileNail *) CreateEntityByName("ff_projectile_nail");
 
 	UTIL_SetOrigin(pNail, vecOrigin);
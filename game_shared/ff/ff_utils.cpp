@@ -29,6 +29,7 @@
 #include "ff_utils.h"
 #include "Color.h"		// |-- Mirv: Fixed case for GCC
 #include "ammodef.h"
+#include "bitbuf.h"
 
 #ifdef CLIENT_DLL
 	#include <igameresources.h>
@@ -47,6 +48,7 @@
 #include "ff_grenade_parse.h" //for parseing ff gren txts
 #ifdef GAME_DLL
 	#include "ff_scriptman.h"
+	#include "ff_luahudman.h"
 #endif
 
 // This function takes a class name like "scout"
@@ -701,8 +703,173 @@ bool FF_IsGrenade( CBaseEntity *pEntity )
 	return !!( pEntity->GetFlags() & FL_GRENADE );
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Which fields an element type uses
+//-----------------------------------------------------------------------------
+int FF_LuaHudFields( int iType )
+{
+	const int iPosition = ( 1 << HUD_FIELD_X ) | ( 1 << HUD_FIELD_Y ) | ( 1 << HUD_FIELD_ALIGNX ) | ( 1 << HUD_FIELD_ALIGNY );
+
+	switch( iType )
+	{
+	case HUD_ICON:
+		return iPosition | ( 1 << HUD_FIELD_STRING ) | ( 1 << HUD_FIELD_WIDTH ) | ( 1 << HUD_FIELD_HEIGHT );
+	case HUD_BOX:
+		return iPosition | ( 1 << HUD_FIELD_WIDTH ) | ( 1 << HUD_FIELD_HEIGHT ) | ( 1 << HUD_FIELD_COLOR ) | ( 1 << HUD_FIELD_BORDERCOLOR ) | ( 1 << HUD_FIELD_BORDERWIDTH );
+	case HUD_TEXT:
+		return iPosition | ( 1 << HUD_FIELD_STRING ) | ( 1 << HUD_FIELD_SIZE );
+	case HUD_TIMER:
+		return iPosition | ( 1 << HUD_FIELD_VALUE ) | ( 1 << HUD_FIELD_SPEED ) | ( 1 << HUD_FIELD_SIZE );
+	}
+
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Reset a lua hud element to nothing
+//-----------------------------------------------------------------------------
+void LuaHudElementState_t::Clear()
+{
+	iType = HUD_REMOVE;
+	x = y = 0;
+	iWidth = iHeight = 0;
+	szString[0] = '\0';
+	clr = clrBorder = Color( 0, 0, 0, 0 );
+	iBorderWidth = 0;
+	flValue = flSpeed = 0.0f;
+	iAlignX = iAlignY = iSize = -1;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Fields used by this element's type that differ from another state
+//-----------------------------------------------------------------------------
+int LuaHudElementState_t::Diff( const LuaHudElementState_t &other ) const
+{
+	int iFields = 0;
+
+	if( x != other.x )
+		iFields |= ( 1 << HUD_FIELD_X );
+	if( y != other.y )
+		iFields |= ( 1 << HUD_FIELD_Y );
+	if( iWidth != other.iWidth )
+		iFields |= ( 1 << HUD_FIELD_WIDTH );
+	if( iHeight != other.iHeight )
+		iFields |= ( 1 << HUD_FIELD_HEIGHT );
+	if( Q_strcmp( szString, other.szString ) != 0 )
+		iFields |= ( 1 << HUD_FIELD_STRING );
+	if( clr != other.clr )
+		iFields |= ( 1 << HUD_FIELD_COLOR );
+	if( clrBorder != other.clrBorder )
+		iFields |= ( 1 << HUD_FIELD_BORDERCOLOR );
+	if( iBorderWidth != other.iBorderWidth )
+		iFields |= ( 1 << HUD_FIELD_BORDERWIDTH );
+	if( flValue != other.flValue )
+		iFields |= ( 1 << HUD_FIELD_VALUE );
+	if( flSpeed != other.flSpeed )
+		iFields |= ( 1 << HUD_FIELD_SPEED );
+	if( iAlignX != other.iAlignX )
+		iFields |= ( 1 << HUD_FIELD_ALIGNX );
+	if( iAlignY != other.iAlignY )
+		iFields |= ( 1 << HUD_FIELD_ALIGNY );
+	if( iSize != other.iSize )
+		iFields |= ( 1 << HUD_FIELD_SIZE );
+
+	return iFields & FF_LuaHudFields( iType );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Write the fields in the mask, in field order
+//-----------------------------------------------------------------------------
+void LuaHudElementState_t::Write( bf_write &buf, int iFields ) const
+{
+	if( iFields & ( 1 << HUD_FIELD_X ) )
+		buf.WriteShort( x );
+	if( iFields & ( 1 << HUD_FIELD_Y ) )
+		buf.WriteShort( y );
+	if( iFields & ( 1 << HUD_FIELD_WIDTH ) )
+		buf.WriteShort( iWidth );
+	if( iFields & ( 1 << HUD_FIELD_HEIGHT ) )
+		buf.WriteShort( iHeight );
+	if( iFields & ( 1 << HUD_FIELD_STRING ) )
+		buf.WriteString( szString );
+	if( iFields & ( 1 << HUD_FIELD_COLOR ) )
+	{
+		buf.WriteByte( clr.r() );
+		buf.WriteByte( clr.g() );
+		buf.WriteByte( clr.b() );
+		buf.WriteByte( clr.a() );
+	}
+	if( iFields & ( 1 << HUD_FIELD_BORDERCOLOR ) )
+	{
+		buf.WriteByte( clrBorder.r() );
+		buf.WriteByte( clrBorder.g() );
+		buf.WriteByte( clrBorder.b() );
+		buf.WriteByte( clrBorder.a() );
+	}
+	if( iFields & ( 1 << HUD_FIELD_BORDERWIDTH ) )
+		buf.WriteShort( iBorderWidth );
+	if( iFields & ( 1 << HUD_FIELD_VALUE ) )
+		buf.WriteFloat( flValue );
+	if( iFields & ( 1 << HUD_FIELD_SPEED ) )
+		buf.WriteFloat( flSpeed );
+	if( iFields & ( 1 << HUD_FIELD_ALIGNX ) )
+		buf.WriteShort( iAlignX );
+	if( iFields & ( 1 << HUD_FIELD_ALIGNY ) )
+		buf.WriteShort( iAlignY );
+	if( iFields & ( 1 << HUD_FIELD_SIZE ) )
+		buf.WriteShort( iSize );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Read the fields in the mask over the top of the current state
+//-----------------------------------------------------------------------------
+void LuaHudElementState_t::Read( bf_read &buf, int iFields )
+{
+	if( iFields & ( 1 << HUD_FIELD_X ) )
+		x = buf.ReadShort();
+	if( iFields & ( 1 << HUD_FIELD_Y ) )
+		y = buf.ReadShort();
+	if( iFields & ( 1 << HUD_FIELD_WIDTH ) )
+		iWidth = buf.ReadShort();
+	if( iFields & ( 1 << HUD_FIELD_HEIGHT ) )
+		iHeight = buf.ReadShort();
+	if( iFields & ( 1 << HUD_FIELD_STRING ) )
+		buf.ReadString( szString, sizeof( szString ) );
+	if( iFields & ( 1 << HUD_FIELD_COLOR ) )
+	{
+		int r = buf.ReadByte();
+		int g = buf.ReadByte();
+		int b = buf.ReadByte();
+		int a = buf.ReadByte();
+		clr.SetColor( r, g, b, a );
+	}
+	if( iFields & ( 1 << HUD_FIELD_BORDERCOLOR ) )
+	{
+		int r = buf.ReadByte();
+		int g = buf.ReadByte();
+		int b = buf.ReadByte();
+		int a = buf.ReadByte();
+		clrBorder.SetColor( r, g, b, a );
+	}
+	if( iFields & ( 1 << HUD_FIELD_BORDERWIDTH ) )
+		iBorderWidth = buf.ReadShort();
+	if( iFields & ( 1 << HUD_FIELD_VALUE ) )
+		flValue = buf.ReadFloat();
+	if( iFields & ( 1 << HUD_FIELD_SPEED ) )
+		flSpeed = buf.ReadFloat();
+	if( iFields & ( 1 << HUD_FIELD_ALIGNX ) )
+		iAlignX = buf.ReadShort();
+	if( iFields & ( 1 << HUD_FIELD_ALIGNY ) )
+		iAlignY = buf.ReadShort();
+	if( iFields & ( 1 << HUD_FIELD_SIZE ) )
+		iSize = buf.ReadShort();
+}
+
 #ifdef GAME_DLL
 
+// The FF_LuaHud functions only queue the new state of an element,
+// _luahudman sends whatever changed once a tick.
+
 //-----------------------------------------------------------------------------
 // Purpose: Set an icon on the hud
 //-----------------------------------------------------------------------------
@@ -711,20 +878,18 @@ void FF_LuaHudIcon(CFFPlayer *pPlayer, const char *pszIdentifier, int x, int y,
 	if (!pPlayer)
 		return;
 
-	CSingleUserRecipientFilter user(pPlayer);
-	user.MakeReliable();
-
-	UserMessageBegin(user, "FF_HudLua");
-		WRITE_BYTE(HUD_ICON);
-		WRITE_SHORT(_scriptman.GetOrAddHudElementIndex(pszIdentifier));
-		WRITE_SHORT(x);
-		WRITE_SHORT(y);
-		WRITE_STRING(pszImage);
-		WRITE_SHORT(iWidth);
-		WRITE_SHORT(iHeight);
-		WRITE_SHORT(iAlignX);
-		WRITE_SHORT(iAlignY);
-	MessageEnd();
+	LuaHudElementState_t state;
+	state.Clear();
+	state.iType = HUD_ICON;
+	state.x = x;
+	state.y = y;
+	Q_strncpy(state.szString, pszImage ? pszImage : "", sizeof(state.szString));
+	state.iWidth = iWidth;
+	state.iHeight = iHeight;
+	state.iAlignX = iAlignX;
+	state.iAlignY = iAlignY;
+
+	_luahudman.SetElement(pPlayer, _scriptman.GetOrAddHudElementIndex(pszIdentifier), state);
 }
 
 //-----------------------------------------------------------------------------
@@ -735,28 +900,20 @@ void FF_LuaHudBox(CFFPlayer *pPlayer, const char *pszIdentifier, int x, int y, i
 	if (!pPlayer)
 		return;
 
-	CSingleUserRecipientFilter user(pPlayer);
-	user.MakeReliable();
-
-	UserMessageBegin(user, "FF_HudLua");
-		WRITE_BYTE(HUD_BOX);
-		WRITE_SHORT(_scriptman.GetOrAddHudElementIndex(pszIdentifier));
-		WRITE_SHORT(x);
-		WRITE_SHORT(y);
-		WRITE_SHORT(iWidth);
-		WRITE_SHORT(iHeight);
-		WRITE_SHORT(clr.r());
-		WRITE_SHORT(clr.g());
-		WRITE_SHORT(clr.b());
-		WRITE_SHORT(clr.a());
-		WRITE_SHORT(clrBorder.r());
-		WRITE_SHORT(clrBorder.g());
-		WRITE_SHORT(clrBorder.b());
-		WRITE_SHORT(clrBorder.a());
-		WRITE_SHORT(iBorderWidth);
-		WRITE_SHORT(iAlignX);
-		WRITE_SHORT(iAlignY);
-	MessageEnd();
+	LuaHudElementState_t state;
+	state.Clear();
+	state.iType = HUD_BOX;
+	state.x = x;
+	state.y = y;
+	state.iWidth = iWidth;
+	state.iHeight = iHeight;
+	state.clr = clr;
+	state.clrBorder = clrBorder;
+	state.iBorderWidth = iBorderWidth;
+	state.iAlignX = iAlignX;
+	state.iAlignY = iAlignY;
+
+	_luahudman.SetElement(pPlayer, _scriptman.GetOrAddHudElementIndex(pszIdentifier), state);
 }
 
 //-----------------------------------------------------------------------------
@@ -767,19 +924,17 @@ void FF_LuaHudText(CFFPlayer *pPlayer, const char *pszIdentifier, int x, int y,
 	if (!pPlayer)
 		return;
 
-	CSingleUserRecipientFilter user(pPlayer);
-	user.MakeReliable();
-
-	UserMessageBegin(user, "FF_HudLua");
-		WRITE_BYTE(HUD_TEXT);
-		WRITE_SHORT(_scriptman.GetOrAddHudElementIndex(pszIdentifier));
-		WRITE_SHORT(x);
-		WRITE_SHORT(y);
-		WRITE_STRING(pszText);
-		WRITE_SHORT(iAlignX);
-		WRITE_SHORT(iAlignY);
-		WRITE_SHORT(iSize);
-	MessageEnd();
+	LuaHudElementState_t state;
+	state.Clear();
+	state.iType = HUD_TEXT;
+	state.x = x;
+	state.y = y;
+	Q_strncpy(state.szString, pszText ? pszText : "", sizeof(state.szString));
+	state.iAlignX = iAlignX;
+	state.iAlignY = iAlignY;
+	state.iSize = iSize;
+
+	_luahudman.SetElement(pPlayer, _scriptman.GetOrAddHudElementIndex(pszIdentifier), state);
 }
 
 //-----------------------------------------------------------------------------
@@ -790,20 +945,19 @@ void FF_LuaHudTimer(CFFPlayer *pPlayer, const char *pszIdentifier, int x, int y,
 	if (!pPlayer)
 		return;
 
-	CSingleUserRecipientFilter user(pPlayer);
-	user.MakeReliable();
-
-	UserMessageBegin(user, "FF_HudLua");
-		WRITE_BYTE(HUD_TIMER);
-		WRITE_SHORT(_scriptman.GetOrAddHudElementIndex(pszIdentifier));
-		WRITE_SHORT(x);
-		WRITE_SHORT(y);
-		WRITE_FLOAT(flStartValue);
-		WRITE_FLOAT(flSpeed);
-		WRITE_SHORT(iAlignX);
-		WRITE_SHORT(iAlignY);
-		WRITE_SHORT(iSize);
-	MessageEnd();
+	LuaHudElementState_t state;
+	state.Clear();
+	state.iType = HUD_TIMER;
+	state.x = x;
+	state.y = y;
+	state.flValue = flStartValue;
+	state.flSpeed = flSpeed;
+	state.iAlignX = iAlignX;
+	state.iAlignY = iAlignY;
+	state.iSize = iSize;
+
+	// setting a timer (re)starts it even when nothing else changed
+	_luahudman.SetElement(pPlayer, _scriptman.GetOrAddHudElementIndex(pszIdentifier), state, true);
 }
 
 void FF_LuaHudRemove(CFFPlayer *pPlayer, const char *pszIdentifier)
@@ -811,13 +965,7 @@ void FF_LuaHudRemove(CFFPlayer *pPlayer, const char *pszIdentifier)
 	if (!pPlayer)
 		return;
 
-	CSingleUserRecipientFilter user(pPlayer);
-	user.MakeReliable();
-
-	UserMessageBegin(user, "FF_HudLua");
-		WRITE_BYTE(HUD_REMOVE);
-		WRITE_SHORT(_scriptman.GetOrAddHudElementIndex(pszIdentifier));
-	MessageEnd();
+	_luahudman.RemoveElement(pPlayer, _scriptman.GetOrAddHudElementIndex(pszIdentifier));
 }
 #endif
 
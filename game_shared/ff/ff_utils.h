@@ -70,6 +70,67 @@ enum HudElementType_t
 	HUD_REMOVE,
 };
 
+// Fields of a lua hud element. FF_HudLua messages carry a mask of these
+// so that only the fields that changed since the last update are sent.
+enum HudElementField_t
+{
+	HUD_FIELD_X = 0,
+	HUD_FIELD_Y,
+	HUD_FIELD_WIDTH,
+	HUD_FIELD_HEIGHT,
+	HUD_FIELD_STRING,		// icon image or text
+	HUD_FIELD_COLOR,
+	HUD_FIELD_BORDERCOLOR,
+	HUD_FIELD_BORDERWIDTH,
+	HUD_FIELD_VALUE,		// timer start value
+	HUD_FIELD_SPEED,
+	HUD_FIELD_ALIGNX,
+	HUD_FIELD_ALIGNY,
+	HUD_FIELD_SIZE,
+
+	HUD_FIELD_COUNT
+};
+
+// FF_HudLua is a batch of element updates, each one:
+//	type (HUD_ELEMENT_TYPE_BITS), element (HUD_ELEMENT_INDEX_BITS), and
+//	unless it's a remove, a field mask (HUD_FIELD_COUNT bits) followed
+//	by the fields in the mask
+#define HUD_ELEMENT_TYPE_BITS		3
+#define HUD_ELEMENT_INDEX_BITS		16
+#define HUD_ELEMENT_MAX_STRING		256
+
+class bf_write;
+class bf_read;
+
+struct LuaHudElementState_t
+{
+	int		iType;
+	int		x;
+	int		y;
+	int		iWidth;
+	int		iHeight;
+	char	szString[HUD_ELEMENT_MAX_STRING];
+	Color	clr;
+	Color	clrBorder;
+	int		iBorderWidth;
+	float	flValue;
+	float	flSpeed;
+	int		iAlignX;
+	int		iAlignY;
+	int		iSize;
+
+	void	Clear();
+
+	// mask of the fields used by iType that differ from other
+	int		Diff( const LuaHudElementState_t &other ) const;
+
+	void	Write( bf_write &buf, int iFields ) const;
+	void	Read( bf_read &buf, int iFields );
+};
+
+// mask of the fields an element type uses
+int FF_LuaHudFields( int iType );
+
 enum HudMessageType_t
 {
 	HUD_MESSAGE = 0,
@@ -17,6 +17,7 @@
 #include "ff_luacontext.h"
 #include "ff_utils.h"
 #include "ff_gamerules.h"
+#include "ff_pvscache.h"
 extern ConVar mp_prematch;
 
 // Mirv: Just added this to stop all the redefinition warnings whenever i do a full recompile
@@ -957,11 +958,7 @@ namespace Omnibot
 			Vector start(_pos[0],_pos[1],_pos[2]);
 			Vector end(_target[0],_target[1],_target[2]);
 
-			byte pvs[ MAX_MAP_CLUSTERS/8 ];
-			int iPVSCluster = engine->GetClusterForOrigin(start);
-			int iPVSLength = engine->GetPVSForCluster(iPVSCluster, sizeof(pvs), pvs);
-
-			return engine->CheckOriginInPVS(end, pvs, iPVSLength) ? True : False;
+			return _pvscache.CheckPVS(start, end) ? True : False;
 		}
 
 		obResult TraceLine(obTraceResult &_result, const float _start[3], const float _end[3], 
@@ -970,11 +967,7 @@ namespace Omnibot
 			Vector start(_start[0],_start[1],_start[2]);
 			Vector end(_end[0],_end[1],_end[2]);
 
-			byte pvs[ MAX_MAP_CLUSTERS/8 ];
-			int iPVSCluster = engine->GetClusterForOrigin(start);
-			int iPVSLength = engine->GetPVSForCluster(iPVSCluster, sizeof(pvs), pvs);
-
-			bool bInPVS = _bUsePVS ? engine->CheckOriginInPVS(end, pvs, iPVSLength) : true;
+			bool bInPVS = _bUsePVS ? _pvscache.CheckPVS(start, end) : true;
 			if(bInPVS)
 			{
 				int iMask = 0;
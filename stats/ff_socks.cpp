@@ -143,9 +143,17 @@ bool Socks::Connect(const char *hostname, unsigned short port)
 
 	int readsocks = select(m_iSocket + 1, (fd_set *) 0, &socks, (fd_set *) 0, &timeout);
 
-	// We connected
+	// We connected, unless the socket's only writeable because it failed
 	if (readsocks > 0) 
-		return true;
+	{
+		int error = 0;
+		socklen_t errorlen = sizeof(error);
+
+		if (getsockopt(m_iSocket, SOL_SOCKET, SO_ERROR, (raw_type *) &error, &errorlen) < 0)
+			return false;
+
+		return error == 0;
+	}
 
 	return false;
 }
@@ -157,25 +165,45 @@ bool Socks::Connect(const char *hostname, unsigned short port)
 */
 bool Socks::Send(const char *buffer) 
 {
-	fd_set socks;
+	return Send(buffer, strlen(buffer));
+}
 
-	FD_ZERO(&socks);
-	FD_SET(m_iSocket, &socks);
+/**
+* Send data, as many times as it takes for all of it to go
+*
+* @param buffer Data to send
+* @param bufferlen Length of data
+*/
+bool Socks::Send(const void *buffer, int bufferlen) 
+{
+	const char *data = (const char *) buffer;
 
-	struct timeval timeout;
-	timeout.tv_sec = TIMEOUT;
-	timeout.tv_usec = 0;
+	while (bufferlen > 0) 
+	{
+		fd_set socks;
 
-	// We're waiting here for the socket to be writeable
-	int writesocks = select(m_iSocket + 1, (fd_set *) 0, &socks, (fd_set *) 0, &timeout);
+		FD_ZERO(&socks);
+		FD_SET(m_iSocket, &socks);
 
-	// No sockets ready with data, so abandon plan
-	if (writesocks < 1) 
-		return false;
+		struct timeval timeout;
+		timeout.tv_sec = TIMEOUT;
+		timeout.tv_usec = 0;
 
-	// Send data then
-	if ((send(m_iSocket, (raw_type *) buffer, strlen(buffer), 0)) < 0) 
-		return false;
+		// We're waiting here for the socket to be writeable
+		int writesocks = select(m_iSocket + 1, (fd_set *) 0, &socks, (fd_set *) 0, &timeout);
+
+		// No sockets ready with data, so abandon plan
+		if (writesocks < 1) 
+			return false;
+
+		// Send as much as it'll take
+		int sent = send(m_iSocket, (const raw_type *) data, bufferlen, 0);
+		if (sent < 0) 
+			return false;
+
+		data += sent;
+		bufferlen -= sent;
+	}
 
 	return true;
 }
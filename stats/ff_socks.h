@@ -28,6 +28,7 @@ public:
 	bool	Open(int type, int protocol);
 	bool	Connect(const char *hostname, unsigned short port);
 	bool	Send(const char *buffer);
+	bool	Send(const void *buffer, int bufferlen);
 	int		Recv(void *buffer, int bufferlen);
 	bool	Close();
 
@@ -0,0 +1,62 @@
+// ff_statsfile.h
+
+/////////////////////////////////////////////////////////////////////////////
+// Binary match stats format. Written a record at a time while the match is
+// played (see ff_statswriter.h) and turned back into the text stats report
+// by utils/ffstatsreader. Only plain C types here so the reader can use it
+// without the rest of the SDK.
+//
+// A file is STATSFILE_MAGIC, one byte of STATSFILE_VERSION, then records.
+// Each record is one type byte followed by its fields:
+//
+//	varint		unsigned LEB128, 7 bits a byte, low bits first
+//	svarint		zigzag encoded signed value, then as a varint
+//	whole		the text "%.0f" printed for a value, as an int: n for "n"
+//				and ~n for "-n" (so "-0" is -1). Deltas of these are svarints
+//	string		varint length, then that many bytes (no terminator)
+//	u32			little endian
+//
+// STATSREC_INFO		string hostname, string login, u32 auth, string date, string map
+// STATSREC_STRING		varint id, string
+// STATSREC_PLAYER		varint player, string steamid, string name, svarint team, svarint class
+// STATSREC_STATDEF		varint stat, varint type, string name
+// STATSREC_ACTIONDEF	varint action, string name
+// STATSREC_ACTION		varint player, svarint target, varint action, svarint time,
+//						varint param, varint location, svarint x, svarint y, svarint z
+// STATSREC_STATS		varint count, then count of (varint player, varint stat, string value)
+// STATSREC_END			svarint duration, svarint blue, red, yellow and green score
+//
+// A player record with an id that has been seen before replaces it (names
+// change during a match). Action times and coordinates are wholes, relative
+// to the previous action's. Stat values are the text "%.0f" printed for
+// them. Both are worked out by printing on the server, so the reader gets
+// back exactly the text the report has, whichever way the server's CRT
+// rounds halves. Params and locations are ids of earlier string records.
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef FF_STATSFILE_H
+#define FF_STATSFILE_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#define STATSFILE_MAGIC			"FFST"
+#define STATSFILE_MAGIC_LENGTH	4
+#define STATSFILE_VERSION		2
+
+#define STATSFILE_EXTENSION		"ffs"
+
+enum StatsRecord_t
+{
+	STATSREC_INFO = 1,
+	STATSREC_STRING,
+	STATSREC_PLAYER,
+	STATSREC_STATDEF,
+	STATSREC_ACTIONDEF,
+	STATSREC_ACTION,
+	STATSREC_STATS,
+	STATSREC_END,
+};
+
+#endif // FF_STATSFILE_H
@@ -18,17 +18,20 @@
 
 #include "cbase.h"
 #include "ff_statslog.h"
-#include "ff_socks.h"
+#include "ff_statsupload.h"
+#include "ff_statswriter.h"
 #include "ff_weapon_base.h"
 #include "ff_player.h"
-#include "ff_string.h"
+#include "generichash.h"
+#include "utlbuffer.h"
+#include "tier0/vprof.h"
 
 #include <time.h>
 
 //#include <list>
 //#include <algorithm>
 //#include <string>
-#include <vector>
+//#include <vector>
 
 #undef MINMAX_H
 #include "minmax.h"
@@ -39,51 +42,268 @@ ConVar stats_enable("ff_stats_enable", "1", FCVAR_NOTIFY|FCVAR_ARCHIVE, "Enable
 ConVar stats_login("ff_stats_login", "unset", FCVAR_PROTECTED, "Fortress Forever Stats login information for this server");
 ConVar stats_secret("ff_stats_pass", "unset", FCVAR_PROTECTED, "Fortress Forever Stats shared secret for this server's login information");
 
+ConVar stats_max_actions("ff_stats_max_actions", "0", 0, "Most actions kept for one map's stats log, 0 for no limit. Any further actions are dropped from the uploaded report (the binary stats file still gets them).");
+
+// actions are kept in fixed size chunks so a long map never has to move them
+#define STATS_ACTIONS_PER_CHUNK		512
+
+// interned strings are packed into blocks of this many bytes
+#define STATS_STRING_CHUNK_SIZE		4096
+
+/**
+Interns strings and gives each a dense id. Lookups hash the string instead of
+comparing it against every name seen so far, and every copy lives in a few
+large blocks rather than one allocation per string.
+*/
+class CFFStatsStringTable
+{
+public:
+	CFFStatsStringTable();
+	~CFFStatsStringTable();
+
+	int Find(const char *str) const;
+	int Add(const char *str, bool *pbAdded = NULL);
+	const char *String(int id) const { return m_vStrings[id]; }
+	int Count() const { return m_vStrings.Count(); }
+	void Clear();
+
+private:
+	void Rehash(int iBuckets);
+	const char *CopyString(const char *str);
+
+	CUtlVector<const char *> m_vStrings;
+	CUtlVector<unsigned int> m_vHashes;
+
+	// open addressing, -1 is an empty bucket and the count is a power of two
+	CUtlVector<int> m_vBuckets;
+
+	CUtlVector<char *> m_vBlocks;
+	char *m_pBlock;
+	int m_iBlockUsed;
+};
+
+/**
+Constructor for the CFFStatsStringTable class
+*/
+CFFStatsStringTable::CFFStatsStringTable()
+{
+	m_pBlock = NULL;
+	m_iBlockUsed = 0;
+}
+
+/**
+Destructor for the CFFStatsStringTable class
+*/
+CFFStatsStringTable::~CFFStatsStringTable()
+{
+	Clear();
+}
+
+/**
+Looks up the id of a string, or -1 if it hasn't been added
+*/
+int CFFStatsStringTable::Find(const char *str) const
+{
+	if (!m_vBuckets.Count())
+		return -1;
+
+	unsigned int hash = HashString(str);
+	int mask = m_vBuckets.Count() - 1;
+
+	for (int i = hash & mask; m_vBuckets[i] != -1; i = (i + 1) & mask)
+	{
+		int id = m_vBuckets[i];
+		if (m_vHashes[id] == hash && !Q_strcmp(m_vStrings[id], str))
+			return id;
+	}
+
+	return -1;
+}
+
+/**
+Looks up the id of a string, adding it if it's new
+*/
+int CFFStatsStringTable::Add(const char *str, bool *pbAdded)
+{
+	if (pbAdded)
+		*pbAdded = false;
+
+	int id = Find(str);
+	if (id != -1)
+		return id;
+
+	// keep the table at most half full so probes stay short
+	if ((m_vStrings.Count() + 1) * 2 > m_vBuckets.Count())
+		Rehash(max(64, m_vBuckets.Count() * 2));
+
+	id = m_vStrings.AddToTail(CopyString(str));
+	m_vHashes.AddToTail(HashString(str));
+
+	int mask = m_vBuckets.Count() - 1;
+	int i = m_vHashes[id] & mask;
+	while (m_vBuckets[i] != -1)
+		i = (i + 1) & mask;
+	m_vBuckets[i] = id;
+
+	if (pbAdded)
+		*pbAdded = true;
+
+	return id;
+}
+
+/**
+Forget all strings and give back the memory they used
+*/
+void CFFStatsStringTable::Clear()
+{
+	for (int i = 0; i < m_vBlocks.Count(); i++)
+		delete [] m_vBlocks[i];
+
+	m_vBlocks.Purge();
+	m_vStrings.Purge();
+	m_vHashes.Purge();
+	m_vBuckets.Purge();
+
+	m_pBlock = NULL;
+	m_iBlockUsed = 0;
+}
+
+/**
+Rebuild the buckets with a new size
+*/
+void CFFStatsStringTable::Rehash(int iBuckets)
+{
+	m_vBuckets.SetCount(iBuckets);
+	for (int i = 0; i < iBuckets; i++)
+		m_vBuckets[i] = -1;
+
+	int mask = iBuckets - 1;
+	for (int id = 0; id < m_vStrings.Count(); id++)
+	{
+		int i = m_vHashes[id] & mask;
+		while (m_vBuckets[i] != -1)
+			i = (i + 1) & mask;
+		m_vBuckets[i] = id;
+	}
+}
+
+/**
+Copy a string into the current block, starting a new one if it's full
+*/
+const char *CFFStatsStringTable::CopyString(const char *str)
+{
+	int len = Q_strlen(str) + 1;
+
+	// too big to share a block, so it gets one to itself
+	if (len > STATS_STRING_CHUNK_SIZE)
+	{
+		char *pCopy = new char[len];
+		Q_memcpy(pCopy, str, len);
+		m_vBlocks.AddToTail(pCopy);
+		return pCopy;
+	}
+
+	if (!m_pBlock || m_iBlockUsed + len > STATS_STRING_CHUNK_SIZE)
+	{
+		m_pBlock = new char[STATS_STRING_CHUNK_SIZE];
+		m_iBlockUsed = 0;
+		m_vBlocks.AddToTail(m_pBlock);
+	}
+
+	char *pCopy = m_pBlock + m_iBlockUsed;
+	Q_memcpy(pCopy, str, len);
+	m_iBlockUsed += len;
+
+	return pCopy;
+}
+
+/**
+An action as it is stored. The strings are ids into the action string table,
+and each player's actions are chained together in the order they happened.
+*/
+struct StatsAction_t
+{
+	int actionid;
+	int targetid;
+	float time;
+	int param;
+	Vector coords;
+	int location;
+	int next;
+};
+
 class CFFPlayerStats 
 {
 public:
 	// Default constructor
 	CFFPlayerStats( void )
 	{
+		m_szName[0] = '\0';
+		m_szSteamID[0] = '\0';
 		m_iClass = CLASS_NONE;
 		m_iTeam = TEAM_UNASSIGNED;
 		m_iUniqueID = -1;
+		m_iFirstAction = -1;
+		m_iLastAction = -1;
 	}
 
 	// Overloaded constructor
 	CFFPlayerStats( const char *pszName, const char *pszSteamID, int iClass, int iTeam, int iUniqueID )
 	{
-		m_sName = pszName;
-		m_sSteamID = pszSteamID;
+		SetName( pszName, pszSteamID );
 		m_iClass = iClass;
 		m_iTeam = iTeam;
 		m_iUniqueID = iUniqueID;
+		m_iFirstAction = -1;
+		m_iLastAction = -1;
 	}
 
-	// Deconstructor
-	~CFFPlayerStats( void )
-	{
-		Cleanup();
-	}
-
-	// Deallocate
-	void Cleanup( void )
+	void SetName( const char *pszName, const char *pszSteamID )
 	{
-		m_vStats.clear();
-		m_vStartTimes.clear();
-		m_vActions.clear();
+		Q_strncpy( m_szName, pszName ? pszName : "", sizeof( m_szName ) );
+		Q_strncpy( m_szSteamID, pszSteamID ? pszSteamID : "", sizeof( m_szSteamID ) );
 	}
 	
 public:
-	CFFString m_sName;
-	CFFString m_sSteamID;
+	char m_szName[MAX_PLAYER_NAME_LENGTH];
+	char m_szSteamID[MAX_NETWORKID_LENGTH];
 	int m_iClass;
 	int m_iTeam;
 	int m_iUniqueID;
-	std::vector< double > m_vStats;
-	std::vector< double > m_vStartTimes;
-	std::vector< bool > m_vAutoApply;
-	std::vector< CFFAction > m_vActions;
+
+	// first and last of this player's actions in the action arena
+	int m_iFirstAction;
+	int m_iLastAction;
+};
+
+/**
+One stat's values for every player, indexed by player id. A column only
+grows when a player it hasn't seen yet adds to it.
+*/
+class CFFStatColumn 
+{
+public:
+	CFFStatColumn( stattype_t iType )
+	{
+		m_iType = iType;
+	}
+
+	// make sure the player has a slot in this column
+	void EnsurePlayer( int playerid )
+	{
+		while (m_vValues.Count() <= playerid)
+		{
+			m_vValues.AddToTail(0.0);
+			m_vStartTimes.AddToTail(0.0f);
+			m_vAutoApply.AddToTail(false);
+		}
+	}
+
+public:
+	stattype_t m_iType;
+	CUtlVector< double > m_vValues;
+	CUtlVector< float > m_vStartTimes;
+	CUtlVector< bool > m_vAutoApply;
 };
 
 class CFFStatsLog : public IStatsLog 
@@ -100,28 +320,66 @@ public:
 	void StopTimer(int playerid, int statid, bool apply = true);
 	void ResetStats();
 	void Serialise(char *buffer, int buffer_size);
+	void Serialise(CUtlBuffer &buf);
 	void FinalizeStats();
 
 	const char *GetAuthString() const;
 	const char *GetTimestampString() const;
+	unsigned long GetAuthHash(const char *pszDate) const;
+
+	void FinishStatsFile();
 
-	const bool HasData() { return m_vPlayers.size() && m_vStats.size(); }
+	const bool HasData() { return m_vPlayers.Count() && m_vStats.Count(); }
 private:
+	StatsAction_t &Action(int i) { return m_vActionChunks[i / STATS_ACTIONS_PER_CHUNK][i % STATS_ACTIONS_PER_CHUNK]; }
+	void RehashPlayers(int iBuckets);
+	void StartStatsFile();
+	void ClearStats();
+
 	// holds all of the player's stats
-	std::vector<CFFPlayerStats> m_vPlayers;
-	std::vector<CFFStatDef> m_vStats;
-	std::vector<CFFActionDef> m_vActions;
+	CUtlVector<CFFPlayerStats> m_vPlayers;
+
+	// (uniqueid, class) -> player id, open addressing like the string tables
+	CUtlVector<int> m_vPlayerBuckets;
+
+	// stat and action names, the ids are indices into m_vStats and the action names
+	CFFStatsStringTable m_StatNames;
+	CFFStatsStringTable m_ActionNames;
+	CUtlVector<CFFStatColumn *> m_vStats;
+
+	// every action's param and location
+	CFFStatsStringTable m_ActionStrings;
+
+	// all players' actions, in the order they happened
+	CUtlVector<StatsAction_t *> m_vActionChunks;
+	int m_nActions;
+	int m_nDroppedActions;
+
+	// binary copy of everything above, written as it happens
+	CFFStatsFileWriter m_File;
+	bool m_bFileStarted;
 };
 
 // singleton
 static CFFStatsLog g_StatsLogSingleton;
 IStatsLog *g_StatsLog = (IStatsLog *) &g_StatsLogSingleton;
 
+/**
+Hash for a player's (uniqueid, class) pair
+*/
+static inline unsigned int PlayerKeyHash(int uniqueid, int classid)
+{
+	return ((unsigned int)uniqueid * 2654435761u) ^ (unsigned int)classid;
+}
+
 /**
 Constructor for the CFFStatsLog class
 */
 CFFStatsLog::CFFStatsLog()
 {
+	m_nActions = 0;
+	m_nDroppedActions = 0;
+	m_bFileStarted = false;
 }
 
 /**
@@ -129,9 +387,12 @@ Destructor for the CFFStatsLog class
 */
 CFFStatsLog::~CFFStatsLog()
 {
-	m_vPlayers.clear();
-	m_vStats.clear();
-	m_vActions.clear();
+	// too late for the filesystem, ShutdownStats has closed the file
+	ClearStats();
+
+	for (int i = 0; i < m_vActionChunks.Count(); i++)
+		delete [] m_vActionChunks[i];
+	m_vActionChunks.Purge();
 }
 
 /**
@@ -141,21 +402,20 @@ int CFFStatsLog::GetStatID(const char *statname, stattype_t type)
 {
 	VPROF_BUDGET( "CFFStatsLog::GetStatID", VPROF_BUDGETGROUP_FF_STATS );
 
-	int i;
-	
-	// see if we have it already
-	for( i = 0; i < (int)m_vStats.size(); i++ )
+	bool bAdded;
+	int i = m_StatNames.Add( statname, &bAdded );
+
+	// otherwise we need to create it
+	if( bAdded )
 	{
-		// if we do, then return it
-		if( m_vStats[i].m_sName == statname )
-			return i;
+		m_vStats.AddToTail( new CFFStatColumn( type ) );
+
+		StartStatsFile();
+		m_File.WriteStatDef( i, type, statname );
 	}
 
-	// otherwise we need to create it
-	CFFStatDef s( statname, type );
-	m_vStats.push_back( s );
-	
-	// i should now be the end, which is the one we created
+	Assert( i < m_vStats.Count() );
+
 	return i;
 }
 
@@ -166,21 +426,15 @@ int CFFStatsLog::GetActionID(const char *actionname)
 {
 	VPROF_BUDGET( "CFFStatsLog::GetActionID", VPROF_BUDGETGROUP_FF_STATS );
 
-	int i;
-	
-	// see if we have it already
-	for( i = 0; i < (int)m_vActions.size(); i++ )
+	bool bAdded;
+	int i = m_ActionNames.Add( actionname, &bAdded );
+
+	if( bAdded )
 	{
-		// if we do, then return it
-		if( m_vActions[i].m_sName == actionname )
-			return i;
+		StartStatsFile();
+		m_File.WriteActionDef( i, actionname );
 	}
 
-	// otherwise we need to create it
-	CFFActionDef s( actionname );
-	m_vActions.push_back( s );
-	
-	// i should now be the end, which is the one we created
 	return i;
 }
 
@@ -191,25 +445,64 @@ int CFFStatsLog::GetPlayerID(const char *steamid, int classid, int teamnum, int
 {
 	VPROF_BUDGET( "CFFStatsLog::GetPlayerID", VPROF_BUDGETGROUP_FF_STATS );
 
+	int mask = m_vPlayerBuckets.Count() - 1;
 	int i;
 	
 	// see if we have it already
-	for( i = 0; i < (int)m_vPlayers.size(); i++ )
+	if( m_vPlayerBuckets.Count() )
 	{
-		// if we do, then return it
-		if( ( m_vPlayers[i].m_iUniqueID == uniqueid ) && ( m_vPlayers[i].m_iClass == classid ) ) {
-			m_vPlayers[i].m_sSteamID = steamid;
-			m_vPlayers[i].m_sName = name;
-			return i;
+		for( i = PlayerKeyHash( uniqueid, classid ) & mask; m_vPlayerBuckets[i] != -1; i = ( i + 1 ) & mask )
+		{
+			CFFPlayerStats &player = m_vPlayers[ m_vPlayerBuckets[i] ];
+
+			// if we do, then return it
+			if( ( player.m_iUniqueID == uniqueid ) && ( player.m_iClass == classid ) ) {
+				CFFPlayerStats old = player;
+				player.SetName( name, steamid );
+
+				// only a rename needs to go in the file
+				if( Q_strcmp( player.m_szName, old.m_szName ) || Q_strcmp( player.m_szSteamID, old.m_szSteamID ) )
+					m_File.WritePlayer( m_vPlayerBuckets[i], player.m_szSteamID, player.m_szName, player.m_iTeam, player.m_iClass );
+
+				return m_vPlayerBuckets[i];
+			}
 		}
 	}
 
 	// otherwise we need to create it
-	CFFPlayerStats s( name, steamid, classid, teamnum, uniqueid );
-	m_vPlayers.push_back( s );
+	if( ( m_vPlayers.Count() + 1 ) * 2 > m_vPlayerBuckets.Count() )
+		RehashPlayers( max( 64, m_vPlayerBuckets.Count() * 2 ) );
+
+	int id = m_vPlayers.AddToTail( CFFPlayerStats( name, steamid, classid, teamnum, uniqueid ) );
+
+	StartStatsFile();
+	m_File.WritePlayer( id, m_vPlayers[id].m_szSteamID, m_vPlayers[id].m_szName, teamnum, classid );
+
+	mask = m_vPlayerBuckets.Count() - 1;
+	for( i = PlayerKeyHash( uniqueid, classid ) & mask; m_vPlayerBuckets[i] != -1; i = ( i + 1 ) & mask )
+		;
+	m_vPlayerBuckets[i] = id;
 	
-	// i should now be the end, which is the one we created
-	return i;
+	return id;
+}
+
+/**
+Rebuild the player lookup with a new size
+*/
+void CFFStatsLog::RehashPlayers(int iBuckets)
+{
+	m_vPlayerBuckets.SetCount(iBuckets);
+	for (int i = 0; i < iBuckets; i++)
+		m_vPlayerBuckets[i] = -1;
+
+	int mask = iBuckets - 1;
+	for (int id = 0; id < m_vPlayers.Count(); id++)
+	{
+		int i = PlayerKeyHash(m_vPlayers[id].m_iUniqueID, m_vPlayers[id].m_iClass) & mask;
+		while (m_vPlayerBuckets[i] != -1)
+			i = (i + 1) & mask;
+		m_vPlayerBuckets[i] = id;
+	}
 }
 
 /**
@@ -219,32 +512,35 @@ void CFFStatsLog::AddStat(int playerid, int statid, double value)
 {
 	VPROF_BUDGET( "CFFStatsLog::AddStat", VPROF_BUDGETGROUP_FF_STATS );
 
-	assert(playerid >= 0 && playerid < (int)m_vPlayers.size());
-	assert(statid >= 0 && statid < (int)m_vStats.size());
+	assert(playerid >= 0 && playerid < m_vPlayers.Count());
+	assert(statid >= 0 && statid < m_vStats.Count());
 
 	//DevMsg("[STATS] adding stat %d to %d (+%.2f)\n", statid, playerid, value);
 
+	CFFStatColumn *pStat = m_vStats[statid];
+
 	// make sure it's big enough
-	if (m_vPlayers[playerid].m_vStats.size() < m_vStats.size())
-		m_vPlayers[playerid].m_vStats.resize(m_vStats.size(), 0.0);
+	pStat->EnsurePlayer(playerid);
+
+	double &stat = pStat->m_vValues[playerid];
 
 	// update the stat for the appropriate type
-	if (m_vStats[statid].m_iType == STAT_ADD) 
+	if (pStat->m_iType == STAT_ADD) 
 	{
-		m_vPlayers[playerid].m_vStats[statid] += value;
+		stat += value;
 	} 
-	else if (m_vStats[statid].m_iType == STAT_MIN) 
+	else if (pStat->m_iType == STAT_MIN) 
 	{
-		if (value < m_vPlayers[playerid].m_vStats[statid])
-			m_vPlayers[playerid].m_vStats[statid] = value;
+		if (value < stat)
+			stat = value;
 	} 
-	else if (m_vStats[statid].m_iType == STAT_MAX) 
+	else if (pStat->m_iType == STAT_MAX) 
 	{
-		if (value > m_vPlayers[playerid].m_vStats[statid])
-			m_vPlayers[playerid].m_vStats[statid] = value;
+		if (value > stat)
+			stat = value;
 	}
 
-	//DevMsg("Added stat to player %d: %s += %f\n", playerid, m_vStats[statid].m_sName, value);
+	//DevMsg("Added stat to player %d: %s += %f\n", playerid, m_StatNames.String(statid), value);
 }
 
 /**
@@ -260,17 +556,58 @@ void CFFStatsLog::AddAction(int playerid, int targetid, int actionid, const char
 {
 	VPROF_BUDGET( "CFFStatsLog::AddAction", VPROF_BUDGETGROUP_FF_STATS );
 
-	assert(playerid >= 0 && playerid < (int)m_vPlayers.size());
+	assert(playerid >= 0 && playerid < m_vPlayers.Count());
 	
 	float time = gpGlobals->curtime;
 
 	DevMsg("[STATS] adding action %d[%s] to %d (at (%.2f, %.2f, %.2f) aka '%s')\n", actionid, param, playerid, coords.x, coords.y, coords.z, location);
 
-	// build the action def
-	CFFAction a( actionid, targetid, time, param, coords, location?location:"" );
+	StartStatsFile();
+
+	bool bAdded;
+	int iParam = m_ActionStrings.Add(param?param:"", &bAdded);
+	if (bAdded)
+		m_File.WriteString(iParam, m_ActionStrings.String(iParam));
 
-	// add it
-	m_vPlayers[ playerid ].m_vActions.push_back( a );
+	int iLocation = m_ActionStrings.Add(location?location:"", &bAdded);
+	if (bAdded)
+		m_File.WriteString(iLocation, m_ActionStrings.String(iLocation));
+
+	// the file doesn't take up memory, so it gets every action
+	m_File.WriteAction(playerid, targetid, actionid, time, iParam, coords, iLocation);
+
+	// the log has as much as it's allowed to hold for this map
+	if (stats_max_actions.GetInt() > 0 && m_nActions >= stats_max_actions.GetInt())
+	{
+		if (!m_nDroppedActions)
+			Warning("[STATS] Action log is full (%d actions, ff_stats_max_actions), dropping any more from this map's report\n", m_nActions);
+
+		m_nDroppedActions++;
+		return;
+	}
+
+	// start another chunk if the last one is full
+	if (m_nActions / STATS_ACTIONS_PER_CHUNK >= m_vActionChunks.Count())
+		m_vActionChunks.AddToTail(new StatsAction_t[STATS_ACTIONS_PER_CHUNK]);
+
+	// build the action
+	int i = m_nActions++;
+	StatsAction_t &a = Action(i);
+	a.actionid = actionid;
+	a.targetid = targetid;
+	a.time = time;
+	a.param = iParam;
+	a.coords = coords;
+	a.location = iLocation;
+	a.next = -1;
+
+	// add it to the end of the player's actions
+	CFFPlayerStats &player = m_vPlayers[playerid];
+	if (player.m_iLastAction == -1)
+		player.m_iFirstAction = i;
+	else
+		Action(player.m_iLastAction).next = i;
+	player.m_iLastAction = i;
 }
 
 /**
@@ -283,25 +620,24 @@ void CFFStatsLog::StartTimer(int playerid, int statid, bool autoapply)
 	return;
 	VPROF_BUDGET( "CFFStatsLog::StartTimer", VPROF_BUDGETGROUP_FF_STATS );
 
-	assert(playerid >= 0 && playerid < (int)m_vPlayers.size());
-	assert(statid >= 0 && statid < (int)m_vStats.size());
+	assert(playerid >= 0 && playerid < m_vPlayers.Count());
+	assert(statid >= 0 && statid < m_vStats.Count());
+
+	CFFStatColumn *pStat = m_vStats[statid];
 
 	// make sure it's big enough
-	if (m_vPlayers[playerid].m_vStartTimes.size() < m_vStats.size())
-		m_vPlayers[playerid].m_vStartTimes.resize(m_vStats.size(), 0.0);
-	if (m_vPlayers[playerid].m_vAutoApply.size() < m_vStats.size())
-		m_vPlayers[playerid].m_vAutoApply.resize(m_vStats.size(), 0.0);
+	pStat->EnsurePlayer(playerid);
 
 	// make sure it's stopped
-	if (m_vPlayers[playerid].m_vStartTimes[statid] > 0.0001)
+	if (pStat->m_vStartTimes[playerid] > 0.0001)
 	{
 		DevWarning("Starting timer for stat %d without stopping it first\n", statid);
 		StopTimer(playerid, statid, true);
 	}
 
 	// set the start time to now
-	m_vPlayers[playerid].m_vStartTimes[statid] = gpGlobals->curtime;
-	m_vPlayers[playerid].m_vAutoApply[statid] = autoapply;
+	pStat->m_vStartTimes[playerid] = gpGlobals->curtime;
+	pStat->m_vAutoApply[playerid] = autoapply;
 }
 
 /**
@@ -317,23 +653,22 @@ void CFFStatsLog::StopTimer(int playerid, int statid, bool apply)
 	VPROF_BUDGET( "CFFStatsLog::StopTimer", VPROF_BUDGETGROUP_FF_STATS );
 	
 	// don't try this if we're not even running
-	if (m_vPlayers.size() == 0)
+	if (m_vPlayers.Count() == 0)
 		return;
 
-	assert(playerid >= 0 && playerid < (int)m_vPlayers.size());
-	assert(statid >= 0 && statid < (int)m_vStats.size());
+	assert(playerid >= 0 && playerid < m_vPlayers.Count());
+	assert(statid >= 0 && statid < m_vStats.Count());
+
+	CFFStatColumn *pStat = m_vStats[statid];
 
 	// make sure it's big enough
-	if (m_vPlayers[playerid].m_vStartTimes.size() < m_vStats.size())
-		m_vPlayers[playerid].m_vStartTimes.resize(m_vStats.size(), 0.0);
-	if (m_vPlayers[playerid].m_vAutoApply.size() < m_vStats.size())
-		m_vPlayers[playerid].m_vAutoApply.resize(m_vStats.size(), 0.0);
+	pStat->EnsurePlayer(playerid);
 		
-	if (apply && m_vPlayers[playerid].m_vStartTimes[statid] > 0.0f)
-		AddStat(playerid, statid, gpGlobals->curtime - m_vPlayers[playerid].m_vStartTimes[statid]);
+	if (apply && pStat->m_vStartTimes[playerid] > 0.0f)
+		AddStat(playerid, statid, gpGlobals->curtime - pStat->m_vStartTimes[playerid]);
 
-	m_vPlayers[playerid].m_vStartTimes[statid] = 0.0f;
-	m_vPlayers[playerid].m_vAutoApply[statid] = false;	// false so it doesn't attempt to try to apply something that's not on
+	pStat->m_vStartTimes[playerid] = 0.0f;
+	pStat->m_vAutoApply[playerid] = false;	// false so it doesn't attempt to try to apply something that's not on
 }
 
 /**
@@ -342,9 +677,9 @@ Stop all timers that need to be stopped before the round ends
 void CFFStatsLog::FinalizeStats()
 {
 	int i, j;
-	for (i=0; i<(int)m_vPlayers.size(); i++) {
-		for (j=0; j<(int)m_vPlayers[i].m_vAutoApply.size(); j++) {
-			if (m_vPlayers[i].m_vAutoApply[i]) {
+	for (j=0; j<m_vStats.Count(); j++) {
+		for (i=0; i<m_vStats[j]->m_vAutoApply.Count(); i++) {
+			if (m_vStats[j]->m_vAutoApply[i]) {
 				StopTimer(i, j, true);
 			}
 		}
@@ -359,9 +694,35 @@ void CFFStatsLog::ResetStats()
 {
 	VPROF_BUDGET( "CFFStatsLog::ResetStats", VPROF_BUDGETGROUP_FF_STATS );
 
-	m_vPlayers.clear();
-	m_vStats.clear();
-	m_vActions.clear();
+	// the file gets the final values before they go, and the next action
+	// starts a new one
+	FinishStatsFile();
+
+	ClearStats();
+}
+
+/**
+Throw away everything logged so far, without touching the stats file
+*/
+void CFFStatsLog::ClearStats()
+{
+	if (m_nDroppedActions)
+		Warning("[STATS] %d actions didn't fit in the log and were left out of the report\n", m_nDroppedActions);
+
+	m_vPlayers.Purge();
+	m_vPlayerBuckets.Purge();
+
+	for (int i = 0; i < m_vStats.Count(); i++)
+		delete m_vStats[i];
+	m_vStats.Purge();
+
+	m_StatNames.Clear();
+	m_ActionNames.Clear();
+	m_ActionStrings.Clear();
+
+	// the action chunks are kept for the next map, they're only overwritten
+	m_nActions = 0;
+	m_nDroppedActions = 0;
 
 	// TODO: Do we care about other stuff resetting?
 }
@@ -397,193 +758,217 @@ const char *CFFStatsLog::GetTimestampString() const
 	return ret;
 }
 /**
-Serialise the stored data for sending
+Hash of the login, shared secret and date that the stats server checks
 */
-void CFFStatsLog::Serialise(char *buffer, int buffer_size)
+unsigned long CFFStatsLog::GetAuthHash(const char *pszDate) const
 {
-	VPROF_BUDGET( "CFFStatsLog::Serialise", VPROF_BUDGETGROUP_FF_STATS );
-
-	DevMsg("[STATS] Generating Serialized stats log\n");
-
-	// build the auth string here
 	const char *pszLogin = stats_login.GetString();
 	const char *pszSecret = stats_secret.GetString();
-	const char *pszDate = GetTimestampString(); // abuse staticness of return here
 	char preAuthString[80];
 	Q_snprintf( preAuthString, 80, "%s%s%s", pszLogin, pszSecret, pszDate );
 	//DevMsg( "[STATS] preAuthString: [%s]\n", preAuthString );
 
-	int i, j, offset = 0;
-	CFFTeam *pTeam;
-
 	// Simple hash used here
 	unsigned long hash = 0;
-	for(i = 0; i < (int)strlen( preAuthString ); i++)
+	for(int i = 0; i < (int)strlen( preAuthString ); i++)
 	{
 		hash = (hash<<7) | (hash>>31);
 		hash ^= preAuthString[i];
 	}
 
+	return hash;
+}
+
+/**
+Start the binary stats file for this map, the first time anything is logged
+*/
+void CFFStatsLog::StartStatsFile()
+{
+	if (m_bFileStarted)
+		return;
+
+	// only try once a map, even if it can't be opened
+	m_bFileStarted = true;
+
+	const char *pszDate = GetTimestampString();
+	ConVar *hostname = cvar->FindVar("hostname");
+
+	m_File.Open(hostname->GetString(), stats_login.GetString(), GetAuthHash(pszDate), pszDate, gpGlobals->mapname.ToCStr());
+}
+
+/**
+Write the final stat values and the scores to the binary stats file and close it
+*/
+void CFFStatsLog::FinishStatsFile()
+{
+	VPROF_BUDGET( "CFFStatsLog::FinishStatsFile", VPROF_BUDGETGROUP_FF_STATS );
+
+	m_bFileStarted = false;
+
+	if (!m_File.IsOpen())
+		return;
+
+	int i, j, nStats = 0;
+
+	// same order and the same unset stats skipped as Serialise
+	for (i=0; i<m_vPlayers.Count(); i++)
+		for (j=0; j<m_vStats.Count(); j++)
+			if (i < m_vStats[j]->m_vValues.Count() && m_vStats[j]->m_vValues[i] != 0.0)
+				nStats++;
+
+	m_File.BeginStats(nStats);
+
+	for (i=0; i<m_vPlayers.Count(); i++)
+		for (j=0; j<m_vStats.Count(); j++)
+			if (i < m_vStats[j]->m_vValues.Count() && m_vStats[j]->m_vValues[i] != 0.0)
+				m_File.WriteStat(i, j, m_vStats[j]->m_vValues[i]);
+
+	int iScores[4];
+	const int iTeams[4] = { TEAM_BLUE, TEAM_RED, TEAM_YELLOW, TEAM_GREEN };
+	for (i=0; i<4; i++)
+	{
+		CFFTeam *pTeam = GetGlobalFFTeam(iTeams[i]);
+		iScores[i] = pTeam ? pTeam->GetScore() : -1;
+	}
+
+	m_File.WriteEnd((int)gpGlobals->curtime, iScores);
+	m_File.Close();
+}
+
+/**
+Serialise the stored data for sending
+*/
+void CFFStatsLog::Serialise(CUtlBuffer &buf)
+{
+	VPROF_BUDGET( "CFFStatsLog::Serialise", VPROF_BUDGETGROUP_FF_STATS );
+
+	DevMsg("[STATS] Generating Serialized stats log\n");
+
+	// build the auth string here
+	const char *pszLogin = stats_login.GetString();
+	const char *pszDate = GetTimestampString(); // abuse staticness of return here
+	unsigned long hash = GetAuthHash( pszDate );
+
+	int i, j;
+	CFFTeam *pTeam;
+
 	// Basic header information
 	ConVar *hostname = cvar->FindVar("hostname");
-	offset += Q_snprintf(buffer+offset, buffer_size-offset, "hostname %s\n", hostname->GetString());
-	offset += Q_snprintf(buffer+offset, buffer_size-offset, "login %s\n", pszLogin);
-	offset += Q_snprintf(buffer+offset, buffer_size-offset, "auth %08X\n", hash);
-	offset += Q_snprintf(buffer+offset, buffer_size-offset, "date %s\n", pszDate);
-	offset += Q_snprintf(buffer+offset, buffer_size-offset, "duration %d\n", (int)gpGlobals->curtime);
-	offset += Q_snprintf(buffer+offset, buffer_size-offset, "map %s\n", gpGlobals->mapname.ToCStr());
+	buf.Printf("hostname %s\n", hostname->GetString());
+	buf.Printf("login %s\n", pszLogin);
+	buf.Printf("auth %08X\n", hash);
+	buf.Printf("date %s\n", pszDate);
+	buf.Printf("duration %d\n", (int)gpGlobals->curtime);
+	buf.Printf("map %s\n", gpGlobals->mapname.ToCStr());
 	pTeam = GetGlobalFFTeam(TEAM_BLUE);
-	offset += Q_snprintf(buffer+offset, buffer_size-offset, "bluescore %d\n", pTeam ? pTeam->GetScore() : -1);
+	buf.Printf("bluescore %d\n", pTeam ? pTeam->GetScore() : -1);
 	pTeam = GetGlobalFFTeam(TEAM_RED);
-	offset += Q_snprintf(buffer+offset, buffer_size-offset, "redscore %d\n", pTeam ? pTeam->GetScore() : -1);
+	buf.Printf("redscore %d\n", pTeam ? pTeam->GetScore() : -1);
 	pTeam = GetGlobalFFTeam(TEAM_YELLOW);
-	offset += Q_snprintf(buffer+offset, buffer_size-offset, "yellowscore %d\n", pTeam ? pTeam->GetScore() : -1);
+	buf.Printf("yellowscore %d\n", pTeam ? pTeam->GetScore() : -1);
 	pTeam = GetGlobalFFTeam(TEAM_GREEN);
-	offset += Q_snprintf(buffer+offset, buffer_size-offset, "greenscore %d\n", pTeam ? pTeam->GetScore() : -1);
+	buf.Printf("greenscore %d\n", pTeam ? pTeam->GetScore() : -1);
 	
 	// add the players section
-	offset += Q_snprintf(buffer+offset, buffer_size-offset, "players\n");
-	for (i=0; i<(int)m_vPlayers.size(); i++) {
-		offset += Q_snprintf(buffer+offset, buffer_size-offset, "%s %s %d %d\n",
-			m_vPlayers[i].m_sSteamID.GetString(),
-			m_vPlayers[i].m_sName.GetString(),
+	buf.Printf("players\n");
+	for (i=0; i<m_vPlayers.Count(); i++) {
+		buf.Printf("%s %s %d %d\n",
+			m_vPlayers[i].m_szSteamID,
+			m_vPlayers[i].m_szName,
 			m_vPlayers[i].m_iTeam,
 			m_vPlayers[i].m_iClass);
 	}
 
 	// add the actions section
-	offset += Q_snprintf(buffer+offset, buffer_size-offset, "actions\n");
-	for (i=0; i<(int)m_vPlayers.size(); i++) {
-		for (j=0; j<(int)m_vPlayers[i].m_vActions.size(); j++) {
-	//for (std::vector<CFFPlayerStats>::const_iterator it = m_vPlayers.begin(); it!=m_vPlayers.end(); it++) {
-	//	for (std::vector<CFFAction>::const_iterator jt = (*it).m_vActions.begin(); jt!=(*it).m_vActions.end(); jt++) {
-			offset += Q_snprintf(buffer+offset, buffer_size-offset, "%d %d %s %.0f %s %.0f,%.0f,%.0f %s\n",
+	buf.Printf("actions\n");
+	for (i=0; i<m_vPlayers.Count(); i++) {
+		for (j=m_vPlayers[i].m_iFirstAction; j!=-1; j=Action(j).next) {
+			const StatsAction_t &a = Action(j);
+			buf.Printf("%d %d %s %.0f %s %.0f,%.0f,%.0f %s\n",
 				i,
-				m_vPlayers[i].m_vActions[j].targetid,
-				m_vActions[m_vPlayers[i].m_vActions[j].actionid].m_sName.GetString(),
-				m_vPlayers[i].m_vActions[j].time,
-				m_vPlayers[i].m_vActions[j].param.GetString(),
-				m_vPlayers[i].m_vActions[j].coords.x,
-				m_vPlayers[i].m_vActions[j].coords.y,
-				m_vPlayers[i].m_vActions[j].coords.z,
-				m_vPlayers[i].m_vActions[j].location.GetString());
+				a.targetid,
+				m_ActionNames.String(a.actionid),
+				a.time,
+				m_ActionStrings.String(a.param),
+				a.coords.x,
+				a.coords.y,
+				a.coords.z,
+				m_ActionStrings.String(a.location));
 		}
 	}
 
 	// add the stats section
-	offset += Q_snprintf(buffer+offset, buffer_size-offset, "stats\n");
-	for (i=0; i<(int)m_vPlayers.size(); i++) {
-		for (j=0; j<(int)m_vPlayers[i].m_vStats.size(); j++) {
-			if (m_vPlayers[i].m_vStats[j] == 0.0) continue; // skip unset stats
-			offset += Q_snprintf(buffer+offset, buffer_size-offset, "%d %s %.0f\n",
+	buf.Printf("stats\n");
+	for (i=0; i<m_vPlayers.Count(); i++) {
+		for (j=0; j<m_vStats.Count(); j++) {
+			const CUtlVector<double> &values = m_vStats[j]->m_vValues;
+			if (i >= values.Count() || values[i] == 0.0) continue; // skip unset stats
+			buf.Printf("%d %s %.0f\n",
 				i,
-				m_vStats[j].m_sName.GetString(),
-				m_vPlayers[i].m_vStats[j]);
+				m_StatNames.String(j),
+				values[i]);
 		}
 	}
 }
 
-#define STATS_HOST "www.burntpopcorn.net"
-#define STATS_URL "/ff/storestats.php"
-#define STATS_BOUNDARY "STATSBOUNDSzx9n12"
-void SendStats() 
+/**
+Serialise into a fixed buffer. Anything that doesn't fit is cut off.
+*/
+void CFFStatsLog::Serialise(char *buffer, int buffer_size)
 {
-	return;
-	Socks sock;
+	if (buffer_size <= 0)
+		return;
 
-	VPROF_BUDGET( "CFFStatsLog::SendStats", VPROF_BUDGETGROUP_FF_STATS );
+	CUtlBuffer buf(0, 0, CUtlBuffer::TEXT_BUFFER);
+	Serialise(buf);
 
-	if (!stats_enable.GetBool())
-		goto end;
-		
-	if (!g_StatsLogSingleton.HasData())
-		goto end;
+	int len = min(buf.TellPut(), buffer_size - 1);
+	Q_memcpy(buffer, buf.Base(), len);
+	buffer[len] = '\0';
+}
+
+/**
+Hand the stats for this map to the uploader. It writes the report to its
+spool here; only sending it happens on the uploader's own thread.
+*/
+void SendStats() 
+{
+	VPROF_BUDGET( "CFFStatsLog::SendStats", VPROF_BUDGETGROUP_FF_STATS );
 
 	g_StatsLogSingleton.FinalizeStats();
-		
-	// this is kind of wasteful :(
-	char buf[100000], buf2[120000];
-
-	DevMsg("[STATS] Sending stats...\n");
-
-	g_StatsLogSingleton.Serialise(buf, sizeof(buf));
-	//DevMsg(buf);
-	//DevMsg("------\n\n");
-
-	// generate post-data first (size is used in the part below)
-	Q_snprintf(buf2, sizeof(buf2),
-		"--" STATS_BOUNDARY "\r\n"
-        "Content-Disposition: form-data; name=\"data\"\r\n"
-        "\r\n%s\r\n"
-        "--" STATS_BOUNDARY "\r\n",
-
-		buf);
-
-	// generate http request
-    Q_snprintf(buf, sizeof(buf),
-		"POST %s HTTP/1.1\r\n"
-		"Host: %s\r\n"
-		"Connection: close\r\n"
-		"Content-type: multipart/form-data, boundary=" STATS_BOUNDARY "\r\n"
-		"Content-length: %d\r\n\r\n"
-		"%s",
-		
-		STATS_URL,
-		STATS_HOST,
-		strlen(buf2),
-		buf2);
 
-	DevMsg(buf);
-	//UTIL_LogPrintf(buf);
+	// the local copy is kept whether or not it's uploaded
+	g_StatsLogSingleton.FinishStatsFile();
 
-	// Open up a socket
-	if (!sock.Open(/*SOCK_STREAM */ 1, 0)) 
+	if (stats_enable.GetBool() && g_StatsLogSingleton.HasData())
 	{
-		Warning("[STATS] Could not open socket\n");
-		goto end;
-	}
 
-	// Connect to remote host
-	if (!sock.Connect(STATS_HOST, 80)) 
-	{
-		Warning("[STATS] Could not connect to remote host\n");
-		goto end;
-	}
+		CUtlBuffer buf(0, 0, CUtlBuffer::TEXT_BUFFER);
+		g_StatsLogSingleton.Serialise(buf);
 
-	// Send data
-	if (!sock.Send(buf)) 
-	{
-		Warning("[STATS] Could not send data to remote host\n");
-		sock.Close();
-		goto end;
-	}
+		DevMsg("[STATS] Queueing %d bytes of stats for upload\n", buf.TellPut());
 
-	// Send data
-	if (!sock.Send(buf)) 
-	{
-		Warning("[STATS] Could not send data to remote host\n");
-		sock.Close();
-		goto end;
+		_statsuploader.QueueReport(buf);
 	}
 
-	int a;
-
-	// Send data
-	if ((a = sock.Recv(buf, sizeof(buf)-1)) == 0) 
-	{
-		Warning("[STATS] Did not get response from stats server\n");
-		sock.Close();
-		return;
-	}
-
-	buf[a] = '\0';
-
-	DevMsg("[STATS] Successfully sent stats data. Response:\n---\n%s\n---\n", buf);
+	// now that they're queued, we can reset them.	
+	g_StatsLogSingleton.ResetStats();
+}
 
-	// Close socket
-	sock.Close();
+/**
+Let the uploader send whatever is waiting in the spool
+*/
+void UpdateStats()
+{
+	_statsuploader.Update();
+}
 
-end:
-	// now that we've sent them, we can reset them.	
-	g_StatsLogSingleton.ResetStats();
+/**
+Close this map's binary stats file and stop the uploader. Reports it hasn't
+sent yet stay in the spool for next time.
+*/
+void ShutdownStats()
+{
+	g_StatsLogSingleton.FinishStatsFile();
+	_statsuploader.Shutdown();
 }
@@ -19,7 +19,7 @@
 
 #include "ff_statdefs.h"
 #include "ff_weapon_base.h"
-#include "ff_string.h"
+#include "utlstring.h"
 
 // Forward declarations
 class CFFPlayer;
@@ -49,7 +49,7 @@ public:
 	}
 
 public:
-	CFFString m_sName;
+	CUtlString m_sName;
 	stattype_t m_iType;
 };
 
@@ -63,7 +63,7 @@ public:
 	}
 
 public:
-	CFFString m_sName;
+	CUtlString m_sName;
 };
 
 class CFFAction 
@@ -93,9 +93,9 @@ public:
 	int actionid;
 	int targetid;
 	float time;
-	CFFString param;
+	CUtlString param;
 	Vector coords;
-	CFFString location;
+	CUtlString location;
 };
 
 // STL stuff has been moved out of here because Valve and STL don't really mix very well!
@@ -116,7 +116,18 @@ public:
 // Singleton to use
 //extern IStatsLog *g_StatsLog;
 
+// Nothing in stats/ is built into any project yet, so nothing calls these.
+// Wiring it up means adding these files to the server and calling
+// SendStats at the end of each map, UpdateStats once a frame and
+// ShutdownStats when the server dll shuts down.
+
 // Function to send stats
 void SendStats();
 
+// Function to send stats reports waiting in the spool, once a frame
+void UpdateStats();
+
+// Function to stop sending stats when the server shuts down
+void ShutdownStats();
+
 #endif /* FF_STATSLOG_H */
@@ -0,0 +1,471 @@
+// ff_statsupload.cpp
+
+/////////////////////////////////////////////////////////////////////////////
+// includes
+#include "cbase.h"
+#include "ff_statsupload.h"
+#include "ff_socks.h"
+#include "filesystem.h"
+
+#include <time.h>
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+/////////////////////////////////////////////////////////////////////////////
+ConVar stats_host( "ff_stats_host", "www.burntpopcorn.net", FCVAR_PROTECTED, "Host the Fortress Forever stats are sent to. Can be pointed at a local server for testing." );
+ConVar stats_port( "ff_stats_port", "80", FCVAR_PROTECTED, "Port on ff_stats_host the stats are sent to" );
+ConVar stats_url( "ff_stats_url", "/ff/storestats.php", FCVAR_PROTECTED, "Path on ff_stats_host the stats are posted to" );
+ConVar stats_spool_max( "ff_stats_spool_max", "16", 0, "Most stats reports kept waiting to be sent. The oldest are thrown away beyond this." );
+ConVar stats_retry_min( "ff_stats_retry_min", "30", 0, "Seconds to wait before retrying a failed stats upload. Doubles with each failure in a row." );
+ConVar stats_retry_max( "ff_stats_retry_max", "900", 0, "Longest wait in seconds between stats upload retries" );
+
+/////////////////////////////////////////////////////////////////////////////
+// reports are kept here (under the mod directory) until they're sent
+#define STATS_SPOOL_DIR		"stats_spool"
+
+#define STATS_BOUNDARY		"STATSBOUNDSzx9n12"
+
+/////////////////////////////////////////////////////////////////////////////
+CFFStatsUploader _statsuploader;
+
+/////////////////////////////////////////////////////////////////////////////
+// Appends text to a binary buffer without the terminating zero that
+// PutString and Printf would write
+/////////////////////////////////////////////////////////////////////////////
+static void PutText( CUtlBuffer &buf, const char *pszText )
+{
+	buf.Put( pszText, Q_strlen( pszText ) );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+CFFStatsUploader::CFFStatsUploader()
+{
+	Q_memset( &m_Settings, 0, sizeof( m_Settings ) );
+
+	m_bExit = false;
+	m_bBusy = false;
+	m_bDone = false;
+	m_bSent = false;
+	m_iStatus = 0;
+	Q_memset( &m_UploadSettings, 0, sizeof( m_UploadSettings ) );
+
+	m_szUploading[ 0 ] = '\0';
+	m_nFailuresInRow = 0;
+	m_flNextAttempt = 0.0;
+	m_iSequence = 0;
+
+	m_nSpooled = 0;
+	m_nSent = 0;
+	m_nFailures = 0;
+	m_nDropped = 0;
+	m_iLastStatus = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Shutdown() has to have stopped the worker by now
+/////////////////////////////////////////////////////////////////////////////
+CFFStatsUploader::~CFFStatsUploader()
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Writes the report to the spool, it's sent from there by Update
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsUploader::QueueReport( const CUtlBuffer &report )
+{
+	ReadSettings();
+
+	// the name sorts by when the report was made, so the oldest goes first
+	char szTime[ 32 ];
+	struct tm timeinfo;
+	VCRHook_LocalTime( &timeinfo );
+	strftime( szTime, sizeof( szTime ), "%Y%m%d_%H%M%S", &timeinfo );
+
+	char szName[ 64 ];
+	Q_snprintf( szName, sizeof( szName ), STATS_SPOOL_DIR "/%s_%04u.txt", szTime, m_iSequence++ % 10000 );
+
+	filesystem->CreateDirHierarchy( STATS_SPOOL_DIR, "MOD" );
+
+	if( filesystem->WriteFile( szName, "MOD", const_cast<CUtlBuffer &>( report ) ) )
+	{
+		m_nSpooled++;
+	}
+	else
+	{
+		Warning( "[STATS] Could not write %s, the report is lost\n", szName );
+		m_nDropped++;
+	}
+
+	Update();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Picks up what the worker did with the last report and hands it the next
+// one when it's due. Call once a frame.
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsUploader::Update( void )
+{
+	FinishUpload();
+	StartUpload();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Forget the backoff and try the oldest report again straight away
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsUploader::RetryNow( void )
+{
+	ReadSettings();
+
+	m_flNextAttempt = 0.0;
+
+	Update();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Stops the worker. Whatever hasn't been sent stays in the spool.
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsUploader::Shutdown( void )
+{
+	if( IsAlive() )
+	{
+		{
+			AUTO_LOCK( m_Mutex );
+			m_bExit = true;
+		}
+
+		m_Wake.Set();
+		Join();
+	}
+
+	// it might have finished one on the way out
+	FinishUpload();
+
+	AUTO_LOCK( m_Mutex );
+	m_bBusy = false;
+	m_bDone = false;
+	m_Upload.Purge();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsUploader::PrintStatus( void )
+{
+	bool bBusy;
+	{
+		AUTO_LOCK( m_Mutex );
+		bBusy = m_bBusy && !m_bDone;
+	}
+
+	Msg( "Stats upload to %s:%d%s\n", m_Settings.szHost, m_Settings.iPort, m_Settings.szURL );
+	Msg( "  worker %s, %s\n", IsAlive() ? "running" : "stopped", bBusy ? m_szUploading : "idle" );
+	Msg( "  %d spooled, %d sent, %d failed attempts, %d dropped\n", m_nSpooled, m_nSent, m_nFailures, m_nDropped );
+
+	if( m_iLastStatus )
+		Msg( "  last response: HTTP %d\n", m_iLastStatus );
+
+	if( m_flNextAttempt > 0.0 )
+		Msg( "  next attempt in %.0f seconds\n", m_flNextAttempt - Plat_FloatTime() );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+bool CFFStatsUploader::StartWorker( void )
+{
+	if( IsAlive() )
+		return true;
+
+	{
+		AUTO_LOCK( m_Mutex );
+		m_bExit = false;
+	}
+
+	SetName( "FFStatsUpload" );
+	return Start();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// The worker never reads convars itself, it gets a copy with each report
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsUploader::ReadSettings( void )
+{
+	Q_strncpy( m_Settings.szHost, stats_host.GetString(), sizeof( m_Settings.szHost ) );
+	m_Settings.iPort = stats_port.GetInt();
+	Q_strncpy( m_Settings.szURL, stats_url.GetString(), sizeof( m_Settings.szURL ) );
+	m_Settings.nSpoolMax = stats_spool_max.GetInt() > 1 ? stats_spool_max.GetInt() : 1;
+	m_Settings.flRetryMin = stats_retry_min.GetFloat() > 1.0f ? stats_retry_min.GetFloat() : 1.0f;
+	m_Settings.flRetryMax = stats_retry_max.GetFloat() > m_Settings.flRetryMin ? stats_retry_max.GetFloat() : m_Settings.flRetryMin;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Spooled reports, oldest first
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsUploader::ListSpool( CUtlVector<SpoolFile_t> &files )
+{
+	FileFindHandle_t hFind;
+	const char *pszFile = filesystem->FindFirstEx( STATS_SPOOL_DIR "/*.txt", "MOD", &hFind );
+
+	while( pszFile )
+	{
+		if( !filesystem->FindIsDirectory( hFind ) )
+		{
+			SpoolFile_t &file = files[ files.AddToTail() ];
+			Q_snprintf( file.szName, sizeof( file.szName ), STATS_SPOOL_DIR "/%s", pszFile );
+		}
+
+		pszFile = filesystem->FindNext( hFind );
+	}
+
+	filesystem->FindClose( hFind );
+
+	files.Sort( SpoolFileCompare );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Throws away the oldest reports until there are no more than the spool max
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsUploader::TrimSpool( CUtlVector<SpoolFile_t> &files )
+{
+	while( files.Count() > m_Settings.nSpoolMax )
+	{
+		Warning( "[STATS] Too many stats reports waiting, throwing away %s\n", files[ 0 ].szName );
+
+		filesystem->RemoveFile( files[ 0 ].szName, "MOD" );
+		files.Remove( 0 );
+
+		m_nDropped++;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Takes the worker's answer for the report it was given, if it has one
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsUploader::FinishUpload( void )
+{
+	bool bSent;
+	int iStatus;
+	{
+		AUTO_LOCK( m_Mutex );
+
+		if( !m_bBusy || !m_bDone )
+			return;
+
+		bSent = m_bSent;
+		iStatus = m_iStatus;
+
+		m_bBusy = false;
+		m_bDone = false;
+		m_Upload.Purge();
+	}
+
+	// the server understood and turned it down, sending it again won't help
+	bool bRejected = !bSent && iStatus >= 400 && iStatus < 500;
+
+	if( bSent || bRejected )
+		filesystem->RemoveFile( m_szUploading, "MOD" );
+
+	m_iLastStatus = iStatus;
+
+	if( bSent )
+	{
+		m_nSent++;
+		DevMsg( "[STATS] Sent %s\n", m_szUploading );
+	}
+	else if( bRejected )
+	{
+		m_nDropped++;
+		Warning( "[STATS] Stats server turned down %s (HTTP %d)\n", m_szUploading, iStatus );
+	}
+	else
+	{
+		m_nFailures++;
+		DevMsg( "[STATS] Could not send %s (HTTP %d), will try again\n", m_szUploading, iStatus );
+	}
+
+	if( bSent || bRejected )
+	{
+		// straight on to the next one
+		m_nFailuresInRow = 0;
+		m_flNextAttempt = 0.0;
+	}
+	else
+	{
+		m_nFailuresInRow++;
+
+		// the shortest delay, doubled for each failure in a row
+		float flDelay = m_Settings.flRetryMin * (float)( 1 << ( m_nFailuresInRow - 1 < 16 ? m_nFailuresInRow - 1 : 16 ) );
+		if( flDelay > m_Settings.flRetryMax )
+			flDelay = m_Settings.flRetryMax;
+
+		m_flNextAttempt = Plat_FloatTime() + flDelay;
+	}
+
+	m_szUploading[ 0 ] = '\0';
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Reads the oldest spooled report and gives it to the worker
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsUploader::StartUpload( void )
+{
+	{
+		AUTO_LOCK( m_Mutex );
+		if( m_bBusy )
+			return;
+	}
+
+	if( m_flNextAttempt > 0.0 && Plat_FloatTime() < m_flNextAttempt )
+		return;
+
+	ReadSettings();
+
+	CUtlVector<SpoolFile_t> files;
+	ListSpool( files );
+	TrimSpool( files );
+
+	if( !files.Count() )
+	{
+		m_flNextAttempt = 0.0;
+		return;
+	}
+
+	CUtlBuffer report;
+
+	// nothing to retry if it can't be read, the next one goes next frame
+	if( !filesystem->ReadFile( files[ 0 ].szName, "MOD", report ) )
+	{
+		Warning( "[STATS] Could not read %s, throwing it away\n", files[ 0 ].szName );
+		filesystem->RemoveFile( files[ 0 ].szName, "MOD" );
+		m_nDropped++;
+		return;
+	}
+
+	// it stays in the spool for later
+	if( !StartWorker() )
+	{
+		Warning( "[STATS] Could not start the stats upload thread, the report will be sent later\n" );
+		m_flNextAttempt = Plat_FloatTime() + m_Settings.flRetryMin;
+		return;
+	}
+
+	Q_strncpy( m_szUploading, files[ 0 ].szName, sizeof( m_szUploading ) );
+
+	{
+		AUTO_LOCK( m_Mutex );
+		m_UploadSettings = m_Settings;
+		m_Upload.Purge();
+		m_Upload.Put( report.Base(), report.TellPut() );
+		m_bSent = false;
+		m_iStatus = 0;
+		m_bDone = false;
+		m_bBusy = true;
+	}
+
+	m_Wake.Set();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Posts each report it's given and leaves the answer for FinishUpload.
+// m_Upload and m_UploadSettings are left alone by the game thread until
+// m_bDone is set, so the post itself doesn't need the lock.
+/////////////////////////////////////////////////////////////////////////////
+int CFFStatsUploader::Run( void )
+{
+	for( ;; )
+	{
+		m_Wake.Wait();
+
+		{
+			AUTO_LOCK( m_Mutex );
+
+			if( m_bExit )
+				break;
+
+			if( !m_bBusy || m_bDone )
+				continue;
+		}
+
+		int iStatus = 0;
+		bool bSent = Post( m_UploadSettings, m_Upload, &iStatus );
+
+		AUTO_LOCK( m_Mutex );
+		m_bSent = bSent;
+		m_iStatus = iStatus;
+		m_bDone = true;
+	}
+
+	return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Posts a report and reads back the HTTP status. 0 if there wasn't one.
+/////////////////////////////////////////////////////////////////////////////
+bool CFFStatsUploader::Post( const Settings_t &settings, const CUtlBuffer &report, int *piStatus )
+{
+	*piStatus = 0;
+
+	// post-data first, its size goes in the header
+	CUtlBuffer body;
+	PutText( body, "--" STATS_BOUNDARY "\r\n"
+		"Content-Disposition: form-data; name=\"data\"\r\n"
+		"\r\n" );
+	body.Put( report.Base(), report.TellPut() );
+	PutText( body, "\r\n--" STATS_BOUNDARY "--\r\n" );
+
+	char szHeader[ 512 ];
+	Q_snprintf( szHeader, sizeof( szHeader ),
+		"POST %s HTTP/1.1\r\n"
+		"Host: %s\r\n"
+		"Connection: close\r\n"
+		"Content-type: multipart/form-data, boundary=" STATS_BOUNDARY "\r\n"
+		"Content-length: %d\r\n\r\n",
+
+		settings.szURL,
+		settings.szHost,
+		body.TellPut() );
+
+	Socks sock;
+
+	if( !sock.Open( /*SOCK_STREAM */ 1, 0 ) )
+		return false;
+
+	if( !sock.Connect( settings.szHost, (unsigned short)settings.iPort ) )
+		return false;
+
+	if( !sock.Send( szHeader, Q_strlen( szHeader ) ) || !sock.Send( body.Base(), body.TellPut() ) )
+		return false;
+
+	char szResponse[ 512 ];
+	int nReceived = sock.Recv( szResponse, sizeof( szResponse ) - 1 );
+	if( nReceived <= 0 )
+		return false;
+
+	szResponse[ nReceived ] = '\0';
+
+	if( sscanf( szResponse, "HTTP/%*d.%*d %d", piStatus ) != 1 )
+		return false;
+
+	return *piStatus >= 200 && *piStatus < 300;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+int __cdecl CFFStatsUploader::SpoolFileCompare( const SpoolFile_t *a, const SpoolFile_t *b )
+{
+	return Q_strcmp( a->szName, b->szName );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+CON_COMMAND( ff_stats_upload_status, "Shows what the stats uploader is doing" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	_statsuploader.PrintStatus();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+CON_COMMAND( ff_stats_upload_retry, "Tries to send waiting stats reports now instead of waiting out the retry delay" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	_statsuploader.RetryNow();
+}
@@ -0,0 +1,102 @@
+// ff_statsupload.h
+
+/////////////////////////////////////////////////////////////////////////////
+// Sends end of map stats reports without holding up the game. Reports are
+// written to a spool directory first so they survive a failed upload or
+// a server restart, and are retried with a growing delay until the stats
+// server takes them.
+//
+// The spool is only ever touched from the game thread, in QueueReport and
+// Update. The worker thread is handed one report at a time and does
+// nothing but the HTTP post, so it never goes near the engine filesystem.
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef FF_STATSUPLOAD_H
+#define FF_STATSUPLOAD_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier0/threadtools.h"
+#include "utlbuffer.h"
+#include "utlvector.h"
+
+/////////////////////////////////////////////////////////////////////////////
+class CFFStatsUploader : public CThread
+{
+public:
+	CFFStatsUploader();
+	~CFFStatsUploader();
+
+	// game thread
+	void QueueReport( const CUtlBuffer &report );
+	void Update( void );
+	void RetryNow( void );
+	void Shutdown( void );
+	void PrintStatus( void );
+
+protected:
+	virtual int Run( void );
+
+private:
+	// everything the worker needs to know from the convars
+	struct Settings_t
+	{
+		char	szHost[ 128 ];
+		int		iPort;
+		char	szURL[ 128 ];
+		int		nSpoolMax;
+		float	flRetryMin;
+		float	flRetryMax;
+	};
+
+	struct SpoolFile_t
+	{
+		char	szName[ 64 ];
+	};
+
+	// game thread
+	bool StartWorker( void );
+	void ReadSettings( void );
+	void ListSpool( CUtlVector<SpoolFile_t> &files );
+	void TrimSpool( CUtlVector<SpoolFile_t> &files );
+	void FinishUpload( void );
+	void StartUpload( void );
+
+	// worker thread
+	static bool Post( const Settings_t &settings, const CUtlBuffer &report, int *piStatus );
+
+	static int __cdecl SpoolFileCompare( const SpoolFile_t *a, const SpoolFile_t *b );
+
+	Settings_t		m_Settings;
+
+	// the report being sent. The flags are only touched with m_Mutex held.
+	// m_Upload and m_UploadSettings are filled in by the game thread while
+	// the worker is idle, and only read by the worker until m_bDone is set.
+	CThreadMutex	m_Mutex;
+	CThreadEvent	m_Wake;
+	bool			m_bExit;
+	bool			m_bBusy;			// the worker has a report
+	bool			m_bDone;			// and has finished with it
+	bool			m_bSent;
+	int				m_iStatus;
+	Settings_t		m_UploadSettings;
+	CUtlBuffer		m_Upload;
+
+	// game thread
+	char			m_szUploading[ 64 ];
+	int				m_nFailuresInRow;
+	double			m_flNextAttempt;
+	unsigned int	m_iSequence;
+
+	int				m_nSpooled;
+	int				m_nSent;
+	int				m_nFailures;
+	int				m_nDropped;
+	int				m_iLastStatus;
+};
+
+extern CFFStatsUploader _statsuploader;
+
+#endif // FF_STATSUPLOAD_H
@@ -0,0 +1,343 @@
+// ff_statswriter.cpp
+
+/////////////////////////////////////////////////////////////////////////////
+// includes
+#include "cbase.h"
+#include "ff_statswriter.h"
+
+#include <time.h>
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+/////////////////////////////////////////////////////////////////////////////
+ConVar stats_file( "ff_stats_file", "1", 0, "Keep a binary log of each map's stats in the stats_log directory (read them with ffstatsreader)" );
+ConVar stats_file_max( "ff_stats_file_max", "32", 0, "Most binary stats logs kept. The oldest are deleted to make room for a new one." );
+
+/////////////////////////////////////////////////////////////////////////////
+// files go here, under the mod directory
+#define STATS_LOG_DIR			"stats_log"
+
+// the buffer is written out once it gets this big
+#define STATS_FLUSH_SIZE		16384
+
+/////////////////////////////////////////////////////////////////////////////
+struct StatsLogFile_t
+{
+	char szName[ 128 ];
+};
+
+/////////////////////////////////////////////////////////////////////////////
+static int __cdecl StatsLogFileCompare( const StatsLogFile_t *a, const StatsLogFile_t *b )
+{
+	return Q_strcmp( a->szName, b->szName );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// What the text report prints for a value with "%.0f", as a whole (see
+// ff_statsfile.h). It's printed here rather than rounded so that halves go
+// the same way they do in the report.
+/////////////////////////////////////////////////////////////////////////////
+static int PrintedWhole( double value )
+{
+	char szValue[ 64 ];
+	Q_snprintf( szValue, sizeof( szValue ), "%.0f", value );
+
+	if( szValue[ 0 ] == '-' )
+		return ~atoi( szValue + 1 );
+
+	return atoi( szValue );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+CFFStatsFileWriter::CFFStatsFileWriter()
+{
+	m_hFile = FILESYSTEM_INVALID_HANDLE;
+	m_nBytesWritten = 0;
+	m_iLastTime = 0;
+	m_iLastCoords[ 0 ] = m_iLastCoords[ 1 ] = m_iLastCoords[ 2 ] = 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Close() has to be called while the filesystem is still around, this is
+// too late
+/////////////////////////////////////////////////////////////////////////////
+CFFStatsFileWriter::~CFFStatsFileWriter()
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Starts a new file for a match
+/////////////////////////////////////////////////////////////////////////////
+bool CFFStatsFileWriter::Open( const char *pszHostname, const char *pszLogin, unsigned int iAuth, const char *pszDate, const char *pszMap )
+{
+	Close();
+
+	if( !stats_file.GetBool() )
+		return false;
+
+	filesystem->CreateDirHierarchy( STATS_LOG_DIR, "MOD" );
+	RotateFiles();
+
+	// the name sorts by when the match started, for rotating
+	char szTime[ 32 ];
+	struct tm timeinfo;
+	VCRHook_LocalTime( &timeinfo );
+	strftime( szTime, sizeof( szTime ), "%Y%m%d_%H%M%S", &timeinfo );
+
+	char szName[ MAX_PATH ];
+	Q_snprintf( szName, sizeof( szName ), STATS_LOG_DIR "/%s_%s." STATSFILE_EXTENSION, szTime, pszMap );
+
+	m_hFile = filesystem->Open( szName, "wb", "MOD" );
+	if( !IsOpen() )
+	{
+		Warning( "[STATS] Could not open %s for writing\n", szName );
+		return false;
+	}
+
+	m_Buffer.SeekPut( CUtlBuffer::SEEK_HEAD, 0 );
+	m_nBytesWritten = 0;
+	m_iLastTime = 0;
+	m_iLastCoords[ 0 ] = m_iLastCoords[ 1 ] = m_iLastCoords[ 2 ] = 0;
+
+	m_Buffer.Put( STATSFILE_MAGIC, STATSFILE_MAGIC_LENGTH );
+	PutByte( STATSFILE_VERSION );
+
+	PutByte( STATSREC_INFO );
+	PutString( pszHostname );
+	PutString( pszLogin );
+	PutByte( iAuth & 0xFF );
+	PutByte( ( iAuth >> 8 ) & 0xFF );
+	PutByte( ( iAuth >> 16 ) & 0xFF );
+	PutByte( ( iAuth >> 24 ) & 0xFF );
+	PutString( pszDate );
+	PutString( pszMap );
+
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsFileWriter::Close( void )
+{
+	if( !IsOpen() )
+		return;
+
+	Flush();
+
+	filesystem->Close( m_hFile );
+	m_hFile = FILESYSTEM_INVALID_HANDLE;
+
+	DevMsg( "[STATS] Wrote %u bytes of binary stats\n", m_nBytesWritten );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsFileWriter::WriteString( int id, const char *pszString )
+{
+	if( !IsOpen() )
+		return;
+
+	PutByte( STATSREC_STRING );
+	PutVarInt( id );
+	PutString( pszString );
+
+	FlushIfFull();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsFileWriter::WritePlayer( int playerid, const char *pszSteamID, const char *pszName, int iTeam, int iClass )
+{
+	if( !IsOpen() )
+		return;
+
+	PutByte( STATSREC_PLAYER );
+	PutVarInt( playerid );
+	PutString( pszSteamID );
+	PutString( pszName );
+	PutSignedVarInt( iTeam );
+	PutSignedVarInt( iClass );
+
+	FlushIfFull();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsFileWriter::WriteStatDef( int statid, int iType, const char *pszName )
+{
+	if( !IsOpen() )
+		return;
+
+	PutByte( STATSREC_STATDEF );
+	PutVarInt( statid );
+	PutVarInt( iType );
+	PutString( pszName );
+
+	FlushIfFull();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsFileWriter::WriteActionDef( int actionid, const char *pszName )
+{
+	if( !IsOpen() )
+		return;
+
+	PutByte( STATSREC_ACTIONDEF );
+	PutVarInt( actionid );
+	PutString( pszName );
+
+	FlushIfFull();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsFileWriter::WriteAction( int playerid, int targetid, int actionid, float flTime, int param, const Vector &vecCoords, int location )
+{
+	if( !IsOpen() )
+		return;
+
+	int iTime = PrintedWhole( flTime );
+
+	PutByte( STATSREC_ACTION );
+	PutVarInt( playerid );
+	PutSignedVarInt( targetid );
+	PutVarInt( actionid );
+	PutSignedVarInt( iTime - m_iLastTime );
+	PutVarInt( param );
+	PutVarInt( location );
+
+	m_iLastTime = iTime;
+
+	for( int i = 0; i < 3; i++ )
+	{
+		int iCoord = PrintedWhole( vecCoords[ i ] );
+		PutSignedVarInt( iCoord - m_iLastCoords[ i ] );
+		m_iLastCoords[ i ] = iCoord;
+	}
+
+	FlushIfFull();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsFileWriter::BeginStats( int nStats )
+{
+	if( !IsOpen() )
+		return;
+
+	PutByte( STATSREC_STATS );
+	PutVarInt( nStats );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsFileWriter::WriteStat( int playerid, int statid, double value )
+{
+	if( !IsOpen() )
+		return;
+
+	// big enough for any double
+	char szValue[ 512 ];
+	Q_snprintf( szValue, sizeof( szValue ), "%.0f", value );
+
+	PutVarInt( playerid );
+	PutVarInt( statid );
+	PutString( szValue );
+
+	FlushIfFull();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// pScores is blue, red, yellow and green
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsFileWriter::WriteEnd( int iDuration, const int *pScores )
+{
+	if( !IsOpen() )
+		return;
+
+	PutByte( STATSREC_END );
+	PutSignedVarInt( iDuration );
+
+	for( int i = 0; i < 4; i++ )
+		PutSignedVarInt( pScores[ i ] );
+
+	FlushIfFull();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// Deletes the oldest files so there's room for one more
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsFileWriter::RotateFiles( void )
+{
+	CUtlVector<StatsLogFile_t> files;
+
+	FileFindHandle_t hFind;
+	const char *pszFile = filesystem->FindFirstEx( STATS_LOG_DIR "/*." STATSFILE_EXTENSION, "MOD", &hFind );
+
+	while( pszFile )
+	{
+		if( !filesystem->FindIsDirectory( hFind ) )
+		{
+			StatsLogFile_t &file = files[ files.AddToTail() ];
+			Q_snprintf( file.szName, sizeof( file.szName ), STATS_LOG_DIR "/%s", pszFile );
+		}
+
+		pszFile = filesystem->FindNext( hFind );
+	}
+
+	filesystem->FindClose( hFind );
+
+	files.Sort( StatsLogFileCompare );
+
+	int nKeep = stats_file_max.GetInt() - 1;
+	for( int i = 0; i < files.Count() - nKeep; i++ )
+		filesystem->RemoveFile( files[ i ].szName, "MOD" );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsFileWriter::FlushIfFull( void )
+{
+	if( m_Buffer.TellPut() >= STATS_FLUSH_SIZE )
+		Flush();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsFileWriter::Flush( void )
+{
+	if( !m_Buffer.TellPut() )
+		return;
+
+	filesystem->Write( m_Buffer.Base(), m_Buffer.TellPut(), m_hFile );
+	m_nBytesWritten += m_Buffer.TellPut();
+
+	m_Buffer.SeekPut( CUtlBuffer::SEEK_HEAD, 0 );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsFileWriter::PutByte( unsigned char c )
+{
+	m_Buffer.PutUnsignedChar( c );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsFileWriter::PutVarInt( unsigned int i )
+{
+	while( i >= 0x80 )
+	{
+		PutByte( (unsigned char)( i | 0x80 ) );
+		i >>= 7;
+	}
+
+	PutByte( (unsigned char)i );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsFileWriter::PutSignedVarInt( int i )
+{
+	PutVarInt( ( (unsigned int)i << 1 ) ^ (unsigned int)( i >> 31 ) );
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void CFFStatsFileWriter::PutString( const char *psz )
+{
+	if( !psz )
+		psz = "";
+
+	int len = Q_strlen( psz );
+	PutVarInt( len );
+	m_Buffer.Put( psz, len );
+}
@@ -0,0 +1,65 @@
+// ff_statswriter.h
+
+/////////////////////////////////////////////////////////////////////////////
+// Streams the match stats to a local file in the format described in
+// ff_statsfile.h as they happen, so finishing a map only has to write
+// the final stat values. Old files are rotated out.
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef FF_STATSWRITER_H
+#define FF_STATSWRITER_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "ff_statsfile.h"
+#include "filesystem.h"
+#include "utlbuffer.h"
+
+/////////////////////////////////////////////////////////////////////////////
+class CFFStatsFileWriter
+{
+public:
+	CFFStatsFileWriter();
+	~CFFStatsFileWriter();
+
+	bool IsOpen( void ) const { return m_hFile != FILESYSTEM_INVALID_HANDLE; }
+
+	bool Open( const char *pszHostname, const char *pszLogin, unsigned int iAuth, const char *pszDate, const char *pszMap );
+	void Close( void );
+
+	void WriteString( int id, const char *pszString );
+	void WritePlayer( int playerid, const char *pszSteamID, const char *pszName, int iTeam, int iClass );
+	void WriteStatDef( int statid, int iType, const char *pszName );
+	void WriteActionDef( int actionid, const char *pszName );
+	void WriteAction( int playerid, int targetid, int actionid, float flTime, int param, const Vector &vecCoords, int location );
+
+	// final values, BeginStats then exactly nStats WriteStat calls
+	void BeginStats( int nStats );
+	void WriteStat( int playerid, int statid, double value );
+
+	void WriteEnd( int iDuration, const int *pScores );
+
+	unsigned int GetBytesWritten( void ) const { return m_nBytesWritten; }
+
+private:
+	void RotateFiles( void );
+	void FlushIfFull( void );
+	void Flush( void );
+
+	void PutByte( unsigned char c );
+	void PutVarInt( unsigned int i );
+	void PutSignedVarInt( int i );
+	void PutString( const char *psz );
+
+	FileHandle_t	m_hFile;
+	CUtlBuffer		m_Buffer;
+	unsigned int	m_nBytesWritten;
+
+	// what the last action was relative to
+	int				m_iLastTime;
+	int				m_iLastCoords[ 3 ];
+};
+
+#endif // FF_STATSWRITER_H
@@ -0,0 +1,474 @@
+//===========================================================================//
+//
+// Purpose: Turns a binary stats log written by the server (stats_log/*.ffs)
+//			back into the text stats report the stats server takes.
+//
+//===========================================================================//
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "ff_statsfile.h"
+
+//-----------------------------------------------------------------------------
+// What's been read so far
+//-----------------------------------------------------------------------------
+struct Player_t
+{
+	char	*pszSteamID;
+	char	*pszName;
+	int		iTeam;
+	int		iClass;
+};
+
+struct Action_t
+{
+	int		player;
+	int		target;
+	int		action;
+	int		time;
+	int		param;
+	int		location;
+	int		coords[ 3 ];
+};
+
+struct Stat_t
+{
+	int		player;
+	int		stat;
+	char	*pszValue;
+};
+
+// ids and counts in a file are never anywhere near this, anything bigger
+// means the file is corrupt
+#define MAX_ENTRIES		( 1 << 24 )
+
+// a grow-only array of T
+template< class T >
+struct Array_t
+{
+	T		*pData;
+	int		nCount;
+	int		nAlloc;
+
+	Array_t() : pData( NULL ), nCount( 0 ), nAlloc( 0 ) {}
+
+	// makes sure index i exists, new entries are zeroed. NULL if i is out
+	// of range or there isn't the memory for it
+	T *At( unsigned int i )
+	{
+		if( i >= MAX_ENTRIES )
+			return NULL;
+
+		if( (int)i >= nAlloc )
+		{
+			int nNew = nAlloc ? nAlloc * 2 : 64;
+			while( nNew <= (int)i )
+				nNew *= 2;
+
+			T *pNew = (T *)realloc( pData, nNew * sizeof( T ) );
+			if( !pNew )
+				return NULL;
+
+			pData = pNew;
+			memset( pData + nAlloc, 0, ( nNew - nAlloc ) * sizeof( T ) );
+			nAlloc = nNew;
+		}
+
+		if( (int)i >= nCount )
+			nCount = i + 1;
+
+		return &pData[ i ];
+	}
+
+	T *AddToTail() { return At( nCount ); }
+};
+
+static Array_t<char *>		g_Strings;
+static Array_t<char *>		g_StatNames;
+static Array_t<char *>		g_ActionNames;
+static Array_t<Player_t>	g_Players;
+static Array_t<Action_t>	g_Actions;
+static Array_t<Stat_t>		g_Stats;
+
+//-----------------------------------------------------------------------------
+// Reading the file
+//-----------------------------------------------------------------------------
+static const unsigned char	*g_pData;
+static int					g_nSize;
+static int					g_nPos;
+static bool					g_bTruncated;
+
+static bool AtEnd()
+{
+	return g_nPos >= g_nSize;
+}
+
+static unsigned int GetByte()
+{
+	if( AtEnd() )
+	{
+		g_bTruncated = true;
+		return 0;
+	}
+
+	return g_pData[ g_nPos++ ];
+}
+
+static unsigned int GetVarInt()
+{
+	unsigned int i = 0;
+
+	for( int shift = 0; shift < 35; shift += 7 )
+	{
+		unsigned int c = GetByte();
+		i |= ( c & 0x7F ) << shift;
+
+		if( !( c & 0x80 ) )
+			break;
+	}
+
+	return i;
+}
+
+static int GetSignedVarInt()
+{
+	unsigned int i = GetVarInt();
+	return (int)( i >> 1 ) ^ -(int)( i & 1 );
+}
+
+static char *GetString()
+{
+	unsigned int len = GetVarInt();
+	if( len > (unsigned int)( g_nSize - g_nPos ) )
+	{
+		g_bTruncated = true;
+		len = 0;
+	}
+
+	char *psz = (char *)malloc( len + 1 );
+	memcpy( psz, g_pData + g_nPos, len );
+	psz[ len ] = '\0';
+	g_nPos += len;
+
+	return psz;
+}
+
+//-----------------------------------------------------------------------------
+// Stops reading at a record that can't be stored
+//-----------------------------------------------------------------------------
+static void BadRecord( const char *pszWhat, unsigned int id, int iOffset )
+{
+	fprintf( stderr, "Bad %s %u in the record at offset %d, stopping there\n", pszWhat, id, iOffset );
+	g_bTruncated = true;
+}
+
+static unsigned int GetU32()
+{
+	unsigned int i = GetByte();
+	i |= GetByte() << 8;
+	i |= GetByte() << 16;
+	i |= GetByte() << 24;
+	return i;
+}
+
+static const char *Lookup( Array_t<char *> &strings, int i )
+{
+	if( i < 0 || i >= strings.nCount || !strings.pData[ i ] )
+		return "";
+
+	return strings.pData[ i ];
+}
+
+// The text a whole stands for (see ff_statsfile.h), pszBuf needs room for
+// any int
+static const char *WholeText( int iWhole, char *pszBuf )
+{
+	if( iWhole < 0 )
+		sprintf( pszBuf, "-%d", ~iWhole );
+	else
+		sprintf( pszBuf, "%d", iWhole );
+
+	return pszBuf;
+}
+
+//-----------------------------------------------------------------------------
+void Usage( void )
+{
+	printf( "Usage: ffstatsreader stats.ffs [stats.txt]\n" );
+	exit( -1 );
+}
+
+//-----------------------------------------------------------------------------
+int main( int argc, char **argv )
+{
+	if( argc != 2 && argc != 3 )
+	{
+		Usage();
+	}
+
+	FILE *fp = fopen( argv[ 1 ], "rb" );
+	if( !fp )
+	{
+		fprintf( stderr, "Unable to open %s\n", argv[ 1 ] );
+		return -1;
+	}
+
+	fseek( fp, 0, SEEK_END );
+	g_nSize = ftell( fp );
+	fseek( fp, 0, SEEK_SET );
+
+	unsigned char *pData = (unsigned char *)malloc( g_nSize ? g_nSize : 1 );
+	if( (int)fread( pData, 1, g_nSize, fp ) != g_nSize )
+	{
+		fprintf( stderr, "Unable to read %s\n", argv[ 1 ] );
+		return -1;
+	}
+	fclose( fp );
+
+	g_pData = pData;
+	g_nPos = 0;
+
+	if( g_nSize < STATSFILE_MAGIC_LENGTH + 1 || memcmp( pData, STATSFILE_MAGIC, STATSFILE_MAGIC_LENGTH ) )
+	{
+		fprintf( stderr, "%s is not a stats log\n", argv[ 1 ] );
+		return -1;
+	}
+
+	g_nPos = STATSFILE_MAGIC_LENGTH;
+
+	int iVersion = GetByte();
+	if( iVersion != STATSFILE_VERSION )
+	{
+		fprintf( stderr, "%s is version %d, only version %d can be read\n", argv[ 1 ], iVersion, STATSFILE_VERSION );
+		return -1;
+	}
+
+	char *pszHostname = NULL, *pszLogin = NULL, *pszDate = NULL, *pszMap = NULL;
+	unsigned int iAuth = 0;
+	int iDuration = -1;
+	int iScores[ 4 ] = { -1, -1, -1, -1 };
+	bool bEnded = false;
+
+	// running values the actions are relative to
+	int iTime = 0;
+	int iCoords[ 3 ] = { 0, 0, 0 };
+
+	while( !AtEnd() && !g_bTruncated )
+	{
+		int iOffset = g_nPos;
+		int iRecord = GetByte();
+
+		switch( iRecord )
+		{
+		case STATSREC_INFO:
+			pszHostname = GetString();
+			pszLogin = GetString();
+			iAuth = GetU32();
+			pszDate = GetString();
+			pszMap = GetString();
+			break;
+
+		case STATSREC_STRING:
+			{
+				unsigned int id = GetVarInt();
+				char *psz = GetString();
+
+				char **ppsz = g_Strings.At( id );
+				if( ppsz )
+					*ppsz = psz;
+				else
+					BadRecord( "string id", id, iOffset );
+			}
+			break;
+
+		case STATSREC_PLAYER:
+			{
+				unsigned int id = GetVarInt();
+
+				Player_t player;
+				player.pszSteamID = GetString();
+				player.pszName = GetString();
+				player.iTeam = GetSignedVarInt();
+				player.iClass = GetSignedVarInt();
+
+				if( g_bTruncated )
+					break;
+
+				Player_t *pPlayer = g_Players.At( id );
+				if( pPlayer )
+					*pPlayer = player;
+				else
+					BadRecord( "player id", id, iOffset );
+			}
+			break;
+
+		case STATSREC_STATDEF:
+			{
+				unsigned int id = GetVarInt();
+				GetVarInt();	// type, the values are already final
+				char *psz = GetString();
+
+				char **ppsz = g_StatNames.At( id );
+				if( ppsz )
+					*ppsz = psz;
+				else
+					BadRecord( "stat id", id, iOffset );
+			}
+			break;
+
+		case STATSREC_ACTIONDEF:
+			{
+				unsigned int id = GetVarInt();
+				char *psz = GetString();
+
+				char **ppsz = g_ActionNames.At( id );
+				if( ppsz )
+					*ppsz = psz;
+				else
+					BadRecord( "action id", id, iOffset );
+			}
+			break;
+
+		case STATSREC_ACTION:
+			{
+				Action_t action;
+				action.player = GetVarInt();
+				action.target = GetSignedVarInt();
+				action.action = GetVarInt();
+				iTime += GetSignedVarInt();
+				action.time = iTime;
+				action.param = GetVarInt();
+				action.location = GetVarInt();
+
+				for( int i = 0; i < 3; i++ )
+				{
+					iCoords[ i ] += GetSignedVarInt();
+					action.coords[ i ] = iCoords[ i ];
+				}
+
+				if( g_bTruncated )
+					break;
+
+				Action_t *pAction = g_Actions.AddToTail();
+				if( pAction )
+					*pAction = action;
+				else
+					BadRecord( "action number", g_Actions.nCount, iOffset );
+			}
+			break;
+
+		case STATSREC_STATS:
+			{
+				int nStats = GetVarInt();
+				for( int i = 0; i < nStats && !g_bTruncated; i++ )
+				{
+					Stat_t stat;
+					stat.player = GetVarInt();
+					stat.stat = GetVarInt();
+					stat.pszValue = GetString();
+
+					if( g_bTruncated )
+						break;
+
+					Stat_t *pStat = g_Stats.AddToTail();
+					if( pStat )
+						*pStat = stat;
+					else
+						BadRecord( "stat number", g_Stats.nCount, iOffset );
+				}
+			}
+			break;
+
+		case STATSREC_END:
+			iDuration = GetSignedVarInt();
+			for( int i = 0; i < 4; i++ )
+				iScores[ i ] = GetSignedVarInt();
+			bEnded = true;
+			break;
+
+		default:
+			fprintf( stderr, "Unknown record %d at offset %d, stopping there\n", iRecord, g_nPos - 1 );
+			g_bTruncated = true;
+			break;
+		}
+	}
+
+	if( g_bTruncated || !bEnded )
+		fprintf( stderr, "%s is incomplete (the server didn't finish the map?), writing what there is\n", argv[ 1 ] );
+
+	FILE *out = stdout;
+	if( argc == 3 )
+	{
+		out = fopen( argv[ 2 ], "w" );
+		if( !out )
+		{
+			fprintf( stderr, "Unable to open %s\n", argv[ 2 ] );
+			return -1;
+		}
+	}
+
+	// the same as CFFStatsLog::Serialise
+	fprintf( out, "hostname %s\n", pszHostname ? pszHostname : "" );
+	fprintf( out, "login %s\n", pszLogin ? pszLogin : "" );
+	fprintf( out, "auth %08X\n", iAuth );
+	fprintf( out, "date %s\n", pszDate ? pszDate : "" );
+	fprintf( out, "duration %d\n", iDuration );
+	fprintf( out, "map %s\n", pszMap ? pszMap : "" );
+	fprintf( out, "bluescore %d\n", iScores[ 0 ] );
+	fprintf( out, "redscore %d\n", iScores[ 1 ] );
+	fprintf( out, "yellowscore %d\n", iScores[ 2 ] );
+	fprintf( out, "greenscore %d\n", iScores[ 3 ] );
+
+	int i, j;
+
+	fprintf( out, "players\n" );
+	for( i = 0; i < g_Players.nCount; i++ )
+	{
+		Player_t &player = g_Players.pData[ i ];
+		fprintf( out, "%s %s %d %d\n",
+			player.pszSteamID ? player.pszSteamID : "",
+			player.pszName ? player.pszName : "",
+			player.iTeam,
+			player.iClass );
+	}
+
+	// grouped by player, in the order they happened
+	fprintf( out, "actions\n" );
+	for( i = 0; i < g_Players.nCount; i++ )
+	{
+		for( j = 0; j < g_Actions.nCount; j++ )
+		{
+			Action_t &action = g_Actions.pData[ j ];
+			if( action.player != i )
+				continue;
+
+			char szTime[ 16 ], szX[ 16 ], szY[ 16 ], szZ[ 16 ];
+
+			fprintf( out, "%d %d %s %s %s %s,%s,%s %s\n",
+				i,
+				action.target,
+				Lookup( g_ActionNames, action.action ),
+				WholeText( action.time, szTime ),
+				Lookup( g_Strings, action.param ),
+				WholeText( action.coords[ 0 ], szX ),
+				WholeText( action.coords[ 1 ], szY ),
+				WholeText( action.coords[ 2 ], szZ ),
+				Lookup( g_Strings, action.location ) );
+		}
+	}
+
+	fprintf( out, "stats\n" );
+	for( i = 0; i < g_Stats.nCount; i++ )
+	{
+		Stat_t &stat = g_Stats.pData[ i ];
+		fprintf( out, "%d %s %s\n",
+			stat.player,
+			Lookup( g_StatNames, stat.stat ),
+			stat.pszValue );
+	}
+
+	if( out != stdout )
+		fclose( out );
+
+	return 0;
+}